@@ -1,3 +1,4 @@
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
 
@@ -45,6 +46,40 @@ static pid_t run_sh(void)
 	exit(EXIT_FAILURE);
 }
 
+/* write back the dirty pages of the shared mappings every now and then */
+static pid_t run_update(void)
+{
+	int pid = fork();
+	if (pid == -1)
+	{
+		perror("init: fork");
+		return -1;
+	}
+	if (pid != 0)
+		return pid;
+	while (1)
+	{
+		sleep(30);
+		sync();
+	}
+}
+
+/* reclaim memory in the background, the syscall only returns on error */
+static pid_t run_pagedaemon(void)
+{
+	int pid = fork();
+	if (pid == -1)
+	{
+		perror("init: fork");
+		return -1;
+	}
+	if (pid != 0)
+		return pid;
+	syscall(SYS_pagedaemon);
+	perror("init: pagedaemon");
+	exit(EXIT_FAILURE);
+}
+
 int main()
 {
 	umask(02);
@@ -59,6 +94,8 @@ int main()
 	setenv("PS2", "> ", 1);
 	setenv("IFS", " \t\n", 1);
 	system("/etc/rc");
+	pid_t update_pid = run_update();
+	pid_t pagedaemon_pid = run_pagedaemon();
 	pid_t sh_pid = run_sh();
 	pid_t wpid;
 	int wstatus;
@@ -75,6 +112,17 @@ int main()
 			if (WIFEXITED(wstatus) || WIFSIGNALED(wstatus))
 				sh_pid = run_sh();
 		}
+		else if (wpid == update_pid)
+		{
+			if (WIFEXITED(wstatus) || WIFSIGNALED(wstatus))
+				update_pid = run_update();
+		}
+		else if (wpid == pagedaemon_pid)
+		{
+			/* don't loop on errors */
+			if (WIFSIGNALED(wstatus))
+				pagedaemon_pid = run_pagedaemon();
+		}
 	}
 	return EXIT_FAILURE;
 }
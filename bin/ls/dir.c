@@ -75,7 +75,8 @@ static void add_file(struct env *env, struct dir *dir, struct file *file)
 	TAILQ_INSERT_TAIL(&dir->files, file, chain);
 }
 
-void dir_add_file(struct env *env, struct dir *dir, const char *name)
+void dir_add_file(struct env *env, struct dir *dir, const char *name,
+                  const struct stat *st)
 {
 	struct file *file;
 
@@ -85,7 +86,7 @@ void dir_add_file(struct env *env, struct dir *dir, const char *name)
 		fprintf(stderr, "%s: malloc: %s\n", env->progname, strerror(errno));
 		exit(EXIT_FAILURE);
 	}
-	if (load_file(env, file, name, dir))
+	if (load_file(env, file, name, dir, st))
 	{
 		free(file);
 		return;
@@ -101,11 +102,47 @@ void dir_init(struct dir *dir, const char *path)
 	TAILQ_INIT(&dir->files);
 }
 
+static int hidden(struct env *env, const char *name)
+{
+	if (name[0] != '.')
+		return 0;
+	if (!strcmp(name, ".") || !strcmp(name, ".."))
+	{
+		if (!(env->opt & OPT_a))
+			return 1;
+	}
+	return !(env->opt & OPT_A);
+}
+
+/* the attributes come with the names, saving a fstatat per file */
+static void read_entries(struct env *env, struct dir *dir, DIR *fdir)
+{
+	static char buf[64 * 1024] __attribute__((aligned(8)));
+	struct sys_direntplus *dirent;
+	int ret;
+
+	while ((ret = getdentsplus(dirfd(fdir), (struct sys_direntplus*)buf,
+	                           sizeof(buf))) > 0)
+	{
+		for (int i = 0; i < ret; i += dirent->reclen)
+		{
+			dirent = (struct sys_direntplus*)&buf[i];
+			if (hidden(env, dirent->name))
+				continue;
+			dir_add_file(env, dir, dirent->name,
+			             (dirent->flags & DIRENTPLUS_STAT) ? &dirent->st
+			                                               : NULL);
+		}
+	}
+	if (ret == -1)
+		fprintf(stderr, "%s: getdentsplus(%s): %s\n",
+		        env->progname, dir->path, strerror(errno));
+}
+
 struct dir *load_dir(struct env *env, const char *path)
 {
 	struct dir *dir;
 	DIR *fdir;
-	struct dirent *dirent;
 
 	fdir = opendir(path);
 	if (!fdir)
@@ -122,20 +159,7 @@ struct dir *load_dir(struct env *env, const char *path)
 	}
 	dir_init(dir, path);
 	dir->dir = fdir;
-	while ((dirent = readdir(fdir)))
-	{
-		if (dirent->d_name[0] == '.')
-		{
-			if (!strcmp(dirent->d_name, ".") || !strcmp(dirent->d_name, ".."))
-			{
-				if (!(env->opt & OPT_a))
-					continue;
-			}
-			if (!(env->opt & OPT_A))
-				continue;
-		}
-		dir_add_file(env, dir, dirent->d_name);
-	}
+	read_entries(env, dir, fdir);
 	closedir(fdir);
 	dir->dir = NULL;
 	return dir;
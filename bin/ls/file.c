@@ -218,8 +218,9 @@ static void load_symb(struct env *env, struct file *file, const char *name,
 		file->lnk_mode = lst.st_mode;
 }
 
+/* dst is the lstat of the file if already known */
 int load_file(struct env *env, struct file *file, const char *name,
-              struct dir *dir)
+              struct dir *dir, const struct stat *dst)
 {
 	struct stat st;
 	char path[MAXPATHLEN];
@@ -229,7 +230,11 @@ int load_file(struct env *env, struct file *file, const char *name,
 		strlcpy(path, name, sizeof(path));
 	else
 		snprintf(path, sizeof(path), "%s/%s", dir->path, name);
-	if (env->opt & OPT_L)
+	if (dst && (!(env->opt & OPT_L) || !S_ISLNK(dst->st_mode)))
+	{
+		st = *dst;
+	}
+	else if (env->opt & OPT_L)
 	{
 		if (fstatat(dir->dir ? dirfd(dir->dir) : AT_FDCWD,
 		            dir->dir ? name : path, &st, 0) == -1)
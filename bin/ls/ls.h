@@ -93,11 +93,13 @@ struct env
 void parse_sources(struct env *env, int ac, char **argv);
 void print_dir(struct env *env, const char *path, int is_recur, const char *display_path);
 void print_file(struct env *env, struct file *file, struct dir *dir, int last);
-void dir_add_file(struct env *env, struct dir *dir, const char *name);
+void dir_add_file(struct env *env, struct dir *dir, const char *name,
+                  const struct stat *st);
 void dir_init(struct dir *dir, const char *path);
 struct dir *load_dir(struct env *env, const char *path);
 void free_file(struct file *file);
-int load_file(struct env *env, struct file *file, const char *name, struct dir *dir);
+int load_file(struct env *env, struct file *file, const char *name,
+              struct dir *dir, const struct stat *dst);
 time_t file_time(const struct env *env, const struct stat *st);
 void print_sources(struct env *env, int recur);
 
@@ -106,7 +106,7 @@ static int add_source(struct env *env, char *path, struct dir *dir, char *displa
 		push_source(env, path, display_path, &st);
 		return 0;
 	}
-	dir_add_file(env, dir, path);
+	dir_add_file(env, dir, path, NULL);
 	return 1;
 }
 
@@ -0,0 +1,5 @@
+#include <libelf32.h>
+
+#define dso_load_elfN dso_load_elf32
+
+#include "elfn.c"
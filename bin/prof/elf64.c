@@ -0,0 +1,5 @@
+#include <libelf64.h>
+
+#define dso_load_elfN dso_load_elf64
+
+#include "elfn.c"
@@ -0,0 +1,84 @@
+#include "prof.h"
+
+#include <stdlib.h>
+
+static int load_symtab(struct dso *dso, struct elfN *elf,
+                       const ElfN_Shdr *symtab_shdr)
+{
+	const ElfN_Shdr *strtab_shdr;
+	uint8_t *symtab_data = NULL;
+	uint8_t *strtab_data = NULL;
+	int ret = 1;
+
+	if (!symtab_shdr->sh_entsize)
+		goto end;
+	strtab_shdr = elfN_get_shdr(elf, symtab_shdr->sh_link);
+	if (!strtab_shdr)
+		goto end;
+	if (elfN_read_section(elf, symtab_shdr, (void**)&symtab_data, NULL)
+	 || elfN_read_section(elf, strtab_shdr, (void**)&strtab_data, NULL))
+		goto end;
+	for (ElfN_Off i = sizeof(ElfN_Sym); i < symtab_shdr->sh_size; i += symtab_shdr->sh_entsize)
+	{
+		const ElfN_Sym *sym = (const ElfN_Sym*)&symtab_data[i];
+		if (ELFN_ST_TYPE(sym->st_info) != STT_FUNC
+		 || sym->st_shndx == SHN_UNDEF
+		 || sym->st_name >= strtab_shdr->sh_size)
+			continue;
+		if (dso_add_sym(dso, sym->st_value, sym->st_size,
+		                (char*)&strtab_data[sym->st_name]))
+			goto end;
+	}
+	ret = 0;
+
+end:
+	free(strtab_data);
+	free(symtab_data);
+	return ret;
+}
+
+static int load_dynsym(struct dso *dso, struct elfN *elf)
+{
+	for (ElfN_Word i = 1; i < elfN_get_dynsymnum(elf); ++i)
+	{
+		const ElfN_Sym *sym = elfN_get_dynsym(elf, i);
+		if (!sym
+		 || ELFN_ST_TYPE(sym->st_info) != STT_FUNC
+		 || sym->st_shndx == SHN_UNDEF)
+			continue;
+		const char *name = elfN_get_dynstr_str(elf, sym->st_name);
+		if (!name)
+			continue;
+		if (dso_add_sym(dso, sym->st_value, sym->st_size, name))
+			return 1;
+	}
+	return 0;
+}
+
+int dso_load_elfN(struct dso *dso, struct elfN *elf)
+{
+	int has_symtab = 0;
+
+	for (ElfN_Half i = 0; i < elfN_get_phnum(elf); ++i)
+	{
+		const ElfN_Phdr *phdr = elfN_get_phdr(elf, i);
+		if (phdr->p_type != PT_LOAD)
+			continue;
+		if (dso_add_load(dso, phdr->p_offset, phdr->p_vaddr,
+		                 phdr->p_filesz))
+			return 1;
+	}
+	for (ElfN_Half i = 0; i < elfN_get_shnum(elf); ++i)
+	{
+		const ElfN_Shdr *shdr = elfN_get_shdr(elf, i);
+		if (shdr->sh_type != SHT_SYMTAB)
+			continue;
+		if (load_symtab(dso, elf, shdr))
+			return 1;
+		has_symtab = 1;
+	}
+	/* stripped binaries still have their exported functions */
+	if (!has_symtab)
+		return load_dynsym(dso, elf);
+	return 0;
+}
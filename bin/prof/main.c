@@ -0,0 +1,773 @@
+#include "prof.h"
+
+#include <eklat/prof.h>
+
+#include <sys/ioctl.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <inttypes.h>
+#include <libelf.h>
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+
+#define SYM_HASH_SIZE  4096
+#define ADDR_HASH_SIZE 16384
+#define READ_SIZE      (64 * 1024)
+
+#define OPT_CALLGRAPH (1 << 0)
+#define OPT_ALL       (1 << 1)
+
+struct sym;
+
+struct edge
+{
+	struct sym *sym;
+	uint64_t count;
+	struct edge *next;
+};
+
+struct sym
+{
+	char *name;
+	const char *dso;
+	uint64_t self;
+	uint64_t total;
+	uint64_t mark; /* last sample accounted in total */
+	struct edge *callers;
+	struct sym *next;
+};
+
+struct addr
+{
+	uint64_t value; /* file offset for mapped files, pc otherwise */
+	uint64_t ino;
+	uint32_t dev;
+	uint32_t flags;
+	struct sym *sym;
+	struct addr *next;
+};
+
+struct env
+{
+	const char *progname;
+	const char *command;
+	int opt;
+	int fd;
+	size_t lines;
+	struct sym *sym_hash[SYM_HASH_SIZE];
+	struct sym **syms;
+	size_t syms_count;
+	size_t syms_size;
+	struct addr *addr_hash[ADDR_HASH_SIZE];
+	struct dso *dsos;
+	int dsos_scanned;
+	uint64_t samples;
+	uint64_t kernel_samples;
+	uint64_t *buf;
+};
+
+/* symbols are interned by dso pointer and name */
+static const char kernel_dso[] = "[kernel]";
+static const char anon_dso[] = "[anon]";
+static const char unknown_dso[] = "[unknown]";
+
+static const char *dso_dirs[] =
+{
+	"/bin",
+	"/sbin",
+	"/lib",
+	"/usr/bin",
+	"/usr/sbin",
+	"/usr/lib",
+	"/usr/local/bin",
+	"/usr/local/lib",
+};
+
+static uint32_t hash_str(uint32_t hash, const char *s)
+{
+	while (*s)
+		hash = hash * 31 + (uint8_t)*(s++);
+	return hash;
+}
+
+int dso_add_load(struct dso *dso, uint64_t offset, uint64_t vaddr,
+                 uint64_t size)
+{
+	struct dso_load *loads = realloc(dso->loads,
+	                                 sizeof(*loads) * (dso->loads_count + 1));
+	if (!loads)
+		return 1;
+	loads[dso->loads_count].offset = offset;
+	loads[dso->loads_count].vaddr = vaddr;
+	loads[dso->loads_count].size = size;
+	dso->loads = loads;
+	dso->loads_count++;
+	return 0;
+}
+
+int dso_add_sym(struct dso *dso, uint64_t addr, uint64_t size,
+                const char *name)
+{
+	struct dso_sym *syms = realloc(dso->syms,
+	                               sizeof(*syms) * (dso->syms_count + 1));
+	if (!syms)
+		return 1;
+	dso->syms = syms;
+	syms[dso->syms_count].name = strdup(name);
+	if (!syms[dso->syms_count].name)
+		return 1;
+	syms[dso->syms_count].addr = addr;
+	syms[dso->syms_count].size = size;
+	dso->syms_count++;
+	return 0;
+}
+
+static int dso_sym_cmp(const void *a, const void *b)
+{
+	const struct dso_sym *sym_a = a;
+	const struct dso_sym *sym_b = b;
+	if (sym_a->addr < sym_b->addr)
+		return -1;
+	if (sym_a->addr > sym_b->addr)
+		return 1;
+	return 0;
+}
+
+static void dso_load(struct env *env, struct dso *dso)
+{
+	struct elf32 *elf32;
+	struct elf64 *elf64;
+	int ret;
+
+	dso->loaded = 1;
+	elf32 = elf32_open(dso->path);
+	if (elf32)
+	{
+		ret = dso_load_elf32(dso, elf32);
+		elf32_free(elf32);
+	}
+	else
+	{
+		elf64 = elf64_open(dso->path);
+		if (!elf64)
+			return;
+		ret = dso_load_elf64(dso, elf64);
+		elf64_free(elf64);
+	}
+	if (ret)
+		fprintf(stderr, "%s: %s: failed to load symbols\n",
+		        env->progname, dso->path);
+	qsort(dso->syms, dso->syms_count, sizeof(*dso->syms), dso_sym_cmp);
+}
+
+static const char *dso_find_sym(struct dso *dso, uint64_t off)
+{
+	uint64_t vaddr;
+	size_t i;
+
+	for (i = 0; i < dso->loads_count; ++i)
+	{
+		struct dso_load *load = &dso->loads[i];
+		if (off >= load->offset && off < load->offset + load->size)
+		{
+			vaddr = off - load->offset + load->vaddr;
+			break;
+		}
+	}
+	if (i == dso->loads_count)
+		return NULL;
+	size_t min = 0;
+	size_t max = dso->syms_count;
+	while (min < max)
+	{
+		size_t mid = min + (max - min) / 2;
+		if (dso->syms[mid].addr <= vaddr)
+			min = mid + 1;
+		else
+			max = mid;
+	}
+	if (!min)
+		return NULL;
+	struct dso_sym *sym = &dso->syms[min - 1];
+	if (sym->size && vaddr >= sym->addr + sym->size)
+		return NULL;
+	return sym->name;
+}
+
+static int add_dso(struct env *env, const char *path, const struct stat *st)
+{
+	for (struct dso *dso = env->dsos; dso; dso = dso->next)
+	{
+		if (dso->dev == st->st_dev && dso->ino == st->st_ino)
+			return 0;
+	}
+	struct dso *dso = calloc(1, sizeof(*dso));
+	if (!dso)
+		return 1;
+	dso->path = strdup(path);
+	if (!dso->path)
+	{
+		free(dso);
+		return 1;
+	}
+	dso->dev = st->st_dev;
+	dso->ino = st->st_ino;
+	dso->next = env->dsos;
+	env->dsos = dso;
+	return 0;
+}
+
+static int scan_dir(struct env *env, const char *dir_path)
+{
+	char path[MAXPATHLEN];
+	struct dirent *dirent;
+	struct stat st;
+	DIR *dir;
+
+	dir = opendir(dir_path);
+	if (!dir)
+		return 0;
+	while ((dirent = readdir(dir)))
+	{
+		if (dirent->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir_path, dirent->d_name);
+		if (stat(path, &st) == -1 || !S_ISREG(st.st_mode))
+			continue;
+		if (add_dso(env, path, &st))
+		{
+			closedir(dir);
+			return 1;
+		}
+	}
+	closedir(dir);
+	return 0;
+}
+
+/* the kernel reports mapped files as device / inode pairs: build a
+ * list of the binaries that can be found at usual locations
+ */
+static int scan_dsos(struct env *env)
+{
+	struct stat st;
+
+	env->dsos_scanned = 1;
+	if (env->command && strchr(env->command, '/')
+	 && !stat(env->command, &st) && add_dso(env, env->command, &st))
+		return 1;
+	for (size_t i = 0; i < sizeof(dso_dirs) / sizeof(*dso_dirs); ++i)
+	{
+		if (scan_dir(env, dso_dirs[i]))
+			return 1;
+	}
+	return 0;
+}
+
+static struct dso *get_dso(struct env *env, uint32_t dev, uint64_t ino)
+{
+	if (!env->dsos_scanned && scan_dsos(env))
+		return NULL;
+	for (struct dso *dso = env->dsos; dso; dso = dso->next)
+	{
+		if ((uint32_t)dso->dev != dev || (uint64_t)dso->ino != ino)
+			continue;
+		if (!dso->loaded)
+			dso_load(env, dso);
+		return dso;
+	}
+	return NULL;
+}
+
+static struct sym *get_sym(struct env *env, const char *dso,
+                           const char *name)
+{
+	uint32_t hash = hash_str(hash_str(0, dso), name) % SYM_HASH_SIZE;
+	struct sym *sym;
+
+	for (sym = env->sym_hash[hash]; sym; sym = sym->next)
+	{
+		if (sym->dso == dso && !strcmp(sym->name, name))
+			return sym;
+	}
+	if (env->syms_count == env->syms_size)
+	{
+		size_t size = env->syms_size ? env->syms_size * 2 : 256;
+		struct sym **syms = realloc(env->syms, sizeof(*syms) * size);
+		if (!syms)
+			return NULL;
+		env->syms = syms;
+		env->syms_size = size;
+	}
+	sym = calloc(1, sizeof(*sym));
+	if (!sym)
+		return NULL;
+	sym->name = strdup(name);
+	if (!sym->name)
+	{
+		free(sym);
+		return NULL;
+	}
+	sym->dso = dso;
+	sym->next = env->sym_hash[hash];
+	env->sym_hash[hash] = sym;
+	env->syms[env->syms_count++] = sym;
+	return sym;
+}
+
+static struct sym *resolve_kernel(struct env *env, uint64_t pc)
+{
+	struct prof_ksym ksym;
+	char name[64];
+
+	memset(&ksym, 0, sizeof(ksym));
+	ksym.addr = pc;
+	if (!ioctl(env->fd, PROFIO_KSYM, &ksym))
+		return get_sym(env, kernel_dso, ksym.name);
+	snprintf(name, sizeof(name), "0x%" PRIx64, pc);
+	return get_sym(env, kernel_dso, name);
+}
+
+static struct sym *resolve_user(struct env *env,
+                                const struct prof_frame *frame)
+{
+	char name[64];
+
+	if (!(frame->flags & PROF_FRAME_FILE))
+	{
+		snprintf(name, sizeof(name), "0x%" PRIx64, frame->pc);
+		return get_sym(env, anon_dso, name);
+	}
+	struct dso *dso = get_dso(env, frame->dev, frame->ino);
+	if (!dso)
+	{
+		snprintf(name, sizeof(name), "%" PRIu32 ":%" PRIu64 "+0x%" PRIx64,
+		         frame->dev, frame->ino, frame->off);
+		return get_sym(env, unknown_dso, name);
+	}
+	const char *sym_name = dso_find_sym(dso, frame->off);
+	if (sym_name)
+		return get_sym(env, dso->path, sym_name);
+	snprintf(name, sizeof(name), "+0x%" PRIx64, frame->off);
+	return get_sym(env, dso->path, name);
+}
+
+static struct sym *resolve_frame(struct env *env,
+                                 const struct prof_frame *frame)
+{
+	uint32_t flags = frame->flags & (PROF_FRAME_USER | PROF_FRAME_FILE);
+	uint64_t value = (flags & PROF_FRAME_FILE) ? frame->off : frame->pc;
+	uint32_t hash = (uint32_t)((value ^ (value >> 32) ^ frame->ino
+	                          ^ frame->dev ^ flags) * 2654435761u)
+	              % ADDR_HASH_SIZE;
+	struct addr *addr;
+
+	for (addr = env->addr_hash[hash]; addr; addr = addr->next)
+	{
+		if (addr->value == value && addr->flags == flags
+		 && addr->ino == frame->ino && addr->dev == frame->dev)
+			return addr->sym;
+	}
+	addr = malloc(sizeof(*addr));
+	if (!addr)
+		return NULL;
+	if (flags & PROF_FRAME_USER)
+		addr->sym = resolve_user(env, frame);
+	else
+		addr->sym = resolve_kernel(env, frame->pc);
+	if (!addr->sym)
+	{
+		free(addr);
+		return NULL;
+	}
+	addr->value = value;
+	addr->ino = frame->ino;
+	addr->dev = frame->dev;
+	addr->flags = flags;
+	addr->next = env->addr_hash[hash];
+	env->addr_hash[hash] = addr;
+	return addr->sym;
+}
+
+static int add_caller(struct sym *callee, struct sym *caller)
+{
+	struct edge *edge;
+
+	for (edge = callee->callers; edge; edge = edge->next)
+	{
+		if (edge->sym == caller)
+		{
+			edge->count++;
+			return 0;
+		}
+	}
+	edge = malloc(sizeof(*edge));
+	if (!edge)
+		return 1;
+	edge->sym = caller;
+	edge->count = 1;
+	edge->next = callee->callers;
+	callee->callers = edge;
+	return 0;
+}
+
+static int process_sample(struct env *env, const struct prof_sample *sample)
+{
+	struct sym *prev = NULL;
+
+	env->samples++;
+	if (sample->depth && !(sample->frames[0].flags & PROF_FRAME_USER))
+		env->kernel_samples++;
+	for (uint32_t i = 0; i < sample->depth; ++i)
+	{
+		struct sym *sym = resolve_frame(env, &sample->frames[i]);
+		if (!sym)
+			return 1;
+		if (!i)
+			sym->self++;
+		if (sym->mark != env->samples)
+		{
+			sym->mark = env->samples;
+			sym->total++;
+		}
+		if (prev && prev != sym && add_caller(prev, sym))
+			return 1;
+		prev = sym;
+	}
+	return 0;
+}
+
+static ssize_t read_samples(struct env *env)
+{
+	ssize_t ret = read(env->fd, env->buf, READ_SIZE);
+	if (ret == -1)
+	{
+		fprintf(stderr, "%s: read: %s\n", env->progname, strerror(errno));
+		return -1;
+	}
+	size_t off = 0;
+	while (off + sizeof(struct prof_sample) <= (size_t)ret)
+	{
+		const struct prof_sample *sample;
+		sample = (const struct prof_sample*)&((uint8_t*)env->buf)[off];
+		if (sample->size < sizeof(*sample)
+		 || off + sample->size > (size_t)ret
+		 || sample->depth > PROF_MAX_DEPTH)
+		{
+			fprintf(stderr, "%s: invalid sample\n", env->progname);
+			return -1;
+		}
+		if (process_sample(env, sample))
+		{
+			fprintf(stderr, "%s: malloc: %s\n", env->progname,
+			        strerror(errno));
+			return -1;
+		}
+		off += sample->size;
+	}
+	return ret;
+}
+
+static int self_cmp(const void *a, const void *b)
+{
+	const struct sym *sym_a = *(const struct sym**)a;
+	const struct sym *sym_b = *(const struct sym**)b;
+	if (sym_a->self != sym_b->self)
+		return sym_a->self < sym_b->self ? 1 : -1;
+	return strcmp(sym_a->name, sym_b->name);
+}
+
+static int total_cmp(const void *a, const void *b)
+{
+	const struct sym *sym_a = *(const struct sym**)a;
+	const struct sym *sym_b = *(const struct sym**)b;
+	if (sym_a->total != sym_b->total)
+		return sym_a->total < sym_b->total ? 1 : -1;
+	return self_cmp(a, b);
+}
+
+static double percent(struct env *env, uint64_t v)
+{
+	return v * 100.0 / env->samples;
+}
+
+static void print_flat(struct env *env)
+{
+	qsort(env->syms, env->syms_count, sizeof(*env->syms), self_cmp);
+	printf("%7s %8s %7s  %s\n", "self", "samples", "total", "symbol");
+	for (size_t i = 0; i < env->syms_count && i < env->lines; ++i)
+	{
+		struct sym *sym = env->syms[i];
+		if (!sym->self)
+			break;
+		printf("%6.2f%% %8" PRIu64 " %6.2f%%  %s [%s]\n",
+		       percent(env, sym->self), sym->self,
+		       percent(env, sym->total), sym->name, sym->dso);
+	}
+}
+
+static void print_callgraph(struct env *env)
+{
+	qsort(env->syms, env->syms_count, sizeof(*env->syms), total_cmp);
+	printf("%7s %7s  %s\n", "total", "self", "symbol / callers");
+	for (size_t i = 0; i < env->syms_count && i < env->lines; ++i)
+	{
+		struct sym *sym = env->syms[i];
+		uint64_t calls = 0;
+		printf("%6.2f%% %6.2f%%  %s [%s]\n",
+		       percent(env, sym->total), percent(env, sym->self),
+		       sym->name, sym->dso);
+		for (struct edge *edge = sym->callers; edge; edge = edge->next)
+			calls += edge->count;
+		for (struct edge *edge = sym->callers; edge; edge = edge->next)
+			printf("%18s%6.2f%%  %s [%s]\n", "",
+			       edge->count * 100.0 / calls,
+			       edge->sym->name, edge->sym->dso);
+	}
+}
+
+/* the command is started stopped on a pipe, to be released once
+ * the profiler is configured with its pid
+ */
+static pid_t run_command(struct env *env, char **argv, int *start_fd)
+{
+	int fds[2];
+	pid_t pid;
+	char c;
+
+	if (pipe(fds) == -1)
+	{
+		fprintf(stderr, "%s: pipe: %s\n", env->progname,
+		        strerror(errno));
+		return -1;
+	}
+	pid = fork();
+	if (pid == -1)
+	{
+		fprintf(stderr, "%s: fork: %s\n", env->progname,
+		        strerror(errno));
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	if (!pid)
+	{
+		close(fds[1]);
+		close(env->fd);
+		read(fds[0], &c, 1);
+		close(fds[0]);
+		execvp(argv[0], argv);
+		fprintf(stderr, "%s: execvp: %s\n", env->progname,
+		        strerror(errno));
+		_exit(EXIT_FAILURE);
+	}
+	close(fds[0]);
+	*start_fd = fds[1];
+	return pid;
+}
+
+static int elapsed_ms(const struct timespec *begin)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - begin->tv_sec) * 1000
+	     + (now.tv_nsec - begin->tv_nsec) / 1000000;
+}
+
+static void usage(const char *progname)
+{
+	printf("%s [-h] [-a] [-g] [-k] [-u] [-F frequency] [-d duration] [-p pid] [-n lines] [COMMAND [ARGS...]]\n", progname);
+	printf("-h: display this help\n");
+	printf("-a: profile all the processes while running COMMAND\n");
+	printf("-g: record call chains and display the call graph\n");
+	printf("-k: only sample kernel code\n");
+	printf("-u: only sample user code\n");
+	printf("-F frequency: sampling frequency in Hz (default: 100)\n");
+	printf("-d duration: duration in seconds without COMMAND (default: 10)\n");
+	printf("-p pid: only sample the given process\n");
+	printf("-n lines: maximum number of symbols to display (default: 50)\n");
+}
+
+static int parse_uint(struct env *env, const char *s, uint32_t max,
+                      uint32_t *v)
+{
+	char *endptr;
+	errno = 0;
+	unsigned long ret = strtoul(s, &endptr, 10);
+	if (errno || *endptr || !ret || ret > max)
+	{
+		fprintf(stderr, "%s: invalid number: %s\n", env->progname, s);
+		return 1;
+	}
+	*v = ret;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct prof_config config;
+	struct prof_stats stats;
+	struct timespec begin;
+	struct env env;
+	uint32_t duration = 10;
+	uint32_t lines = 50;
+	uint32_t pid = 0;
+	pid_t child = -1;
+	int start_fd = -1;
+	int ret = EXIT_FAILURE;
+	int c;
+
+	memset(&env, 0, sizeof(env));
+	memset(&config, 0, sizeof(config));
+	env.progname = argv[0];
+	env.fd = -1;
+	config.frequency = 100;
+	while ((c = getopt(argc, argv, "hagkuF:d:p:n:")) != -1)
+	{
+		switch (c)
+		{
+			case 'a':
+				env.opt |= OPT_ALL;
+				break;
+			case 'g':
+				env.opt |= OPT_CALLGRAPH;
+				config.flags |= PROF_F_CALLCHAIN;
+				break;
+			case 'k':
+				config.flags |= PROF_F_KERNEL;
+				break;
+			case 'u':
+				config.flags |= PROF_F_USER;
+				break;
+			case 'F':
+				if (parse_uint(&env, optarg, 1000, &config.frequency))
+					return EXIT_FAILURE;
+				break;
+			case 'd':
+				if (parse_uint(&env, optarg, 86400, &duration))
+					return EXIT_FAILURE;
+				break;
+			case 'p':
+				if (parse_uint(&env, optarg, INT32_MAX, &pid))
+					return EXIT_FAILURE;
+				break;
+			case 'n':
+				if (parse_uint(&env, optarg, UINT32_MAX, &lines))
+					return EXIT_FAILURE;
+				break;
+			case 'h':
+				usage(argv[0]);
+				return EXIT_SUCCESS;
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	env.lines = lines;
+	env.buf = malloc(READ_SIZE);
+	if (!env.buf)
+	{
+		fprintf(stderr, "%s: malloc: %s\n", argv[0], strerror(errno));
+		return EXIT_FAILURE;
+	}
+	env.fd = open("/dev/prof", O_RDONLY);
+	if (env.fd == -1)
+	{
+		fprintf(stderr, "%s: open: %s\n", argv[0], strerror(errno));
+		goto end;
+	}
+	config.pid = pid;
+	if (optind < argc)
+	{
+		env.command = argv[optind];
+		child = run_command(&env, &argv[optind], &start_fd);
+		if (child == -1)
+			goto end;
+		if (!(env.opt & OPT_ALL) && !pid)
+			config.pid = child;
+	}
+	if (ioctl(env.fd, PROFIO_START, &config) == -1)
+	{
+		fprintf(stderr, "%s: ioctl: %s\n", argv[0], strerror(errno));
+		goto end;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	if (start_fd != -1)
+	{
+		close(start_fd);
+		start_fd = -1;
+	}
+	while (1)
+	{
+		ssize_t rd = read_samples(&env);
+		if (rd == -1)
+			goto end;
+		if (child != -1)
+		{
+			int wstatus;
+			if (waitpid(child, &wstatus, WNOHANG) == child)
+			{
+				child = -1;
+				break;
+			}
+		}
+		else if (elapsed_ms(&begin) >= (int)duration * 1000)
+		{
+			break;
+		}
+		if (rd < READ_SIZE / 2)
+			usleep(20000);
+	}
+	if (ioctl(env.fd, PROFIO_STOP) == -1)
+	{
+		fprintf(stderr, "%s: ioctl: %s\n", argv[0], strerror(errno));
+		goto end;
+	}
+	while (1)
+	{
+		ssize_t rd = read_samples(&env);
+		if (rd == -1)
+			goto end;
+		if (!rd)
+			break;
+	}
+	if (ioctl(env.fd, PROFIO_STATS, &stats) == -1)
+	{
+		fprintf(stderr, "%s: ioctl: %s\n", argv[0], strerror(errno));
+		goto end;
+	}
+	printf("samples: %" PRIu64 " (kernel: %" PRIu64 ", user: %" PRIu64 ")"
+	       ", dropped: %" PRIu64 "\n", env.samples, env.kernel_samples,
+	       env.samples - env.kernel_samples, stats.dropped);
+	if (env.samples)
+	{
+		printf("\n");
+		print_flat(&env);
+		if (env.opt & OPT_CALLGRAPH)
+		{
+			printf("\n");
+			print_callgraph(&env);
+		}
+	}
+	ret = EXIT_SUCCESS;
+
+end:
+	if (child != -1 && ret != EXIT_SUCCESS)
+		kill(child, SIGKILL);
+	if (start_fd != -1)
+		close(start_fd);
+	if (child != -1)
+		waitpid(child, NULL, 0);
+	if (env.fd != -1)
+		close(env.fd);
+	free(env.buf);
+	return ret;
+}
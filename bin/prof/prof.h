@@ -0,0 +1,46 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct elf32;
+struct elf64;
+
+struct dso_load
+{
+	uint64_t offset;
+	uint64_t vaddr;
+	uint64_t size;
+};
+
+struct dso_sym
+{
+	uint64_t addr;
+	uint64_t size;
+	char *name;
+};
+
+struct dso
+{
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	int loaded;
+	struct dso_load *loads;
+	size_t loads_count;
+	struct dso_sym *syms;
+	size_t syms_count;
+	struct dso *next;
+};
+
+int dso_load_elf32(struct dso *dso, struct elf32 *elf);
+int dso_load_elf64(struct dso *dso, struct elf64 *elf);
+int dso_add_load(struct dso *dso, uint64_t offset, uint64_t vaddr,
+                 uint64_t size);
+int dso_add_sym(struct dso *dso, uint64_t addr, uint64_t size,
+                const char *name);
+
+#endif
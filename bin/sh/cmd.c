@@ -6,10 +6,13 @@
 #include <string.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <spawn.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <stdio.h>
 
+extern char **environ;
+
 static int build_args(struct sh *sh, struct cmd *cmd, int *argc, char ***argv)
 {
 	*argc = 0;
@@ -55,43 +58,45 @@ static void free_argv(char **argv)
 	free(argv);
 }
 
-static void launch_child(struct sh *sh, struct cmd *cmd, pid_t pgid, char **argv)
+static int build_actions(struct cmd *cmd,
+                         posix_spawn_file_actions_t *actions)
 {
-	if (setpgid(0, pgid) == -1)
-	{
-		fprintf(stderr, "%s: setpgid: %s\n", sh->progname,
-		        strerror(errno));
-		return;
-	}
+	int err;
 	struct cmd *pipe_next = TAILQ_NEXT(cmd, chain);
 	struct cmd *pipe_prev = TAILQ_PREV(cmd, cmd_head, chain);
 	if (pipe_next)
 	{
-		if (dup2(cmd->pipefd[1], 1) == -1)
-		{
-			fprintf(stderr, "%s: dup2: %s\n", sh->progname,
-			        strerror(errno));
-			return;
-		}
-		if (cmd->pipe2 && dup2(cmd->pipefd[1], 2) == -1)
+		err = posix_spawn_file_actions_adddup2(actions, cmd->pipefd[1], 1);
+		if (err)
+			return err;
+		if (cmd->pipe2)
 		{
-			fprintf(stderr, "%s: dup2: %s\n", sh->progname,
-			        strerror(errno));
-			return;
+			err = posix_spawn_file_actions_adddup2(actions,
+			                                       cmd->pipefd[1], 2);
+			if (err)
+				return err;
 		}
-		close(cmd->pipefd[0]);
-		close(cmd->pipefd[1]);
+		err = posix_spawn_file_actions_addclose(actions, cmd->pipefd[0]);
+		if (err)
+			return err;
+		err = posix_spawn_file_actions_addclose(actions, cmd->pipefd[1]);
+		if (err)
+			return err;
 	}
 	if (pipe_prev)
 	{
-		if (dup2(pipe_prev->pipefd[0], 0) == -1)
-		{
-			fprintf(stderr, "%s: dup2: %s\n", sh->progname,
-			        strerror(errno));
-			return;
-		}
-		close(pipe_prev->pipefd[0]);
-		close(pipe_prev->pipefd[1]);
+		err = posix_spawn_file_actions_adddup2(actions,
+		                                       pipe_prev->pipefd[0], 0);
+		if (err)
+			return err;
+		err = posix_spawn_file_actions_addclose(actions,
+		                                        pipe_prev->pipefd[0]);
+		if (err)
+			return err;
+		err = posix_spawn_file_actions_addclose(actions,
+		                                        pipe_prev->pipefd[1]);
+		if (err)
+			return err;
 	}
 	for (size_t i = 0; i < cmd->redir_nb; ++i)
 	{
@@ -99,20 +104,17 @@ static void launch_child(struct sh *sh, struct cmd *cmd, pid_t pgid, char **argv
 		switch (redir->type)
 		{
 			case CMD_REDIR_CLOSE:
-				if (close(redir->fd))
-				{
-					fprintf(stderr, "%s: close: %s\n",
-					        sh->progname, strerror(errno));
-					return;
-				}
+				err = posix_spawn_file_actions_addclose(actions,
+				                                        redir->fd);
+				if (err)
+					return err;
 				break;
 			case CMD_REDIR_FD:
-				if (dup2(redir->src.fd, redir->fd) == -1)
-				{
-					fprintf(stderr, "%s: dup2: %s\n",
-					        sh->progname, strerror(errno));
-					return;
-				}
+				err = posix_spawn_file_actions_adddup2(actions,
+				                                       redir->src.fd,
+				                                       redir->fd);
+				if (err)
+					return err;
 				break;
 			case CMD_REDIR_FILE:
 			{
@@ -124,7 +126,7 @@ static void launch_child(struct sh *sh, struct cmd *cmd, pid_t pgid, char **argv
 				else if (redir->inout == CMD_REDIR_INOUT)
 					flags = O_RDWR | O_CREAT;
 				else
-					return;
+					return EINVAL;
 				if (redir->inout == CMD_REDIR_OUT
 				 || redir->inout == CMD_REDIR_INOUT)
 				{
@@ -133,28 +135,17 @@ static void launch_child(struct sh *sh, struct cmd *cmd, pid_t pgid, char **argv
 					else
 						flags |= O_TRUNC;
 				}
-				int fd = open(redir->src.file, flags, 0666);
-				if (fd == -1)
-				{
-					fprintf(stderr, "%s: open(%s): %s\n",
-					        sh->progname, redir->src.file,
-					        strerror(errno));
-					return;
-				}
-				if (dup2(fd, redir->fd) == -1)
-				{
-					fprintf(stderr, "%s: dup2: %s\n",
-					        sh->progname, strerror(errno));
-					return;
-				}
+				err = posix_spawn_file_actions_addopen(actions,
+				                                       redir->fd,
+				                                       redir->src.file,
+				                                       flags, 0666);
+				if (err)
+					return err;
 				break;
 			}
 		}
 	}
-	execvp(argv[0], argv);
-	fprintf(stderr, "%s: %s: %s\n", sh->progname, argv[0],
-	        strerror(errno));
-	return;
+	return 0;
 }
 
 static pid_t launch_cmd(struct sh *sh, struct cmd *cmd, pid_t pgid)
@@ -198,21 +189,32 @@ static pid_t launch_cmd(struct sh *sh, struct cmd *cmd, pid_t pgid)
 		return 0;
 	}
 
-	pid_t pid = vfork();
-	if (pid < 0)
-	{
-		fprintf(stderr, "%s: vfork: %s\n", sh->progname,
-		        strerror(errno));
-		free_argv(argv);
-		return -1;
-	}
-	if (pid)
+	/* the file actions, the process group and the exec are done by the
+	 * kernel, so a failure is reported here, as the exit code of the
+	 * command
+	 */
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	pid_t pid;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+	posix_spawnattr_setpgroup(&attr, pgid);
+	int err = build_actions(cmd, &actions);
+	if (!err)
+		err = posix_spawnp(&pid, argv[0], &actions, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+	if (err)
 	{
+		fprintf(stderr, "%s: %s: %s\n", sh->progname, argv[0],
+		        strerror(err));
+		cmd->failed = 1;
 		free_argv(argv);
-		return pid;
+		return 0;
 	}
-	launch_child(sh, cmd, pgid, argv);
-	_exit(EXIT_FAILURE);
+	free_argv(argv);
+	return pid;
 }
 
 static int start_cmd(struct sh *sh, struct cmd *cmd, pid_t *pgid)
@@ -236,6 +238,7 @@ static int start_cmd(struct sh *sh, struct cmd *cmd, pid_t *pgid)
 		}
 	}
 
+	cmd->failed = 0;
 	cmd->pid = launch_cmd(sh, cmd, *pgid);
 	if (cmd->pid)
 	{
@@ -265,6 +268,12 @@ int pipeline_exec(struct sh *sh, struct pipeline *pipeline, int *exit_code)
 	struct cmd *cmd;
 	TAILQ_FOREACH(cmd, &pipeline->cmds, chain)
 	{
+		if (cmd->failed)
+		{
+			*exit_code = EXIT_FAILURE;
+			sh->last_exit_code = *exit_code;
+			continue;
+		}
 		if (cmd->pid <= 0)
 			continue;
 		int wstatus;
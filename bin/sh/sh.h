@@ -162,6 +162,7 @@ struct cmd
 	size_t redir_nb;
 	int async;
 	pid_t pid;
+	int failed; /* couldn't be spawned */
 	int pipefd[2];
 	int pipe2;
 	TAILQ_ENTRY(cmd) chain;
@@ -0,0 +1,61 @@
+#include <sys/swap.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+
+static void usage(const char *progname)
+{
+	printf("%s [-d] file\n", progname);
+	printf("-d: stop swapping to the file\n");
+}
+
+int main(int argc, char **argv)
+{
+	int off = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "d")) != -1)
+	{
+		switch (c)
+		{
+			case 'd':
+				off = 1;
+				break;
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	if (optind == argc)
+	{
+		fprintf(stderr, "%s: missing operand\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (argc - optind > 1)
+	{
+		fprintf(stderr, "%s: extra operand\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (off)
+	{
+		if (swapoff(argv[optind]) == -1)
+		{
+			fprintf(stderr, "%s: swapoff: %s\n", argv[0],
+			        strerror(errno));
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		if (swapon(argv[optind], 0) == -1)
+		{
+			fprintf(stderr, "%s: swapon: %s\n", argv[0],
+			        strerror(errno));
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -1,5 +1,7 @@
 #include "tests.h"
 
+#include <sys/mman.h>
+
 #include <inttypes.h>
 #include <libelf.h>
 #include <unistd.h>
@@ -37,6 +39,20 @@ static void __attribute__ ((noinline)) test_syscall(void)
 {
 	ASSERT_EQ(unlink((char*)1), -1);
 	ASSERT_EQ(errno, EFAULT);
+	/* user copies stopping at an unmapped page */
+	char *pages = mmap(NULL, 8192, PROT_READ | PROT_WRITE,
+	                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	ASSERT_NE(pages, MAP_FAILED);
+	ASSERT_EQ(munmap(&pages[4096], 4096), 0);
+	strcpy(&pages[4096 - 8], "/nofile");
+	ASSERT_EQ(unlink(&pages[4096 - 8]), -1);
+	ASSERT_EQ(errno, ENOENT);
+	pages[4095] = 'a';
+	ASSERT_EQ(unlink(&pages[4096 - 8]), -1);
+	ASSERT_EQ(errno, EFAULT);
+	ASSERT_EQ(pipe((int*)&pages[4096 - 4]), -1);
+	ASSERT_EQ(errno, EFAULT);
+	ASSERT_EQ(munmap(pages, 4096), 0);
 	struct timespec ts[20];
 	for (size_t i = 0; i < sizeof(ts) / sizeof(*ts); ++i)
 		clock_gettime(CLOCK_MONOTONIC, &ts[i]);
@@ -209,6 +225,8 @@ int main(int argc, char **argv)
 			test_memset_rate();
 		if (!strcmp(argv[1], "malloc"))
 			test_malloc();
+		if (!strcmp(argv[1], "uring_rate"))
+			test_uring_rate();
 	}
 	/* string.c */
 	test_strlen();
@@ -303,8 +321,12 @@ int main(int argc, char **argv)
 
 	/* misc.c */
 	test_pipe();
+	test_splice();
+	test_pread();
+	test_uring();
 	test_env();
 	test_time();
+	test_clock();
 	test_strftime();
 	test_printf();
 	test_fifo();
@@ -327,6 +349,11 @@ int main(int argc, char **argv)
 	test_popen();
 	test_fmemopen();
 	test_bsearch();
+	test_madvise();
+	test_zero_page();
+	test_mmap_shared();
+	test_dcache_race();
+	test_ext2_htree();
 
 	ASSERT_EQ(atexit(test_atexit), 0);
 	printf("passed: %zu\n", g_passed);
@@ -5,15 +5,23 @@
 #include <netinet/in.h>
 
 #include <sys/socket.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/wait.h>
+#include <sys/uring.h>
+#include <sys/auxv.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 
+#include <inttypes.h>
 #include <unistd.h>
 #include <signal.h>
+#include <sched.h>
 #include <string.h>
 #include <libgen.h>
+#include <dirent.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <fetch.h>
@@ -21,6 +29,7 @@
 #include <errno.h>
 #include <dlfcn.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <zlib.h>
 
 void test_pipe(void)
@@ -37,6 +46,234 @@ void test_pipe(void)
 	ASSERT_EQ(close(fds[0]), 0);
 }
 
+void test_splice(void)
+{
+	int fds[2];
+	int tees[2];
+	char buf[16];
+	unlink("/tmp/splice");
+	int fd = open("/tmp/splice", O_RDWR | O_CREAT | O_TRUNC, 0644);
+	ASSERT_NE(fd, -1);
+	ASSERT_EQ(write(fd, "bonjour", 7), 7);
+	ASSERT_NE(pipe(fds), -1);
+	ASSERT_NE(pipe(tees), -1);
+	ASSERT_EQ(write(fds[1], "<", 1), 1);
+	off_t off = 3;
+	ASSERT_EQ(sendfile(fds[1], fd, &off, 16), 4);
+	ASSERT_EQ(off, 7);
+	ASSERT_EQ(lseek(fd, 0, SEEK_CUR), 7);
+	ASSERT_EQ(write(fds[1], ">", 1), 1);
+	ASSERT_EQ(tee(fds[0], tees[1], 16, 0), 6);
+	ASSERT_EQ(read(tees[0], buf, sizeof(buf)), 6);
+	ASSERT_EQ(memcmp(buf, "<jour>", 6), 0);
+	off = 0;
+	ASSERT_EQ(splice(fds[0], NULL, fd, &off, 16, 0), 6);
+	ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0);
+	ASSERT_EQ(read(fd, buf, sizeof(buf)), 7);
+	ASSERT_EQ(memcmp(buf, "<jour>r", 7), 0);
+	ASSERT_EQ(splice(fds[0], NULL, tees[1], NULL, 16, SPLICE_F_NONBLOCK), -1);
+	ASSERT_EQ(errno, EAGAIN);
+	ASSERT_EQ(splice(fd, NULL, fd, NULL, 16, 0), -1);
+	ASSERT_EQ(errno, EINVAL);
+	ASSERT_EQ(close(fds[0]), 0);
+	ASSERT_EQ(close(fds[1]), 0);
+	ASSERT_EQ(close(tees[0]), 0);
+	ASSERT_EQ(close(tees[1]), 0);
+	ASSERT_EQ(close(fd), 0);
+	ASSERT_EQ(unlink("/tmp/splice"), 0);
+}
+
+void test_pread(void)
+{
+	char buf[16];
+	char a[4];
+	char b[4];
+	unlink("/tmp/pread");
+	int fd = open("/tmp/pread", O_RDWR | O_CREAT | O_TRUNC, 0644);
+	ASSERT_NE(fd, -1);
+	ASSERT_EQ(write(fd, "bonjour", 7), 7);
+	ASSERT_EQ(pread(fd, buf, 4, 3), 4);
+	ASSERT_EQ(memcmp(buf, "jour", 4), 0);
+	ASSERT_EQ(lseek(fd, 0, SEEK_CUR), 7);
+	ASSERT_EQ(pwrite(fd, "ns", 2, 1), 2);
+	ASSERT_EQ(lseek(fd, 0, SEEK_CUR), 7);
+	struct iovec iov[2];
+	iov[0].iov_base = a;
+	iov[0].iov_len = sizeof(a);
+	iov[1].iov_base = b;
+	iov[1].iov_len = sizeof(b);
+	ASSERT_EQ(preadv(fd, iov, 2, 0), 7);
+	ASSERT_EQ(memcmp(a, "bnsj", 4), 0);
+	ASSERT_EQ(memcmp(b, "our", 3), 0);
+	ASSERT_EQ(pwritev(fd, iov, 1, 7), 4);
+	ASSERT_EQ(pread(fd, buf, sizeof(buf), 0), 11);
+	ASSERT_EQ(memcmp(buf, "bnsjourbnsj", 11), 0);
+	ASSERT_EQ(pread(fd, buf, 1, -1), -1);
+	ASSERT_EQ(errno, EINVAL);
+	ASSERT_EQ(close(fd), 0);
+	ASSERT_EQ(unlink("/tmp/pread"), 0);
+	int fds[2];
+	ASSERT_NE(pipe(fds), -1);
+	ASSERT_EQ(pwrite(fds[1], "x", 1, 0), -1);
+	ASSERT_EQ(errno, ESPIPE);
+	ASSERT_EQ(close(fds[0]), 0);
+	ASSERT_EQ(close(fds[1]), 0);
+}
+
+static void uring_push(struct uring_ring *ring, struct uring_sqe *sqes,
+                       const struct uring_sqe *sqe)
+{
+	sqes[ring->sq_tail & ring->sq_mask] = *sqe;
+	__atomic_store_n(&ring->sq_tail, ring->sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+static int uring_pop(struct uring_ring *ring, struct uring_cqe *cqes,
+                     struct uring_cqe *cqe)
+{
+	uint32_t head = ring->cq_head;
+	if (head == __atomic_load_n(&ring->cq_tail, __ATOMIC_ACQUIRE))
+		return 0;
+	*cqe = cqes[head & ring->cq_mask];
+	__atomic_store_n(&ring->cq_head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+void test_uring(void)
+{
+	struct uring_params params;
+	struct uring_sqe sqe;
+	struct uring_cqe cqe;
+	struct timespec ts;
+	char buf[16];
+	int fds[2];
+	memset(&params, 0, sizeof(params));
+	int fd = uring_setup(3, &params);
+	ASSERT_NE(fd, -1);
+	ASSERT_EQ(params.sq_entries, 4);
+	ASSERT_EQ(params.cq_entries, 8);
+	uint8_t *map = mmap(NULL, params.size, PROT_READ | PROT_WRITE,
+	                    MAP_SHARED, fd, 0);
+	ASSERT_NE(map, MAP_FAILED);
+	struct uring_ring *ring = (struct uring_ring*)map;
+	struct uring_sqe *sqes = (struct uring_sqe*)&map[params.sqes_off];
+	struct uring_cqe *cqes = (struct uring_cqe*)&map[params.cqes_off];
+	ASSERT_NE(pipe(fds), -1);
+	/* the read waits for the write of the same batch */
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = URING_OP_READ;
+	sqe.fd = fds[0];
+	sqe.off = -1;
+	sqe.addr = (uintptr_t)buf;
+	sqe.len = sizeof(buf);
+	sqe.user_data = 1;
+	uring_push(ring, sqes, &sqe);
+	sqe.opcode = URING_OP_WRITE;
+	sqe.fd = fds[1];
+	sqe.addr = (uintptr_t)"salut";
+	sqe.len = 5;
+	sqe.user_data = 2;
+	uring_push(ring, sqes, &sqe);
+	ASSERT_EQ(uring_enter(fd, 2, 2, URING_ENTER_GETEVENTS, NULL), 2);
+	ASSERT_EQ(uring_pop(ring, cqes, &cqe), 1);
+	ASSERT_EQ(cqe.user_data, 2);
+	ASSERT_EQ(cqe.res, 5);
+	ASSERT_EQ(uring_pop(ring, cqes, &cqe), 1);
+	ASSERT_EQ(cqe.user_data, 1);
+	ASSERT_EQ(cqe.res, 5);
+	ASSERT_EQ(memcmp(buf, "salut", 5), 0);
+	ASSERT_EQ(uring_pop(ring, cqes, &cqe), 0);
+	/* the poll completes on the next enter after the write */
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = URING_OP_POLL_ADD;
+	sqe.fd = fds[0];
+	sqe.op_flags = POLLIN;
+	sqe.user_data = 3;
+	uring_push(ring, sqes, &sqe);
+	ASSERT_EQ(uring_enter(fd, 1, 0, 0, NULL), 1);
+	ASSERT_EQ(uring_pop(ring, cqes, &cqe), 0);
+	ASSERT_EQ(write(fds[1], "x", 1), 1);
+	ASSERT_EQ(uring_enter(fd, 0, 1, URING_ENTER_GETEVENTS, NULL), 0);
+	ASSERT_EQ(uring_pop(ring, cqes, &cqe), 1);
+	ASSERT_EQ(cqe.user_data, 3);
+	ASSERT_EQ(cqe.res & POLLIN, POLLIN);
+	memset(&sqe, 0, sizeof(sqe));
+	ts.tv_sec = 0;
+	ts.tv_nsec = 1000000;
+	sqe.opcode = URING_OP_TIMEOUT;
+	sqe.addr = (uintptr_t)&ts;
+	sqe.user_data = 4;
+	uring_push(ring, sqes, &sqe);
+	ASSERT_EQ(uring_enter(fd, 1, 1, URING_ENTER_GETEVENTS, NULL), 1);
+	ASSERT_EQ(uring_pop(ring, cqes, &cqe), 1);
+	ASSERT_EQ(cqe.user_data, 4);
+	ASSERT_EQ(cqe.res, -ETIME);
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = URING_OP_READ;
+	sqe.fd = fds[1];
+	sqe.off = -1;
+	sqe.user_data = 5;
+	uring_push(ring, sqes, &sqe);
+	ASSERT_EQ(uring_enter(fd, 1, 1, URING_ENTER_GETEVENTS, NULL), 1);
+	ASSERT_EQ(uring_pop(ring, cqes, &cqe), 1);
+	ASSERT_EQ(cqe.res, -EBADF);
+	ASSERT_EQ(close(fds[0]), 0);
+	ASSERT_EQ(close(fds[1]), 0);
+	ASSERT_EQ(munmap(map, params.size), 0);
+	ASSERT_EQ(close(fd), 0);
+}
+
+/* reads of a cached file: one syscall each against batches of a ring */
+void test_uring_rate(void)
+{
+	static const size_t count = 100000;
+	static const size_t batch = 32;
+	struct uring_params params;
+	struct uring_sqe sqe;
+	struct uring_cqe cqe;
+	uint64_t begin;
+	uint64_t end;
+	char buf[64];
+	memset(buf, 0, sizeof(buf));
+	int file = open("/tmp/uring", O_RDWR | O_CREAT | O_TRUNC, 0644);
+	ASSERT_NE(file, -1);
+	ASSERT_EQ(write(file, buf, sizeof(buf)), (ssize_t)sizeof(buf));
+	begin = nanotime();
+	for (size_t i = 0; i < count; ++i)
+		pread(file, buf, sizeof(buf), 0);
+	end = nanotime();
+	printf("pread duration: %" PRIu64 "ns\n", (end - begin) / count);
+	memset(&params, 0, sizeof(params));
+	int fd = uring_setup(batch, &params);
+	ASSERT_NE(fd, -1);
+	uint8_t *map = mmap(NULL, params.size, PROT_READ | PROT_WRITE,
+	                    MAP_SHARED, fd, 0);
+	ASSERT_NE(map, MAP_FAILED);
+	struct uring_ring *ring = (struct uring_ring*)map;
+	struct uring_sqe *sqes = (struct uring_sqe*)&map[params.sqes_off];
+	struct uring_cqe *cqes = (struct uring_cqe*)&map[params.cqes_off];
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = URING_OP_READ;
+	sqe.fd = file;
+	sqe.off = 0;
+	sqe.addr = (uintptr_t)buf;
+	sqe.len = sizeof(buf);
+	begin = nanotime();
+	for (size_t i = 0; i < count; i += batch)
+	{
+		for (size_t j = 0; j < batch; ++j)
+			uring_push(ring, sqes, &sqe);
+		uring_enter(fd, batch, batch, URING_ENTER_GETEVENTS, NULL);
+		while (uring_pop(ring, cqes, &cqe))
+			;
+	}
+	end = nanotime();
+	printf("uring read duration: %" PRIu64 "ns\n", (end - begin) / count);
+	ASSERT_EQ(munmap(map, params.size), 0);
+	ASSERT_EQ(close(fd), 0);
+	ASSERT_EQ(close(file), 0);
+	ASSERT_EQ(unlink("/tmp/uring"), 0);
+}
+
 void test_env(void)
 {
 	char *tmp = getenv("SHELL");
@@ -125,6 +362,38 @@ void test_time(void)
 	ASSERT_STR_EQ(test, "Thu Feb 29 00:00:00 2024\n");
 }
 
+void test_clock(void)
+{
+	struct timespec prev;
+	struct timespec ts;
+	struct timeval tv;
+	unsigned cpu;
+	unsigned node;
+
+	ASSERT_EQ(clock_gettime(CLOCK_MONOTONIC, &prev), 0);
+	for (size_t i = 0; i < 1000; ++i)
+	{
+		ASSERT_EQ(clock_gettime(CLOCK_MONOTONIC, &ts), 0);
+		ASSERT_LT(ts.tv_nsec, 1000000000);
+		ASSERT_GE(ts.tv_sec * 1000000000 + ts.tv_nsec,
+		          prev.tv_sec * 1000000000 + prev.tv_nsec);
+		prev = ts;
+	}
+	ASSERT_EQ(clock_gettime(-1, &ts), -1);
+	ASSERT_EQ(errno, EINVAL);
+	ASSERT_EQ(clock_gettime(CLOCK_REALTIME, &ts), 0);
+	ASSERT_EQ(gettimeofday(&tv, NULL), 0);
+	ASSERT_LT(tv.tv_usec, 1000000);
+	ASSERT_LE(tv.tv_sec - ts.tv_sec, 1);
+	ASSERT_LE(ts.tv_sec - time(NULL), 1);
+	ASSERT_EQ(getcpu(&cpu, &node), 0);
+	/* the vdso pages are shared by every process */
+	void *vdso = (void*)getauxval(AT_SYSINFO_EHDR);
+	ASSERT_NE(vdso, NULL);
+	ASSERT_EQ(mprotect(vdso, 4096, PROT_READ | PROT_WRITE), -1);
+	ASSERT_EQ(errno, EACCES);
+}
+
 void test_strftime(void)
 {
 	time_t t = 1661928356;
@@ -858,3 +1127,229 @@ void test_bsearch(void)
 		}
 	}
 }
+
+void test_madvise(void)
+{
+	size_t size = 16 * 4096;
+	uint8_t *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	                    MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	ASSERT_NE(ptr, MAP_FAILED);
+	ASSERT_EQ(madvise(ptr, size, MADV_SEQUENTIAL), 0);
+	memset(ptr, 0xAB, size);
+	ASSERT_EQ(madvise(&ptr[4096], 4096, MADV_DONTNEED), 0);
+	ASSERT_EQ(ptr[4096], 0);
+	ASSERT_EQ(ptr[4095], 0xAB);
+	ASSERT_EQ(ptr[8192], 0xAB);
+	ASSERT_EQ(madvise(ptr, size, MADV_WILLNEED), 0);
+	ASSERT_EQ(madvise(ptr, size, MADV_NORMAL), 0);
+	ASSERT_EQ(madvise(ptr, size, 42), -1);
+	ASSERT_EQ(errno, EINVAL);
+	ASSERT_EQ(munmap(ptr, size), 0);
+}
+
+void test_zero_page(void)
+{
+	size_t size = 4 * 4096;
+	uint8_t *ptr = mmap(NULL, size, PROT_READ,
+	                    MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	ASSERT_NE(ptr, MAP_FAILED);
+	for (size_t i = 0; i < size; i += 512)
+		ASSERT_EQ(ptr[i], 0);
+	ASSERT_EQ(mprotect(ptr, size, PROT_READ | PROT_WRITE), 0);
+	ptr[4096] = 0xAB;
+	ASSERT_EQ(ptr[0], 0);
+	ASSERT_EQ(ptr[8192], 0);
+	int child = fork();
+	ASSERT_NE(child, -1);
+	if (!child)
+	{
+		ptr[0] = 0xCD;
+		ptr[4096] = 0xCD;
+		exit(EXIT_SUCCESS);
+	}
+	int status;
+	ASSERT_EQ(waitpid(child, &status, 0), child);
+	ASSERT_EQ(ptr[0], 0);
+	ASSERT_EQ(ptr[4096], 0xAB);
+	ptr[12288] = 0xEF;
+	ASSERT_EQ(ptr[8192], 0);
+	ASSERT_EQ(munmap(ptr, size), 0);
+}
+
+void test_mmap_shared(void)
+{
+	size_t size = 2 * 4096;
+	unlink("/tmp/mmap_shared");
+	int fd = open("/tmp/mmap_shared", O_RDWR | O_CREAT | O_TRUNC, 0644);
+	ASSERT_NE(fd, -1);
+	ASSERT_EQ(ftruncate(fd, size), 0);
+	uint8_t *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+	                    fd, 0);
+	ASSERT_NE(ptr, MAP_FAILED);
+	uint8_t c = 0;
+	ptr[10] = 0xAB;
+	ASSERT_EQ(lseek(fd, 10, SEEK_SET), 10);
+	ASSERT_EQ(read(fd, &c, 1), 1);
+	ASSERT_EQ(c, 0xAB);
+	c = 0xCD;
+	ASSERT_EQ(lseek(fd, 4096, SEEK_SET), 4096);
+	ASSERT_EQ(write(fd, &c, 1), 1);
+	ASSERT_EQ(ptr[4096], 0xCD);
+	int child = fork();
+	ASSERT_NE(child, -1);
+	if (!child)
+	{
+		ptr[20] = 0xEF;
+		exit(EXIT_SUCCESS);
+	}
+	int status;
+	ASSERT_EQ(waitpid(child, &status, 0), child);
+	ASSERT_EQ(ptr[20], 0xEF);
+	ptr[30] = 0x12;
+	ASSERT_EQ(msync(ptr, size, MS_SYNC), 0);
+	ASSERT_EQ(munmap(ptr, size), 0);
+	ASSERT_EQ(lseek(fd, 30, SEEK_SET), 30);
+	ASSERT_EQ(read(fd, &c, 1), 1);
+	ASSERT_EQ(c, 0x12);
+	close(fd);
+	ASSERT_EQ(unlink("/tmp/mmap_shared"), 0);
+	ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	           MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+	ASSERT_NE(ptr, MAP_FAILED);
+	child = fork();
+	ASSERT_NE(child, -1);
+	if (!child)
+	{
+		ptr[4096] = 0x34;
+		exit(EXIT_SUCCESS);
+	}
+	ASSERT_EQ(waitpid(child, &status, 0), child);
+	ASSERT_EQ(ptr[4096], 0x34);
+	ASSERT_EQ(munmap(ptr, size), 0);
+}
+
+/* the child keeps looking the name up while the parent creates and
+ * removes it: a lookup started before a change but done after it must
+ * not leave a stale entry in the dentry cache
+ */
+void test_dcache_race(void)
+{
+	const char *path = "/tmp/dcache_race/file";
+	struct stat st;
+	rmdir("/tmp/dcache_race");
+	ASSERT_EQ(mkdir("/tmp/dcache_race", 0755), 0);
+	int child = fork();
+	ASSERT_NE(child, -1);
+	if (!child)
+	{
+		while (1)
+			stat(path, &st);
+	}
+	for (size_t i = 0; i < 1000; ++i)
+	{
+		int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		ASSERT_NE(fd, -1);
+		close(fd);
+		ASSERT_EQ(stat(path, &st), 0);
+		ASSERT_EQ(unlink(path), 0);
+		ASSERT_EQ(stat(path, &st), -1);
+		ASSERT_EQ(errno, ENOENT);
+	}
+	int status;
+	ASSERT_EQ(kill(child, SIGKILL), 0);
+	ASSERT_EQ(waitpid(child, &status, 0), child);
+	ASSERT_EQ(rmdir("/tmp/dcache_race"), 0);
+}
+
+#define HTREE_DIR     "/home/htree"
+#define HTREE_ENTRIES 512
+
+static char htree_pad[201];
+
+static void htree_path(char *path, size_t size, size_t i)
+{
+	snprintf(path, size, HTREE_DIR "/%zu%s", i, htree_pad);
+}
+
+/* every entry is seen once, and only the ones expected */
+static void htree_readdir(size_t step)
+{
+	uint8_t seen[HTREE_ENTRIES];
+	struct dirent *dirent;
+	size_t n = 0;
+	DIR *dir = opendir(HTREE_DIR);
+	ASSERT_NE(dir, NULL);
+	memset(seen, 0, sizeof(seen));
+	while ((dirent = readdir(dir)))
+	{
+		if (!strcmp(dirent->d_name, ".") || !strcmp(dirent->d_name, ".."))
+			continue;
+		char *end;
+		size_t i = strtoul(dirent->d_name, &end, 10);
+		ASSERT_STR_EQ(end, htree_pad);
+		ASSERT_LT(i, HTREE_ENTRIES);
+		if (i >= HTREE_ENTRIES)
+			continue;
+		ASSERT_EQ(i % step, step - 1);
+		ASSERT_EQ(seen[i], 0);
+		seen[i] = 1;
+		n++;
+	}
+	ASSERT_EQ(n, HTREE_ENTRIES / step);
+	closedir(dir);
+}
+
+/* /home is ext2: the long names overflow the first block of the
+ * directory, which gets indexed, and then its leaves, which get split
+ */
+void test_ext2_htree(void)
+{
+	char path[MAXPATHLEN];
+	struct stat st;
+	memset(htree_pad, 'x', sizeof(htree_pad) - 1);
+	mkdir(HTREE_DIR, 0755); /* XXX ext2fs can't rmdir it */
+	ASSERT_EQ(stat(HTREE_DIR, &st), 0);
+	for (size_t i = 0; i < HTREE_ENTRIES; ++i)
+	{
+		htree_path(path, sizeof(path), i);
+		int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		ASSERT_NE(fd, -1);
+		close(fd);
+	}
+	for (size_t i = 0; i < HTREE_ENTRIES; ++i)
+	{
+		htree_path(path, sizeof(path), i);
+		ASSERT_EQ(stat(path, &st), 0);
+	}
+	htree_path(path, sizeof(path), HTREE_ENTRIES);
+	ASSERT_EQ(stat(path, &st), -1);
+	ASSERT_EQ(errno, ENOENT);
+	htree_readdir(1);
+	for (size_t i = 0; i < HTREE_ENTRIES; i += 2)
+	{
+		htree_path(path, sizeof(path), i);
+		ASSERT_EQ(unlink(path), 0);
+	}
+	for (size_t i = 0; i < HTREE_ENTRIES; ++i)
+	{
+		htree_path(path, sizeof(path), i);
+		if (i % 2)
+		{
+			ASSERT_EQ(stat(path, &st), 0);
+		}
+		else
+		{
+			ASSERT_EQ(stat(path, &st), -1);
+			ASSERT_EQ(errno, ENOENT);
+		}
+	}
+	htree_readdir(2);
+	for (size_t i = 1; i < HTREE_ENTRIES; i += 2)
+	{
+		htree_path(path, sizeof(path), i);
+		ASSERT_EQ(unlink(path), 0);
+		ASSERT_EQ(stat(path, &st), -1);
+	}
+	ASSERT_EQ(unlink(HTREE_DIR), -1);
+	ASSERT_EQ(errno, EISDIR);
+}
@@ -163,8 +163,13 @@ void test_wcscspn(void);
 
 /* misc.c */
 void test_pipe(void);
+void test_splice(void);
+void test_pread(void);
+void test_uring(void);
+void test_uring_rate(void);
 void test_env(void);
 void test_time(void);
+void test_clock(void);
 void test_strftime(void);
 void test_printf(void);
 void test_fifo(void);
@@ -187,5 +192,10 @@ void test_dirname(void);
 void test_popen(void);
 void test_fmemopen(void);
 void test_bsearch(void);
+void test_madvise(void);
+void test_zero_page(void);
+void test_mmap_shared(void);
+void test_dcache_race(void);
+void test_ext2_htree(void);
 
 #endif
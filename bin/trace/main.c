@@ -0,0 +1,451 @@
+#include <eklat/trace.h>
+
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+
+#define READ_SIZE (64 * 1024)
+
+#define OPT_ALL (1 << 0)
+
+struct env
+{
+	const char *progname;
+	int fd;
+	int opt;
+	int32_t pid;
+	void *buf;
+	uint64_t events;
+};
+
+static const struct
+{
+	const char *name;
+	uint32_t mask;
+} g_events[] =
+{
+	{"sched_switch",   1 << TP_SCHED_SWITCH},
+	{"sched_wakeup",   1 << TP_SCHED_WAKEUP},
+	{"page_fault",     1 << TP_PAGE_FAULT},
+	{"syscall_enter",  1 << TP_SYSCALL_ENTER},
+	{"syscall_exit",   1 << TP_SYSCALL_EXIT},
+	{"block_submit",   1 << TP_BLOCK_SUBMIT},
+	{"block_complete", 1 << TP_BLOCK_COMPLETE},
+	{"net_rx",         1 << TP_NET_RX},
+	{"net_tx",         1 << TP_NET_TX},
+	{"tcp_input",      1 << TP_TCP_INPUT},
+	{"tcp_output",     1 << TP_TCP_OUTPUT},
+	{"sched",          (1 << TP_SCHED_SWITCH) | (1 << TP_SCHED_WAKEUP)},
+	{"syscall",        (1 << TP_SYSCALL_ENTER) | (1 << TP_SYSCALL_EXIT)},
+	{"block",          (1 << TP_BLOCK_SUBMIT) | (1 << TP_BLOCK_COMPLETE)},
+	{"net",            (1 << TP_NET_RX) | (1 << TP_NET_TX)},
+	{"tcp",            (1 << TP_TCP_INPUT) | (1 << TP_TCP_OUTPUT)},
+	{"all",            (1 << TP_EVENT_COUNT) - 1},
+};
+
+static int parse_events(struct env *env, char *s, uint32_t *mask)
+{
+	char *saveptr;
+	for (char *name = strtok_r(s, ",", &saveptr);
+	     name;
+	     name = strtok_r(NULL, ",", &saveptr))
+	{
+		size_t i;
+		for (i = 0; i < sizeof(g_events) / sizeof(*g_events); ++i)
+		{
+			if (!strcmp(g_events[i].name, name))
+				break;
+		}
+		if (i == sizeof(g_events) / sizeof(*g_events))
+		{
+			fprintf(stderr, "%s: unknown event: %s\n", env->progname,
+			        name);
+			return 1;
+		}
+		*mask |= g_events[i].mask;
+	}
+	return 0;
+}
+
+static void print_flags(uint8_t flags)
+{
+	static const char names[] = "FSRPAU";
+	for (size_t i = 0; i < 6; ++i)
+		putchar((flags & (1 << i)) ? names[i] : '.');
+}
+
+static void print_payload(uint16_t event, const void *payload)
+{
+	switch (event)
+	{
+		case TP_SCHED_SWITCH:
+		{
+			const struct tp_sched_switch *tp = payload;
+			printf("sched_switch: %.*s %" PRId32 "/%" PRId32
+			       " pri=%" PRId32 " %s => %.*s %" PRId32 "/%" PRId32
+			       " pri=%" PRId32,
+			       TP_COMM_LEN, tp->prev_comm, tp->prev_pid,
+			       tp->prev_tid, tp->prev_pri,
+			       tp->prev_state ? "blocked" : "preempted",
+			       TP_COMM_LEN, tp->next_comm, tp->next_pid,
+			       tp->next_tid, tp->next_pri);
+			break;
+		}
+		case TP_SCHED_WAKEUP:
+		{
+			const struct tp_sched_wakeup *tp = payload;
+			printf("sched_wakeup: %.*s %" PRId32 "/%" PRId32
+			       " pri=%" PRId32 " cpu=%" PRIu32,
+			       TP_COMM_LEN, tp->comm, tp->pid, tp->tid, tp->pri,
+			       tp->target_cpu);
+			break;
+		}
+		case TP_PAGE_FAULT:
+		{
+			const struct tp_page_fault *tp = payload;
+			printf("page_fault: addr=0x%" PRIx64 " prot=0x%" PRIx32
+			       " ret=%" PRId32 " %" PRIu64 "us",
+			       tp->addr, tp->prot, tp->ret, tp->duration / 1000);
+			break;
+		}
+		case TP_SYSCALL_ENTER:
+		{
+			const struct tp_syscall_enter *tp = payload;
+			printf("syscall_enter: %" PRIu64 " (0x%" PRIx64 ", 0x%" PRIx64
+			       ", 0x%" PRIx64 ", 0x%" PRIx64 ", 0x%" PRIx64
+			       ", 0x%" PRIx64 ")",
+			       tp->id, tp->args[0], tp->args[1], tp->args[2],
+			       tp->args[3], tp->args[4], tp->args[5]);
+			break;
+		}
+		case TP_SYSCALL_EXIT:
+		{
+			const struct tp_syscall_exit *tp = payload;
+			printf("syscall_exit: %" PRIu64 " = %" PRId64 " %" PRIu64 "us",
+			       tp->id, tp->ret, tp->duration / 1000);
+			break;
+		}
+		case TP_BLOCK_SUBMIT:
+		case TP_BLOCK_COMPLETE:
+		{
+			const struct tp_block *tp = payload;
+			printf("%s: dev=%" PRIu32 ",%" PRIu32 " %s off=%" PRIu64
+			       " size=%" PRIu64,
+			       event == TP_BLOCK_SUBMIT ? "block_submit"
+			                                : "block_complete",
+			       (tp->dev >> 16) & 0xFFFF, tp->dev & 0xFFFF,
+			       tp->write ? "W" : "R", tp->off, tp->size);
+			if (event == TP_BLOCK_COMPLETE)
+				printf(" ret=%" PRId64 " %" PRIu64 "us", tp->ret,
+				       tp->duration / 1000);
+			break;
+		}
+		case TP_NET_RX:
+		case TP_NET_TX:
+		{
+			const struct tp_net *tp = payload;
+			printf("%s: %.*s len=%" PRIu32 " proto=0x%04" PRIx16,
+			       event == TP_NET_RX ? "net_rx" : "net_tx",
+			       (int)sizeof(tp->ifname), tp->ifname, tp->len,
+			       tp->proto);
+			break;
+		}
+		case TP_TCP_INPUT:
+		case TP_TCP_OUTPUT:
+		{
+			const struct tp_tcp *tp = payload;
+			printf("%s: %" PRIu16 " > %" PRIu16 " ",
+			       event == TP_TCP_INPUT ? "tcp_input" : "tcp_output",
+			       tp->sport, tp->dport);
+			print_flags(tp->flags);
+			printf(" seq=%" PRIu32 " ack=%" PRIu32 " win=%" PRIu16
+			       " len=%" PRIu32,
+			       tp->seq, tp->ack, tp->win, tp->len);
+			break;
+		}
+		default:
+			printf("unknown event %" PRIu16, event);
+			break;
+	}
+	printf("\n");
+}
+
+/* an event is related to the traced process if it runs in it or if it
+ * targets one of its threads
+ */
+static int match_pid(struct env *env, const struct tp_header *hdr)
+{
+	const void *payload = &hdr[1];
+	if (!env->pid || hdr->pid == env->pid)
+		return 1;
+	switch (hdr->event)
+	{
+		case TP_SCHED_SWITCH:
+		{
+			const struct tp_sched_switch *tp = payload;
+			return tp->prev_pid == env->pid
+			    || tp->next_pid == env->pid;
+		}
+		case TP_SCHED_WAKEUP:
+		{
+			const struct tp_sched_wakeup *tp = payload;
+			return tp->pid == env->pid;
+		}
+		default:
+			return 0;
+	}
+}
+
+static ssize_t read_events(struct env *env)
+{
+	ssize_t ret = read(env->fd, env->buf, READ_SIZE);
+	if (ret == -1)
+	{
+		fprintf(stderr, "%s: read: %s\n", env->progname, strerror(errno));
+		return -1;
+	}
+	size_t off = 0;
+	while (off + sizeof(struct tp_header) <= (size_t)ret)
+	{
+		const struct tp_header *hdr;
+		hdr = (const struct tp_header*)&((uint8_t*)env->buf)[off];
+		if (hdr->size < sizeof(*hdr)
+		 || off + hdr->size > (size_t)ret)
+		{
+			fprintf(stderr, "%s: invalid event\n", env->progname);
+			return -1;
+		}
+		if (match_pid(env, hdr))
+		{
+			printf("[%2" PRIu32 "] %" PRIu64 ".%06" PRIu64
+			       " %" PRId32 "/%" PRId32 " ",
+			       hdr->cpu, hdr->time / 1000000000,
+			       (hdr->time / 1000) % 1000000, hdr->pid, hdr->tid);
+			print_payload(hdr->event, &hdr[1]);
+			env->events++;
+		}
+		off += hdr->size;
+	}
+	return ret;
+}
+
+/* the command is started stopped on a pipe, to be released once
+ * tracing is enabled
+ */
+static pid_t run_command(struct env *env, char **argv, int *start_fd)
+{
+	int fds[2];
+	pid_t pid;
+	char c;
+
+	if (pipe(fds) == -1)
+	{
+		fprintf(stderr, "%s: pipe: %s\n", env->progname,
+		        strerror(errno));
+		return -1;
+	}
+	pid = fork();
+	if (pid == -1)
+	{
+		fprintf(stderr, "%s: fork: %s\n", env->progname,
+		        strerror(errno));
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	if (!pid)
+	{
+		close(fds[1]);
+		close(env->fd);
+		read(fds[0], &c, 1);
+		close(fds[0]);
+		execvp(argv[0], argv);
+		fprintf(stderr, "%s: execvp: %s\n", env->progname,
+		        strerror(errno));
+		_exit(EXIT_FAILURE);
+	}
+	close(fds[0]);
+	*start_fd = fds[1];
+	return pid;
+}
+
+static int elapsed_ms(const struct timespec *begin)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - begin->tv_sec) * 1000
+	     + (now.tv_nsec - begin->tv_nsec) / 1000000;
+}
+
+static void usage(const char *progname)
+{
+	printf("%s [-h] [-l] [-a] [-e events] [-d duration] [-p pid] [COMMAND [ARGS...]]\n", progname);
+	printf("-h: display this help\n");
+	printf("-l: list the available events\n");
+	printf("-a: display the events of all the processes while running COMMAND\n");
+	printf("-e events: comma-separated list of events to trace (default: all)\n");
+	printf("-d duration: duration in seconds without COMMAND (default: 10)\n");
+	printf("-p pid: only display the events related to the given process\n");
+}
+
+static int parse_uint(struct env *env, const char *s, uint32_t max,
+                      uint32_t *v)
+{
+	char *endptr;
+	errno = 0;
+	unsigned long ret = strtoul(s, &endptr, 10);
+	if (errno || *endptr || !ret || ret > max)
+	{
+		fprintf(stderr, "%s: invalid number: %s\n", env->progname, s);
+		return 1;
+	}
+	*v = ret;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct tp_stats stats;
+	struct timespec begin;
+	struct env env;
+	uint32_t duration = 10;
+	uint32_t mask = 0;
+	uint32_t pid = 0;
+	pid_t child = -1;
+	int start_fd = -1;
+	int ret = EXIT_FAILURE;
+	int c;
+
+	memset(&env, 0, sizeof(env));
+	env.progname = argv[0];
+	env.fd = -1;
+	while ((c = getopt(argc, argv, "hlae:d:p:")) != -1)
+	{
+		switch (c)
+		{
+			case 'l':
+				for (size_t i = 0; i < sizeof(g_events) / sizeof(*g_events); ++i)
+					printf("%s\n", g_events[i].name);
+				return EXIT_SUCCESS;
+			case 'a':
+				env.opt |= OPT_ALL;
+				break;
+			case 'e':
+				if (parse_events(&env, optarg, &mask))
+					return EXIT_FAILURE;
+				break;
+			case 'd':
+				if (parse_uint(&env, optarg, 86400, &duration))
+					return EXIT_FAILURE;
+				break;
+			case 'p':
+				if (parse_uint(&env, optarg, INT32_MAX, &pid))
+					return EXIT_FAILURE;
+				break;
+			case 'h':
+				usage(argv[0]);
+				return EXIT_SUCCESS;
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	if (!mask)
+		mask = (1 << TP_EVENT_COUNT) - 1;
+	env.buf = malloc(READ_SIZE);
+	if (!env.buf)
+	{
+		fprintf(stderr, "%s: malloc: %s\n", argv[0], strerror(errno));
+		return EXIT_FAILURE;
+	}
+	env.fd = open("/dev/trace", O_RDONLY);
+	if (env.fd == -1)
+	{
+		fprintf(stderr, "%s: open: %s\n", argv[0], strerror(errno));
+		goto end;
+	}
+	env.pid = pid;
+	if (optind < argc)
+	{
+		child = run_command(&env, &argv[optind], &start_fd);
+		if (child == -1)
+			goto end;
+		if (!(env.opt & OPT_ALL) && !pid)
+			env.pid = child;
+	}
+	if (ioctl(env.fd, TRACEIO_START, &mask) == -1)
+	{
+		fprintf(stderr, "%s: ioctl: %s\n", argv[0], strerror(errno));
+		goto end;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	if (start_fd != -1)
+	{
+		close(start_fd);
+		start_fd = -1;
+	}
+	while (1)
+	{
+		ssize_t rd = read_events(&env);
+		if (rd == -1)
+			goto end;
+		if (child != -1)
+		{
+			int wstatus;
+			if (waitpid(child, &wstatus, WNOHANG) == child)
+			{
+				child = -1;
+				break;
+			}
+		}
+		else if (elapsed_ms(&begin) >= (int)duration * 1000)
+		{
+			break;
+		}
+		if (rd < READ_SIZE / 2)
+			usleep(20000);
+	}
+	if (ioctl(env.fd, TRACEIO_STOP) == -1)
+	{
+		fprintf(stderr, "%s: ioctl: %s\n", argv[0], strerror(errno));
+		goto end;
+	}
+	while (1)
+	{
+		ssize_t rd = read_events(&env);
+		if (rd == -1)
+			goto end;
+		if (!rd)
+			break;
+	}
+	if (ioctl(env.fd, TRACEIO_STATS, &stats) == -1)
+	{
+		fprintf(stderr, "%s: ioctl: %s\n", argv[0], strerror(errno));
+		goto end;
+	}
+	fprintf(stderr, "events: %" PRIu64 " (displayed: %" PRIu64 ")"
+	        ", dropped: %" PRIu64 "\n", stats.events, env.events,
+	        stats.dropped);
+	ret = EXIT_SUCCESS;
+
+end:
+	if (child != -1 && ret != EXIT_SUCCESS)
+		kill(child, SIGKILL);
+	if (start_fd != -1)
+		close(start_fd);
+	if (child != -1)
+		waitpid(child, NULL, 0);
+	if (env.fd != -1)
+		close(env.fd);
+	free(env.buf);
+	return ret;
+}
@@ -13,6 +13,7 @@
 
 #include <multiboot.h>
 #include <file.h>
+#include <numa.h>
 #include <std.h>
 #include <uio.h>
 #include <pci.h>
@@ -388,6 +389,86 @@ struct facs
 	uint8_t reserved40[24];
 };
 
+struct srat
+{
+	struct acpi_hdr hdr;
+	uint32_t reserved1;
+	uint64_t reserved2;
+} __attribute__ ((packed));
+
+struct srat_entry
+{
+	uint8_t type;
+	uint8_t length;
+} __attribute__ ((packed));
+
+enum srat_type
+{
+	SRAT_LOCAL_APIC   = 0x0,
+	SRAT_MEMORY       = 0x1,
+	SRAT_LOCAL_X2APIC = 0x2,
+	SRAT_GICC         = 0x3,
+};
+
+struct srat_local_apic
+{
+	struct srat_entry entry;
+	uint8_t proximity_domain_lo;
+	uint8_t apic_id;
+	uint32_t flags;
+	uint8_t local_sapic_eid;
+	uint8_t proximity_domain_hi[3];
+	uint32_t clock_domain;
+} __attribute__ ((packed));
+
+struct srat_memory
+{
+	struct srat_entry entry;
+	uint32_t proximity_domain;
+	uint16_t reserved1;
+	uint32_t base_addr_lo;
+	uint32_t base_addr_hi;
+	uint32_t length_lo;
+	uint32_t length_hi;
+	uint32_t reserved2;
+	uint32_t flags;
+	uint64_t reserved3;
+} __attribute__ ((packed));
+
+struct srat_local_x2apic
+{
+	struct srat_entry entry;
+	uint16_t reserved1;
+	uint32_t proximity_domain;
+	uint32_t x2apic_id;
+	uint32_t flags;
+	uint32_t clock_domain;
+	uint32_t reserved2;
+} __attribute__ ((packed));
+
+struct srat_gicc
+{
+	struct srat_entry entry;
+	uint32_t proximity_domain;
+	uint32_t acpi_processor_uid;
+	uint32_t flags;
+	uint32_t clock_domain;
+} __attribute__ ((packed));
+
+enum srat_flags
+{
+	SRAT_F_ENABLED      = 0x1,
+	SRAT_F_HOTPLUGGABLE = 0x2,
+	SRAT_F_NONVOLATILE  = 0x4,
+};
+
+struct slit
+{
+	struct acpi_hdr hdr;
+	uint64_t localities;
+	uint8_t entries[];
+} __attribute__ ((packed));
+
 static const struct rsdp *rsdp;
 static const struct rsdt *rsdt;
 static const struct xsdt *xsdt;
@@ -398,6 +479,8 @@ static const struct mcfg *mcfg;
 static const struct dsdt *dsdt;
 static const struct ssdt *ssdt[MAX_SSDT];
 static const struct tpm2 *tpm2;
+static const struct srat *srat;
+static const struct slit *slit;
 static struct facs *facs;
 
 static struct node *rsdp_node;
@@ -410,11 +493,20 @@ static struct node *mcfg_node;
 static struct node *dsdt_node;
 static struct node *ssdt_nodes[MAX_SSDT];
 static struct node *tpm2_node;
+static struct node *srat_node;
+static struct node *slit_node;
 static struct node *facs_node;
 static struct node *acpi_node;
 
 static struct aml_state *aml_state;
 
+#if defined(__aarch64__)
+/* the srat references the gicc by their acpi processor uid */
+static uint32_t gicc_uids[MAXCPU];
+static uint64_t gicc_mpidrs[MAXCPU];
+static size_t gicc_count;
+#endif
+
 static const void *map_table(uint32_t addr);
 static void unmap_table(const struct acpi_hdr *hdr);
 
@@ -876,6 +968,112 @@ static const struct file_op mcfg_fop =
 	.read = mcfg_fread,
 };
 
+static ssize_t srat_fread(struct file *file, struct uio *uio)
+{
+	(void)file;
+	size_t count = uio->count;
+	off_t off = uio->off;
+	print_acpi_hdr(uio, &srat->hdr);
+	const struct srat_entry *entry = (const struct srat_entry*)&srat[1];
+	while ((const uint8_t*)entry < (const uint8_t*)srat + srat->hdr.length)
+	{
+		if (!entry->length)
+			break;
+		switch (entry->type)
+		{
+			case SRAT_LOCAL_APIC:
+			{
+				const struct srat_local_apic *local_apic = (const struct srat_local_apic*)entry;
+				uprintf(uio, "local apic\n"
+				             "  domain : 0x%02" PRIx8 "%02" PRIx8 "%02" PRIx8 "%02" PRIx8 "\n"
+				             "  apic id: 0x%02" PRIx8 "\n"
+				             "  flags  : 0x%08" PRIx32 "\n",
+				             local_apic->proximity_domain_hi[2],
+				             local_apic->proximity_domain_hi[1],
+				             local_apic->proximity_domain_hi[0],
+				             local_apic->proximity_domain_lo,
+				             local_apic->apic_id,
+				             local_apic->flags);
+				break;
+			}
+			case SRAT_MEMORY:
+			{
+				const struct srat_memory *memory = (const struct srat_memory*)entry;
+				uprintf(uio, "memory\n"
+				             "  domain: 0x%08" PRIx32 "\n"
+				             "  base  : 0x%08" PRIx32 "%08" PRIx32 "\n"
+				             "  length: 0x%08" PRIx32 "%08" PRIx32 "\n"
+				             "  flags : 0x%08" PRIx32 "\n",
+				             memory->proximity_domain,
+				             memory->base_addr_hi,
+				             memory->base_addr_lo,
+				             memory->length_hi,
+				             memory->length_lo,
+				             memory->flags);
+				break;
+			}
+			case SRAT_LOCAL_X2APIC:
+			{
+				const struct srat_local_x2apic *local_x2apic = (const struct srat_local_x2apic*)entry;
+				uprintf(uio, "local x2apic\n"
+				             "  domain   : 0x%08" PRIx32 "\n"
+				             "  x2apic id: 0x%08" PRIx32 "\n"
+				             "  flags    : 0x%08" PRIx32 "\n",
+				             local_x2apic->proximity_domain,
+				             local_x2apic->x2apic_id,
+				             local_x2apic->flags);
+				break;
+			}
+			case SRAT_GICC:
+			{
+				const struct srat_gicc *gicc = (const struct srat_gicc*)entry;
+				uprintf(uio, "gicc\n"
+				             "  domain       : 0x%08" PRIx32 "\n"
+				             "  acpi proc uid: 0x%08" PRIx32 "\n"
+				             "  flags        : 0x%08" PRIx32 "\n",
+				             gicc->proximity_domain,
+				             gicc->acpi_processor_uid,
+				             gicc->flags);
+				break;
+			}
+			default:
+				uprintf(uio, "acpi: unhandled srat entry type: %" PRIx8 "\n", entry->type);
+				break;
+		}
+		entry = (const struct srat_entry*)((const uint8_t*)entry + entry->length);
+	}
+	uio->off = off + count - uio->count;
+	return count - uio->count;
+}
+
+static const struct file_op srat_fop =
+{
+	.read = srat_fread,
+};
+
+static ssize_t slit_fread(struct file *file, struct uio *uio)
+{
+	(void)file;
+	size_t count = uio->count;
+	off_t off = uio->off;
+	print_acpi_hdr(uio, &slit->hdr);
+	uprintf(uio, "localities : %" PRIu64 "\n", slit->localities);
+	for (uint64_t i = 0; i < slit->localities; ++i)
+	{
+		for (uint64_t j = 0; j < slit->localities; ++j)
+			uprintf(uio, "%s%3" PRIu8, j ? " " : "",
+			        slit->entries[i * slit->localities + j]);
+		uprintf(uio, "\n");
+	}
+	uio->off = off + count - uio->count;
+	return count - uio->count;
+}
+
+static const struct file_op slit_fop =
+{
+	.read = slit_fread,
+};
+
 static ssize_t dsdt_fread(struct file *file, struct uio *uio)
 {
 	(void)file;
@@ -1249,6 +1447,12 @@ static void handle_madt(void)
 				if (!gicc->acpi_processor_uid)
 					gicv2_init_gicc(gicc->physical_base_address);
 				psci_add_cpu(gicc->mpidr, gicc->cpu_interface_number);
+				if (gicc_count < MAXCPU)
+				{
+					gicc_uids[gicc_count] = gicc->acpi_processor_uid;
+					gicc_mpidrs[gicc_count] = gicc->mpidr;
+					gicc_count++;
+				}
 				break;
 			}
 			case MADT_GICD:
@@ -1300,6 +1504,104 @@ static void handle_tpm2(void)
 		printf("acpi: failed to create tpm2 sysnode: %s\n", strerror(ret));
 }
 
+static void srat_gicc(const struct srat_gicc *gicc)
+{
+#if defined(__aarch64__)
+	for (size_t i = 0; i < gicc_count; ++i)
+	{
+		if (gicc_uids[i] != gicc->acpi_processor_uid)
+			continue;
+		numa_add_cpu(gicc->proximity_domain, gicc_mpidrs[i]);
+		return;
+	}
+	printf("acpi: srat gicc %" PRIu32 " not found\n",
+	       gicc->acpi_processor_uid);
+#else
+	(void)gicc;
+#endif
+}
+
+static void handle_srat(void)
+{
+	int ret = sysfs_mknode("acpi/srat", 0, 0, 0400, &srat_fop, &srat_node);
+	if (ret)
+		printf("acpi: failed to create srat sysnode: %s\n", strerror(ret));
+	const struct srat_entry *entry = (const struct srat_entry*)&srat[1];
+	while ((const uint8_t*)entry < (const uint8_t*)srat + srat->hdr.length)
+	{
+		if (!entry->length)
+		{
+			printf("acpi: invalid srat entry length\n");
+			return;
+		}
+		switch (entry->type)
+		{
+			case SRAT_LOCAL_APIC:
+			{
+				const struct srat_local_apic *local_apic = (const struct srat_local_apic*)entry;
+				if (!(local_apic->flags & SRAT_F_ENABLED))
+					break;
+				uint32_t domain = local_apic->proximity_domain_lo
+				                | (local_apic->proximity_domain_hi[0] << 8)
+				                | (local_apic->proximity_domain_hi[1] << 16)
+				                | ((uint32_t)local_apic->proximity_domain_hi[2] << 24);
+				numa_add_cpu(domain, local_apic->apic_id);
+				break;
+			}
+			case SRAT_MEMORY:
+			{
+				const struct srat_memory *memory = (const struct srat_memory*)entry;
+				if (!(memory->flags & SRAT_F_ENABLED))
+					break;
+				numa_add_memory(memory->proximity_domain,
+				                ((uint64_t)memory->base_addr_hi << 32) | memory->base_addr_lo,
+				                ((uint64_t)memory->length_hi << 32) | memory->length_lo);
+				break;
+			}
+			case SRAT_LOCAL_X2APIC:
+			{
+				const struct srat_local_x2apic *local_x2apic = (const struct srat_local_x2apic*)entry;
+				if (!(local_x2apic->flags & SRAT_F_ENABLED))
+					break;
+				numa_add_cpu(local_x2apic->proximity_domain,
+				             local_x2apic->x2apic_id);
+				break;
+			}
+			case SRAT_GICC:
+			{
+				const struct srat_gicc *gicc = (const struct srat_gicc*)entry;
+				if (!(gicc->flags & SRAT_F_ENABLED))
+					break;
+				srat_gicc(gicc);
+				break;
+			}
+			default:
+				break;
+		}
+		entry = (const struct srat_entry*)((const uint8_t*)entry + entry->length);
+	}
+}
+
+/* the localities of the slit are the proximity domains of the srat */
+static void handle_slit(void)
+{
+	if (slit->hdr.length < sizeof(*slit)
+	 || slit->localities > UINT32_MAX
+	 || slit->localities * slit->localities > slit->hdr.length - sizeof(*slit))
+	{
+		printf("acpi: invalid slit localities\n");
+		return;
+	}
+	int ret = sysfs_mknode("acpi/slit", 0, 0, 0400, &slit_fop, &slit_node);
+	if (ret)
+		printf("acpi: failed to create slit sysnode: %s\n", strerror(ret));
+	for (uint64_t i = 0; i < slit->localities; ++i)
+	{
+		for (uint64_t j = 0; j < slit->localities; ++j)
+			numa_set_distance(i, j, slit->entries[i * slit->localities + j]);
+	}
+}
+
 int acpi_get_ecam_addr(const struct pci_device *device, uintptr_t *poffp)
 {
 	if (!mcfg)
@@ -1349,6 +1651,12 @@ static void handle_rsdt(void)
 	tpm2 = rsdt_find_table("TPM2");
 	if (tpm2)
 		handle_tpm2();
+	srat = rsdt_find_table("SRAT");
+	if (srat)
+		handle_srat();
+	slit = rsdt_find_table("SLIT");
+	if (slit)
+		handle_slit();
 }
 
 static void handle_xsdt(void)
@@ -1376,6 +1684,12 @@ static void handle_xsdt(void)
 	tpm2 = xsdt_find_table("TPM2");
 	if (tpm2)
 		handle_tpm2();
+	srat = xsdt_find_table("SRAT");
+	if (srat)
+		handle_srat();
+	slit = xsdt_find_table("SLIT");
+	if (slit)
+		handle_slit();
 }
 
 static void handle_rsdp(void)
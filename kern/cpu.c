@@ -4,9 +4,14 @@
 
 #include <net/if.h>
 
+#include <tracepoint.h>
 #include <multiboot.h>
+#include <lockstat.h>
 #include <random.h>
+#include <prof.h>
 #include <evdev.h>
+#include <numa.h>
+#include <vdso.h>
 #include <sched.h>
 #include <timer.h>
 #include <proc.h>
@@ -30,6 +35,7 @@
 void sock_init(void);
 void file_init(void);
 void vm_zone_init(void);
+void vm_cache_init(void);
 void bcdev_init(void);
 void sysv_ipc_init(void);
 void pty_init_sma(void);
@@ -143,17 +149,21 @@ void _panic(const char *file, size_t line, const char *fn, const char *fmt, ...)
 
 void kernel_lock(void)
 {
-	while (!spinlock_trylock(&g_kernel_lock))
+	uint64_t start = lockstat_enabled() ? arch_get_cycles() : 0;
+	int contended = 0;
+	uint32_t ticket = spinlock_get_ticket(&g_kernel_lock);
+	while (!spinlock_ticket_ready(&g_kernel_lock, ticket))
 	{
+		contended = 1;
 		cpu_test_panic();
 		arch_spin_yield();
 	}
-	/* XXX hack: always reload vmem to avoid memory problems
-	 * tlb shootdown should be implemented instead
-	 * it costs around 300ns (relative to a 400ns getpid() syscall without it)
-	 */
-	struct thread *thread = curcpu()->thread;
-	arch_vm_setspace(thread ? thread->proc->vm_space : NULL);
+	if (start)
+		lockstat_spin_acquired(&g_kernel_lock,
+		                       (uintptr_t)__builtin_return_address(0),
+		                       arch_get_cycles() - start, contended);
+	vm_tlb_kern_sync();
+	vm_tlb_user_sync();
 }
 
 void kernel_unlock(void)
@@ -182,8 +192,11 @@ static void register_sysfs_nodes(void)
 	loadavg_register_sysfs();
 	uptime_register_sysfs();
 	cpustat_register_sysfs();
+	numa_register_sysfs();
 	sma_register_sysfs();
 	irq_register_sysfs();
+	lockclass_register_sysfs();
+	lockstat_register_sysfs();
 }
 
 static void init_sma(void)
@@ -191,6 +204,8 @@ static void init_sma(void)
 	sock_init();
 	file_init();
 	vm_zone_init();
+	vm_cache_init();
+	vm_reclaim_init();
 	vm_region_init_sma();
 	bcdev_init();
 	sysv_ipc_init();
@@ -257,10 +272,14 @@ static void first_cpu_init(void)
 	vfs_init();
 	cdev_init();
 	arch_device_init();
+	numa_init();
 	evdev_init();
+	prof_init();
+	tracepoint_init();
 	ipc_init();
 	net_loopback_init();
 	clock_gettime(CLOCK_MONOTONIC, &g_boottime);
+	vdso_init();
 	random_register(random_boottime_collect, NULL);
 	random_init();
 	pci_init();
@@ -278,8 +297,11 @@ void cpu_boot(void)
 	for (size_t i = 0; i < sizeof(cpu->irq_handles) / sizeof(*cpu->irq_handles); ++i)
 		TAILQ_INIT(&cpu->irq_handles[i]);
 	arch_cpu_boot(cpu);
+	pm_init_cpu();
 	if (!cpu->id)
 		first_cpu_init();
+	cpu->node = numa_cpu_node(cpu);
+	vdso_init_cpu(cpu);
 	if (clock_gettime(CLOCK_MONOTONIC, &cpu->loadavg_time))
 		panic("failed to get monotonic clock\n");
 	arch_init_copy_zone(&cpu->copy_src_page);
@@ -350,8 +372,9 @@ void cpu_start_smp(size_t ncpu)
 void cpu_tick(void)
 {
 	struct cpu *cpu = curcpu();
-	waitq_check_timeout(); /* XXX move somewhere else */
 	timer_check_timeout(); /* XXX move somewhere else */
+	if (!cpu->id)
+		vdso_update();
 	if (!cpu->id && cpu->thread && cpu->thread->tf_nest_level < 2)
 		sched_tick();
 }
@@ -1,3 +1,4 @@
+#include <tracepoint.h>
 #include <errno.h>
 #include <disk.h>
 #include <file.h>
@@ -133,10 +134,23 @@ static off_t disk_fseek(struct file *file, off_t off, int whence)
 	}
 }
 
-ssize_t disk_read(struct disk *disk, struct uio *uio)
+static ssize_t traced_io(struct disk *disk, struct uio *uio, int write,
+                         ssize_t (*fn)(struct disk*, struct uio*))
+{
+	off_t off = uio->off;
+	size_t size = uio->count;
+	uint64_t start = tp_time();
+	if (tp_enabled(TP_BLOCK_SUBMIT))
+		tp_block_emit(TP_BLOCK_SUBMIT, disk, off, size, write, 0, 0);
+	ssize_t ret = fn(disk, uio);
+	if (tp_enabled(TP_BLOCK_COMPLETE))
+		tp_block_emit(TP_BLOCK_COMPLETE, disk, off, size, write, ret,
+		              start);
+	return ret;
+}
+
+static ssize_t do_read(struct disk *disk, struct uio *uio)
 {
-	if (!disk->op || !disk->op->read)
-		return -EINVAL;
 	size_t rd = 0;
 	ssize_t ret;
 	size_t align = uio->off % disk->blksz;
@@ -192,10 +206,17 @@ ssize_t disk_read(struct disk *disk, struct uio *uio)
 	return rd;
 }
 
-ssize_t disk_write(struct disk *disk, struct uio *uio)
+ssize_t disk_read(struct disk *disk, struct uio *uio)
 {
 	if (!disk->op || !disk->op->read)
 		return -EINVAL;
+	if (tp_enabled(TP_BLOCK_SUBMIT) || tp_enabled(TP_BLOCK_COMPLETE))
+		return traced_io(disk, uio, 0, do_read);
+	return do_read(disk, uio);
+}
+
+static ssize_t do_write(struct disk *disk, struct uio *uio)
+{
 	size_t wr = 0;
 	ssize_t ret;
 	size_t align = uio->off % disk->blksz;
@@ -263,6 +284,15 @@ ssize_t disk_write(struct disk *disk, struct uio *uio)
 	return wr;
 }
 
+ssize_t disk_write(struct disk *disk, struct uio *uio)
+{
+	if (!disk->op || !disk->op->read)
+		return -EINVAL;
+	if (tp_enabled(TP_BLOCK_SUBMIT) || tp_enabled(TP_BLOCK_COMPLETE))
+		return traced_io(disk, uio, 1, do_write);
+	return do_write(disk, uio);
+}
+
 int partition_new(struct disk *disk, size_t id, off_t offset, off_t size,
                   struct partition **partitionp)
 {
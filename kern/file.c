@@ -9,6 +9,7 @@
 #include <vfs.h>
 #include <uio.h>
 #include <sma.h>
+#include <mem.h>
 
 static struct sma file_sma;
 
@@ -149,6 +150,8 @@ ssize_t file_write(struct file *file, struct uio *uio)
 {
 	if (!file->op || !file->op->write)
 		return -ENOSYS;
+	if (file->node && file->node->cache)
+		return vm_cache_write(file->node->cache, file, uio);
 	return file->op->write(file, uio);
 }
 
@@ -156,6 +159,8 @@ ssize_t file_read(struct file *file, struct uio *uio)
 {
 	if (!file->op || !file->op->read)
 		return -ENOSYS;
+	if (file->node && file->node->cache)
+		return vm_cache_read(file->node->cache, file, uio);
 	return file->op->read(file, uio);
 }
 
@@ -167,6 +172,70 @@ ssize_t file_readseq(struct file *file, void *data, size_t count, off_t off)
 	return file_read(file, &uio);
 }
 
+/* get a page holding up to count bytes of the file at *off, at the same
+ * offset in the page as in the file: the page of the shared mappings
+ * cache when there is one, or a new page the data is read to
+ */
+ssize_t file_read_page(struct file *file, off_t *off, size_t count,
+                       struct page **page, size_t *poff)
+{
+	struct node *node = file->node;
+	size_t pgoff = *off & PAGE_MASK;
+	if (count > PAGE_SIZE - pgoff)
+		count = PAGE_SIZE - pgoff;
+	if (node && node->cache && S_ISREG(node->attr.mode))
+	{
+		if (*off >= node->attr.size)
+			return 0;
+		if ((off_t)count > node->attr.size - *off)
+			count = node->attr.size - *off;
+		if (!vm_cache_get_page(node->cache, *off - pgoff, page))
+		{
+			*off += count;
+			*poff = pgoff;
+			return count;
+		}
+	}
+	int res = pm_alloc_page(page);
+	if (res)
+		return res;
+	void *ptr = vm_map(*page, PAGE_SIZE, VM_PROT_W);
+	if (!ptr)
+	{
+		pm_free_page(*page);
+		return -ENOMEM;
+	}
+	struct iovec iov;
+	struct uio uio;
+	uio_fromkbuf(&uio, &iov, (uint8_t*)ptr + pgoff, count, *off);
+	ssize_t ret = file_read(file, &uio);
+	vm_unmap(ptr, PAGE_SIZE);
+	if (ret <= 0)
+	{
+		pm_free_page(*page);
+		return ret;
+	}
+	*off = uio.off;
+	*poff = pgoff;
+	return ret;
+}
+
+ssize_t file_write_page(struct file *file, off_t *off, struct page *page,
+                        size_t poff, size_t count)
+{
+	void *ptr = vm_map(page, PAGE_SIZE, VM_PROT_R);
+	if (!ptr)
+		return -ENOMEM;
+	struct iovec iov;
+	struct uio uio;
+	uio_fromkbuf(&uio, &iov, (uint8_t*)ptr + poff, count, *off);
+	ssize_t ret = file_write(file, &uio);
+	vm_unmap(ptr, PAGE_SIZE);
+	if (ret > 0)
+		*off = uio.off;
+	return ret;
+}
+
 int file_ioctl(struct file *file, unsigned long request, uintptr_t data)
 {
 	if (!file->op || !file->op->ioctl)
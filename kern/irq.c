@@ -67,7 +67,10 @@ void trap_handle(size_t id, struct irq_ctx *ctx)
 	if (thread)
 	{
 		if (!thread->tf_nest_level)
+		{
+			vm_tlb_leave_user();
 			kernel_lock();
+		}
 		thread->tf_nest_level++;
 		if (thread->tf_nest_level > 2)
 			panic("too much nested interrupt\n");
@@ -139,6 +142,7 @@ void trap_return(void)
 		if (!thread->tf_nest_level)
 		{
 			arch_set_tls_addr(thread->tls_addr);
+			vm_tlb_enter_user(thread->proc->vm_space);
 			cpu_sync_leave();
 		}
 	}
@@ -0,0 +1,385 @@
+#include <lockstat.h>
+#include <spinlock.h>
+#include <mutex.h>
+#include <errno.h>
+#include <ksym.h>
+#include <kmod.h>
+#include <file.h>
+#include <cpu.h>
+#include <std.h>
+#include <uio.h>
+#include <vfs.h>
+
+/* per-cpu tables of lock acquisition sites
+ * the tables are only ever written by their own cpu with the kernel
+ * being non-preemptible, so no atomic operation is required to update
+ * them; readers aggregate all the cpus and accept slightly racy values
+ * for the same reason, a reset only bumps the generation and each cpu
+ * clears its own table the next time it records something
+ */
+
+#define LOCKSTAT_ENTRIES 512 /* must be a power of two */
+#define LOCKSTAT_PROBES  16
+#define LOCKSTAT_HELD    16
+
+struct lockstat_entry
+{
+	uintptr_t site;
+	enum lockstat_type type;
+	uint64_t acquired;
+	uint64_t contended;
+	uint64_t wait; /* in arch cycles */
+	uint64_t hold; /* in arch cycles */
+};
+
+/* spinlocks currently held by the cpu, to compute the hold time */
+struct lockstat_held
+{
+	const void *lock;
+	uintptr_t site;
+	uint64_t start;
+};
+
+struct lockstat_cpu
+{
+	struct lockstat_entry entries[LOCKSTAT_ENTRIES];
+	struct lockstat_held held[LOCKSTAT_HELD];
+	size_t held_nb;
+	uint64_t dropped;
+	uint64_t gen;
+};
+
+int g_lockstat_enabled;
+static struct lockstat_cpu *g_lockstat_cpus[MAXCPU];
+static struct mutex g_lockstat_mutex;
+static uint64_t g_lockstat_gen;
+
+static const char *type_names[] =
+{
+	[LOCKSTAT_SPINLOCK]  = "spin",
+	[LOCKSTAT_MUTEX]     = "mutex",
+	[LOCKSTAT_RWLOCK_RD] = "rwlock_rd",
+	[LOCKSTAT_RWLOCK_WR] = "rwlock_wr",
+};
+
+static size_t site_hash(enum lockstat_type type, uintptr_t site)
+{
+	return ((site >> 2) ^ type) * 2654435761u;
+}
+
+static struct lockstat_entry *get_entry(struct lockstat_entry *entries,
+                                        size_t count,
+                                        enum lockstat_type type,
+                                        uintptr_t site)
+{
+	size_t hash = site_hash(type, site);
+	for (size_t i = 0; i < LOCKSTAT_PROBES; ++i)
+	{
+		struct lockstat_entry *entry = &entries[(hash + i) & (count - 1)];
+		if (entry->site == site && entry->type == type)
+			return entry;
+		if (entry->site)
+			continue;
+		entry->site = site;
+		entry->type = type;
+		return entry;
+	}
+	return NULL;
+}
+
+static struct lockstat_cpu *cpu_stats(void)
+{
+	struct lockstat_cpu *stats = g_lockstat_cpus[curcpu()->id];
+	if (!stats)
+		return NULL;
+	uint64_t gen = __atomic_load_n(&g_lockstat_gen, __ATOMIC_ACQUIRE);
+	if (stats->gen != gen)
+	{
+		memset(stats, 0, sizeof(*stats));
+		stats->gen = gen;
+	}
+	return stats;
+}
+
+static void record(enum lockstat_type type, uintptr_t site, uint64_t wait,
+                   int contended)
+{
+	struct lockstat_cpu *stats = cpu_stats();
+	if (!stats)
+		return;
+	struct lockstat_entry *entry = get_entry(stats->entries,
+	                                         LOCKSTAT_ENTRIES, type, site);
+	if (!entry)
+	{
+		stats->dropped++;
+		return;
+	}
+	entry->acquired++;
+	if (contended)
+		entry->contended++;
+	entry->wait += wait;
+}
+
+void lockstat_acquired(enum lockstat_type type, uintptr_t site,
+                       uint64_t wait, int contended)
+{
+	record(type, site, wait, contended);
+}
+
+void lockstat_released(enum lockstat_type type, uintptr_t site,
+                       uint64_t hold)
+{
+	struct lockstat_cpu *stats = cpu_stats();
+	if (!stats)
+		return;
+	struct lockstat_entry *entry = get_entry(stats->entries,
+	                                         LOCKSTAT_ENTRIES, type, site);
+	if (entry)
+		entry->hold += hold;
+}
+
+void lockstat_spin_acquired(const void *lock, uintptr_t site, uint64_t wait,
+                            int contended)
+{
+	record(LOCKSTAT_SPINLOCK, site, wait, contended);
+	struct lockstat_cpu *stats = cpu_stats();
+	if (!stats)
+		return;
+	struct lockstat_held *held = NULL;
+	/* an entry for the same lock is a leftover of a lock released
+	 * on another cpu, reuse it
+	 */
+	for (size_t i = 0; i < stats->held_nb; ++i)
+	{
+		if (stats->held[i].lock == lock)
+		{
+			held = &stats->held[i];
+			break;
+		}
+	}
+	if (!held)
+	{
+		if (stats->held_nb == LOCKSTAT_HELD)
+			return;
+		held = &stats->held[stats->held_nb++];
+	}
+	held->lock = lock;
+	held->site = site;
+	held->start = arch_get_cycles();
+}
+
+void lockstat_spinlock_lock(struct spinlock *spinlock, uint32_t ticket)
+{
+	uintptr_t site = (uintptr_t)__builtin_return_address(0);
+	uint64_t start = arch_get_cycles();
+	int contended = 0;
+	while (!spinlock_ticket_ready(spinlock, ticket))
+	{
+		contended = 1;
+		arch_spin_yield();
+	}
+	lockstat_spin_acquired(spinlock, site, arch_get_cycles() - start,
+	                       contended);
+}
+
+void lockstat_spinlock_trylock(struct spinlock *spinlock)
+{
+	lockstat_spin_acquired(spinlock,
+	                       (uintptr_t)__builtin_return_address(0), 0, 0);
+}
+
+void lockstat_spinlock_unlock(struct spinlock *spinlock)
+{
+	struct lockstat_cpu *stats = cpu_stats();
+	if (!stats)
+		return;
+	for (size_t i = stats->held_nb; i > 0; --i)
+	{
+		struct lockstat_held *held = &stats->held[i - 1];
+		if (held->lock != spinlock)
+			continue;
+		lockstat_released(LOCKSTAT_SPINLOCK, held->site,
+		                  arch_get_cycles() - held->start);
+		for (size_t j = i; j < stats->held_nb; ++j)
+			stats->held[j - 1] = stats->held[j];
+		stats->held_nb--;
+		return;
+	}
+}
+
+static void print_site(struct uio *uio, uintptr_t site)
+{
+	uintptr_t off;
+	const char *sym = ksym_find_by_addr(g_kern_ksym_ctx, site, &off);
+	if (sym)
+	{
+		uprintf(uio, " %s+0x%zx\n", sym, off);
+		return;
+	}
+	struct kmod *kmod = kmod_find_by_addr(site);
+	if (kmod)
+	{
+		sym = kmod_get_sym(kmod, site, &off);
+		if (sym)
+			uprintf(uio, " %s:%s+0x%zx\n", kmod->info->name, sym, off);
+		else
+			uprintf(uio, " %s:+0x%zx\n", kmod->info->name,
+			        site - kmod->elf_info.base_addr);
+		kmod_free(kmod);
+		return;
+	}
+	uprintf(uio, " 0x%0*zx\n", (int)sizeof(site) * 2, site);
+}
+
+static ssize_t lockstat_read(struct file *file, struct uio *uio)
+{
+	(void)file;
+	size_t count = uio->count;
+	off_t off = uio->off;
+	size_t merged_count = LOCKSTAT_ENTRIES * 4;
+	struct lockstat_entry *merged = malloc(sizeof(*merged) * merged_count,
+	                                       M_ZERO);
+	if (!merged)
+		return -ENOMEM;
+	uint64_t dropped = 0;
+	mutex_lock(&g_lockstat_mutex);
+	for (size_t i = 0; i < g_ncpus; ++i)
+	{
+		struct lockstat_cpu *stats = g_lockstat_cpus[i];
+		if (!stats)
+			continue;
+		/* not cleared since the last reset */
+		if (__atomic_load_n(&stats->gen, __ATOMIC_RELAXED)
+		 != g_lockstat_gen)
+			continue;
+		dropped += stats->dropped;
+		for (size_t j = 0; j < LOCKSTAT_ENTRIES; ++j)
+		{
+			struct lockstat_entry *src = &stats->entries[j];
+			if (!src->site)
+				continue;
+			struct lockstat_entry *dst = get_entry(merged,
+			                                       merged_count,
+			                                       src->type,
+			                                       src->site);
+			if (!dst)
+			{
+				dropped += src->acquired;
+				continue;
+			}
+			dst->acquired += src->acquired;
+			dst->contended += src->contended;
+			dst->wait += src->wait;
+			dst->hold += src->hold;
+		}
+	}
+	mutex_unlock(&g_lockstat_mutex);
+	/* compact and sort by wait time */
+	size_t n = 0;
+	for (size_t i = 0; i < merged_count; ++i)
+	{
+		if (!merged[i].site)
+			continue;
+		struct lockstat_entry tmp = merged[i];
+		size_t j = n++;
+		while (j > 0 && merged[j - 1].wait < tmp.wait)
+		{
+			merged[j] = merged[j - 1];
+			j--;
+		}
+		merged[j] = tmp;
+	}
+	uprintf(uio, "enabled: %d\n", lockstat_enabled());
+	uprintf(uio, "dropped: %" PRIu64 "\n", dropped);
+	uprintf(uio, "%-9s %12s %12s %16s %16s site\n", "type",
+	        "acquired", "contended", "wait", "hold");
+	for (size_t i = 0; i < n; ++i)
+	{
+		struct lockstat_entry *entry = &merged[i];
+		uprintf(uio, "%-9s %12" PRIu64 " %12" PRIu64 " %16" PRIu64
+		        " %16" PRIu64, type_names[entry->type],
+		        entry->acquired, entry->contended, entry->wait,
+		        entry->hold);
+		print_site(uio, entry->site);
+	}
+	free(merged);
+	uio->off = off + count - uio->count;
+	return count - uio->count;
+}
+
+static void reset_stats(void)
+{
+	__atomic_add_fetch(&g_lockstat_gen, 1, __ATOMIC_RELEASE);
+}
+
+static int enable_stats(void)
+{
+	for (size_t i = 0; i < g_ncpus; ++i)
+	{
+		if (g_lockstat_cpus[i])
+			continue;
+		g_lockstat_cpus[i] = malloc(sizeof(*g_lockstat_cpus[i]), M_ZERO);
+		if (!g_lockstat_cpus[i])
+			return -ENOMEM;
+	}
+	reset_stats();
+	__atomic_store_n(&g_lockstat_enabled, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* "1" resets and enables the statistics, "0" disables them and
+ * "reset" clears them
+ */
+static ssize_t lockstat_write(struct file *file, struct uio *uio)
+{
+	(void)file;
+	char buf[16];
+	size_t count = uio->count;
+	ssize_t ret = uio_copyout(buf, uio, sizeof(buf) - 1);
+	if (ret < 0)
+		return ret;
+	buf[ret] = '\0';
+	if (ret && buf[ret - 1] == '\n')
+		buf[ret - 1] = '\0';
+	mutex_lock(&g_lockstat_mutex);
+	int enabled = lockstat_enabled();
+	__atomic_store_n(&g_lockstat_enabled, 0, __ATOMIC_RELAXED);
+	if (!strcmp(buf, "1"))
+	{
+		ret = enable_stats();
+	}
+	else if (!strcmp(buf, "0"))
+	{
+		ret = 0;
+	}
+	else if (!strcmp(buf, "reset"))
+	{
+		reset_stats();
+		__atomic_store_n(&g_lockstat_enabled, enabled,
+		                 __ATOMIC_RELAXED);
+		ret = 0;
+	}
+	else
+	{
+		__atomic_store_n(&g_lockstat_enabled, enabled,
+		                 __ATOMIC_RELAXED);
+		ret = -EINVAL;
+	}
+	mutex_unlock(&g_lockstat_mutex);
+	if (ret)
+		return ret;
+	return count;
+}
+
+static const struct file_op lockstat_fop =
+{
+	.read = lockstat_read,
+	.write = lockstat_write,
+};
+
+int lockstat_register_sysfs(void)
+{
+	mutex_init(&g_lockstat_mutex, 0);
+	return sysfs_mknode("kernel/lockstat", 0, 0, 0600, &lockstat_fop,
+	                    NULL);
+}
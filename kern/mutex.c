@@ -1,7 +1,41 @@
 #include <spinlock.h>
+#include <lockstat.h>
 #include <mutex.h>
+#include <proc.h>
+#include <file.h>
 #include <cpu.h>
 #include <std.h>
+#include <uio.h>
+#include <vfs.h>
+
+/* maximum number of spin iterations on a running owner before
+ * going to sleep on the waitq
+ */
+#define MUTEX_SPIN_MAX 4096
+
+static struct lock_class g_mutex_class = LOCK_CLASS_INITIALIZER("mutex");
+static TAILQ_HEAD(, lock_class) g_lock_classes = TAILQ_HEAD_INITIALIZER(g_lock_classes);
+static struct spinlock g_lock_classes_lock = SPINLOCK_INITIALIZER();
+static int g_lock_class_stats;
+
+#define CLASS_STAT(mutex, field) \
+do \
+{ \
+	if (__atomic_load_n(&g_lock_class_stats, __ATOMIC_RELAXED)) \
+		__atomic_add_fetch(&(mutex)->lock_class->field, 1, \
+		                   __ATOMIC_RELAXED); \
+} while (0)
+
+static void register_class(struct lock_class *lock_class)
+{
+	spinlock_lock(&g_lock_classes_lock);
+	if (!lock_class->registered)
+	{
+		TAILQ_INSERT_TAIL(&g_lock_classes, lock_class, chain);
+		lock_class->registered = 1;
+	}
+	spinlock_unlock(&g_lock_classes_lock);
+}
 
 void mutex_init(struct mutex *mutex, int flags)
 {
@@ -10,6 +44,8 @@ void mutex_init(struct mutex *mutex, int flags)
 	mutex->owner = NULL;
 	mutex->flags = flags;
 	mutex->recursive_nb = 0;
+	mutex->lock_class = &g_mutex_class;
+	mutex->stat_start = 0;
 }
 
 void mutex_destroy(struct mutex *mutex)
@@ -20,6 +56,13 @@ void mutex_destroy(struct mutex *mutex)
 	waitq_destroy(&mutex->waitq);
 }
 
+void mutex_set_class(struct mutex *mutex, struct lock_class *lock_class)
+{
+	if (!__atomic_load_n(&lock_class->registered, __ATOMIC_ACQUIRE))
+		register_class(lock_class);
+	mutex->lock_class = lock_class;
+}
+
 static void mutex_acquire(struct mutex *mutex)
 {
 	mutex->owner = curcpu()->thread;
@@ -27,16 +70,72 @@ static void mutex_acquire(struct mutex *mutex)
 		mutex->recursive_nb = 1;
 }
 
+static void stat_acquired(struct mutex *mutex, uintptr_t site, uint64_t start,
+                          int contended)
+{
+	if (!start)
+		return;
+	uint64_t now = arch_get_cycles();
+	lockstat_acquired(LOCKSTAT_MUTEX, site, now - start, contended);
+	mutex->stat_site = site;
+	mutex->stat_start = now;
+}
+
+static void stat_released(struct mutex *mutex)
+{
+	if (!mutex->stat_start)
+		return;
+	if (lockstat_enabled())
+		lockstat_released(LOCKSTAT_MUTEX, mutex->stat_site,
+		                  arch_get_cycles() - mutex->stat_start);
+	mutex->stat_start = 0;
+}
+
+static int owner_running(struct thread *owner)
+{
+	ssize_t cpuid = __atomic_load_n(&owner->running_cpuid,
+	                                __ATOMIC_RELAXED);
+	return cpuid != -1 && (size_t)cpuid != curcpu()->id;
+}
+
+/* spin while the owner is running on another cpu: it will most likely
+ * release the mutex sooner than a sleep / wakeup round-trip
+ * must be called with the mutex spinlock held, returns with it held
+ * threads memory is never unmapped, so peeking at a stale owner is safe
+ */
+static int adaptive_spin(struct mutex *mutex)
+{
+	struct thread *owner = mutex->owner;
+	if (!owner_running(owner))
+		return 0;
+	spinlock_unlock(&mutex->spinlock);
+	for (size_t i = 0; i < MUTEX_SPIN_MAX; ++i)
+	{
+		if (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) != owner
+		 || !owner_running(owner))
+			break;
+		arch_spin_yield();
+	}
+	spinlock_lock(&mutex->spinlock);
+	return 1;
+}
+
 void mutex_lock(struct mutex *mutex)
 {
+	uintptr_t site = (uintptr_t)__builtin_return_address(0);
+	uint64_t start = lockstat_enabled() ? arch_get_cycles() : 0;
 	spinlock_lock(&mutex->spinlock);
+	CLASS_STAT(mutex, acquired);
 	if (!mutex->owner)
 	{
 		mutex_acquire(mutex);
+		stat_acquired(mutex, site, start, 0);
 		spinlock_unlock(&mutex->spinlock);
 		return;
 	}
 	struct thread *thread = curcpu()->thread;
+	int spun = 0;
+	int slept = 0;
 	do
 	{
 		if (mutex->owner == thread)
@@ -47,23 +146,41 @@ void mutex_lock(struct mutex *mutex)
 			spinlock_unlock(&mutex->spinlock);
 			return;
 		}
+		if (!spun && thread)
+		{
+			CLASS_STAT(mutex, contended);
+			spun = 1;
+			if (adaptive_spin(mutex))
+				continue;
+		}
 		waitq_wait_tail(&mutex->waitq, &mutex->spinlock, NULL);
+		slept = 1;
 	} while (mutex->owner);
+	if (slept)
+		CLASS_STAT(mutex, slept);
+	else
+		CLASS_STAT(mutex, spun);
 	mutex->owner = thread;
 	if (mutex->flags & MUTEX_RECURSIVE)
 		mutex->recursive_nb = 1;
+	stat_acquired(mutex, site, start, 1);
 	spinlock_unlock(&mutex->spinlock);
 }
 
 void mutex_spinlock(struct mutex *mutex)
 {
+	uintptr_t site = (uintptr_t)__builtin_return_address(0);
+	uint64_t start = lockstat_enabled() ? arch_get_cycles() : 0;
 	spinlock_lock(&mutex->spinlock);
+	CLASS_STAT(mutex, acquired);
 	if (!mutex->owner)
 	{
 		mutex_acquire(mutex);
+		stat_acquired(mutex, site, start, 0);
 		spinlock_unlock(&mutex->spinlock);
 		return;
 	}
+	CLASS_STAT(mutex, contended);
 	struct thread *thread = curcpu()->thread;
 	do
 	{
@@ -75,24 +192,35 @@ void mutex_spinlock(struct mutex *mutex)
 			spinlock_unlock(&mutex->spinlock);
 			return;
 		}
+		/* wait for the owner to go away without bouncing the
+		 * spinlock cache line between the waiting cpus
+		 */
 		spinlock_unlock(&mutex->spinlock);
-		arch_spin_yield();
+		while (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED))
+			arch_spin_yield();
 		spinlock_lock(&mutex->spinlock);
 	} while (mutex->owner);
+	CLASS_STAT(mutex, spun);
 	mutex->owner = thread;
 	if (mutex->flags & MUTEX_RECURSIVE)
 		mutex->recursive_nb = 1;
+	stat_acquired(mutex, site, start, 1);
 	spinlock_unlock(&mutex->spinlock);
 }
 
 int mutex_trylock(struct mutex *mutex)
 {
 	int res;
-	if (spinlock_trylock(&mutex->spinlock))
+	if (!spinlock_trylock(&mutex->spinlock))
 		return 1;
 	if (!mutex->owner)
 	{
+		CLASS_STAT(mutex, acquired);
 		mutex_acquire(mutex);
+		if (lockstat_enabled())
+			stat_acquired(mutex,
+			              (uintptr_t)__builtin_return_address(0),
+			              arch_get_cycles(), 0);
 		res = 0;
 	}
 	else if (mutex->owner == curcpu()->thread)
@@ -124,14 +252,90 @@ void mutex_unlock(struct mutex *mutex)
 		mutex->recursive_nb--;
 		if (!mutex->recursive_nb)
 		{
+			stat_released(mutex);
 			mutex->owner = NULL;
 			waitq_signal(&mutex->waitq, 0);
 		}
 	}
 	else
 	{
+		stat_released(mutex);
 		mutex->owner = NULL;
 		waitq_signal(&mutex->waitq, 0);
 	}
 	spinlock_unlock(&mutex->spinlock);
 }
+
+static ssize_t lockclass_read(struct file *file, struct uio *uio)
+{
+	(void)file;
+	size_t count = uio->count;
+	off_t off = uio->off;
+	uprintf(uio, "enabled: %d\n",
+	        __atomic_load_n(&g_lock_class_stats, __ATOMIC_RELAXED));
+	uprintf(uio, "%-16s %12s %12s %12s %12s\n",
+	        "class", "acquired", "contended", "spun", "slept");
+	struct lock_class *lock_class;
+	spinlock_lock(&g_lock_classes_lock);
+	TAILQ_FOREACH(lock_class, &g_lock_classes, chain)
+	{
+		uprintf(uio, "%-16s %12zu %12zu %12zu %12zu\n",
+		        lock_class->name,
+		        lock_class->acquired,
+		        lock_class->contended,
+		        lock_class->spun,
+		        lock_class->slept);
+	}
+	spinlock_unlock(&g_lock_classes_lock);
+	uio->off = off + count - uio->count;
+	return count - uio->count;
+}
+
+/* writing 1 resets the counters and enables the statistics,
+ * writing 0 disables them
+ */
+static ssize_t lockclass_write(struct file *file, struct uio *uio)
+{
+	(void)file;
+	char buf[16];
+	size_t count = uio->count;
+	ssize_t ret = uio_copyout(buf, uio, sizeof(buf) - 1);
+	if (ret < 0)
+		return ret;
+	buf[ret] = '\0';
+	int enable;
+	if (buf[0] == '0')
+		enable = 0;
+	else if (buf[0] == '1')
+		enable = 1;
+	else
+		return -EINVAL;
+	struct lock_class *lock_class;
+	__atomic_store_n(&g_lock_class_stats, 0, __ATOMIC_RELAXED);
+	if (enable)
+	{
+		spinlock_lock(&g_lock_classes_lock);
+		TAILQ_FOREACH(lock_class, &g_lock_classes, chain)
+		{
+			lock_class->acquired = 0;
+			lock_class->contended = 0;
+			lock_class->spun = 0;
+			lock_class->slept = 0;
+		}
+		spinlock_unlock(&g_lock_classes_lock);
+		__atomic_store_n(&g_lock_class_stats, 1, __ATOMIC_RELAXED);
+	}
+	return count;
+}
+
+static const struct file_op lockclass_fop =
+{
+	.read = lockclass_read,
+	.write = lockclass_write,
+};
+
+int lockclass_register_sysfs(void)
+{
+	register_class(&g_mutex_class);
+	return sysfs_mknode("lockclass", 0, 0, 0644, &lockclass_fop, NULL);
+}
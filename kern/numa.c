@@ -0,0 +1,381 @@
+#include <errno.h>
+#include <file.h>
+#include <numa.h>
+#include <std.h>
+#include <uio.h>
+#include <vfs.h>
+#include <cpu.h>
+#include <mem.h>
+
+#if WITH_FDT
+#include <endian.h>
+#include <fdt.h>
+#endif
+
+/* the topology is described by the firmware (acpi srat / slit or the
+ * numa-node-id properties of the fdt) before numa_init() is called: the
+ * pools are then split at the boundaries of the memory ranges of the
+ * nodes and tagged with their node, and each node gets the list of the
+ * nodes to allocate from, sorted by distance
+ */
+
+#define MAX_RANGES (MAXNODE * 4)
+
+#if defined(__aarch64__)
+#define HWID_MASK 0xFF00FFFFFFULL
+#elif defined(__arm__)
+#define HWID_MASK 0xFFFFFFULL
+#else
+#define HWID_MASK UINT64_MAX
+#endif
+
+struct numa_range
+{
+	uint64_t addr;
+	uint64_t size;
+	uint32_t node;
+};
+
+struct numa_cpu
+{
+	uint64_t hwid;
+	uint32_t node;
+};
+
+size_t g_numa_nodes = 1;
+
+static uint32_t g_domains[MAXNODE]; /* firmware id of each node */
+static size_t g_domains_count;
+static struct numa_range g_ranges[MAX_RANGES];
+static size_t g_ranges_count;
+static struct numa_cpu g_numa_cpus[MAXCPU];
+static size_t g_numa_cpus_count;
+static uint8_t g_distances[MAXNODE][MAXNODE];
+static uint32_t g_fallbacks[MAXNODE][MAXNODE]; /* nodes by distance */
+
+static int find_node(uint32_t domain, uint32_t *node)
+{
+	for (size_t i = 0; i < g_domains_count; ++i)
+	{
+		if (g_domains[i] == domain)
+		{
+			*node = i;
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+
+static int get_node(uint32_t domain, uint32_t *node)
+{
+	if (!find_node(domain, node))
+		return 0;
+	if (g_domains_count == MAXNODE)
+	{
+		printf("numa: too many nodes\n");
+		return -ENOMEM;
+	}
+	*node = g_domains_count;
+	g_domains[g_domains_count++] = domain;
+	return 0;
+}
+
+void numa_add_memory(uint32_t domain, uint64_t addr, uint64_t size)
+{
+	uint32_t node;
+	if (get_node(domain, &node))
+		return;
+	if (g_ranges_count == MAX_RANGES)
+	{
+		printf("numa: too many memory ranges\n");
+		return;
+	}
+	struct numa_range *range = &g_ranges[g_ranges_count++];
+	range->addr = addr;
+	range->size = size;
+	range->node = node;
+}
+
+void numa_add_cpu(uint32_t domain, uint64_t hwid)
+{
+	uint32_t node;
+	if (get_node(domain, &node))
+		return;
+	if (g_numa_cpus_count == MAXCPU)
+		return;
+	struct numa_cpu *cpu = &g_numa_cpus[g_numa_cpus_count++];
+	cpu->hwid = hwid & HWID_MASK;
+	cpu->node = node;
+}
+
+void numa_set_distance(uint32_t from, uint32_t to, uint8_t distance)
+{
+	uint32_t from_node;
+	uint32_t to_node;
+	if (find_node(from, &from_node)
+	 || find_node(to, &to_node))
+		return;
+	g_distances[from_node][to_node] = distance;
+}
+
+#if WITH_FDT
+static int fdt_node_id(const struct fdt_node *node, uint32_t *domain)
+{
+	const struct fdt_prop *prop = fdt_get_prop(node, "numa-node-id");
+	if (!prop || prop->len != 4)
+		return -ENOENT;
+	*domain = be32toh(*(uint32_t*)prop->data);
+	return 0;
+}
+
+static void fdt_probe_memory(const struct fdt_node *node)
+{
+	uint32_t domain;
+	if (fdt_node_id(node, &domain))
+		return;
+	const struct fdt_prop *reg = fdt_get_prop(node, "reg");
+	if (!reg)
+		return;
+	uintptr_t base;
+	size_t size;
+	for (size_t i = 0; !fdt_get_base_size_reg(reg, i, &base, &size); ++i)
+		numa_add_memory(domain, base, size);
+}
+
+static void fdt_probe_cpus(const struct fdt_node *node)
+{
+	struct fdt_node *child;
+	TAILQ_FOREACH(child, &node->children, chain)
+	{
+		if (strncmp(child->name, "cpu@", 4))
+			continue;
+		uint32_t domain;
+		if (fdt_node_id(child, &domain))
+			continue;
+		const struct fdt_prop *reg = fdt_get_prop(child, "reg");
+		if (!reg || reg->len != 4)
+			continue;
+		numa_add_cpu(domain, be32toh(*(uint32_t*)reg->data));
+	}
+}
+
+static void fdt_probe_distances(const struct fdt_node *node)
+{
+	const struct fdt_prop *prop = fdt_get_prop(node, "distance-matrix");
+	if (!prop)
+		return;
+	const uint32_t *data = (const uint32_t*)prop->data;
+	for (size_t i = 0; i + 3 <= prop->len / 4; i += 3)
+	{
+		uint32_t distance = be32toh(data[i + 2]);
+		if (distance > UINT8_MAX)
+			distance = UINT8_MAX;
+		numa_set_distance(be32toh(data[i + 0]),
+		                  be32toh(data[i + 1]),
+		                  distance);
+	}
+}
+
+/* the distances reference the nodes found in the first pass */
+static void fdt_probe(const struct fdt_node *node, int distances)
+{
+	struct fdt_node *child;
+	TAILQ_FOREACH(child, &node->children, chain)
+	{
+		if (distances)
+		{
+			if (!fdt_check_compatible(child, "numa-distance-map-v1"))
+				fdt_probe_distances(child);
+			continue;
+		}
+		if (!strncmp(child->name, "memory@", 7))
+			fdt_probe_memory(child);
+		else if (!strcmp(child->name, "cpus"))
+			fdt_probe_cpus(child);
+	}
+}
+#endif
+
+static void init_distances(void)
+{
+	for (size_t i = 0; i < g_numa_nodes; ++i)
+	{
+		for (size_t j = 0; j < g_numa_nodes; ++j)
+		{
+			if (g_distances[i][j])
+				continue;
+			/* the firmware may only give one direction */
+			if (g_distances[j][i])
+				g_distances[i][j] = g_distances[j][i];
+			else
+				g_distances[i][j] = i == j ? NUMA_LOCAL_DISTANCE
+				                           : NUMA_REMOTE_DISTANCE;
+		}
+	}
+}
+
+/* the local node goes first, whatever the firmware says */
+static int closer(uint32_t node, uint32_t a, uint32_t b)
+{
+	if (a == node || b == node)
+		return a == node;
+	return g_distances[node][a] < g_distances[node][b];
+}
+
+static void init_fallbacks(void)
+{
+	for (size_t i = 0; i < g_numa_nodes; ++i)
+	{
+		uint32_t *fallback = g_fallbacks[i];
+		for (size_t j = 0; j < g_numa_nodes; ++j)
+		{
+			size_t k = j;
+			while (k && closer(i, j, fallback[k - 1]))
+			{
+				fallback[k] = fallback[k - 1];
+				k--;
+			}
+			fallback[k] = j;
+		}
+	}
+}
+
+static void split_pools(uint64_t addr)
+{
+	uint64_t pfn = addr / PAGE_SIZE;
+	if (pfn > SIZE_MAX)
+		return;
+	struct pm_pool *pm_pool;
+	TAILQ_FOREACH(pm_pool, &g_pm_pools, chain)
+	{
+		if (pfn <= pm_pool->offset
+		 || pfn >= pm_pool->offset + pm_pool->count)
+			continue;
+		int ret = pm_split_pool(pm_pool, pfn);
+		if (ret)
+			printf("numa: failed to split pool: %s\n", strerror(ret));
+		return;
+	}
+}
+
+/* XXX a pool only partially described by the firmware (e.g. if it failed
+ * to be split) gets the node of the range covering most of it
+ */
+static void tag_pool(struct pm_pool *pm_pool)
+{
+	uint64_t start = (uint64_t)pm_pool->offset * PAGE_SIZE;
+	uint64_t end = start + (uint64_t)pm_pool->count * PAGE_SIZE;
+	uint64_t best = 0;
+	for (size_t i = 0; i < g_ranges_count; ++i)
+	{
+		const struct numa_range *range = &g_ranges[i];
+		uint64_t range_start = range->addr;
+		uint64_t range_end = range->addr + range->size;
+		if (range_start < start)
+			range_start = start;
+		if (range_end > end)
+			range_end = end;
+		if (range_start >= range_end || range_end - range_start <= best)
+			continue;
+		best = range_end - range_start;
+		pm_pool->node = range->node;
+	}
+}
+
+void numa_init(void)
+{
+#if WITH_FDT
+	struct fdt_node *node;
+	TAILQ_FOREACH(node, &fdt_nodes, chain)
+		fdt_probe(node, 0);
+	TAILQ_FOREACH(node, &fdt_nodes, chain)
+		fdt_probe(node, 1);
+#endif
+	if (g_domains_count > 1)
+		g_numa_nodes = g_domains_count;
+	init_distances();
+	init_fallbacks();
+	if (g_numa_nodes < 2)
+		return;
+	for (size_t i = 0; i < g_ranges_count; ++i)
+	{
+		split_pools(g_ranges[i].addr);
+		split_pools(g_ranges[i].addr + g_ranges[i].size);
+	}
+	struct pm_pool *pm_pool;
+	TAILQ_FOREACH(pm_pool, &g_pm_pools, chain)
+		tag_pool(pm_pool);
+	printf("numa: %zu nodes\n", g_numa_nodes);
+}
+
+uint32_t numa_cpu_node(const struct cpu *cpu)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	uint64_t hwid = cpu->arch.lapic_id;
+#elif defined(__aarch64__) || defined(__arm__)
+	uint64_t hwid = cpu->arch.mpidr & HWID_MASK;
+#elif defined(__riscv)
+	uint64_t hwid = cpu->arch.hartid;
+#endif
+	if (g_numa_nodes < 2)
+		return 0;
+	for (size_t i = 0; i < g_numa_cpus_count; ++i)
+	{
+		if (g_numa_cpus[i].hwid == hwid)
+			return g_numa_cpus[i].node;
+	}
+	return 0;
+}
+
+const uint32_t *numa_fallback(uint32_t node)
+{
+	return g_fallbacks[node];
+}
+
+static ssize_t numa_read(struct file *file, struct uio *uio)
+{
+	(void)file;
+	size_t count = uio->count;
+	off_t off = uio->off;
+	for (size_t i = 0; i < g_numa_nodes; ++i)
+	{
+		size_t size = 0;
+		size_t used = 0;
+		struct pm_pool *pm_pool;
+		TAILQ_FOREACH(pm_pool, &g_pm_pools, chain)
+		{
+			if (pm_pool->node != i)
+				continue;
+			size += pm_pool->count;
+			used += pm_pool->used;
+		}
+		uprintf(uio, "node%zu\n", i);
+		uprintf(uio, "  cpus     :");
+		struct cpu *cpu;
+		CPU_FOREACH(cpu)
+		{
+			if (cpu->node == i)
+				uprintf(uio, " %" PRIu32, cpu->id);
+		}
+		uprintf(uio, "\n");
+		uprintf(uio, "  size     : %zu kB\n", size * (PAGE_SIZE / 1024));
+		uprintf(uio, "  free     : %zu kB\n",
+		        (size - used) * (PAGE_SIZE / 1024));
+		uprintf(uio, "  distances:");
+		for (size_t j = 0; j < g_numa_nodes; ++j)
+			uprintf(uio, " %" PRIu8, g_distances[i][j]);
+		uprintf(uio, "\n");
+	}
+	uio->off = off + count - uio->count;
+	return count - uio->count;
+}
+
+static const struct file_op numa_fop =
+{
+	.read = numa_read,
+};
+
+int numa_register_sysfs(void)
+{
+	return sysfs_mknode("numa", 0, 0, 0444, &numa_fop, NULL);
+}
@@ -8,6 +8,7 @@
 #include <vfs.h>
 #include <uio.h>
 #include <sma.h>
+#include <mem.h>
 
 static struct sma pipe_sma;
 
@@ -40,9 +41,9 @@ static ssize_t pipe_read(struct file *file, struct uio *uio)
 	struct pipe *pipe = getpipe(file);
 	if (!pipe)
 		return -EINVAL;
+	int nonblock = (file->flags & O_NONBLOCK) || uio->nonblock;
 	ssize_t ret = pipebuf_read(&pipe->pipebuf, uio,
-	                           file->flags & O_NONBLOCK ? 0 : uio->count,
-	                           NULL);
+	                           nonblock ? 0 : uio->count, NULL);
 	if (ret > 0)
 		poller_broadcast(&pipe->poll_entries, POLLOUT);
 	return ret;
@@ -53,9 +54,9 @@ static ssize_t pipe_write(struct file *file, struct uio *uio)
 	struct pipe *pipe = getpipe(file);
 	if (!pipe)
 		return -EINVAL;
+	int nonblock = (file->flags & O_NONBLOCK) || uio->nonblock;
 	ssize_t ret = pipebuf_write(&pipe->pipebuf, uio,
-	                            file->flags & O_NONBLOCK ? 0 : uio->count,
-	                            NULL);
+	                            nonblock ? 0 : uio->count, NULL);
 	if (ret > 0)
 		poller_broadcast(&pipe->poll_entries, POLLIN);
 	return ret;
@@ -151,6 +152,172 @@ static int pipe_poll(struct file *file, struct poll_entry *entry)
 	return poller_add(entry);
 }
 
+static int splice_nonblock(struct file *file, int flags)
+{
+	return (flags & SPLICE_F_NONBLOCK) || (file->flags & O_NONBLOCK);
+}
+
+static void splice_give(struct pipe *pipe, struct pipebuf_page_head *pages)
+{
+	pipe_lock(pipe);
+	pipebuf_give_locked(&pipe->pipebuf, pages);
+	pipe_unlock(pipe);
+	poller_broadcast(&pipe->poll_entries, POLLIN);
+}
+
+/* the room of out is only waited for before taking the pages of in: both
+ * pipes are never locked together
+ */
+static ssize_t splice_pipes(struct file *in, struct file *out, size_t count,
+                            int flags, int dup)
+{
+	struct pipebuf_page_head pages = TAILQ_HEAD_INITIALIZER(pages);
+	struct pipebuf_page_head dups = TAILQ_HEAD_INITIALIZER(dups);
+	struct pipe *src = getpipe(in);
+	struct pipe *dst = getpipe(out);
+	if (!src || !dst || src == dst)
+		return -EINVAL;
+	pipe_lock(dst);
+	ssize_t room = pipebuf_wait_write_locked(&dst->pipebuf,
+	                                         splice_nonblock(out, flags));
+	pipe_unlock(dst);
+	if (room < 0)
+		return room;
+	pipe_lock(src);
+	ssize_t ret = pipebuf_wait_read_locked(&src->pipebuf,
+	                                       splice_nonblock(in, flags));
+	if (ret > 0)
+		ret = pipebuf_take_locked(&src->pipebuf, &pages, count, room);
+	if (ret > 0 && dup)
+	{
+		int res = pipebuf_pages_dup(&dups, &pages);
+		pipebuf_unget_locked(&src->pipebuf, &pages);
+		if (res)
+			ret = res;
+	}
+	pipe_unlock(src);
+	if (ret <= 0)
+		return ret;
+	if (dup)
+	{
+		splice_give(dst, &dups);
+	}
+	else
+	{
+		poller_broadcast(&src->poll_entries, POLLOUT);
+		splice_give(dst, &pages);
+	}
+	return ret;
+}
+
+ssize_t pipe_splice(struct file *in, struct file *out, size_t count,
+                    int flags)
+{
+	return splice_pipes(in, out, count, flags, 0);
+}
+
+ssize_t pipe_tee(struct file *in, struct file *out, size_t count, int flags)
+{
+	return splice_pipes(in, out, count, flags, 1);
+}
+
+/* queue references to the pages of in: the data is only copied if they
+ * aren't in the shared mappings cache, and stops at the first short read
+ */
+ssize_t pipe_splice_from(struct file *out, struct file *in, off_t *off,
+                         size_t count, int flags)
+{
+	struct pipebuf_page_head pages = TAILQ_HEAD_INITIALIZER(pages);
+	struct pipe *pipe = getpipe(out);
+	if (!pipe)
+		return -EINVAL;
+	pipe_lock(pipe);
+	ssize_t room = pipebuf_wait_write_locked(&pipe->pipebuf,
+	                                         splice_nonblock(out, flags));
+	pipe_unlock(pipe);
+	if (room < 0)
+		return room;
+	size_t done = 0;
+	ssize_t ret = 0;
+	while (done < count && room--)
+	{
+		size_t pgoff = *off & PAGE_MASK;
+		size_t size = count - done;
+		if (size > PAGE_SIZE - pgoff)
+			size = PAGE_SIZE - pgoff;
+		struct page *page;
+		size_t poff;
+		ret = file_read_page(in, off, size, &page, &poff);
+		if (ret <= 0)
+			break;
+		struct pipebuf_page *pp;
+		int res = pipebuf_page_alloc(page, poff, ret, &pp);
+		pm_free_page(page);
+		if (res)
+		{
+			*off -= ret;
+			ret = res;
+			break;
+		}
+		TAILQ_INSERT_TAIL(&pages, pp, chain);
+		done += ret;
+		if ((size_t)ret < size)
+			break;
+	}
+	if (!done)
+		return ret;
+	splice_give(pipe, &pages);
+	return done;
+}
+
+/* the pages are taken out of the pipe while writing them to out, which
+ * may block: what isn't written is given back at the head of the pipe
+ */
+ssize_t pipe_splice_to(struct file *in, struct file *out, off_t *off,
+                       size_t count, int flags)
+{
+	struct pipebuf_page_head pages = TAILQ_HEAD_INITIALIZER(pages);
+	struct pipe *pipe = getpipe(in);
+	if (!pipe)
+		return -EINVAL;
+	pipe_lock(pipe);
+	ssize_t ret = pipebuf_wait_read_locked(&pipe->pipebuf,
+	                                       splice_nonblock(in, flags));
+	if (ret > 0)
+		ret = pipebuf_take_locked(&pipe->pipebuf, &pages, count,
+		                          SIZE_MAX);
+	pipe_unlock(pipe);
+	if (ret <= 0)
+		return ret;
+	size_t done = 0;
+	struct pipebuf_page *pp;
+	while ((pp = TAILQ_FIRST(&pages)))
+	{
+		ret = file_write_page(out, off, pp->page, pp->off, pp->len);
+		if (ret <= 0)
+			break;
+		done += ret;
+		if ((size_t)ret < pp->len)
+		{
+			pp->off += ret;
+			pp->len -= ret;
+			break;
+		}
+		TAILQ_REMOVE(&pages, pp, chain);
+		pipebuf_page_free(pp);
+	}
+	if (!TAILQ_EMPTY(&pages))
+	{
+		pipe_lock(pipe);
+		pipebuf_unget_locked(&pipe->pipebuf, &pages);
+		pipe_unlock(pipe);
+	}
+	if (!done)
+		return ret;
+	poller_broadcast(&pipe->poll_entries, POLLOUT);
+	return done;
+}
+
 void pipe_free(struct pipe *pipe)
 {
 	pipebuf_destroy(&pipe->pipebuf);
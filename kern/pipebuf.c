@@ -2,7 +2,9 @@
 #include <errno.h>
 #include <file.h>
 #include <poll.h>
+#include <std.h>
 #include <uio.h>
+#include <mem.h>
 
 int pipebuf_init(struct pipebuf *pipebuf, size_t size, struct mutex *mutex,
                  struct waitq *rwaitq, struct waitq *wwaitq)
@@ -10,6 +12,10 @@ int pipebuf_init(struct pipebuf *pipebuf, size_t size, struct mutex *mutex,
 	int ret = ringbuf_init(&pipebuf->ringbuf, size);
 	if (ret)
 		return ret;
+	TAILQ_INIT(&pipebuf->pages);
+	pipebuf->pages_count = 0;
+	pipebuf->pages_size = 0;
+	pipebuf->pages_bytes = 0;
 	pipebuf->mutex = mutex;
 	pipebuf->rwaitq = rwaitq;
 	pipebuf->wwaitq = wwaitq;
@@ -20,16 +26,145 @@ int pipebuf_init(struct pipebuf *pipebuf, size_t size, struct mutex *mutex,
 
 void pipebuf_destroy(struct pipebuf *pipebuf)
 {
+	pipebuf_pages_free(&pipebuf->pages);
 	ringbuf_destroy(&pipebuf->ringbuf);
 }
 
+int pipebuf_page_alloc(struct page *page, size_t off, size_t len,
+                       struct pipebuf_page **pagep)
+{
+	struct pipebuf_page *pp = malloc(sizeof(*pp), 0);
+	if (!pp)
+		return -ENOMEM;
+	pm_ref_page(page);
+	pp->page = page;
+	pp->off = off;
+	pp->len = len;
+	pp->bytes = 0;
+	*pagep = pp;
+	return 0;
+}
+
+void pipebuf_page_free(struct pipebuf_page *pp)
+{
+	pm_free_page(pp->page);
+	free(pp);
+}
+
+void pipebuf_pages_free(struct pipebuf_page_head *pages)
+{
+	struct pipebuf_page *pp;
+	while ((pp = TAILQ_FIRST(pages)))
+	{
+		TAILQ_REMOVE(pages, pp, chain);
+		pipebuf_page_free(pp);
+	}
+}
+
+int pipebuf_pages_dup(struct pipebuf_page_head *dst,
+                      const struct pipebuf_page_head *src)
+{
+	struct pipebuf_page *pp;
+	TAILQ_FOREACH(pp, src, chain)
+	{
+		struct pipebuf_page *dup;
+		int ret = pipebuf_page_alloc(pp->page, pp->off, pp->len, &dup);
+		if (ret)
+		{
+			pipebuf_pages_free(dst);
+			return ret;
+		}
+		TAILQ_INSERT_TAIL(dst, dup, chain);
+	}
+	return 0;
+}
+
+static size_t read_size(const struct pipebuf *pipebuf)
+{
+	return ringbuf_read_size(&pipebuf->ringbuf) + pipebuf->pages_size;
+}
+
+static void page_remove(struct pipebuf *pipebuf, struct pipebuf_page *pp)
+{
+	TAILQ_REMOVE(&pipebuf->pages, pp, chain);
+	pipebuf->pages_count--;
+	pipebuf->pages_size -= pp->len;
+	pipebuf->pages_bytes -= pp->bytes;
+}
+
+static void consume_page(struct pipebuf *pipebuf, struct pipebuf_page *pp,
+                         size_t size)
+{
+	pp->off += size;
+	pp->len -= size;
+	pipebuf->pages_size -= size;
+	if (pp->len)
+		return;
+	page_remove(pipebuf, pp);
+	pipebuf_page_free(pp);
+}
+
+/* the ringbuf bytes read are the ones queued before the first page */
+static void consume_ringbuf(struct pipebuf *pipebuf, size_t size)
+{
+	struct pipebuf_page *pp = TAILQ_FIRST(&pipebuf->pages);
+	if (!pp)
+		return;
+	pp->bytes -= size;
+	pipebuf->pages_bytes -= size;
+}
+
+static ssize_t read_page(struct pipebuf *pipebuf, struct pipebuf_page *pp,
+                         struct uio *uio, size_t size)
+{
+	if (size > pp->len)
+		size = pp->len;
+	void *ptr = vm_map(pp->page, PAGE_SIZE, VM_PROT_R);
+	if (!ptr)
+		return -ENOMEM;
+	ssize_t ret = uio_copyin(uio, (uint8_t*)ptr + pp->off, size);
+	vm_unmap(ptr, PAGE_SIZE);
+	if (ret > 0)
+		consume_page(pipebuf, pp, ret);
+	return ret;
+}
+
+static ssize_t read_uio(struct pipebuf *pipebuf, struct uio *uio, size_t size)
+{
+	size_t rd = 0;
+	while (rd < size)
+	{
+		struct pipebuf_page *pp = TAILQ_FIRST(&pipebuf->pages);
+		ssize_t ret;
+		if (pp && !pp->bytes)
+		{
+			ret = read_page(pipebuf, pp, uio, size - rd);
+		}
+		else
+		{
+			size_t count = size - rd;
+			if (pp && pp->bytes < count)
+				count = pp->bytes;
+			ret = ringbuf_readuio(&pipebuf->ringbuf, uio, count);
+			if (ret > 0)
+				consume_ringbuf(pipebuf, ret);
+		}
+		if (ret < 0)
+			return rd ? (ssize_t)rd : ret;
+		if (!ret)
+			break;
+		rd += ret;
+	}
+	return rd;
+}
+
 ssize_t pipebuf_read_locked(struct pipebuf *pipebuf, struct uio *uio, size_t min,
                             struct timespec *timeout)
 {
 	size_t rd = 0;
 	while (uio->count)
 	{
-		size_t available = ringbuf_read_size(&pipebuf->ringbuf);
+		size_t available = read_size(pipebuf);
 		if (!available)
 		{
 			if (!pipebuf->nwriters || rd)
@@ -70,13 +205,13 @@ ssize_t pipebuf_read_locked(struct pipebuf *pipebuf, struct uio *uio, size_t min
 					break;
 				}
 			}
-			available = ringbuf_read_size(&pipebuf->ringbuf);
+			available = read_size(pipebuf);
 		}
 		if (!read_sz)
 			break;
 		if (available < read_sz)
 			read_sz = available;
-		ssize_t ret = ringbuf_readuio(&pipebuf->ringbuf, uio, read_sz);
+		ssize_t ret = read_uio(pipebuf, uio, read_sz);
 		if (pipebuf->wwaitq)
 			waitq_broadcast(pipebuf->wwaitq, 0);
 		if (ret < 0)
@@ -169,7 +304,7 @@ int pipebuf_poll_locked(struct pipebuf *pipebuf, int events)
 	int ret = 0;
 	if (events & POLLIN)
 	{
-		if (ringbuf_read_size(&pipebuf->ringbuf))
+		if (read_size(pipebuf))
 			ret |= POLLIN;
 		if (!pipebuf->nwriters)
 			ret |= POLLHUP;
@@ -191,3 +326,158 @@ int pipebuf_poll(struct pipebuf *pipebuf, int events)
 	pipebuf_unlock(pipebuf);
 	return ret;
 }
+
+/* wait for data to be queued, returns 0 at the end of the stream */
+ssize_t pipebuf_wait_read_locked(struct pipebuf *pipebuf, int nonblock)
+{
+	while (1)
+	{
+		size_t available = read_size(pipebuf);
+		if (available)
+			return available;
+		if (!pipebuf->nwriters)
+			return 0;
+		if (nonblock || !pipebuf->rwaitq)
+			return -EAGAIN;
+		int ret = waitq_wait_tail_mutex(pipebuf->rwaitq, pipebuf->mutex,
+		                                NULL);
+		if (ret)
+			return ret;
+	}
+}
+
+/* wait for room in the pages queue, returns the number of pages which
+ * can be given
+ */
+ssize_t pipebuf_wait_write_locked(struct pipebuf *pipebuf, int nonblock)
+{
+	while (1)
+	{
+		if (!pipebuf->nreaders)
+			return -EPIPE;
+		if (pipebuf->pages_count < PIPEBUF_PAGES)
+			return PIPEBUF_PAGES - pipebuf->pages_count;
+		if (nonblock || !pipebuf->wwaitq)
+			return -EAGAIN;
+		int ret = waitq_wait_tail_mutex(pipebuf->wwaitq, pipebuf->mutex,
+		                                NULL);
+		if (ret)
+			return ret;
+	}
+}
+
+static int copy_ringbuf(struct pipebuf *pipebuf, size_t size,
+                        struct pipebuf_page **pagep)
+{
+	struct page *page;
+	int ret = pm_alloc_page(&page);
+	if (ret)
+		return ret;
+	ret = pipebuf_page_alloc(page, 0, size, pagep);
+	pm_free_page(page);
+	if (ret)
+		return ret;
+	void *ptr = vm_map(page, PAGE_SIZE, VM_PROT_W);
+	if (!ptr)
+	{
+		pipebuf_page_free(*pagep);
+		return -ENOMEM;
+	}
+	ringbuf_read(&pipebuf->ringbuf, ptr, size);
+	vm_unmap(ptr, PAGE_SIZE);
+	consume_ringbuf(pipebuf, size);
+	return 0;
+}
+
+/* move up to count bytes in at most max pages from the head of the
+ * buffer to pages, the bytes of the ringbuf being copied to new pages
+ */
+ssize_t pipebuf_take_locked(struct pipebuf *pipebuf,
+                            struct pipebuf_page_head *pages, size_t count,
+                            size_t max)
+{
+	size_t taken = 0;
+	size_t n = 0;
+	int ret = 0;
+	while (taken < count && n < max)
+	{
+		struct pipebuf_page *pp = TAILQ_FIRST(&pipebuf->pages);
+		size_t size = count - taken;
+		if (pp && !pp->bytes)
+		{
+			if (size < pp->len)
+			{
+				struct pipebuf_page *part;
+				ret = pipebuf_page_alloc(pp->page, pp->off, size, &part);
+				if (ret)
+					break;
+				consume_page(pipebuf, pp, size);
+				pp = part;
+			}
+			else
+			{
+				page_remove(pipebuf, pp);
+			}
+		}
+		else
+		{
+			size_t available = pp ? pp->bytes
+			                      : ringbuf_read_size(&pipebuf->ringbuf);
+			if (!available)
+				break;
+			if (size > available)
+				size = available;
+			if (size > PAGE_SIZE)
+				size = PAGE_SIZE;
+			ret = copy_ringbuf(pipebuf, size, &pp);
+			if (ret)
+				break;
+		}
+		TAILQ_INSERT_TAIL(pages, pp, chain);
+		taken += pp->len;
+		n++;
+	}
+	if (!taken)
+		return ret;
+	if (pipebuf->wwaitq)
+		waitq_broadcast(pipebuf->wwaitq, 0);
+	return taken;
+}
+
+/* append the pages, their references being given to the buffer */
+void pipebuf_give_locked(struct pipebuf *pipebuf,
+                         struct pipebuf_page_head *pages)
+{
+	struct pipebuf_page *pp;
+	while ((pp = TAILQ_FIRST(pages)))
+	{
+		TAILQ_REMOVE(pages, pp, chain);
+		pp->bytes = ringbuf_read_size(&pipebuf->ringbuf)
+		          - pipebuf->pages_bytes;
+		TAILQ_INSERT_TAIL(&pipebuf->pages, pp, chain);
+		pipebuf->pages_count++;
+		pipebuf->pages_size += pp->len;
+		pipebuf->pages_bytes += pp->bytes;
+	}
+	if (pipebuf->rwaitq)
+		waitq_broadcast(pipebuf->rwaitq, 0);
+}
+
+/* put back taken pages at the head of the buffer */
+void pipebuf_unget_locked(struct pipebuf *pipebuf,
+                          struct pipebuf_page_head *pages)
+{
+	struct pipebuf_page *pp;
+	if (TAILQ_EMPTY(pages))
+		return;
+	TAILQ_FOREACH(pp, pages, chain)
+	{
+		pp->bytes = 0;
+		pipebuf->pages_count++;
+		pipebuf->pages_size += pp->len;
+	}
+	TAILQ_CONCAT(pages, &pipebuf->pages, chain);
+	TAILQ_SWAP(pages, &pipebuf->pages, pipebuf_page, chain);
+	if (pipebuf->rwaitq)
+		waitq_broadcast(pipebuf->rwaitq, 0);
+}
@@ -61,6 +61,19 @@ void poller_remove(struct poller_head *head)
 	}
 }
 
+/* remove a single entry, ready or not, from its poller and its file */
+void poller_del(struct poll_entry *entry)
+{
+	spinlock_lock(&entry->poller->spinlock);
+	if (entry->revents)
+		TAILQ_REMOVE(&entry->poller->ready_entries, entry, poller_chain);
+	else
+		TAILQ_REMOVE(&entry->poller->entries, entry, poller_chain);
+	TAILQ_REMOVE(entry->file_head, entry, file_chain);
+	spinlock_unlock(&entry->poller->spinlock);
+	file_free(entry->file);
+}
+
 int poller_wait(struct poller *poller, struct timespec *timeout)
 {
 	spinlock_lock(&poller->spinlock);
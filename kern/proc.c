@@ -8,6 +8,7 @@
 #include <ptrace.h>
 #include <random.h>
 #include <errno.h>
+#include <vdso.h>
 #include <sched.h>
 #include <proc.h>
 #include <file.h>
@@ -23,15 +24,24 @@
 #define PANIC_ON_PFX 0
 #define PANIC_ON_ILL 0
 
-#define AUXV_SIZE 14
+#define AUXV_SIZE 15
 
 struct spinlock g_sess_list_lock = SPINLOCK_INITIALIZER(); /* XXX rwlock */
 struct sess_head g_sess_list = TAILQ_HEAD_INITIALIZER(g_sess_list);
-struct spinlock g_proc_list_lock = SPINLOCK_INITIALIZER(); /* XXX rwlock */
+struct rwlock g_proc_list_lock;
 struct proc_head g_proc_list = TAILQ_HEAD_INITIALIZER(g_proc_list);
-struct spinlock g_thread_list_lock = SPINLOCK_INITIALIZER(); /* XXX rwlock */
+/* thread_free may be called from the scheduler, which can't sleep */
+struct spinlock g_thread_list_lock = SPINLOCK_INITIALIZER();
 struct thread_head g_thread_list = TAILQ_HEAD_INITIALIZER(g_thread_list);
 
+/* the processes and the threads of the lists, hashed by pid / tid
+ * pids and tids are given by the same counter, which never wraps
+ */
+#define PID_HASH_SIZE 1024
+
+static struct proc_head g_proc_hash[PID_HASH_SIZE];
+static struct thread_head g_thread_hash[PID_HASH_SIZE];
+
 static struct thread *g_initthread;
 
 static pid_t g_pid;
@@ -47,6 +57,30 @@ void proc_init(void)
 	sma_init(&pgrp_sma, sizeof(struct pgrp), NULL, NULL, "pgrp");
 	sma_init(&thread_sma, sizeof(struct thread), NULL, NULL, "thread");
 	sma_init(&proc_sma, sizeof(struct proc), NULL, NULL, "proc");
+	rwlock_init(&g_proc_list_lock);
+	for (size_t i = 0; i < PID_HASH_SIZE; ++i)
+	{
+		TAILQ_INIT(&g_proc_hash[i]);
+		TAILQ_INIT(&g_thread_hash[i]);
+	}
+}
+
+static void proc_list_add(struct proc *proc)
+{
+	rwlock_wrlock(&g_proc_list_lock);
+	TAILQ_INSERT_TAIL(&g_proc_list, proc, chain);
+	TAILQ_INSERT_HEAD(&g_proc_hash[proc->pid % PID_HASH_SIZE], proc,
+	                  hash_chain);
+	rwlock_unlock(&g_proc_list_lock);
+}
+
+static void thread_list_add(struct thread *thread)
+{
+	spinlock_lock(&g_thread_list_lock);
+	TAILQ_INSERT_TAIL(&g_thread_list, thread, chain);
+	TAILQ_INSERT_HEAD(&g_thread_hash[thread->tid % PID_HASH_SIZE], thread,
+	                  hash_chain);
+	spinlock_unlock(&g_thread_list_lock);
 }
 
 struct sess *sess_alloc(pid_t id)
@@ -254,6 +288,8 @@ void thread_free(struct thread *thread)
 	sched_dequeue(thread);
 	spinlock_lock(&g_thread_list_lock);
 	TAILQ_REMOVE(&g_thread_list, thread, chain);
+	TAILQ_REMOVE(&g_thread_hash[thread->tid % PID_HASH_SIZE], thread,
+	             hash_chain);
 	spinlock_unlock(&g_thread_list_lock);
 	TAILQ_REMOVE(&thread->proc->threads, thread, thread_chain);
 	sma_free(&thread_sma, thread);
@@ -295,11 +331,14 @@ void proc_free(struct proc *proc)
 	vm_space_free(proc->vm_space);
 	free(proc->name);
 	free(proc->files);
+	free(proc->files_map);
+	free(proc->files_full);
 	if (proc->parent)
 		TAILQ_REMOVE(&proc->parent->childs, proc, child_chain);
-	spinlock_lock(&g_proc_list_lock);
+	rwlock_wrlock(&g_proc_list_lock);
 	TAILQ_REMOVE(&g_proc_list, proc, chain);
-	spinlock_unlock(&g_proc_list_lock);
+	TAILQ_REMOVE(&g_proc_hash[proc->pid % PID_HASH_SIZE], proc, hash_chain);
+	rwlock_unlock(&g_proc_list_lock);
 	pgrp_lock(proc->pgrp);
 	TAILQ_REMOVE(&proc->pgrp->processes, proc, pgrp_chain);
 	pgrp_unlock(proc->pgrp);
@@ -350,6 +389,8 @@ static int proc_create(const char *name, struct vm_space *vm_space, void *entry,
 	proc->cwd = proc->root;
 	node_ref(proc->root);
 	proc->files = NULL;
+	proc->files_map = NULL;
+	proc->files_full = NULL;
 	proc->files_nb = 0;
 	proc->vm_space = vm_space;
 	proc->entrypoint = entry;
@@ -374,9 +415,7 @@ static int proc_create(const char *name, struct vm_space *vm_space, void *entry,
 		return ret;
 	}
 	TAILQ_INSERT_HEAD(&proc->threads, thread, thread_chain);
-	spinlock_lock(&g_proc_list_lock);
-	TAILQ_INSERT_TAIL(&g_proc_list, proc, chain);
-	spinlock_unlock(&g_proc_list_lock);
+	proc_list_add(proc);
 	*threadp = thread;
 	return 0;
 }
@@ -615,6 +654,7 @@ static int proc_push_init_args(struct thread *thread,
 
 static int create_auxv(size_t auxv[AUXV_SIZE * 2],
                        const struct thread *thread,
+                       struct vm_space *vm_space,
                        const struct elf_info *info)
 {
 	auxv[0 * 2 + 0] = AT_ENTRY;
@@ -890,8 +930,17 @@ static int create_auxv(size_t auxv[AUXV_SIZE * 2],
 		*hwcap2 |= HWCAP2_SME_SF8DP2;
 #endif
 #endif
-	auxv[13 * 2 + 0] = AT_NULL;
-	auxv[13 * 2 + 1] = AT_NULL;
+	uintptr_t vdso;
+	ret = vdso_map(vm_space, &vdso);
+	if (ret)
+	{
+		TRACE("failed to map vdso");
+		return ret;
+	}
+	auxv[13 * 2 + 0] = AT_SYSINFO_EHDR;
+	auxv[13 * 2 + 1] = vdso;
+	auxv[14 * 2 + 0] = AT_NULL;
+	auxv[14 * 2 + 1] = AT_NULL;
 	return 0;
 }
 
@@ -948,7 +997,7 @@ static int uproc_create_elf(const char *name, struct file *file,
 		return ret;
 	}
 	arch_init_trapframe_user(thread);
-	ret = create_auxv(auxv, thread, &info);
+	ret = create_auxv(auxv, thread, vm_space, &info);
 	if (ret)
 	{
 		TRACE("failed to create auxv");
@@ -968,6 +1017,124 @@ static int uproc_create_elf(const char *name, struct file *file,
 	return 0;
 }
 
+/* files_map has a bit per fd, set when it's used, and files_full a bit
+ * per word of files_map, set when all of its fds are used: the lowest free
+ * fd is found without looking at the full words
+ * files_nb is a multiple of FILES_BPW, doubled each time the table is full
+ */
+#define FILES_BPW       (sizeof(unsigned long) * 8)
+#define FILES_WORDS(nb) (((nb) + FILES_BPW - 1) / FILES_BPW)
+
+static void fd_setbit(struct proc *proc, size_t fd)
+{
+	size_t word = fd / FILES_BPW;
+	proc->files_map[word] |= 1UL << (fd % FILES_BPW);
+	if (proc->files_map[word] == ~0UL)
+		proc->files_full[word / FILES_BPW] |= 1UL << (word % FILES_BPW);
+}
+
+static void fd_clrbit(struct proc *proc, size_t fd)
+{
+	size_t word = fd / FILES_BPW;
+	proc->files_map[word] &= ~(1UL << (fd % FILES_BPW));
+	proc->files_full[word / FILES_BPW] &= ~(1UL << (word % FILES_BPW));
+}
+
+/* files_nb if all of them are used */
+static size_t fd_lowest(struct proc *proc)
+{
+	size_t words = proc->files_nb / FILES_BPW;
+	for (size_t i = 0; i < FILES_WORDS(words); ++i)
+	{
+		unsigned long full = proc->files_full[i];
+		if (full == ~0UL)
+			continue;
+		size_t word = i * FILES_BPW + __builtin_ctzl(~full);
+		if (word >= words)
+			break;
+		return word * FILES_BPW
+		     + __builtin_ctzl(~proc->files_map[word]);
+	}
+	return proc->files_nb;
+}
+
+static int files_grow(struct proc *proc, size_t nb)
+{
+	if (nb <= proc->files_nb)
+		return 0;
+	size_t new_nb = proc->files_nb ? proc->files_nb : FILES_BPW;
+	while (new_nb < nb)
+		new_nb *= 2;
+	size_t words = proc->files_nb / FILES_BPW;
+	size_t new_words = new_nb / FILES_BPW;
+	struct filedesc *files = realloc(proc->files, sizeof(*files) * new_nb,
+	                                 0);
+	if (!files)
+		return -ENOMEM;
+	memset(&files[proc->files_nb], 0,
+	       sizeof(*files) * (new_nb - proc->files_nb));
+	proc->files = files;
+	unsigned long *map = realloc(proc->files_map,
+	                             sizeof(*map) * new_words, 0);
+	if (!map)
+		return -ENOMEM;
+	memset(&map[words], 0, sizeof(*map) * (new_words - words));
+	proc->files_map = map;
+	unsigned long *full = realloc(proc->files_full,
+	                              sizeof(*full) * FILES_WORDS(new_words), 0);
+	if (!full)
+		return -ENOMEM;
+	memset(&full[FILES_WORDS(words)], 0,
+	       sizeof(*full) * (FILES_WORDS(new_words) - FILES_WORDS(words)));
+	proc->files_full = full;
+	proc->files_nb = new_nb;
+	return 0;
+}
+
+static void files_close(struct proc *proc)
+{
+	rwlock_wrlock(&proc->files_lock);
+	for (size_t i = 0; i < proc->files_nb; ++i)
+	{
+		struct filedesc *fd = &proc->files[i];
+		if (!fd->file)
+			continue;
+		file_free(fd->file);
+		fd->file = NULL;
+		fd_clrbit(proc, i);
+	}
+	rwlock_unlock(&proc->files_lock);
+}
+
+static int files_dup(struct proc *newp, struct proc *proc)
+{
+	newp->files = NULL;
+	newp->files_map = NULL;
+	newp->files_full = NULL;
+	newp->files_nb = 0;
+	if (!proc->files_nb)
+		return 0;
+	int ret = files_grow(newp, proc->files_nb);
+	if (ret)
+	{
+		free(newp->files);
+		free(newp->files_map);
+		free(newp->files_full);
+		return ret;
+	}
+	for (size_t i = 0; i < proc->files_nb; ++i)
+	{
+		newp->files[i] = proc->files[i];
+		if (newp->files[i].file)
+			file_ref(newp->files[i].file);
+	}
+	memcpy(newp->files_map, proc->files_map,
+	       sizeof(*proc->files_map) * (proc->files_nb / FILES_BPW));
+	memcpy(newp->files_full, proc->files_full,
+	       sizeof(*proc->files_full) * FILES_WORDS(proc->files_nb / FILES_BPW));
+	return 0;
+}
+
 static int proc_dup(struct proc *proc, int flags, struct proc **newprocp)
 {
 	struct proc *newp;
@@ -996,21 +1163,14 @@ static int proc_dup(struct proc *proc, int flags, struct proc **newprocp)
 		}
 	}
 	newp->entrypoint = proc->entrypoint;
-	newp->files = malloc(sizeof(*newp->files) * proc->files_nb, 0);
-	if (!newp->files)
+	ret = files_dup(newp, proc);
+	if (ret)
 	{
 		vm_space_free(newp->vm_space);
 		free(newp->name);
 		sma_free(&proc_sma, newp);
-		return -ENOMEM;
-	}
-	for (size_t i = 0; i < proc->files_nb; ++i)
-	{
-		newp->files[i] = proc->files[i];
-		if (newp->files[i].file)
-			file_ref(newp->files[i].file);
+		return ret;
 	}
-	newp->files_nb = proc->files_nb;
 	newp->root = proc->root;
 	newp->cwd = proc->cwd;
 	node_ref(newp->root);
@@ -1071,16 +1231,19 @@ int uproc_clone(struct thread *thread, int flags, struct thread **newthreadp)
 	newt->proc = newp;
 	newt->tid = newp->pid;
 	TAILQ_INSERT_TAIL(&newp->threads, newt, thread_chain);
-	spinlock_lock(&g_thread_list_lock);
-	TAILQ_INSERT_TAIL(&g_thread_list, newt, chain);
-	spinlock_unlock(&g_thread_list_lock);
-	spinlock_lock(&g_proc_list_lock);
-	TAILQ_INSERT_TAIL(&g_proc_list, newp, chain);
-	spinlock_unlock(&g_proc_list_lock);
+	thread_list_add(newt);
+	proc_list_add(newp);
 	*newthreadp = newt;
 	return 0;
 }
 
+/* releases a process created by uproc_clone which has never been run */
+void uproc_discard(struct proc *proc)
+{
+	files_close(proc);
+	proc_free(proc);
+}
+
 int uthread_clone(struct thread *thread, int flags, struct thread **newthreadp)
 {
 	(void)flags;
@@ -1094,9 +1257,7 @@ int uthread_clone(struct thread *thread, int flags, struct thread **newthreadp)
 	newt->proc = thread->proc;
 	newt->tid = __atomic_add_fetch(&g_pid, 1, __ATOMIC_SEQ_CST);
 	TAILQ_INSERT_TAIL(&thread->proc->threads, newt, thread_chain);
-	spinlock_lock(&g_thread_list_lock);
-	TAILQ_INSERT_TAIL(&g_thread_list, newt, chain);
-	spinlock_unlock(&g_thread_list_lock);
+	thread_list_add(newt);
 	*newthreadp = newt;
 	return 0;
 }
@@ -1229,7 +1390,7 @@ int uproc_execve(struct thread *thread, struct file *file, const char *path,
 			vm_space_free(vm_space);
 			return ret;
 		}
-		ret = create_auxv(auxv, thread, &info);
+		ret = create_auxv(auxv, thread, vm_space, &info);
 		if (ret)
 		{
 			free(newname);
@@ -1258,7 +1419,7 @@ int uproc_execve(struct thread *thread, struct file *file, const char *path,
 			vm_space_free(vm_space);
 			return ret;
 		}
-		ret = create_auxv(auxv, thread, &info);
+		ret = create_auxv(auxv, thread, vm_space, &info);
 		if (ret)
 		{
 			free(newname);
@@ -1298,7 +1459,9 @@ int uproc_execve(struct thread *thread, struct file *file, const char *path,
 #if ARCH_REGISTER_PARAMETERS >= 4
 	arch_set_argument3(&thread->tf_user, (uintptr_t)stack_auxv);
 #endif
-	arch_vm_setspace(thread->proc->vm_space); /* XXX move at another place */
+	/* a spawned child is given its image by its parent */
+	if (thread == curcpu()->thread)
+		arch_vm_setspace(thread->proc->vm_space); /* XXX move at another place */
 	vm_space_free(oldctx);
 	rwlock_wrlock(&thread->proc->files_lock);
 	for (size_t i = 0; i < thread->proc->files_nb; ++i)
@@ -1310,6 +1473,7 @@ int uproc_execve(struct thread *thread, struct file *file, const char *path,
 			continue;
 		struct file *f = fd->file;
 		fd->file = NULL;
+		fd_clrbit(thread->proc, i);
 		/* XXX don't do this inside the rwlock */
 		file_free(f);
 	}
@@ -1324,30 +1488,29 @@ struct proc *getproc(pid_t pid)
 	struct proc *proc;
 	if (pid <= 0)
 		return NULL;
-	spinlock_lock(&g_proc_list_lock);
-	TAILQ_FOREACH(proc, &g_proc_list, chain)
+	rwlock_rdlock(&g_proc_list_lock);
+	TAILQ_FOREACH(proc, &g_proc_hash[pid % PID_HASH_SIZE], hash_chain)
 	{
 		if (proc->pid == pid)
 			break;
 	}
-	spinlock_unlock(&g_proc_list_lock);
+	rwlock_unlock(&g_proc_list_lock);
 	return proc;
 }
 
 struct thread *getthread(pid_t tid)
 {
 	struct thread *thread;
-	struct proc *proc;
 	if (tid <= 0)
 		return NULL;
-	spinlock_lock(&g_proc_list_lock);
-	TAILQ_FOREACH(proc, &g_proc_list, chain)
+	spinlock_lock(&g_thread_list_lock);
+	TAILQ_FOREACH(thread, &g_thread_hash[tid % PID_HASH_SIZE], hash_chain)
 	{
-		thread = proc_getthread(proc, tid);
-		if (thread)
+		/* thread_free waits for the lock once the last reference is gone */
+		if (thread->tid == tid && refcount_inc_not_zero(&thread->refcount))
 			break;
 	}
-	spinlock_unlock(&g_proc_list_lock);
+	spinlock_unlock(&g_thread_list_lock);
 	return thread;
 }
 
@@ -1690,18 +1853,9 @@ int proc_exit(struct proc *proc, int code)
 	}
 	if (proc->vfork_rel)
 		proc_wakeup_vfork(proc->vfork_rel);
-	rwlock_wrlock(&proc->files_lock);
-	for (size_t i = 0; i < proc->files_nb; ++i)
-	{
-		struct filedesc *fd = &proc->files[i];
-		if (!fd->file)
-			continue;
-		file_free(fd->file);
-		fd->file = NULL;
-	}
-	rwlock_unlock(&proc->files_lock);
+	files_close(proc);
 	if (refcount_get(&proc->vm_space->refcount) == 1) /* XXX make it non-racy */
-		arch_vm_space_cleanup(proc->vm_space);
+		vm_space_cleanup(proc->vm_space);
 	if (proc->parent)
 		proc_wakeup_wait(proc->parent, TAILQ_FIRST(&proc->threads));
 	/* XXX delete directly if no parent / parent ignore SIGCHLD ? */
@@ -1860,53 +2014,82 @@ void thread_illegal_instruction(struct thread *thread)
 	thread_signal(thread, SIGILL);
 }
 
+/* the table is only changed by the threads of the process: if the caller
+ * is the only one, nothing can change it concurrently and the lock isn't
+ * needed
+ */
+static int files_owned(struct proc *proc)
+{
+	struct thread *thread = curcpu()->thread;
+	return thread->proc == proc
+	    && TAILQ_FIRST(&proc->threads) == thread
+	    && !TAILQ_NEXT(thread, thread_chain);
+}
+
 int proc_getfile(struct proc *proc, int fd, struct file **file)
 {
-	rwlock_rdlock(&proc->files_lock);
+	int owned = files_owned(proc);
+	if (!owned)
+		rwlock_rdlock(&proc->files_lock);
 	if (fd < 0 || (size_t)fd >= proc->files_nb)
 	{
-		rwlock_unlock(&proc->files_lock);
+		if (!owned)
+			rwlock_unlock(&proc->files_lock);
 		return -EBADF;
 	}
 	*file = proc->files[fd].file;
 	if (!*file)
 	{
-		rwlock_unlock(&proc->files_lock);
+		if (!owned)
+			rwlock_unlock(&proc->files_lock);
 		return -EBADF;
 	}
 	file_ref(*file);
-	rwlock_unlock(&proc->files_lock);
+	if (!owned)
+		rwlock_unlock(&proc->files_lock);
 	return 0;
 }
 
 int proc_allocfd(struct proc *proc, struct file *file, int cloexec)
 {
 	rwlock_wrlock(&proc->files_lock);
-	for (size_t i = 0; i < proc->files_nb; ++i)
+	size_t fd = fd_lowest(proc);
+	int ret = files_grow(proc, fd + 1);
+	if (ret)
 	{
-		if (proc->files[i].file)
-			continue;
-		proc->files[i].file = file;
-		proc->files[i].cloexec = cloexec;
-		file_ref(file);
 		rwlock_unlock(&proc->files_lock);
-		return i;
+		return ret;
 	}
-	struct filedesc *files = realloc(proc->files,
-	                                 sizeof(*files) * (proc->files_nb + 1),
-	                                 0);
-	if (!files)
+	proc->files[fd].file = file;
+	proc->files[fd].cloexec = cloexec;
+	fd_setbit(proc, fd);
+	file_ref(file);
+	rwlock_unlock(&proc->files_lock);
+	return fd;
+}
+
+/* replaces the file of fd, if any, growing the table if needed */
+int proc_setfd(struct proc *proc, int fd, struct file *file, int cloexec)
+{
+	struct file *prv;
+	if (fd < 0)
+		return -EBADF;
+	/* XXX set a maximum bound (ulimit pls) */
+	rwlock_wrlock(&proc->files_lock);
+	int ret = files_grow(proc, (size_t)fd + 1);
+	if (ret)
 	{
 		rwlock_unlock(&proc->files_lock);
-		return -ENOMEM;
+		return ret;
 	}
-	proc->files = files;
-	int fd = proc->files_nb;
+	prv = proc->files[fd].file;
 	proc->files[fd].file = file;
 	proc->files[fd].cloexec = cloexec;
-	proc->files_nb++;
+	fd_setbit(proc, fd);
 	file_ref(file);
 	rwlock_unlock(&proc->files_lock);
+	if (prv)
+		file_free(prv);
 	return fd;
 }
 
@@ -1921,6 +2104,8 @@ int proc_freefd(struct proc *proc, int fd)
 	}
 	file = proc->files[fd].file;
 	proc->files[fd].file = NULL;
+	if (file)
+		fd_clrbit(proc, fd);
 	rwlock_unlock(&proc->files_lock);
 	if (!file)
 		return -EBADF;
@@ -2020,7 +2205,7 @@ static ssize_t procinfo_read(struct file *file, struct uio *uio)
 	size_t count = uio->count;
 	off_t off = uio->off;
 	struct proc *proc;
-	spinlock_lock(&g_proc_list_lock);
+	rwlock_rdlock(&g_proc_list_lock);
 	TAILQ_FOREACH(proc, &g_proc_list, chain)
 	{
 		const char *state;
@@ -2051,7 +2236,7 @@ static ssize_t procinfo_read(struct file *file, struct uio *uio)
 		        proc->stats.stime.tv_sec,
 		        proc->stats.stime.tv_nsec / 1000000);
 	}
-	spinlock_unlock(&g_proc_list_lock);
+	rwlock_unlock(&g_proc_list_lock);
 	uio->off = off + count - uio->count;
 	return count - uio->count;
 }
@@ -2125,9 +2310,7 @@ int setup_idlethread(void)
 	CPUMASK_SET(&idlethread->affinity, cpuid, 1);
 	idlethread->pri = 255;
 	curcpu()->idlethread = idlethread;
-	spinlock_lock(&g_thread_list_lock);
-	TAILQ_INSERT_TAIL(&g_thread_list, idlethread, chain);
-	spinlock_unlock(&g_thread_list_lock);
+	thread_list_add(idlethread);
 	idlethread->state = THREAD_RUNNING;
 	return 0;
 }
@@ -2152,9 +2335,7 @@ int setup_initthread(struct thread **thread)
 		return ret;
 	}
 	(*thread)->proc->parent = (*thread)->proc;
-	spinlock_lock(&g_thread_list_lock);
-	TAILQ_INSERT_TAIL(&g_thread_list, *thread, chain);
-	spinlock_unlock(&g_thread_list_lock);
+	thread_list_add(*thread);
 	(*thread)->tf_nest_level = 1;
 	g_initthread = *thread;
 	file_free(file);
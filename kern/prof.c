@@ -0,0 +1,510 @@
+#include <ringbuf.h>
+#include <spinlock.h>
+#include <mutex.h>
+#include <timer.h>
+#include <errno.h>
+#include <prof.h>
+#include <ksym.h>
+#include <kmod.h>
+#include <file.h>
+#include <proc.h>
+#include <time.h>
+#include <cpu.h>
+#include <std.h>
+#include <uio.h>
+#include <vfs.h>
+#include <mem.h>
+
+/* sampling profiler
+ * a timer periodically sends an ipi to every cpu, which then records the
+ * interrupted context into its own ring buffer
+ * the kernel runs with interrupts disabled, so kernel samples can only be
+ * taken in interruptible code (idle, waits); time spent in syscalls is
+ * attributed to the user instruction following the syscall
+ */
+
+#define PROF_BUFFER_SIZE (64 * 1024)
+#define PROF_FREQ_MAX    1000 /* timer wheel resolution */
+
+#if defined(__arm__)
+#define FRAME_OFFSET sizeof(uintptr_t)
+#elif defined(__riscv)
+#define FRAME_OFFSET (sizeof(uintptr_t) * 2)
+#else
+#define FRAME_OFFSET 0
+#endif
+
+#define SAMPLE_MAX_SIZE (sizeof(struct prof_sample) \
+                       + sizeof(struct prof_frame) * PROF_MAX_DEPTH)
+
+struct prof_cpu
+{
+	struct ringbuf ringbuf;
+	struct spinlock lock;
+	int pending;
+	uint64_t samples;
+	uint64_t dropped;
+};
+
+static struct prof_cpu g_prof_cpus[MAXCPU];
+static struct prof_config g_prof_config;
+static struct timespec g_prof_period;
+static struct timespec g_prof_next;
+static struct timer g_prof_timer;
+static struct mutex g_prof_mutex;
+static int g_prof_enabled;
+static int g_prof_opened;
+static struct cdev *dev_prof;
+
+static int prof_open(struct file *file, struct node *node);
+static int prof_release(struct file *file);
+static ssize_t prof_read(struct file *file, struct uio *uio);
+static int prof_ioctl(struct file *file, unsigned long request,
+                      uintptr_t data);
+
+static const struct file_op fop =
+{
+	.open = prof_open,
+	.release = prof_release,
+	.read = prof_read,
+	.ioctl = prof_ioctl,
+};
+
+static int in_stack(const uint8_t *stack, size_t size, uintptr_t addr)
+{
+	return addr >= (uintptr_t)stack
+	    && addr + sizeof(uintptr_t) * 2 <= (uintptr_t)stack + size;
+}
+
+static int in_kernel_stack(struct thread *thread, uintptr_t addr)
+{
+	if (thread->int_stack
+	 && in_stack(thread->int_stack, thread->int_stack_size, addr))
+		return 1;
+	if (thread->stack
+	 && in_stack(thread->stack, thread->stack_size, addr))
+		return 1;
+	return 0;
+}
+
+static size_t kernel_callchain(struct thread *thread, uintptr_t fp,
+                               struct prof_frame *frames, size_t max)
+{
+	size_t n = 0;
+	while (n < max && fp > FRAME_OFFSET)
+	{
+		uintptr_t frame = fp - FRAME_OFFSET;
+		if (frame < VADDR_KERN_BEGIN || !in_kernel_stack(thread, frame))
+			break;
+		uintptr_t next = ((uintptr_t*)frame)[0];
+		uintptr_t pc = ((uintptr_t*)frame)[1];
+		if (!pc)
+			break;
+		frames[n].pc = pc;
+		frames[n].flags = 0;
+		n++;
+		if (next <= fp)
+			break;
+		fp = next;
+	}
+	return n;
+}
+
+/* the frames are read from the resident pages only: faulting a page in
+ * may sleep, which the sampling interrupt can't do
+ */
+static size_t user_callchain(struct vm_space *space, uintptr_t fp,
+                             struct prof_frame *frames, size_t max)
+{
+	size_t n = 0;
+	while (n < max && fp > FRAME_OFFSET)
+	{
+		uintptr_t v[2];
+		if (vm_copyin_nofault(space, v, (void*)(fp - FRAME_OFFSET),
+		                      sizeof(v)))
+			break;
+		if (!v[1])
+			break;
+		frames[n].pc = v[1];
+		frames[n].flags = PROF_FRAME_USER;
+		n++;
+		if (v[0] <= fp)
+			break;
+		fp = v[0];
+	}
+	return n;
+}
+
+/* must be called with the vm_space mutex held */
+static void resolve_frame(struct vm_space *space, struct prof_frame *frame)
+{
+	struct vm_zone *zone;
+	if (vm_space_find(space, frame->pc, &zone))
+		return;
+	if (!zone->file || !zone->file->node)
+		return;
+	struct node *node = zone->file->node;
+	frame->off = frame->pc - zone->addr + zone->off;
+	frame->ino = node->ino;
+	frame->dev = node->sb ? node->sb->dev : 0;
+	frame->flags |= PROF_FRAME_FILE;
+}
+
+static void sample_user(struct thread *thread, struct trapframe *tf,
+                        struct prof_sample *sample)
+{
+	struct vm_space *space = thread->proc->vm_space;
+	sample->frames[0].pc = arch_get_instruction_pointer(tf);
+	sample->frames[0].flags = PROF_FRAME_USER;
+	sample->depth = 1;
+	/* the interrupted thread was running userland, so it can't be the
+	 * owner: don't wait for another thread of the process
+	 */
+	if (!space || mutex_trylock(&space->mutex))
+		return;
+	if (g_prof_config.flags & PROF_F_CALLCHAIN)
+		sample->depth += user_callchain(space,
+		                                arch_get_frame_pointer(tf),
+		                                &sample->frames[1],
+		                                PROF_MAX_DEPTH - 1);
+	for (size_t i = 0; i < sample->depth; ++i)
+		resolve_frame(space, &sample->frames[i]);
+	mutex_unlock(&space->mutex);
+}
+
+static void sample_kernel(struct thread *thread, struct trapframe *tf,
+                          struct prof_sample *sample)
+{
+	sample->frames[0].pc = arch_get_instruction_pointer(tf);
+	sample->frames[0].flags = 0;
+	sample->depth = 1;
+	if (g_prof_config.flags & PROF_F_CALLCHAIN)
+		sample->depth += kernel_callchain(thread,
+		                                  arch_get_frame_pointer(tf),
+		                                  &sample->frames[1],
+		                                  PROF_MAX_DEPTH - 1);
+}
+
+static void push_sample(struct prof_cpu *prof_cpu,
+                        const struct prof_sample *sample)
+{
+	spinlock_lock(&prof_cpu->lock);
+	if (prof_cpu->ringbuf.data
+	 && ringbuf_write_size(&prof_cpu->ringbuf) >= sample->size)
+	{
+		ringbuf_write(&prof_cpu->ringbuf, sample, sample->size);
+		prof_cpu->samples++;
+	}
+	else
+	{
+		prof_cpu->dropped++;
+	}
+	spinlock_unlock(&prof_cpu->lock);
+}
+
+void prof_ipi(void)
+{
+	struct cpu *cpu = curcpu();
+	struct prof_cpu *prof_cpu = &g_prof_cpus[cpu->id];
+	if (!__atomic_exchange_n(&prof_cpu->pending, 0, __ATOMIC_ACQUIRE))
+		return;
+	if (!__atomic_load_n(&g_prof_enabled, __ATOMIC_ACQUIRE))
+		return;
+	struct thread *thread = cpu->thread;
+	if (!thread)
+		return;
+	if (g_prof_config.pid > 0 && thread->proc->pid != g_prof_config.pid)
+		return;
+	/* the interrupted context is the one of the previous nest level */
+	struct trapframe *tf = thread->tf_nest_level > 1 ? &thread->tf_kern
+	                                                 : &thread->tf_user;
+	uintptr_t pc = arch_get_instruction_pointer(tf);
+	int user = pc < VADDR_USER_END;
+	if (!(g_prof_config.flags & (user ? PROF_F_USER : PROF_F_KERNEL)))
+		return;
+	uint64_t buf[SAMPLE_MAX_SIZE / sizeof(uint64_t)];
+	struct prof_sample *sample = (struct prof_sample*)buf;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	memset(sample, 0, SAMPLE_MAX_SIZE);
+	sample->cpu = cpu->id;
+	sample->pid = thread->proc->pid;
+	sample->tid = thread->tid;
+	sample->time = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	if (user)
+		sample_user(thread, tf, sample);
+	else
+		sample_kernel(thread, tf, sample);
+	sample->size = sizeof(*sample) + sizeof(*sample->frames) * sample->depth;
+	push_sample(prof_cpu, sample);
+}
+
+static void prof_timer_cb(struct timer *timer);
+
+static void prof_timer_add(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	timespec_add(&g_prof_next, &g_prof_period);
+	/* don't try to catch up after being late */
+	if (timespec_cmp(&g_prof_next, &now) < 0)
+	{
+		g_prof_next = now;
+		timespec_add(&g_prof_next, &g_prof_period);
+	}
+	timer_add(&g_prof_timer, g_prof_next, prof_timer_cb, NULL);
+}
+
+static void prof_timer_cb(struct timer *timer)
+{
+	(void)timer;
+	if (!__atomic_load_n(&g_prof_enabled, __ATOMIC_ACQUIRE))
+		return;
+	struct cpu *cpu;
+	CPU_FOREACH(cpu)
+	{
+		__atomic_store_n(&g_prof_cpus[cpu->id].pending, 1,
+		                 __ATOMIC_RELEASE);
+		arch_cpu_ipi(cpu);
+	}
+	prof_timer_add();
+}
+
+static void free_buffers(void)
+{
+	for (size_t i = 0; i < g_ncpus; ++i)
+	{
+		struct prof_cpu *prof_cpu = &g_prof_cpus[i];
+		struct ringbuf ringbuf;
+		spinlock_lock(&prof_cpu->lock);
+		ringbuf = prof_cpu->ringbuf;
+		ringbuf_init(&prof_cpu->ringbuf, 0);
+		spinlock_unlock(&prof_cpu->lock);
+		ringbuf_destroy(&ringbuf);
+	}
+}
+
+static int alloc_buffers(void)
+{
+	for (size_t i = 0; i < g_ncpus; ++i)
+	{
+		struct prof_cpu *prof_cpu = &g_prof_cpus[i];
+		struct ringbuf ringbuf;
+		int ret = ringbuf_init(&ringbuf, PROF_BUFFER_SIZE);
+		if (ret)
+		{
+			free_buffers();
+			return ret;
+		}
+		spinlock_lock(&prof_cpu->lock);
+		prof_cpu->ringbuf = ringbuf;
+		prof_cpu->samples = 0;
+		prof_cpu->dropped = 0;
+		spinlock_unlock(&prof_cpu->lock);
+	}
+	return 0;
+}
+
+static void prof_stop(void)
+{
+	__atomic_store_n(&g_prof_enabled, 0, __ATOMIC_RELEASE);
+	timer_remove(&g_prof_timer);
+}
+
+static int prof_start(const struct prof_config *config)
+{
+	if (!config->frequency || config->frequency > PROF_FREQ_MAX)
+		return -EINVAL;
+	if (config->flags & ~(PROF_F_KERNEL | PROF_F_USER | PROF_F_CALLCHAIN))
+		return -EINVAL;
+	if (__atomic_load_n(&g_prof_enabled, __ATOMIC_ACQUIRE))
+		return -EBUSY;
+	free_buffers();
+	int ret = alloc_buffers();
+	if (ret)
+		return ret;
+	g_prof_config = *config;
+	if (!(g_prof_config.flags & (PROF_F_KERNEL | PROF_F_USER)))
+		g_prof_config.flags |= PROF_F_KERNEL | PROF_F_USER;
+	g_prof_period.tv_sec = 0;
+	g_prof_period.tv_nsec = 1000000000 / config->frequency;
+	clock_gettime(CLOCK_MONOTONIC, &g_prof_next);
+	__atomic_store_n(&g_prof_enabled, 1, __ATOMIC_RELEASE);
+	prof_timer_add();
+	return 0;
+}
+
+static int prof_open(struct file *file, struct node *node)
+{
+	(void)file;
+	(void)node;
+	if (__atomic_exchange_n(&g_prof_opened, 1, __ATOMIC_ACQUIRE))
+		return -EBUSY;
+	return 0;
+}
+
+static int prof_release(struct file *file)
+{
+	(void)file;
+	mutex_lock(&g_prof_mutex);
+	prof_stop();
+	free_buffers();
+	mutex_unlock(&g_prof_mutex);
+	__atomic_store_n(&g_prof_opened, 0, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* only whole samples are copied
+ * the per-cpu lock can't be held while copying to userland, samples
+ * are bounced through a kernel buffer
+ */
+static size_t read_samples(struct prof_cpu *prof_cpu, uint8_t *buf,
+                           size_t size)
+{
+	size_t n = 0;
+	spinlock_lock(&prof_cpu->lock);
+	while (prof_cpu->ringbuf.data)
+	{
+		uint32_t sample_size;
+		if (ringbuf_peek(&prof_cpu->ringbuf, &sample_size,
+		                 sizeof(sample_size)) != sizeof(sample_size))
+			break;
+		if (n + sample_size > size)
+			break;
+		ringbuf_read(&prof_cpu->ringbuf, &buf[n], sample_size);
+		n += sample_size;
+	}
+	spinlock_unlock(&prof_cpu->lock);
+	return n;
+}
+
+static ssize_t prof_read(struct file *file, struct uio *uio)
+{
+	(void)file;
+	size_t count = uio->count;
+	uint8_t *buf = malloc(PAGE_SIZE, 0);
+	if (!buf)
+		return -ENOMEM;
+	mutex_lock(&g_prof_mutex);
+	for (size_t i = 0; i < g_ncpus; ++i)
+	{
+		size_t n;
+		do
+		{
+			size_t size = uio->count < PAGE_SIZE ? uio->count : PAGE_SIZE;
+			n = read_samples(&g_prof_cpus[i], buf, size);
+			if (!n)
+				break;
+			ssize_t ret = uio_copyin(uio, buf, n);
+			if (ret < 0)
+			{
+				mutex_unlock(&g_prof_mutex);
+				free(buf);
+				return ret;
+			}
+		} while (uio->count >= SAMPLE_MAX_SIZE);
+	}
+	mutex_unlock(&g_prof_mutex);
+	free(buf);
+	return count - uio->count;
+}
+
+static int prof_ksym(struct prof_ksym *ksym)
+{
+	uintptr_t addr = ksym->addr;
+	uintptr_t off;
+	const char *sym = ksym_find_by_addr(g_kern_ksym_ctx, addr, &off);
+	if (sym)
+	{
+		strlcpy(ksym->name, sym, sizeof(ksym->name));
+		ksym->off = off;
+		return 0;
+	}
+	struct kmod *kmod = kmod_find_by_addr(addr);
+	if (!kmod)
+		return -ENOENT;
+	sym = kmod_get_sym(kmod, addr, &off);
+	if (sym)
+	{
+		snprintf(ksym->name, sizeof(ksym->name), "%s:%s",
+		         kmod->info->name, sym);
+		ksym->off = off;
+	}
+	else
+	{
+		snprintf(ksym->name, sizeof(ksym->name), "%s:",
+		         kmod->info->name);
+		ksym->off = addr - kmod->elf_info.base_addr;
+	}
+	kmod_free(kmod);
+	return 0;
+}
+
+static int prof_ioctl(struct file *file, unsigned long request,
+                      uintptr_t data)
+{
+	(void)file;
+	struct vm_space *space = curcpu()->thread->proc->vm_space;
+	int ret;
+	switch (request)
+	{
+		case PROFIO_START:
+		{
+			struct prof_config config;
+			ret = vm_copyin(space, &config, (void*)data,
+			                sizeof(config));
+			if (ret)
+				return ret;
+			mutex_lock(&g_prof_mutex);
+			ret = prof_start(&config);
+			mutex_unlock(&g_prof_mutex);
+			return ret;
+		}
+		case PROFIO_STOP:
+			mutex_lock(&g_prof_mutex);
+			prof_stop();
+			mutex_unlock(&g_prof_mutex);
+			return 0;
+		case PROFIO_STATS:
+		{
+			struct prof_stats stats;
+			stats.samples = 0;
+			stats.dropped = 0;
+			for (size_t i = 0; i < g_ncpus; ++i)
+			{
+				struct prof_cpu *prof_cpu = &g_prof_cpus[i];
+				spinlock_lock(&prof_cpu->lock);
+				stats.samples += prof_cpu->samples;
+				stats.dropped += prof_cpu->dropped;
+				spinlock_unlock(&prof_cpu->lock);
+			}
+			return vm_copyout(space, (void*)data, &stats,
+			                  sizeof(stats));
+		}
+		case PROFIO_KSYM:
+		{
+			struct prof_ksym ksym;
+			ret = vm_copyin(space, &ksym, (void*)data, sizeof(ksym));
+			if (ret)
+				return ret;
+			ret = prof_ksym(&ksym);
+			if (ret)
+				return ret;
+			return vm_copyout(space, (void*)data, &ksym,
+			                  sizeof(ksym));
+		}
+		default:
+			return -EINVAL;
+	}
+}
+
+void prof_init(void)
+{
+	mutex_init(&g_prof_mutex, 0);
+	for (size_t i = 0; i < MAXCPU; ++i)
+		spinlock_init(&g_prof_cpus[i].lock);
+	int ret = cdev_alloc("prof", 0, 0, 0600, makedev(10, 1), &fop,
+	                     &dev_prof);
+	if (ret)
+		printf("prof: failed to create device: %s\n", strerror(ret));
+}
@@ -174,8 +174,8 @@ static ssize_t ptmx_read(struct file *file, struct uio *uio)
 {
 	struct pty *pty = file->userdata;
 	return pipebuf_read(&pty->pipebuf, uio,
-	                    file->flags & O_NONBLOCK ? 0 : uio->count,
-	                    NULL);
+	                    (file->flags & O_NONBLOCK) || uio->nonblock
+	                    ? 0 : uio->count, NULL);
 }
 
 static ssize_t ptmx_write(struct file *file, struct uio *uio)
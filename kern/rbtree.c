@@ -0,0 +1,299 @@
+#include <rbtree.h>
+#include <std.h>
+
+static inline int is_red(const struct rb_node *node)
+{
+	return node && node->color == RB_RED;
+}
+
+static inline int is_black(const struct rb_node *node)
+{
+	return !node || node->color == RB_BLACK;
+}
+
+static inline void augment_node(struct rb_tree *tree, struct rb_node *node)
+{
+	if (tree->augment)
+		tree->augment(node);
+}
+
+static void replace_child(struct rb_tree *tree, struct rb_node *parent,
+                          struct rb_node *old, struct rb_node *new)
+{
+	if (!parent)
+		tree->root = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+}
+
+/* the subtree of the two rotated nodes only changes for them: their
+ * ancestors keep the same descendants
+ */
+static void rotate_left(struct rb_tree *tree, struct rb_node *node)
+{
+	struct rb_node *right = node->right;
+	node->right = right->left;
+	if (right->left)
+		right->left->parent = node;
+	right->parent = node->parent;
+	replace_child(tree, node->parent, node, right);
+	right->left = node;
+	node->parent = right;
+	augment_node(tree, node);
+	augment_node(tree, right);
+}
+
+static void rotate_right(struct rb_tree *tree, struct rb_node *node)
+{
+	struct rb_node *left = node->left;
+	node->left = left->right;
+	if (left->right)
+		left->right->parent = node;
+	left->parent = node->parent;
+	replace_child(tree, node->parent, node, left);
+	left->right = node;
+	node->parent = left;
+	augment_node(tree, node);
+	augment_node(tree, left);
+}
+
+void rb_init(struct rb_tree *tree, void (*augment)(struct rb_node *node))
+{
+	tree->root = NULL;
+	tree->augment = augment;
+}
+
+void rb_augment_path(struct rb_tree *tree, struct rb_node *node)
+{
+	if (!tree->augment)
+		return;
+	for (; node; node = node->parent)
+		tree->augment(node);
+}
+
+void rb_insert(struct rb_tree *tree, struct rb_node *node,
+               struct rb_node *parent, struct rb_node **link)
+{
+	node->parent = parent;
+	node->left = NULL;
+	node->right = NULL;
+	node->color = RB_RED;
+	*link = node;
+	rb_augment_path(tree, node);
+	while (is_red(node->parent))
+	{
+		parent = node->parent;
+		struct rb_node *gparent = parent->parent;
+		if (parent == gparent->left)
+		{
+			struct rb_node *uncle = gparent->right;
+			if (is_red(uncle))
+			{
+				parent->color = RB_BLACK;
+				uncle->color = RB_BLACK;
+				gparent->color = RB_RED;
+				node = gparent;
+				continue;
+			}
+			if (node == parent->right)
+			{
+				rotate_left(tree, parent);
+				node = parent;
+				parent = node->parent;
+			}
+			parent->color = RB_BLACK;
+			gparent->color = RB_RED;
+			rotate_right(tree, gparent);
+		}
+		else
+		{
+			struct rb_node *uncle = gparent->left;
+			if (is_red(uncle))
+			{
+				parent->color = RB_BLACK;
+				uncle->color = RB_BLACK;
+				gparent->color = RB_RED;
+				node = gparent;
+				continue;
+			}
+			if (node == parent->left)
+			{
+				rotate_right(tree, parent);
+				node = parent;
+				parent = node->parent;
+			}
+			parent->color = RB_BLACK;
+			gparent->color = RB_RED;
+			rotate_left(tree, gparent);
+		}
+	}
+	tree->root->color = RB_BLACK;
+}
+
+static void remove_fixup(struct rb_tree *tree, struct rb_node *node,
+                         struct rb_node *parent)
+{
+	while (node != tree->root && is_black(node))
+	{
+		if (node == parent->left)
+		{
+			struct rb_node *sibling = parent->right;
+			if (is_red(sibling))
+			{
+				sibling->color = RB_BLACK;
+				parent->color = RB_RED;
+				rotate_left(tree, parent);
+				sibling = parent->right;
+			}
+			if (is_black(sibling->left) && is_black(sibling->right))
+			{
+				sibling->color = RB_RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+			if (is_black(sibling->right))
+			{
+				sibling->left->color = RB_BLACK;
+				sibling->color = RB_RED;
+				rotate_right(tree, sibling);
+				sibling = parent->right;
+			}
+			sibling->color = parent->color;
+			parent->color = RB_BLACK;
+			sibling->right->color = RB_BLACK;
+			rotate_left(tree, parent);
+			node = tree->root;
+		}
+		else
+		{
+			struct rb_node *sibling = parent->left;
+			if (is_red(sibling))
+			{
+				sibling->color = RB_BLACK;
+				parent->color = RB_RED;
+				rotate_right(tree, parent);
+				sibling = parent->left;
+			}
+			if (is_black(sibling->left) && is_black(sibling->right))
+			{
+				sibling->color = RB_RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+			if (is_black(sibling->left))
+			{
+				sibling->right->color = RB_BLACK;
+				sibling->color = RB_RED;
+				rotate_left(tree, sibling);
+				sibling = parent->left;
+			}
+			sibling->color = parent->color;
+			parent->color = RB_BLACK;
+			sibling->left->color = RB_BLACK;
+			rotate_right(tree, parent);
+			node = tree->root;
+		}
+	}
+	if (node)
+		node->color = RB_BLACK;
+}
+
+void rb_remove(struct rb_tree *tree, struct rb_node *node)
+{
+	struct rb_node *child;
+	struct rb_node *parent;
+	int color;
+
+	if (node->left && node->right)
+	{
+		/* replace the node with its successor */
+		struct rb_node *next = node->right;
+		while (next->left)
+			next = next->left;
+		child = next->right;
+		color = next->color;
+		if (next->parent == node)
+		{
+			parent = next;
+		}
+		else
+		{
+			parent = next->parent;
+			parent->left = child;
+			if (child)
+				child->parent = parent;
+			next->right = node->right;
+			node->right->parent = next;
+		}
+		next->left = node->left;
+		node->left->parent = next;
+		next->parent = node->parent;
+		next->color = node->color;
+		replace_child(tree, node->parent, node, next);
+	}
+	else
+	{
+		child = node->left ? node->left : node->right;
+		parent = node->parent;
+		color = node->color;
+		if (child)
+			child->parent = parent;
+		replace_child(tree, parent, node, child);
+	}
+	/* the successor (if any) is on the path from parent to the root */
+	rb_augment_path(tree, parent);
+	if (color == RB_BLACK)
+		remove_fixup(tree, child, parent);
+}
+
+struct rb_node *rb_first(const struct rb_tree *tree)
+{
+	struct rb_node *node = tree->root;
+	if (!node)
+		return NULL;
+	while (node->left)
+		node = node->left;
+	return node;
+}
+
+struct rb_node *rb_last(const struct rb_tree *tree)
+{
+	struct rb_node *node = tree->root;
+	if (!node)
+		return NULL;
+	while (node->right)
+		node = node->right;
+	return node;
+}
+
+struct rb_node *rb_next(const struct rb_node *node)
+{
+	if (node->right)
+	{
+		node = node->right;
+		while (node->left)
+			node = node->left;
+		return (struct rb_node*)node;
+	}
+	while (node->parent && node == node->parent->right)
+		node = node->parent;
+	return node->parent;
+}
+
+struct rb_node *rb_prev(const struct rb_node *node)
+{
+	if (node->left)
+	{
+		node = node->left;
+		while (node->right)
+			node = node->right;
+		return (struct rb_node*)node;
+	}
+	while (node->parent && node == node->parent->left)
+		node = node->parent;
+	return node->parent;
+}
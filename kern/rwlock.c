@@ -1,3 +1,4 @@
+#include <lockstat.h>
 #include <rwlock.h>
 #include <cpu.h>
 #include <std.h>
@@ -9,6 +10,7 @@ void rwlock_init(struct rwlock *rwlock)
 	waitq_init(&rwlock->wwaitq);
 	rwlock->wowner = NULL;
 	rwlock->rlock_nb = 0;
+	rwlock->stat_start = 0;
 }
 
 void rwlock_destroy(struct rwlock *rwlock)
@@ -20,11 +22,16 @@ void rwlock_destroy(struct rwlock *rwlock)
 
 void rwlock_rdlock(struct rwlock *rwlock)
 {
+	uint64_t start = lockstat_enabled() ? arch_get_cycles() : 0;
+	int contended = 0;
 	spinlock_lock(&rwlock->spinlock);
 	while (1)
 	{
 		while (rwlock->wowner)
+		{
+			contended = 1;
 			waitq_wait_tail(&rwlock->rwaitq, &rwlock->spinlock, NULL);
+		}
 		spinlock_lock(&rwlock->wwaitq.spinlock);
 		if (TAILQ_EMPTY(&rwlock->wwaitq.watchers))
 		{
@@ -32,9 +39,14 @@ void rwlock_rdlock(struct rwlock *rwlock)
 			break;
 		}
 		spinlock_unlock(&rwlock->wwaitq.spinlock);
+		contended = 1;
 		waitq_wait_tail(&rwlock->rwaitq, &rwlock->spinlock, NULL);
 	}
 	rwlock->rlock_nb++;
+	if (start)
+		lockstat_acquired(LOCKSTAT_RWLOCK_RD,
+		                  (uintptr_t)__builtin_return_address(0),
+		                  arch_get_cycles() - start, contended);
 	spinlock_unlock(&rwlock->spinlock);
 }
 
@@ -59,15 +71,33 @@ int rwlock_tryrdlock(struct rwlock *rwlock)
 	return 0;
 }
 
+static void stat_wracquired(struct rwlock *rwlock, uintptr_t site,
+                            uint64_t start, int contended)
+{
+	if (!start)
+		return;
+	uint64_t now = arch_get_cycles();
+	lockstat_acquired(LOCKSTAT_RWLOCK_WR, site, now - start, contended);
+	rwlock->stat_site = site;
+	rwlock->stat_start = now;
+}
+
 void rwlock_wrlock(struct rwlock *rwlock)
 {
+	uint64_t start = lockstat_enabled() ? arch_get_cycles() : 0;
+	int contended = 0;
 	spinlock_lock(&rwlock->spinlock);
 	while (rwlock->wowner || rwlock->rlock_nb)
+	{
+		contended = 1;
 		waitq_wait_tail(&rwlock->wwaitq, &rwlock->spinlock, NULL);
+	}
 	struct thread *thread = curcpu()->thread;
 	if (!thread)
 		thread = (struct thread*)0x1; /* XXX */
 	rwlock->wowner = thread;
+	stat_wracquired(rwlock, (uintptr_t)__builtin_return_address(0),
+	                start, contended);
 	spinlock_unlock(&rwlock->spinlock);
 }
 
@@ -80,6 +110,10 @@ int rwlock_tryrwlock(struct rwlock *rwlock)
 		if (!thread)
 			thread = (struct thread*)0x1; /* XXX */
 		rwlock->wowner = thread;
+		if (lockstat_enabled())
+			stat_wracquired(rwlock,
+			                (uintptr_t)__builtin_return_address(0),
+			                arch_get_cycles(), 0);
 		spinlock_unlock(&rwlock->spinlock);
 		return 0;
 	}
@@ -95,6 +129,14 @@ void rwlock_unlock(struct rwlock *rwlock)
 		thread = (struct thread*)0x1; /* XXX */
 	if (rwlock->wowner && rwlock->wowner == thread)
 	{
+		if (rwlock->stat_start)
+		{
+			if (lockstat_enabled())
+				lockstat_released(LOCKSTAT_RWLOCK_WR,
+				                  rwlock->stat_site,
+				                  arch_get_cycles() - rwlock->stat_start);
+			rwlock->stat_start = 0;
+		}
 		rwlock->wowner = NULL;
 		if (!waitq_signal(&rwlock->wwaitq, 0))
 			waitq_broadcast(&rwlock->rwaitq, 0);
@@ -1,3 +1,4 @@
+#include <tracepoint.h>
 #include <mutex.h>
 #include <sched.h>
 #include <time.h>
@@ -16,9 +17,18 @@ struct runq
 };
 
 static struct runq g_runq[MAXCPU];
+static struct lock_class runq_lock_class = LOCK_CLASS_INITIALIZER("runq");
 
 static struct thread *find_better_thread(int ignoreidle);
 
+/* threads are first stolen from the cpus of the same numa node, to keep
+ * them close to their memory
+ */
+static int steal_pass(uint32_t cpuid, int remote)
+{
+	return (g_cpus[cpuid].node != curcpu()->node) == remote;
+}
+
 void sched_init(void)
 {
 	for (size_t i = 0; i < sizeof(g_runq) / sizeof(*g_runq); ++i)
@@ -26,6 +36,7 @@ void sched_init(void)
 		struct runq *runq = &g_runq[i];
 		TAILQ_INIT(&runq->threads);
 		mutex_init(&runq->mutex, 0);
+		mutex_set_class(&runq->mutex, &runq_lock_class);
 	}
 	g_init = 1;
 }
@@ -33,11 +44,6 @@ void sched_init(void)
 static void runq_enqueue(struct runq *runq, struct thread *thread)
 {
 	struct thread *it;
-#if 0
-	printf("[cpu %2" PRIu32 "] added thread %p (%s; %#zx) to runq\n",
-	       curcpu()->id, thread, thread->proc->name,
-	       arch_get_instruction_pointer(&thread->tf_user));
-#endif
 	mutex_spinlock(&runq->mutex);
 	TAILQ_FOREACH(it, &runq->threads, runq_chain)
 	{
@@ -93,6 +99,7 @@ void sched_ipi(void)
 void sched_run(struct thread *thread)
 {
 	struct cpu *cpu = curcpu();
+	tp_sched_wakeup(thread);
 	runq_enqueue(&g_runq[thread->wait_cpuid], thread);
 	if (cpu->thread == cpu->idlethread)
 		test_better_thread();
@@ -125,37 +132,15 @@ void sched_switch(struct thread *thread)
 	struct thread *curthread = curcpu()->thread;
 	if (thread == curthread)
 		return;
-#if 0
-	printf("[cpu %2" PRIu32 "] changing thread from "
-	       "%p (%s IPU %#zx IPK %#zx NEST %zu PRI %" PRId32 " ST %d) to "
-	       "%p (%s IPU %#zx IPK %#zx NEST %zu PRI %" PRId32 " ST %d)\n",
-	       curcpu()->id, curthread, curthread ? curthread->proc->name : "",
-	       curthread ? arch_get_instruction_pointer(&curthread->tf_user) : 0,
-	       curthread ? arch_get_instruction_pointer(&curthread->tf_kern) : 0,
-	       curthread ? curthread->tf_nest_level : 0,
-	       curthread ? curthread->pri : 0,
-	       curthread ? curthread->state : 0,
-	       thread,
-	       thread->proc->name,
-	       arch_get_instruction_pointer(&thread->tf_user),
-	       arch_get_instruction_pointer(&thread->tf_kern),
-	       thread ? thread->tf_nest_level : 0,
-	       thread ? thread->pri : 0,
-	       thread ? thread->state : 0);
-#endif
+	/* prev_state tells whether the previous thread was preempted
+	 * (THREAD_RUNNING) or is blocked
+	 */
+	tp_sched_switch(curthread, thread);
 	if (curthread && curthread->state == THREAD_RUNNING)
 	{
-#if 0
-		printf("[cpu %2" PRIu32 "] thread %p (%s) now paused\n",
-		       curcpu()->id, curthread, curthread->proc->name);
-#endif
 		curthread->state = THREAD_PAUSED;
 		sched_enqueue(curthread);
 	}
-#if 0
-	printf("[cpu %2" PRIu32 "] thread %p (%s) now running\n",
-	       curcpu()->id, thread, thread->proc->name);
-#endif
 	switch_thread(thread);
 }
 
@@ -184,12 +169,6 @@ static struct thread *find_runq_thread(uint32_t cpuid,
 		TAILQ_REMOVE(&runq->threads, thread, runq_chain);
 		break;
 	}
-#if 0
-	if (thread)
-		printf("[cpu %2" PRIu32 "] removed thread %p (%s; %#zx) from runq\n",
-		       curcpu()->id, thread, thread->proc->name,
-		       arch_get_instruction_pointer(&thread->tf_user));
-#endif
 	mutex_unlock(&runq->mutex);
 	return thread;
 }
@@ -199,15 +178,18 @@ static struct thread *find_thread(int ignoreidle)
 	struct thread *thread = find_runq_thread(curcpu()->id, ignoreidle);
 	if (thread && thread != curcpu()->idlethread)
 		return thread;
-	for (size_t i = 0; i < g_ncpus; ++i)
+	for (int remote = 0; remote < 2; ++remote)
 	{
-		if (i == curcpu()->id)
-			continue;
-		struct thread *other_thread = find_runq_thread(i, 1);
-		if (!other_thread)
-			continue;
-		sched_enqueue(thread);
-		return other_thread;
+		for (size_t i = 0; i < g_ncpus; ++i)
+		{
+			if (i == curcpu()->id || !steal_pass(i, remote))
+				continue;
+			struct thread *other_thread = find_runq_thread(i, 1);
+			if (!other_thread)
+				continue;
+			sched_enqueue(thread);
+			return other_thread;
+		}
 	}
 	return thread;
 }
@@ -245,12 +227,6 @@ static struct thread *find_better_runq_thread(uint32_t cpuid,
 		TAILQ_REMOVE(&runq->threads, thread, runq_chain);
 		break;
 	}
-#if 0
-	if (thread)
-		printf("[cpu %2" PRIu32 "] removed thread %p (%s; %#zx) from runq\n",
-		       curcpu()->id, thread, thread->proc->name,
-		       arch_get_instruction_pointer(&thread->tf_user));
-#endif
 	mutex_unlock(&runq->mutex);
 	return thread;
 }
@@ -262,15 +238,18 @@ static struct thread *find_better_thread(int ignoreidle)
 	struct thread *thread = find_better_runq_thread(cpu->id, curthread, ignoreidle);
 	if (thread && thread != cpu->idlethread)
 		return thread;
-	for (size_t i = 0; i < g_ncpus; ++i)
+	for (int remote = 0; remote < 2; ++remote)
 	{
-		if (i == cpu->id)
-			continue;
-		struct thread *other_thread = find_better_runq_thread(i,
-		                                                      curthread,
-		                                                      1);
-		if (other_thread)
-			return other_thread;
+		for (size_t i = 0; i < g_ncpus; ++i)
+		{
+			if (i == cpu->id || !steal_pass(i, remote))
+				continue;
+			struct thread *other_thread = find_better_runq_thread(i,
+			                                                      curthread,
+			                                                      1);
+			if (other_thread)
+				return other_thread;
+		}
 	}
 	return thread;
 }
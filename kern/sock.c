@@ -42,8 +42,10 @@ static ssize_t sock_read(struct file *file, struct uio *uio)
 	msg.msg_iovlen = uio->iovcnt;
 	msg.msg_control = NULL;
 	msg.msg_controllen = 0;
-	msg.msg_flags = 0;
-	return sock_recv(sock, &msg, 0);
+	msg.msg_flags = uio->userbuf ? 0 : MSG_KBUF;
+	return sock_recv(sock, &msg,
+	                 (file->flags & O_NONBLOCK) || uio->nonblock
+	                 ? MSG_DONTWAIT : 0);
 }
 
 static ssize_t sock_write(struct file *file, struct uio *uio)
@@ -58,8 +60,10 @@ static ssize_t sock_write(struct file *file, struct uio *uio)
 	msg.msg_iovlen = uio->iovcnt;
 	msg.msg_control = NULL;
 	msg.msg_controllen = 0;
-	msg.msg_flags = 0;
-	return sock_send(sock, &msg, 0);
+	msg.msg_flags = uio->userbuf ? 0 : MSG_KBUF;
+	return sock_send(sock, &msg,
+	                 (file->flags & O_NONBLOCK) || uio->nonblock
+	                 ? MSG_DONTWAIT : 0);
 }
 
 static off_t sock_seek(struct file *file, off_t off, int whence)
@@ -257,6 +261,28 @@ int sock_release(struct sock *sock)
 	return sock->op->release(sock);
 }
 
+int sock_test_addrlen(int family, socklen_t addrlen)
+{
+	switch (family)
+	{
+		case AF_INET:
+			if (addrlen < sizeof(struct sockaddr_in))
+				return -EINVAL;
+			break;
+		case AF_INET6:
+			if (addrlen < sizeof(struct sockaddr_in6))
+				return -EINVAL;
+			break;
+		case AF_UNIX:
+			if (addrlen < sizeof(struct sockaddr_un))
+				return -EINVAL;
+			break;
+		default:
+			return -EAFNOSUPPORT;
+	}
+	return 0;
+}
+
 int sock_bind(struct sock *sock, const struct sockaddr *addr, socklen_t addrlen)
 {
 	if (!sock->op || !sock->op->bind)
@@ -264,11 +290,11 @@ int sock_bind(struct sock *sock, const struct sockaddr *addr, socklen_t addrlen)
 	return sock->op->bind(sock, addr, addrlen);
 }
 
-int sock_accept(struct sock *sock, struct sock **child)
+int sock_accept(struct sock *sock, struct sock **child, int flags)
 {
 	if (!sock->op || !sock->op->accept)
 		return -EOPNOTSUPP;
-	return sock->op->accept(sock, child);
+	return sock->op->accept(sock, child, flags);
 }
 
 int sock_connect(struct sock *sock, const struct sockaddr *addr,
@@ -8,7 +8,9 @@
 
 #include <net/net.h>
 
+#include <tracepoint.h>
 #include <resource.h>
+#include <spawn.h>
 #include <syscall.h>
 #include <ptrace.h>
 #include <endian.h>
@@ -23,6 +25,7 @@
 #include <proc.h>
 #include <stat.h>
 #include <time.h>
+#include <uring.h>
 #include <pipe.h>
 #include <poll.h>
 #include <kmod.h>
@@ -209,26 +212,9 @@ static void rusage_from_stats(struct rusage *rusage, struct procstat *stats)
 	rusage->ru_nivcsw = 0;
 }
 
-static int test_sockaddr_len(int family, socklen_t addrlen)
+static int is_pipe(struct file *file)
 {
-	switch (family)
-	{
-		case AF_INET:
-			if (addrlen < sizeof(struct sockaddr_in))
-				return -EINVAL;
-			break;
-		case AF_INET6:
-			if (addrlen < sizeof(struct sockaddr_in6))
-				return -EINVAL;
-			break;
-		case AF_UNIX:
-			if (addrlen < sizeof(struct sockaddr_un))
-				return -EINVAL;
-			break;
-		default:
-			return -EAFNOSUPPORT;
-	}
-	return 0;
+	return file->node && S_ISFIFO(file->node->attr.mode);
 }
 
 ssize_t sys_exit(int code)
@@ -281,7 +267,9 @@ ssize_t sys_clone(int flags)
 	return newthread->tid;
 }
 
-ssize_t sys_readv(int fd, const struct iovec *uiov, int iovcnt)
+/* the file offset is used and updated if uoff is NULL */
+static ssize_t readv_at(int fd, const struct iovec *uiov, int iovcnt,
+                        const off_t *uoff)
 {
 	struct thread *thread = curcpu()->thread;
 	struct iovec iov[IOV_MAX];
@@ -289,6 +277,7 @@ ssize_t sys_readv(int fd, const struct iovec *uiov, int iovcnt)
 	struct uio uio;
 	ssize_t count;
 	ssize_t ret;
+	off_t off = 0;
 
 	if (iovcnt < 0 || iovcnt > IOV_MAX)
 		return -EINVAL;
@@ -301,6 +290,14 @@ ssize_t sys_readv(int fd, const struct iovec *uiov, int iovcnt)
 		if (__builtin_add_overflow(count, iov[i].iov_len, &count))
 			return -EINVAL;
 	}
+	if (uoff)
+	{
+		ret = vm_copyin(thread->proc->vm_space, &off, uoff, sizeof(off));
+		if (ret < 0)
+			return ret;
+		if (off < 0)
+			return -EINVAL;
+	}
 	ret = proc_getfile(thread->proc, fd, &file);
 	if (ret < 0)
 		return ret;
@@ -310,8 +307,14 @@ ssize_t sys_readv(int fd, const struct iovec *uiov, int iovcnt)
 		case O_RDWR:
 			break;
 		default:
+			file_free(file);
 			return -EBADF;
 	}
+	if (uoff && (file->sock || is_pipe(file)))
+	{
+		file_free(file);
+		return -ESPIPE;
+	}
 	if (file->node)
 	{
 		ret = update_node_times(file->node, FS_ATTR_ATIME);
@@ -324,16 +327,32 @@ ssize_t sys_readv(int fd, const struct iovec *uiov, int iovcnt)
 	uio.iov = iov;
 	uio.iovcnt = iovcnt;
 	uio.count = count;
-	uio.off = file->off;
+	uio.off = uoff ? off : file->off;
 	uio.userbuf = 1;
+	uio.nonblock = 0;
 	ret = file_read(file, &uio);
-	if (ret >= 0)
+	if (ret >= 0 && !uoff)
 		file->off = uio.off;
 	file_free(file);
 	return ret;
 }
 
-ssize_t sys_writev(int fd, const struct iovec *uiov, int iovcnt)
+ssize_t sys_readv(int fd, const struct iovec *uiov, int iovcnt)
+{
+	return readv_at(fd, uiov, iovcnt, NULL);
+}
+
+ssize_t sys_preadv(int fd, const struct iovec *uiov, int iovcnt,
+                   const off_t *uoff)
+{
+	if (!uoff)
+		return -EINVAL;
+	return readv_at(fd, uiov, iovcnt, uoff);
+}
+
+/* the file offset is used and updated if uoff is NULL */
+static ssize_t writev_at(int fd, const struct iovec *uiov, int iovcnt,
+                         const off_t *uoff)
 {
 	struct thread *thread = curcpu()->thread;
 	struct iovec iov[IOV_MAX];
@@ -341,6 +360,7 @@ ssize_t sys_writev(int fd, const struct iovec *uiov, int iovcnt)
 	struct uio uio;
 	ssize_t count;
 	ssize_t ret;
+	off_t off = 0;
 
 	if (iovcnt < 0 || iovcnt > IOV_MAX)
 		return -EINVAL;
@@ -353,6 +373,14 @@ ssize_t sys_writev(int fd, const struct iovec *uiov, int iovcnt)
 		if (__builtin_add_overflow(count, iov[i].iov_len, &count))
 			return -EINVAL;
 	}
+	if (uoff)
+	{
+		ret = vm_copyin(thread->proc->vm_space, &off, uoff, sizeof(off));
+		if (ret < 0)
+			return ret;
+		if (off < 0)
+			return -EINVAL;
+	}
 	ret = proc_getfile(thread->proc, fd, &file);
 	if (ret < 0)
 		return ret;
@@ -362,8 +390,14 @@ ssize_t sys_writev(int fd, const struct iovec *uiov, int iovcnt)
 		case O_RDWR:
 			break;
 		default:
+			file_free(file);
 			return -EBADF;
 	}
+	if (uoff && (file->sock || is_pipe(file)))
+	{
+		file_free(file);
+		return -ESPIPE;
+	}
 	if (file->node)
 	{
 		if (is_node_rofs(file->node))
@@ -383,20 +417,32 @@ ssize_t sys_writev(int fd, const struct iovec *uiov, int iovcnt)
 	uio.iov = iov;
 	uio.iovcnt = iovcnt;
 	uio.count = count;
-	uio.off = file->off;
+	uio.off = uoff ? off : file->off;
 	uio.userbuf = 1;
+	uio.nonblock = 0;
 	ret = file_write(file, &uio);
-	if (ret >= 0)
+	if (ret >= 0 && !uoff)
 		file->off = uio.off;
 	file_free(file);
 	return ret;
 }
 
-ssize_t sys_openat(int dirfd, const char *upathname, int flags,
-                   mode_t mode)
+ssize_t sys_writev(int fd, const struct iovec *uiov, int iovcnt)
+{
+	return writev_at(fd, uiov, iovcnt, NULL);
+}
+
+ssize_t sys_pwritev(int fd, const struct iovec *uiov, int iovcnt,
+                    const off_t *uoff)
+{
+	if (!uoff)
+		return -EINVAL;
+	return writev_at(fd, uiov, iovcnt, uoff);
+}
+
+static int open_file(struct thread *thread, int dirfd, const char *pathname,
+                     int flags, mode_t mode, struct file **filep)
 {
-	struct thread *thread = curcpu()->thread;
-	char pathname[MAXPATHLEN];
 	struct node *cwd;
 	struct node *node;
 	int ret;
@@ -414,10 +460,6 @@ ssize_t sys_openat(int dirfd, const char *upathname, int flags,
 	if ((flags & 3) == 3)
 		return -EINVAL;
 	/* XXX handle O_NOCTTY */
-	ret = vm_copystr(thread->proc->vm_space, pathname, upathname,
-	                 sizeof(pathname));
-	if (ret < 0)
-		return ret;
 	ret = getcwdat(thread, dirfd, pathname, 0, &cwd);
 	if (ret < 0)
 		return ret;
@@ -515,17 +557,34 @@ ssize_t sys_openat(int dirfd, const char *upathname, int flags,
 			return -EACCES;
 		}
 	}
-	struct file *file;
-	ret = file_fromnode(node, flags, &file);
+	ret = file_fromnode(node, flags, filep);
 	node_free(node);
 	if (ret < 0)
 		return ret;
-	ret = file_open(file, node);
+	ret = file_open(*filep, node);
 	if (ret < 0)
 	{
-		file_free(file);
+		file_free(*filep);
 		return ret;
 	}
+	return 0;
+}
+
+ssize_t sys_openat(int dirfd, const char *upathname, int flags,
+                   mode_t mode)
+{
+	struct thread *thread = curcpu()->thread;
+	char pathname[MAXPATHLEN];
+	struct file *file;
+	int ret;
+
+	ret = vm_copystr(thread->proc->vm_space, pathname, upathname,
+	                 sizeof(pathname));
+	if (ret < 0)
+		return ret;
+	ret = open_file(thread, dirfd, pathname, flags, mode, &file);
+	if (ret < 0)
+		return ret;
 	ret = proc_allocfd(thread->proc, file,
 	                   (flags & O_CLOEXEC) ? FD_CLOEXEC : 0);
 	file_free(file);
@@ -621,26 +680,8 @@ ssize_t sys_getegid()
 	return curcpu()->thread->proc->cred.egid;
 }
 
-ssize_t sys_setpgid(pid_t pid, pid_t pgid)
+static int setpgid_proc(struct proc *proc, pid_t pgid)
 {
-	if (pgid < 0)
-		return -EINVAL;
-	struct proc *proc;
-	if (!pid)
-	{
-		proc = curcpu()->thread->proc;
-	}
-	else
-	{
-		TAILQ_FOREACH(proc, &curcpu()->thread->proc->childs, child_chain)
-		{
-			if (proc->pid != pid)
-				continue;
-			break;
-		}
-		if (!proc)
-			return -ESRCH;
-	}
 	if (!pgid)
 		pgid = proc->pid;
 	struct pgrp *pgrp = getpgrp(pgid);
@@ -663,6 +704,29 @@ ssize_t sys_setpgid(pid_t pid, pid_t pgid)
 	return 0;
 }
 
+ssize_t sys_setpgid(pid_t pid, pid_t pgid)
+{
+	if (pgid < 0)
+		return -EINVAL;
+	struct proc *proc;
+	if (!pid)
+	{
+		proc = curcpu()->thread->proc;
+	}
+	else
+	{
+		TAILQ_FOREACH(proc, &curcpu()->thread->proc->childs, child_chain)
+		{
+			if (proc->pid != pid)
+				continue;
+			break;
+		}
+		if (!proc)
+			return -ESRCH;
+	}
+	return setpgid_proc(proc, pgid);
+}
+
 ssize_t sys_getppid()
 {
 	struct proc *parent = curcpu()->thread->proc->parent;
@@ -818,6 +882,23 @@ ssize_t sys_ioctl(int fd, unsigned long req, uintptr_t data)
 	return ret;
 }
 
+static void node_stat(struct node *node, struct stat *statbuf)
+{
+	statbuf->st_dev = node->sb ? node->sb->dev : 0;
+	statbuf->st_ino = node->ino;
+	statbuf->st_mode = node->attr.mode;
+	statbuf->st_nlink = node->nlink;
+	statbuf->st_uid = node->attr.uid;
+	statbuf->st_gid = node->attr.gid;
+	statbuf->st_rdev = node->rdev;
+	statbuf->st_size = node->attr.size;
+	statbuf->st_blksize = node->blksize;
+	statbuf->st_blocks = node->blocks;
+	statbuf->st_atim = node->attr.atime;
+	statbuf->st_mtim = node->attr.mtime;
+	statbuf->st_ctim = node->attr.ctime;
+}
+
 ssize_t sys_fstatat(int dirfd, const char *upathname,
                     struct stat *ustatbuf, int flags)
 {
@@ -836,73 +917,150 @@ ssize_t sys_fstatat(int dirfd, const char *upathname,
 	ret = getnodeat(thread, dirfd, pathname, flags, &node);
 	if (ret < 0)
 		return ret;
-	statbuf.st_dev = node->sb ? node->sb->dev : 0;
-	statbuf.st_ino = node->ino;
-	statbuf.st_mode = node->attr.mode;
-	statbuf.st_nlink = node->nlink;
-	statbuf.st_uid = node->attr.uid;
-	statbuf.st_gid = node->attr.gid;
-	statbuf.st_rdev = node->rdev;
-	statbuf.st_size = node->attr.size;
-	statbuf.st_blksize = node->blksize;
-	statbuf.st_blocks = node->blocks;
-	statbuf.st_atim = node->attr.atime;
-	statbuf.st_mtim = node->attr.mtime;
-	statbuf.st_ctim = node->attr.ctime;
+	node_stat(node, &statbuf);
 	node_free(node);
 	return vm_copyout(thread->proc->vm_space, ustatbuf, &statbuf,
 	                  sizeof(statbuf));
 }
 
+#define GETDENTS_BUF_SIZE     PAGE_SIZE
+#define GETDENTSPLUS_BUF_SIZE (64 * 1024)
+
+/* the entries are gathered in buf, which is copied out each time it's
+ * full (getdents) or once at the end (getdentsplus, which has to fill the
+ * attributes once the readdir is done)
+ * off is the size of the entries already given to the user and count the
+ * size of the user buffer
+ */
 struct getdents_ctx
 {
 	struct thread *thread;
-	struct fs_readdir_ctx readdir_ctx;
 	int res;
-	struct sys_dirent *dirp;
+	uint8_t *dirp;
 	size_t count;
 	size_t off;
+	uint8_t *buf;
+	size_t buf_size;
+	size_t buf_len;
 };
 
-static int getdents_fn(struct fs_readdir_ctx *ctx, const char *name,
-                       uint32_t namelen, off_t off, ino_t ino, uint32_t type)
+static int getdents_flush(struct getdents_ctx *getdents_ctx)
 {
-	/* XXX bufferize */
-	(void)off;
-	struct getdents_ctx *getdents_ctx = ctx->userdata;
-	uint32_t entry_size = offsetof(struct sys_dirent, name) + namelen;
-	struct sys_dirent dirent;
 	ssize_t ret;
 
-	if (entry_size > getdents_ctx->count)
-		return -EINVAL;
-	dirent.ino = ino;
-	dirent.off = getdents_ctx->off;
-	dirent.reclen = entry_size;
-	dirent.type = type;
-	ret = vm_copyout(getdents_ctx->thread->proc->vm_space, getdents_ctx->dirp,
-	                 &dirent, offsetof(struct sys_dirent, name));
+	if (!getdents_ctx->buf_len)
+		return 0;
+	ret = vm_copyout(getdents_ctx->thread->proc->vm_space,
+	                 getdents_ctx->dirp + getdents_ctx->off,
+	                 getdents_ctx->buf, getdents_ctx->buf_len);
 	if (ret < 0)
 	{
 		getdents_ctx->res = ret;
 		return ret;
 	}
-	ret = vm_copyout(getdents_ctx->thread->proc->vm_space,
-	                 (uint8_t*)getdents_ctx->dirp + offsetof(struct sys_dirent, name), name,
-	                 namelen);
-	if (ret < 0)
+	getdents_ctx->off += getdents_ctx->buf_len;
+	getdents_ctx->buf_len = 0;
+	return 0;
+}
+
+/* -EINVAL if the user buffer is full, which is an error only if it
+ * can't hold a single entry
+ */
+static int getdents_reserve(struct getdents_ctx *getdents_ctx,
+                            size_t entry_size, int flush)
+{
+	if (getdents_ctx->off + getdents_ctx->buf_len + entry_size
+	  > getdents_ctx->count)
 	{
-		getdents_ctx->res = ret;
-		return ret;
+		if (!getdents_ctx->off && !getdents_ctx->buf_len)
+			getdents_ctx->res = -EINVAL;
+		return -EINVAL;
+	}
+	if (getdents_ctx->buf_len + entry_size > getdents_ctx->buf_size)
+	{
+		if (!flush)
+			return -EINVAL;
+		return getdents_flush(getdents_ctx);
 	}
-	getdents_ctx->count -= entry_size;
-	getdents_ctx->dirp = (struct sys_dirent*)((char*)getdents_ctx->dirp
-	                                         + entry_size);
-	getdents_ctx->off += entry_size;
 	return 0;
 }
 
-ssize_t sys_getdents(int fd, struct sys_dirent *dirp, size_t count)
+static int getdents_fn(struct fs_readdir_ctx *ctx, const char *name,
+                       uint32_t namelen, off_t off, ino_t ino, uint32_t type)
+{
+	(void)off;
+	struct getdents_ctx *getdents_ctx = ctx->userdata;
+	size_t entry_size = offsetof(struct sys_dirent, name) + namelen;
+	struct sys_dirent *dirent;
+	int ret;
+
+	ret = getdents_reserve(getdents_ctx, entry_size, 1);
+	if (ret)
+		return ret;
+	dirent = (struct sys_dirent*)&getdents_ctx->buf[getdents_ctx->buf_len];
+	dirent->ino = ino;
+	dirent->off = getdents_ctx->off + getdents_ctx->buf_len;
+	dirent->reclen = entry_size;
+	dirent->type = type;
+	memcpy(dirent->name, name, namelen);
+	getdents_ctx->buf_len += entry_size;
+	return 0;
+}
+
+static int getdentsplus_fn(struct fs_readdir_ctx *ctx, const char *name,
+                           uint32_t namelen, off_t off, ino_t ino,
+                           uint32_t type)
+{
+	(void)off;
+	struct getdents_ctx *getdents_ctx = ctx->userdata;
+	size_t entry_size = offsetof(struct sys_direntplus, name) + namelen + 1;
+	struct sys_direntplus *dirent;
+	int ret;
+
+	entry_size = (entry_size + 7) & ~7;
+	ret = getdents_reserve(getdents_ctx, entry_size, 0);
+	if (ret)
+		return ret;
+	dirent = (struct sys_direntplus*)&getdents_ctx->buf[getdents_ctx->buf_len];
+	memset(dirent, 0, entry_size);
+	dirent->st.st_ino = ino;
+	dirent->off = getdents_ctx->off + getdents_ctx->buf_len;
+	dirent->reclen = entry_size;
+	dirent->type = type;
+	memcpy(dirent->name, name, namelen);
+	getdents_ctx->buf_len += entry_size;
+	return 0;
+}
+
+/* the lookups can't be done from the readdir callback, the filesystem
+ * possibly holding its locks
+ */
+static void getdentsplus_stat(struct node *dir,
+                              struct getdents_ctx *getdents_ctx)
+{
+	for (size_t i = 0; i < getdents_ctx->buf_len;)
+	{
+		struct sys_direntplus *dirent;
+		struct node *child;
+
+		dirent = (struct sys_direntplus*)&getdents_ctx->buf[i];
+		i += dirent->reclen;
+		if (node_lookup(dir, dirent->name, strlen(dirent->name), &child))
+			continue;
+		if (S_ISDIR(child->attr.mode) && child->mount)
+		{
+			struct node *root = child->mount->root;
+			node_ref(root);
+			node_free(child);
+			child = root;
+		}
+		node_stat(child, &dirent->st);
+		dirent->flags |= DIRENTPLUS_STAT;
+		node_free(child);
+	}
+}
+
+static ssize_t getdents(int fd, void *dirp, size_t count, int plus)
 {
 	struct thread *thread = curcpu()->thread;
 	struct file *file;
@@ -911,6 +1069,8 @@ ssize_t sys_getdents(int fd, struct sys_dirent *dirp, size_t count)
 	struct fs_readdir_ctx readdir_ctx;
 	ssize_t ret;
 
+	if (!count)
+		return -EINVAL;
 	ret = proc_getfile(thread->proc, fd, &file);
 	if (ret < 0)
 		return ret;
@@ -925,16 +1085,33 @@ ssize_t sys_getdents(int fd, struct sys_dirent *dirp, size_t count)
 		file_free(file);
 		return -ENOTDIR;
 	}
-	readdir_ctx.fn = getdents_fn;
-	readdir_ctx.off = file->off;
-	readdir_ctx.userdata = &getdents_ctx;
+	getdents_ctx.thread = thread;
 	getdents_ctx.res = 0;
 	getdents_ctx.dirp = dirp;
 	getdents_ctx.count = count;
 	getdents_ctx.off = 0;
-	getdents_ctx.thread = thread;
+	getdents_ctx.buf_size = plus ? GETDENTSPLUS_BUF_SIZE : GETDENTS_BUF_SIZE;
+	if (getdents_ctx.buf_size > count)
+		getdents_ctx.buf_size = count;
+	getdents_ctx.buf_len = 0;
+	getdents_ctx.buf = malloc(getdents_ctx.buf_size, 0);
+	if (!getdents_ctx.buf)
+	{
+		file_free(file);
+		return -ENOMEM;
+	}
+	readdir_ctx.fn = plus ? getdentsplus_fn : getdents_fn;
+	readdir_ctx.off = file->off;
+	readdir_ctx.userdata = &getdents_ctx;
 	ret = node_readdir(node, &readdir_ctx);
 	file->off = readdir_ctx.off;
+	if (ret >= 0 && !getdents_ctx.res)
+	{
+		if (plus)
+			getdentsplus_stat(node, &getdents_ctx);
+		getdents_flush(&getdents_ctx);
+	}
+	free(getdents_ctx.buf);
 	file_free(file);
 	if (ret < 0)
 		return ret;
@@ -943,6 +1120,53 @@ ssize_t sys_getdents(int fd, struct sys_dirent *dirp, size_t count)
 	return getdents_ctx.off;
 }
 
+ssize_t sys_getdents(int fd, struct sys_dirent *dirp, size_t count)
+{
+	return getdents(fd, dirp, count, 0);
+}
+
+ssize_t sys_getdentsplus(int fd, struct sys_direntplus *dirp, size_t count)
+{
+	return getdents(fd, dirp, count, 1);
+}
+
+static int exec_open(struct thread *thread, int dirfd, const char *pathname,
+                     int flags, struct file **filep)
+{
+	struct node *node;
+	int ret;
+
+	ret = getnodeat(thread, dirfd, pathname, flags, &node);
+	if (ret < 0)
+		return ret;
+	if (!(vfs_getperm(node, thread->proc->cred.euid, thread->proc->cred.egid) & X_OK))
+	{
+		node_free(node);
+		return -EACCES;
+	}
+	if (node->sb && (node->sb->flags & ST_NOEXEC))
+	{
+		node_free(node);
+		return -EACCES;
+	}
+	if (!S_ISREG(node->attr.mode))
+	{
+		node_free(node);
+		return -EACCES;
+	}
+	ret = file_fromnode(node, O_RDONLY, filep);
+	node_free(node);
+	if (ret < 0)
+		return ret;
+	ret = file_open(*filep, node);
+	if (ret < 0)
+	{
+		file_free(*filep);
+		return ret;
+	}
+	return 0;
+}
+
 ssize_t sys_execveat(int dirfd, const char *upathname,
                      const char * const *uargv,
                      const char * const *uenvp,
@@ -951,7 +1175,6 @@ ssize_t sys_execveat(int dirfd, const char *upathname,
 	struct thread *thread = curcpu()->thread;
 	char pathname[MAXPATHLEN];
 	struct file *file;
-	struct node *node;
 	ssize_t ret;
 
 	if (flags & ~(AT_SYMLINK_NOFOLLOW | AT_EMPTY_PATH))
@@ -966,41 +1189,184 @@ ssize_t sys_execveat(int dirfd, const char *upathname,
 	ret = vm_verifystra(thread->proc->vm_space, uenvp);
 	if (ret < 0)
 		return ret;
-	ret = getnodeat(thread, dirfd, pathname, flags, &node);
+	ret = exec_open(thread, dirfd, pathname, flags, &file);
 	if (ret < 0)
 		return ret;
-	if (!(vfs_getperm(node, thread->proc->cred.euid, thread->proc->cred.egid) & X_OK))
+	ret = uproc_execve(thread, file, pathname[0] ? pathname : NULL, uargv, uenvp);
+	file_free(file);
+	if (ret < 0)
+		return ret;
+	if (thread->proc->vfork_rel)
+		proc_wakeup_vfork(thread->proc->vfork_rel);
+	return arch_get_syscall_retval(&thread->tf_user);
+}
+
+static int spawn_actions(struct proc *proc,
+                         const struct spawn_file_action *actions,
+                         struct file **files, size_t actions_nb)
+{
+	struct file *file;
+	int ret;
+
+	for (size_t i = 0; i < actions_nb; ++i)
 	{
-		node_free(node);
-		return -EACCES;
+		const struct spawn_file_action *action = &actions[i];
+		switch (action->type)
+		{
+			case SPAWN_FA_CLOSE:
+				ret = proc_freefd(proc, action->fd);
+				if (ret < 0)
+					return ret;
+				break;
+			case SPAWN_FA_DUP2:
+				ret = proc_getfile(proc, action->srcfd, &file);
+				if (ret < 0)
+					return ret;
+				ret = proc_setfd(proc, action->fd, file, 0);
+				file_free(file);
+				if (ret < 0)
+					return ret;
+				break;
+			case SPAWN_FA_OPEN:
+				ret = proc_setfd(proc, action->fd, files[i],
+				                 (action->flags & O_CLOEXEC) ? FD_CLOEXEC : 0);
+				if (ret < 0)
+					return ret;
+				break;
+		}
 	}
-	if (node->sb && (node->sb->flags & ST_NOEXEC))
+	return 0;
+}
+
+/* the child shares the address space of the parent until its exec, which
+ * is done from here: nothing of the parent is duplicated but the fds,
+ * and the errors are reported before the child is ever run
+ * the files of the open actions are opened beforehand, from the parent
+ * which has the same cwd and credentials
+ */
+ssize_t sys_spawn(const char *upathname, const struct spawn_attr *uattr,
+                  const char * const *uargv, const char * const *uenvp)
+{
+	struct thread *thread = curcpu()->thread;
+	char pathname[MAXPATHLEN];
+	struct spawn_attr attr;
+	struct spawn_file_action *actions = NULL;
+	struct file **files = NULL;
+	struct file *file = NULL;
+	struct thread *newthread;
+	struct proc *newp;
+	ssize_t ret;
+
+	ret = vm_copystr(thread->proc->vm_space, pathname, upathname,
+	                 sizeof(pathname));
+	if (ret < 0)
+		return ret;
+	ret = vm_verifystra(thread->proc->vm_space, uargv);
+	if (ret < 0)
+		return ret;
+	ret = vm_verifystra(thread->proc->vm_space, uenvp);
+	if (ret < 0)
+		return ret;
+	if (uattr)
 	{
-		node_free(node);
-		return -EACCES;
+		ret = vm_copyin(thread->proc->vm_space, &attr, uattr,
+		                sizeof(attr));
+		if (ret < 0)
+			return ret;
 	}
-	if (!S_ISREG(node->attr.mode))
+	else
 	{
-		node_free(node);
-		return -EACCES;
+		memset(&attr, 0, sizeof(attr));
 	}
-	ret = file_fromnode(node, O_RDONLY, &file);
-	node_free(node);
+	if (attr.flags & ~(SPAWN_SETPGROUP | SPAWN_SETSIGMASK | SPAWN_SETSIGDEF))
+		return -EINVAL;
+	if ((attr.flags & SPAWN_SETPGROUP) && attr.pgroup < 0)
+		return -EINVAL;
+	if (attr.actions_nb > SPAWN_ACTIONS_MAX)
+		return -EINVAL;
+	if (attr.actions_nb)
+	{
+		actions = malloc(sizeof(*actions) * attr.actions_nb, 0);
+		files = malloc(sizeof(*files) * attr.actions_nb, M_ZERO);
+		if (!actions || !files)
+		{
+			ret = -ENOMEM;
+			goto end;
+		}
+		ret = vm_copyin(thread->proc->vm_space, actions, attr.actions,
+		                sizeof(*actions) * attr.actions_nb);
+		if (ret < 0)
+			goto end;
+	}
+	/* resolve the image first: posix_spawnp tries each PATH entry, the
+	 * files of the actions (fifos, ttys) mustn't be opened for a miss
+	 */
+	ret = exec_open(thread, AT_FDCWD, pathname, 0, &file);
 	if (ret < 0)
-		return ret;
-	ret = file_open(file, node);
+		goto end;
+	for (size_t i = 0; i < attr.actions_nb; ++i)
+	{
+		char path[MAXPATHLEN];
+		switch (actions[i].type)
+		{
+			case SPAWN_FA_CLOSE:
+			case SPAWN_FA_DUP2:
+				break;
+			case SPAWN_FA_OPEN:
+				ret = vm_copystr(thread->proc->vm_space, path,
+				                 actions[i].path, sizeof(path));
+				if (ret < 0)
+					goto end;
+				ret = open_file(thread, AT_FDCWD, path, actions[i].flags,
+				                actions[i].mode, &files[i]);
+				if (ret < 0)
+					goto end;
+				break;
+			default:
+				ret = -EINVAL;
+				goto end;
+		}
+	}
+	ret = uproc_clone(thread, CLONE_VM, &newthread);
+	if (ret < 0)
+		goto end;
+	newp = newthread->proc;
+	ret = spawn_actions(newp, actions, files, attr.actions_nb);
 	if (ret < 0)
+		goto err;
+	if (attr.flags & SPAWN_SETPGROUP)
+	{
+		ret = setpgid_proc(newp, attr.pgroup);
+		if (ret < 0)
+			goto err;
+	}
+	if (attr.flags & SPAWN_SETSIGMASK)
 	{
+		uint64_t mask = le64dec(attr.sigmask.set);
+		mask &= ~(1 << SIGKILL);
+		mask &= ~(1 << SIGSTOP);
+		newthread->sigmask = mask;
+	}
+	ret = uproc_execve(newthread, file, pathname, uargv, uenvp);
+	if (ret < 0)
+		goto err;
+	ret = newthread->tid;
+	sched_run(newthread);
+	goto end;
+
+err:
+	uproc_discard(newp);
+end:
+	if (file)
 		file_free(file);
-		return ret;
+	for (size_t i = 0; files && i < attr.actions_nb; ++i)
+	{
+		if (files[i])
+			file_free(files[i]);
 	}
-	ret = uproc_execve(thread, file, pathname[0] ? pathname : NULL, uargv, uenvp);
-	file_free(file);
-	if (ret < 0)
-		return ret;
-	if (thread->proc->vfork_rel)
-		proc_wakeup_vfork(thread->proc->vfork_rel);
-	return arch_get_syscall_retval(&thread->tf_user);
+	free(files);
+	free(actions);
+	return ret;
 }
 
 ssize_t sys_lseek(int fd, off_t *uoff, int whence)
@@ -1051,8 +1417,6 @@ void *sys_mmap(void *uaddr, size_t len, int prot, int flags, int fd, off_t *uoff
 		return (void*)-EINVAL;
 	if ((flags & MAP_FIXED) && (!uaddr || ((uintptr_t)uaddr & PAGE_MASK)))
 		return (void*)-EINVAL;
-	if (flags & MAP_SHARED) /* XXX */
-		return (void*)-EINVAL;
 	if (uoff)
 	{
 		ret = vm_copyin(thread->proc->vm_space, &off, uoff, sizeof(off));
@@ -1080,6 +1444,12 @@ void *sys_mmap(void *uaddr, size_t len, int prot, int flags, int fd, off_t *uoff
 		ret = proc_getfile(thread->proc, fd, &file);
 		if (ret)
 			return (void*)(intptr_t)ret;
+		if ((flags & MAP_SHARED) && (prot & PROT_WRITE)
+		 && (file->flags & 3) != O_RDWR)
+		{
+			file_free(file);
+			return (void*)-EACCES;
+		}
 	}
 	/* XXX really ? */
 	if (len & PAGE_MASK)
@@ -1131,6 +1501,20 @@ void *sys_mmap(void *uaddr, size_t len, int prot, int flags, int fd, off_t *uoff
 			goto end;
 		}
 	}
+	/* shared regular files and anonymous memory get the pages of a cache,
+	 * devices keep handing their own
+	 */
+	if ((flags & MAP_SHARED)
+	 && (!file || (file->node && S_ISREG(file->node->attr.mode))))
+	{
+		ret = vm_cache_attach(zone, file);
+		if (ret < 0)
+		{
+			vm_free(vm_space, zone->addr, zone->size);
+			addr = ret;
+			goto end;
+		}
+	}
 	if (flags & MAP_POPULATE)
 	{
 		ret = vm_populate(vm_space, zone->addr, zone->size);
@@ -1188,6 +1572,7 @@ ssize_t sys_readlinkat(int dirfd, const char *upathname, char *buf,
 	uio.count = bufsize;
 	uio.off = 0;
 	uio.userbuf = 1;
+	uio.nonblock = 0;
 	ret = node_readlink(node, &uio);
 	node_free(node);
 	return ret;
@@ -1226,34 +1611,9 @@ ssize_t sys_dup3(int oldfd, int newfd, int flags)
 		file_free(file);
 		return newfd;
 	}
-	if ((unsigned)newfd < thread->proc->files_nb)
-	{
-		rwlock_wrlock(&thread->proc->files_lock);
-		struct filedesc *prv = &thread->proc->files[newfd];
-		if (prv->file)
-			file_free(prv->file);
-		thread->proc->files[newfd].file = file;
-		thread->proc->files[newfd].cloexec = flags;
-		rwlock_unlock(&thread->proc->files_lock);
-		return newfd;
-	}
-	/* XXX set a maximum bound (ulimit pls) */
-	rwlock_wrlock(&thread->proc->files_lock);
-	struct filedesc *fd = realloc(thread->proc->files,
-	                              sizeof(*thread->proc->files) * (newfd + 1),
-	                              M_ZERO);
-	if (!fd)
-	{
-		rwlock_unlock(&thread->proc->files_lock);
-		file_free(file);
-		return -ENOMEM;
-	}
-	thread->proc->files = fd;
-	thread->proc->files_nb = newfd + 1;
-	thread->proc->files[newfd].file = file;
-	thread->proc->files[newfd].cloexec = flags;
-	rwlock_unlock(&thread->proc->files_lock);
-	return newfd;
+	ret = proc_setfd(thread->proc, newfd, file, flags);
+	file_free(file);
+	return ret;
 }
 
 static int wait_predicate(struct thread *child, int *wstatus,
@@ -1525,14 +1885,14 @@ ssize_t sys_kill(pid_t pid, int sig)
 	if (pid == -1)
 	{
 		struct proc *proc;
-		spinlock_lock(&g_proc_list_lock);
+		rwlock_rdlock(&g_proc_list_lock);
 		TAILQ_FOREACH(proc, &g_proc_list, chain)
 		{
 			if (proc->pid == 1 || proc == self)
 				continue;
 			send_signal(self, proc, sig);
 		}
-		spinlock_unlock(&g_proc_list_lock);
+		rwlock_unlock(&g_proc_list_lock);
 		return 0;
 	}
 	if (pid < 0)
@@ -1619,7 +1979,7 @@ ssize_t sys_bind(int fd, const struct sockaddr *uaddr, socklen_t addrlen)
 		ret = -EAFNOSUPPORT;
 		goto end;
 	}
-	ret = test_sockaddr_len(addr.sa.sa_family, addrlen);
+	ret = sock_test_addrlen(addr.sa.sa_family, addrlen);
 	if (ret < 0)
 		goto end;
 	sock_lock(sock);
@@ -1649,7 +2009,7 @@ ssize_t sys_accept(int fd, struct sockaddr *uaddr, socklen_t *uaddrlen)
 	ret = getsock(thread, fd, &sock);
 	if (ret < 0)
 		return ret;
-	ret = sock_accept(sock, &child);
+	ret = sock_accept(sock, &child, 0);
 	sock_free(sock);
 	if (ret < 0)
 		return ret;
@@ -1722,7 +2082,7 @@ ssize_t sys_connect(int fd, const struct sockaddr *uaddr,
 		ret = -EAFNOSUPPORT;
 		goto end;
 	}
-	ret = test_sockaddr_len(addr.sa.sa_family, addrlen);
+	ret = sock_test_addrlen(addr.sa.sa_family, addrlen);
 	if (ret < 0)
 		goto end;
 	sock_lock(sock);
@@ -1780,11 +2140,14 @@ ssize_t sys_mprotect(void *addr, size_t len, int prot)
 
 ssize_t sys_msync(void *addr, size_t length, int flags)
 {
-	(void)addr;
-	(void)length;
-	(void)flags;
-	/* XXX */
-	return -ENOSYS;
+	struct thread *thread = curcpu()->thread;
+	struct vm_space *vm_space = thread->proc->vm_space;
+	ssize_t ret;
+
+	mutex_lock(&vm_space->mutex);
+	ret = vm_msync(vm_space, (uintptr_t)addr, length, flags);
+	mutex_unlock(&vm_space->mutex);
+	return ret;
 }
 
 ssize_t sys_unlinkat(int dirfd, const char *upathname, int flags)
@@ -2673,7 +3036,8 @@ ssize_t sys_fcntl(int fd, int cmd, uintptr_t data)
 		case F_GETFD:
 		{
 			rwlock_wrlock(&thread->proc->files_lock);
-			if (fd < 0 || (size_t)fd >= thread->proc->files_nb)
+			if (fd < 0 || (size_t)fd >= thread->proc->files_nb
+			 || !thread->proc->files[fd].file)
 			{
 				rwlock_unlock(&thread->proc->files_lock);
 				return -EBADF;
@@ -2685,7 +3049,8 @@ ssize_t sys_fcntl(int fd, int cmd, uintptr_t data)
 		case F_SETFD:
 		{
 			rwlock_wrlock(&thread->proc->files_lock);
-			if (fd < 0 || (size_t)fd >= thread->proc->files_nb)
+			if (fd < 0 || (size_t)fd >= thread->proc->files_nb
+			 || !thread->proc->files[fd].file)
 			{
 				rwlock_unlock(&thread->proc->files_lock);
 				return -EBADF;
@@ -3604,9 +3969,11 @@ ssize_t sys_fsync(int fd)
 	ret = proc_getfile(thread->proc, fd, &file);
 	if (ret < 0)
 		return ret;
-	/* XXX */
+	/* XXX only the shared mappings are written back */
+	if (file->node && file->node->cache)
+		ret = vm_cache_sync(file->node->cache, 0, SIZE_MAX);
 	file_free(file);
-	return 0;
+	return ret;
 }
 
 ssize_t sys_fdatasync(int fd)
@@ -3618,11 +3985,359 @@ ssize_t sys_fdatasync(int fd)
 	ret = proc_getfile(thread->proc, fd, &file);
 	if (ret < 0)
 		return ret;
-	/* XXX */
+	/* XXX only the shared mappings are written back */
+	if (file->node && file->node->cache)
+		ret = vm_cache_sync(file->node->cache, 0, SIZE_MAX);
 	file_free(file);
+	return ret;
+}
+
+ssize_t sys_sync(void)
+{
+	return vm_cache_sync_all();
+}
+
+ssize_t sys_pagedaemon(void)
+{
+	struct thread *thread = curcpu()->thread;
+
+	if (thread->proc->cred.euid)
+		return -EPERM;
+	return vm_pagedaemon();
+}
+
+static ssize_t swapctl(const char *upathname, int on)
+{
+	struct thread *thread = curcpu()->thread;
+	char pathname[MAXPATHLEN];
+	struct node *node;
+	ssize_t ret;
+
+	if (thread->proc->cred.euid)
+		return -EPERM;
+	ret = vm_copystr(thread->proc->vm_space, pathname, upathname,
+	                 sizeof(pathname));
+	if (ret < 0)
+		return ret;
+	ret = getnodeat(thread, AT_FDCWD, pathname, 0, &node);
+	if (ret < 0)
+		return ret;
+	if (on)
+		ret = swap_on(node);
+	else
+		ret = swap_off(node);
+	node_free(node);
+	return ret;
+}
+
+ssize_t sys_swapon(const char *upathname, int flags)
+{
+	if (flags)
+		return -EINVAL;
+	return swapctl(upathname, 1);
+}
+
+ssize_t sys_swapoff(const char *upathname)
+{
+	return swapctl(upathname, 0);
+}
+
+ssize_t sys_getcpu(unsigned *ucpu, unsigned *unode)
+{
+	struct thread *thread = curcpu()->thread;
+	unsigned cpu = curcpu()->id;
+	unsigned node = curcpu()->node;
+	ssize_t ret;
+
+	if (ucpu)
+	{
+		ret = vm_copyout(thread->proc->vm_space, ucpu, &cpu,
+		                 sizeof(cpu));
+		if (ret < 0)
+			return ret;
+	}
+	if (unode)
+	{
+		ret = vm_copyout(thread->proc->vm_space, unode, &node,
+		                 sizeof(node));
+		if (ret < 0)
+			return ret;
+	}
+	return 0;
+}
+
+static int splice_files(int fd_in, int fd_out, struct file **in,
+                        struct file **out)
+{
+	struct thread *thread = curcpu()->thread;
+	ssize_t ret;
+
+	ret = proc_getfile(thread->proc, fd_in, in);
+	if (ret < 0)
+		return ret;
+	ret = proc_getfile(thread->proc, fd_out, out);
+	if (ret < 0)
+	{
+		file_free(*in);
+		return ret;
+	}
+	if (((*in)->flags & 3) == O_WRONLY
+	 || ((*out)->flags & 3) == O_RDONLY)
+	{
+		file_free(*in);
+		file_free(*out);
+		return -EBADF;
+	}
 	return 0;
 }
 
+/* the given offset is used and updated instead of the one of the file */
+static int splice_getoff(struct file *file, const off_t *uoff, off_t *off)
+{
+	struct thread *thread = curcpu()->thread;
+
+	if (!uoff)
+	{
+		*off = file->off;
+		return 0;
+	}
+	if (is_pipe(file))
+		return -ESPIPE;
+	return vm_copyin(thread->proc->vm_space, off, uoff, sizeof(*off));
+}
+
+static int splice_putoff(struct file *file, off_t *uoff, off_t off)
+{
+	struct thread *thread = curcpu()->thread;
+
+	if (!uoff)
+	{
+		file->off = off;
+		return 0;
+	}
+	return vm_copyout(thread->proc->vm_space, uoff, &off, sizeof(off));
+}
+
+static ssize_t copy_pages(struct file *in, off_t *in_off, struct file *out,
+                          off_t *out_off, size_t count)
+{
+	size_t done = 0;
+	ssize_t ret = 0;
+	while (done < count)
+	{
+		size_t pgoff = *in_off & PAGE_MASK;
+		size_t size = count - done;
+		if (size > PAGE_SIZE - pgoff)
+			size = PAGE_SIZE - pgoff;
+		struct page *page;
+		size_t poff;
+		ret = file_read_page(in, in_off, size, &page, &poff);
+		if (ret <= 0)
+			break;
+		size_t rd = ret;
+		ret = file_write_page(out, out_off, page, poff, rd);
+		pm_free_page(page);
+		if (ret <= 0)
+		{
+			*in_off -= rd;
+			break;
+		}
+		done += ret;
+		if ((size_t)ret < rd)
+		{
+			*in_off -= rd - ret;
+			break;
+		}
+		if (rd < size)
+			break;
+	}
+	if (!done)
+		return ret;
+	return done;
+}
+
+ssize_t sys_sendfile(int out_fd, int in_fd, off_t *uoffset, size_t count)
+{
+	struct file *in;
+	struct file *out;
+	off_t off;
+	ssize_t ret;
+
+	ret = splice_files(in_fd, out_fd, &in, &out);
+	if (ret < 0)
+		return ret;
+	if (is_pipe(in))
+	{
+		ret = -EINVAL;
+		goto end;
+	}
+	ret = splice_getoff(in, uoffset, &off);
+	if (ret < 0)
+		goto end;
+	/* pipes get references to the pages, the other files a copy */
+	if (is_pipe(out))
+		ret = pipe_splice_from(out, in, &off, count, 0);
+	else
+		ret = copy_pages(in, &off, out, &out->off, count);
+	if (ret > 0)
+	{
+		int res = splice_putoff(in, uoffset, off);
+		if (res)
+			ret = res;
+	}
+
+end:
+	file_free(in);
+	file_free(out);
+	return ret;
+}
+
+ssize_t sys_splice(int fd_in, off_t *uoff_in, int fd_out, off_t *uoff_out,
+                   size_t len, int flags)
+{
+	struct file *in;
+	struct file *out;
+	off_t off;
+	ssize_t ret;
+
+	if (flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE
+	            | SPLICE_F_GIFT))
+		return -EINVAL;
+	ret = splice_files(fd_in, fd_out, &in, &out);
+	if (ret < 0)
+		return ret;
+	if (is_pipe(in) && is_pipe(out))
+	{
+		if (uoff_in || uoff_out)
+			ret = -ESPIPE;
+		else
+			ret = pipe_splice(in, out, len, flags);
+	}
+	else if (is_pipe(in))
+	{
+		if (uoff_in)
+		{
+			ret = -ESPIPE;
+			goto end;
+		}
+		ret = splice_getoff(out, uoff_out, &off);
+		if (ret < 0)
+			goto end;
+		ret = pipe_splice_to(in, out, &off, len, flags);
+		if (ret > 0)
+		{
+			int res = splice_putoff(out, uoff_out, off);
+			if (res)
+				ret = res;
+		}
+	}
+	else if (is_pipe(out))
+	{
+		if (uoff_out)
+		{
+			ret = -ESPIPE;
+			goto end;
+		}
+		ret = splice_getoff(in, uoff_in, &off);
+		if (ret < 0)
+			goto end;
+		ret = pipe_splice_from(out, in, &off, len, flags);
+		if (ret > 0)
+		{
+			int res = splice_putoff(in, uoff_in, off);
+			if (res)
+				ret = res;
+		}
+	}
+	else
+	{
+		ret = -EINVAL;
+	}
+
+end:
+	file_free(in);
+	file_free(out);
+	return ret;
+}
+
+ssize_t sys_tee(int fd_in, int fd_out, size_t len, int flags)
+{
+	struct file *in;
+	struct file *out;
+	ssize_t ret;
+
+	if (flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE
+	            | SPLICE_F_GIFT))
+		return -EINVAL;
+	ret = splice_files(fd_in, fd_out, &in, &out);
+	if (ret < 0)
+		return ret;
+	if (is_pipe(in) && is_pipe(out))
+		ret = pipe_tee(in, out, len, flags);
+	else
+		ret = -EINVAL;
+	file_free(in);
+	file_free(out);
+	return ret;
+}
+
+ssize_t sys_uring_setup(uint32_t entries, struct uring_params *uparams)
+{
+	struct thread *thread = curcpu()->thread;
+	struct uring_params params;
+	struct file *file;
+	ssize_t ret;
+	int fd;
+
+	ret = vm_copyin(thread->proc->vm_space, &params, uparams,
+	                sizeof(params));
+	if (ret < 0)
+		return ret;
+	ret = uring_setup(entries, &params, &file);
+	if (ret < 0)
+		return ret;
+	ret = proc_allocfd(thread->proc, file, FD_CLOEXEC);
+	file_free(file);
+	if (ret < 0)
+		return ret;
+	fd = ret;
+	ret = vm_copyout(thread->proc->vm_space, uparams, &params,
+	                 sizeof(params));
+	if (ret < 0)
+	{
+		proc_freefd(thread->proc, fd);
+		return ret;
+	}
+	return fd;
+}
+
+ssize_t sys_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete,
+                        uint32_t flags, const struct timespec *utimeout)
+{
+	struct thread *thread = curcpu()->thread;
+	struct timespec timeout;
+	struct file *file;
+	ssize_t ret;
+
+	if (utimeout)
+	{
+		ret = vm_copyin(thread->proc->vm_space, &timeout, utimeout,
+		                sizeof(timeout));
+		if (ret < 0)
+			return ret;
+		ret = timespec_validate(&timeout);
+		if (ret < 0)
+			return ret;
+	}
+	ret = proc_getfile(thread->proc, fd, &file);
+	if (ret < 0)
+		return ret;
+	ret = uring_enter(file, to_submit, min_complete, flags,
+	                  utimeout ? &timeout : NULL);
+	file_free(file);
+	return ret;
+}
+
 ssize_t sys_getrusage(int who, struct rusage *urusage)
 {
 	struct thread *thread = curcpu()->thread;
@@ -3924,11 +4639,11 @@ ssize_t sys_sigaltstack(const stack_t *uss, stack_t *uold_ss)
 
 ssize_t sys_madvise(void *uaddr, size_t len, int advise)
 {
-	(void)uaddr;
-	(void)len;
-	(void)advise;
-	/* XXX */
-	return 0;
+	struct vm_space *vm_space = curcpu()->thread->proc->vm_space;
+	mutex_lock(&vm_space->mutex);
+	int ret = vm_advise(vm_space, (uintptr_t)uaddr, len, advise);
+	mutex_unlock(&vm_space->mutex);
+	return ret;
 }
 
 ssize_t sys_getrlimit(int res, struct rlimit *ulimit)
@@ -4164,6 +4879,20 @@ static const struct
 	SYSCALL_DEF(socketpair),
 	SYSCALL_DEF(sigpending),
 	SYSCALL_DEF(reboot),
+	SYSCALL_DEF(sync),
+	SYSCALL_DEF(pagedaemon),
+	SYSCALL_DEF(swapon),
+	SYSCALL_DEF(swapoff),
+	SYSCALL_DEF(getcpu),
+	SYSCALL_DEF(sendfile),
+	SYSCALL_DEF(splice),
+	SYSCALL_DEF(tee),
+	SYSCALL_DEF(preadv),
+	SYSCALL_DEF(pwritev),
+	SYSCALL_DEF(uring_setup),
+	SYSCALL_DEF(uring_enter),
+	SYSCALL_DEF(getdentsplus),
+	SYSCALL_DEF(spawn),
 #undef SYSCALL_DEF
 };
 
@@ -4200,12 +4929,22 @@ uintptr_t syscall(uintptr_t id, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3,
 	clock_gettime(CLOCK_MONOTONIC, &start);
 #endif
 #endif
+	uint64_t tp_start = 0;
+	if (tp_enabled(TP_SYSCALL_ENTER))
+	{
+		uintptr_t args[6] = {arg1, arg2, arg3, arg4, arg5, arg6};
+		tp_syscall_enter_emit(id, args);
+	}
+	if (tp_enabled(TP_SYSCALL_EXIT))
+		tp_start = tp_time();
 	uintptr_t ret;
 	if (id < sizeof(syscalls) / sizeof(*syscalls)
 	 && syscalls[id].fn)
 		ret = syscalls[id].fn(arg1, arg2, arg3, arg4, arg5, arg6);
 	else
 		ret = -ENOSYS;
+	if (tp_enabled(TP_SYSCALL_EXIT))
+		tp_syscall_exit_emit(id, ret, tp_start);
 
 #if DEBUG_SYSCALL == 1
 #if DEBUG_SYSCALL_TIME == 1
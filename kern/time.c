@@ -72,6 +72,13 @@ int clock_settime(int clock, struct timespec *ts)
 	return source->settime(ts);
 }
 
+const struct clock_counter *clock_get_counter(void)
+{
+	if (!clock_monotonic)
+		return NULL;
+	return clock_monotonic->counter;
+}
+
 time_t realtime_seconds(void)
 {
 	struct timespec ts;
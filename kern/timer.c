@@ -1,54 +1,193 @@
 #include <spinlock.h>
 #include <timer.h>
+#include <cpu.h>
 #include <std.h>
 
-static struct spinlock timers_lock = SPINLOCK_INITIALIZER();
-static TAILQ_HEAD(, timer) timers = TAILQ_HEAD_INITIALIZER(timers);
+/* hierarchical timing wheel, one per cpu
+ *
+ * each level has WHEEL_SIZE slots, slots of level n are
+ * WHEEL_SIZE^n ticks wide; when the level 0 index wraps, the matching
+ * slot of the upper level is cascaded down
+ * timers are added to the wheel of the current cpu and stay there
+ * until they expire or get removed
+ */
 
-void timer_check_timeout(void)
+#define TIMER_TICK_NS 1000000 /* 1ms */
+
+#define WHEEL_BITS   6
+#define WHEEL_SIZE   (1 << WHEEL_BITS)
+#define WHEEL_MASK   (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 5
+#define WHEEL_MAX    (((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+LIST_HEAD(timer_head, timer);
+
+struct timer_wheel
+{
+	struct spinlock lock;
+	uint64_t clk; /* next tick to be processed */
+	size_t count;
+	struct timer_head slots[WHEEL_LEVELS][WHEEL_SIZE];
+};
+
+static struct timer_wheel g_wheels[MAXCPU];
+
+static uint64_t ticks_floor(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * (1000000000 / TIMER_TICK_NS)
+	     + ts->tv_nsec / TIMER_TICK_NS;
+}
+
+static uint64_t ticks_ceil(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * (1000000000 / TIMER_TICK_NS)
+	     + (ts->tv_nsec + TIMER_TICK_NS - 1) / TIMER_TICK_NS;
+}
+
+static uint64_t current_ticks(void)
 {
 	struct timespec cur;
 	clock_gettime(CLOCK_MONOTONIC, &cur);
-	spinlock_lock(&timers_lock);
-	while (1)
+	return ticks_floor(&cur);
+}
+
+static void wheel_insert(struct timer_wheel *wheel, struct timer *timer)
+{
+	uint64_t expires = timer->expires;
+	struct timer_head *slot;
+	if (expires < wheel->clk)
 	{
-		struct timer *timer = TAILQ_FIRST(&timers);
-		if (!timer)
-			break;
-		if (timespec_cmp(&cur, &timer->timeout) < 0)
+		slot = &wheel->slots[0][wheel->clk & WHEEL_MASK];
+	}
+	else
+	{
+		/* timers far in the future are parked in the last level
+		 * and cascaded again until they get in range
+		 */
+		if (expires - wheel->clk > WHEEL_MAX)
+			expires = wheel->clk + WHEEL_MAX;
+		uint64_t delta = expires - wheel->clk;
+		size_t level = 0;
+		while (delta >> (WHEEL_BITS * (level + 1)))
+			level++;
+		size_t idx = (expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+		slot = &wheel->slots[level][idx];
+	}
+	LIST_INSERT_HEAD(slot, timer, chain);
+	timer->wheel = wheel;
+}
+
+static size_t cascade(struct timer_wheel *wheel, size_t level)
+{
+	size_t idx = (wheel->clk >> (WHEEL_BITS * level)) & WHEEL_MASK;
+	struct timer_head head = LIST_HEAD_INITIALIZER(head);
+	struct timer *timer;
+	LIST_SWAP(&head, &wheel->slots[level][idx], timer, chain);
+	while ((timer = LIST_FIRST(&head)))
+	{
+		LIST_REMOVE(timer, chain);
+		wheel_insert(wheel, timer);
+	}
+	return idx;
+}
+
+/* must be called with wheel lock held, returns with it released
+ * the lock is dropped around the callbacks: if the clock moved
+ * meanwhile (the wheel run by another cpu, or restarted by timer_add),
+ * the remaining ticks are left to whoever moved it
+ */
+static void run_wheel(struct timer_wheel *wheel, uint64_t now)
+{
+	while (wheel->clk <= now)
+	{
+		if (!wheel->count)
+		{
+			wheel->clk = now + 1;
 			break;
-		TAILQ_REMOVE(&timers, timer, chain);
-		spinlock_unlock(&timers_lock);
-		timer->cb(timer);
-		spinlock_lock(&timers_lock);
+		}
+		uint64_t clk = wheel->clk;
+		size_t idx = clk & WHEEL_MASK;
+		if (!idx)
+		{
+			for (size_t level = 1; level < WHEEL_LEVELS; ++level)
+			{
+				if (cascade(wheel, level))
+					break;
+			}
+		}
+		struct timer_head *slot = &wheel->slots[0][idx];
+		struct timer *timer;
+		while ((timer = LIST_FIRST(slot)))
+		{
+			LIST_REMOVE(timer, chain);
+			__atomic_store_n(&timer->wheel, NULL, __ATOMIC_RELAXED);
+			wheel->count--;
+			spinlock_unlock(&wheel->lock);
+			timer->cb(timer);
+			spinlock_lock(&wheel->lock);
+			if (wheel->clk != clk)
+				goto end;
+		}
+		wheel->clk++;
+	}
+
+end:
+	spinlock_unlock(&wheel->lock);
+}
+
+void timer_check_timeout(void)
+{
+	struct cpu *cpu = curcpu();
+	uint64_t now = current_ticks();
+	struct timer_wheel *wheel = &g_wheels[cpu->id];
+	spinlock_lock(&wheel->lock);
+	run_wheel(wheel, now);
+	if (cpu->id)
+		return;
+	/* other cpus only check their wheel when they receive an
+	 * interrupt or a syscall, make the boot cpu expire the timers of
+	 * the idle ones
+	 */
+	for (size_t i = 1; i < g_ncpus; ++i)
+	{
+		wheel = &g_wheels[i];
+		if (!__atomic_load_n(&wheel->count, __ATOMIC_RELAXED))
+			continue;
+		if (!spinlock_trylock(&wheel->lock))
+			continue;
+		run_wheel(wheel, now);
 	}
-	spinlock_unlock(&timers_lock);
 }
 
 void timer_add(struct timer *timer, struct timespec timeout, timer_cb_t cb,
                void *userdata)
 {
+	timer_remove(timer);
 	timer->timeout = timeout;
+	timer->expires = ticks_ceil(&timeout);
 	timer->cb = cb;
 	timer->userdata = userdata;
-	struct timer *it;
-	spinlock_lock(&timers_lock);
-	TAILQ_FOREACH(it, &timers, chain)
-	{
-		if (timespec_cmp(&timer->timeout, &it->timeout) < 0)
-		{
-			TAILQ_INSERT_BEFORE(it, timer, chain);
-			spinlock_unlock(&timers_lock);
-			return;
-		}
-	}
-	TAILQ_INSERT_TAIL(&timers, timer, chain);
-	spinlock_unlock(&timers_lock);
+	struct timer_wheel *wheel = &g_wheels[curcpu()->id];
+	spinlock_lock(&wheel->lock);
+	if (!wheel->count)
+		wheel->clk = current_ticks();
+	wheel_insert(wheel, timer);
+	wheel->count++;
+	spinlock_unlock(&wheel->lock);
 }
 
 void timer_remove(struct timer *timer)
 {
-	spinlock_lock(&timers_lock);
-	TAILQ_REMOVE(&timers, timer, chain);
-	spinlock_unlock(&timers_lock);
+	struct timer_wheel *wheel = __atomic_load_n(&timer->wheel,
+	                                            __ATOMIC_RELAXED);
+	if (!wheel)
+		return;
+	spinlock_lock(&wheel->lock);
+	if (timer->wheel == wheel)
+	{
+		LIST_REMOVE(timer, chain);
+		timer->wheel = NULL;
+		wheel->count--;
+	}
+	spinlock_unlock(&wheel->lock);
 }
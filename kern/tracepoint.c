@@ -0,0 +1,391 @@
+#include <net/net.h>
+#include <net/tcp.h>
+#include <net/if.h>
+
+#include <tracepoint.h>
+#include <mutex.h>
+#include <errno.h>
+#include <disk.h>
+#include <file.h>
+#include <proc.h>
+#include <time.h>
+#include <cpu.h>
+#include <std.h>
+#include <uio.h>
+#include <vfs.h>
+#include <mem.h>
+
+/* tracepoints
+ * each cpu owns a binary ring buffer of records (struct tp_header followed
+ * by the event payload)
+ * tracepoints run with interrupts disabled, so the owning cpu is the only
+ * producer of its ring and the reader is the only consumer: head is only
+ * written by the producer, tail only by the reader, no lock is needed
+ * a record that doesn't fit is dropped instead of overwriting unread ones
+ */
+
+#define TP_BUFFER_SIZE (64 * 1024) /* must be a power of two */
+#define TP_RECORD_MAX  256
+
+struct tp_cpu
+{
+	uint8_t *data;
+	size_t head;
+	size_t tail;
+	uint64_t events;
+	uint64_t dropped;
+};
+
+uint32_t g_tp_mask;
+
+static struct tp_cpu g_tp_cpus[MAXCPU];
+static struct mutex g_tp_mutex;
+static int g_tp_opened;
+static struct cdev *dev_trace;
+
+static int trace_open(struct file *file, struct node *node);
+static int trace_release(struct file *file);
+static ssize_t trace_read(struct file *file, struct uio *uio);
+static int trace_ioctl(struct file *file, unsigned long request,
+                       uintptr_t data);
+
+static const struct file_op fop =
+{
+	.open = trace_open,
+	.release = trace_release,
+	.read = trace_read,
+	.ioctl = trace_ioctl,
+};
+
+uint64_t tp_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void ring_copyin(struct tp_cpu *tp_cpu, size_t pos, const void *data,
+                        size_t size)
+{
+	size_t off = pos & (TP_BUFFER_SIZE - 1);
+	size_t n = TP_BUFFER_SIZE - off;
+	if (n > size)
+		n = size;
+	memcpy(&tp_cpu->data[off], data, n);
+	memcpy(&tp_cpu->data[0], &((const uint8_t*)data)[n], size - n);
+}
+
+static void ring_copyout(struct tp_cpu *tp_cpu, size_t pos, void *data,
+                         size_t size)
+{
+	size_t off = pos & (TP_BUFFER_SIZE - 1);
+	size_t n = TP_BUFFER_SIZE - off;
+	if (n > size)
+		n = size;
+	memcpy(data, &tp_cpu->data[off], n);
+	memcpy(&((uint8_t*)data)[n], &tp_cpu->data[0], size - n);
+}
+
+void tp_emit(enum tp_event event, const void *payload, size_t size)
+{
+	struct cpu *cpu = curcpu();
+	struct tp_cpu *tp_cpu = &g_tp_cpus[cpu->id];
+	struct thread *thread = cpu->thread;
+	struct tp_header hdr;
+	if (!tp_cpu->data)
+		return;
+	assert(sizeof(hdr) + size <= TP_RECORD_MAX, "tracepoint too big\n");
+	hdr.size = sizeof(hdr) + size;
+	hdr.event = event;
+	hdr.cpu = cpu->id;
+	hdr.time = tp_time();
+	hdr.pid = thread ? thread->proc->pid : 0;
+	hdr.tid = thread ? thread->tid : 0;
+	size_t head = tp_cpu->head;
+	size_t tail = __atomic_load_n(&tp_cpu->tail, __ATOMIC_ACQUIRE);
+	if (TP_BUFFER_SIZE - (head - tail) < hdr.size)
+	{
+		tp_cpu->dropped++;
+		return;
+	}
+	ring_copyin(tp_cpu, head, &hdr, sizeof(hdr));
+	ring_copyin(tp_cpu, head + sizeof(hdr), payload, size);
+	tp_cpu->events++;
+	__atomic_store_n(&tp_cpu->head, head + hdr.size, __ATOMIC_RELEASE);
+}
+
+static void set_comm(char *dst, struct thread *thread)
+{
+	strlcpy(dst, thread->proc->name ? thread->proc->name : "",
+	        TP_COMM_LEN);
+}
+
+void tp_sched_switch_emit(struct thread *prev, struct thread *next)
+{
+	struct tp_sched_switch tp;
+	memset(&tp, 0, sizeof(tp));
+	if (prev)
+	{
+		tp.prev_pid = prev->proc->pid;
+		tp.prev_tid = prev->tid;
+		tp.prev_pri = prev->pri;
+		tp.prev_state = prev->state;
+		set_comm(tp.prev_comm, prev);
+	}
+	tp.next_pid = next->proc->pid;
+	tp.next_tid = next->tid;
+	tp.next_pri = next->pri;
+	set_comm(tp.next_comm, next);
+	tp_emit(TP_SCHED_SWITCH, &tp, sizeof(tp));
+}
+
+void tp_sched_wakeup_emit(struct thread *thread)
+{
+	struct tp_sched_wakeup tp;
+	memset(&tp, 0, sizeof(tp));
+	tp.pid = thread->proc->pid;
+	tp.tid = thread->tid;
+	tp.pri = thread->pri;
+	tp.target_cpu = thread->wait_cpuid;
+	set_comm(tp.comm, thread);
+	tp_emit(TP_SCHED_WAKEUP, &tp, sizeof(tp));
+}
+
+void tp_page_fault_emit(uintptr_t addr, uint32_t prot, int ret,
+                        uint64_t start)
+{
+	struct tp_page_fault tp;
+	tp.addr = addr;
+	tp.duration = start ? tp_time() - start : 0;
+	tp.prot = prot;
+	tp.ret = ret;
+	tp_emit(TP_PAGE_FAULT, &tp, sizeof(tp));
+}
+
+void tp_syscall_enter_emit(uintptr_t id, const uintptr_t *args)
+{
+	struct tp_syscall_enter tp;
+	tp.id = id;
+	for (size_t i = 0; i < 6; ++i)
+		tp.args[i] = args[i];
+	tp_emit(TP_SYSCALL_ENTER, &tp, sizeof(tp));
+}
+
+void tp_syscall_exit_emit(uintptr_t id, uintptr_t ret, uint64_t start)
+{
+	struct tp_syscall_exit tp;
+	tp.id = id;
+	tp.ret = (intptr_t)ret;
+	tp.duration = start ? tp_time() - start : 0;
+	tp_emit(TP_SYSCALL_EXIT, &tp, sizeof(tp));
+}
+
+void tp_block_emit(enum tp_event event, struct disk *disk, off_t off,
+                   size_t size, int write, ssize_t ret, uint64_t start)
+{
+	struct tp_block tp;
+	tp.off = off;
+	tp.size = size;
+	tp.ret = ret;
+	tp.duration = start ? tp_time() - start : 0;
+	tp.dev = disk->bdev ? disk->bdev->rdev : 0;
+	tp.write = write;
+	tp_emit(event, &tp, sizeof(tp));
+}
+
+void tp_net_emit(enum tp_event event, struct netif *netif, size_t len,
+                 uint16_t proto)
+{
+	struct tp_net tp;
+	memset(&tp, 0, sizeof(tp));
+	strlcpy(tp.ifname, netif->name, sizeof(tp.ifname));
+	tp.len = len;
+	tp.proto = proto;
+	tp_emit(event, &tp, sizeof(tp));
+}
+
+void tp_tcp_emit(enum tp_event event, const void *data, size_t len)
+{
+	const struct tcphdr *tcphdr = data;
+	struct tp_tcp tp;
+	memset(&tp, 0, sizeof(tp));
+	tp.sport = ntohs(tcphdr->th_sport);
+	tp.dport = ntohs(tcphdr->th_dport);
+	tp.seq = ntohl(tcphdr->th_seq);
+	tp.ack = ntohl(tcphdr->th_ack);
+	tp.len = len;
+	tp.win = ntohs(tcphdr->th_win);
+	tp.flags = tcphdr->th_flags;
+	tp_emit(event, &tp, sizeof(tp));
+}
+
+static int alloc_buffers(void)
+{
+	for (size_t i = 0; i < g_ncpus; ++i)
+	{
+		struct tp_cpu *tp_cpu = &g_tp_cpus[i];
+		if (tp_cpu->data)
+			continue;
+		uint8_t *data = malloc(TP_BUFFER_SIZE, 0);
+		if (!data)
+			return -ENOMEM;
+		tp_cpu->head = 0;
+		tp_cpu->tail = 0;
+		__atomic_store_n(&tp_cpu->data, data, __ATOMIC_RELEASE);
+	}
+	return 0;
+}
+
+/* producers never synchronize with the reader, so buffers are never
+ * freed once allocated; discarding the content is done by moving
+ * the tail to the current head
+ */
+static int trace_start(uint32_t mask)
+{
+	if (mask & ~((1U << TP_EVENT_COUNT) - 1))
+		return -EINVAL;
+	int ret = alloc_buffers();
+	if (ret)
+		return ret;
+	for (size_t i = 0; i < g_ncpus; ++i)
+	{
+		struct tp_cpu *tp_cpu = &g_tp_cpus[i];
+		size_t head = __atomic_load_n(&tp_cpu->head, __ATOMIC_ACQUIRE);
+		__atomic_store_n(&tp_cpu->tail, head, __ATOMIC_RELEASE);
+		tp_cpu->events = 0;
+		tp_cpu->dropped = 0;
+	}
+	__atomic_store_n(&g_tp_mask, mask, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static void trace_stop(void)
+{
+	__atomic_store_n(&g_tp_mask, 0, __ATOMIC_RELEASE);
+}
+
+static int trace_open(struct file *file, struct node *node)
+{
+	(void)file;
+	(void)node;
+	if (__atomic_exchange_n(&g_tp_opened, 1, __ATOMIC_ACQUIRE))
+		return -EBUSY;
+	return 0;
+}
+
+static int trace_release(struct file *file)
+{
+	(void)file;
+	mutex_lock(&g_tp_mutex);
+	trace_stop();
+	mutex_unlock(&g_tp_mutex);
+	__atomic_store_n(&g_tp_opened, 0, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* only whole records are copied */
+static size_t read_records(struct tp_cpu *tp_cpu, uint8_t *buf, size_t size)
+{
+	size_t n = 0;
+	if (!__atomic_load_n(&tp_cpu->data, __ATOMIC_ACQUIRE))
+		return 0;
+	size_t tail = tp_cpu->tail;
+	size_t head = __atomic_load_n(&tp_cpu->head, __ATOMIC_ACQUIRE);
+	while (tail != head)
+	{
+		struct tp_header hdr;
+		ring_copyout(tp_cpu, tail, &hdr, sizeof(hdr));
+		if (n + hdr.size > size)
+			break;
+		ring_copyout(tp_cpu, tail, &buf[n], hdr.size);
+		n += hdr.size;
+		tail += hdr.size;
+	}
+	__atomic_store_n(&tp_cpu->tail, tail, __ATOMIC_RELEASE);
+	return n;
+}
+
+static ssize_t trace_read(struct file *file, struct uio *uio)
+{
+	(void)file;
+	size_t count = uio->count;
+	uint8_t *buf = malloc(PAGE_SIZE, 0);
+	if (!buf)
+		return -ENOMEM;
+	mutex_lock(&g_tp_mutex);
+	for (size_t i = 0; i < g_ncpus; ++i)
+	{
+		size_t n;
+		do
+		{
+			size_t size = uio->count < PAGE_SIZE ? uio->count : PAGE_SIZE;
+			n = read_records(&g_tp_cpus[i], buf, size);
+			if (!n)
+				break;
+			ssize_t ret = uio_copyin(uio, buf, n);
+			if (ret < 0)
+			{
+				mutex_unlock(&g_tp_mutex);
+				free(buf);
+				return ret;
+			}
+		} while (uio->count >= TP_RECORD_MAX);
+	}
+	mutex_unlock(&g_tp_mutex);
+	free(buf);
+	return count - uio->count;
+}
+
+static int trace_ioctl(struct file *file, unsigned long request,
+                       uintptr_t data)
+{
+	(void)file;
+	struct vm_space *space = curcpu()->thread->proc->vm_space;
+	int ret;
+	switch (request)
+	{
+		case TRACEIO_START:
+		{
+			uint32_t mask;
+			ret = vm_copyin(space, &mask, (void*)data, sizeof(mask));
+			if (ret)
+				return ret;
+			mutex_lock(&g_tp_mutex);
+			ret = trace_start(mask);
+			mutex_unlock(&g_tp_mutex);
+			return ret;
+		}
+		case TRACEIO_STOP:
+			mutex_lock(&g_tp_mutex);
+			trace_stop();
+			mutex_unlock(&g_tp_mutex);
+			return 0;
+		case TRACEIO_STATS:
+		{
+			struct tp_stats stats;
+			stats.events = 0;
+			stats.dropped = 0;
+			for (size_t i = 0; i < g_ncpus; ++i)
+			{
+				struct tp_cpu *tp_cpu = &g_tp_cpus[i];
+				stats.events += __atomic_load_n(&tp_cpu->events,
+				                                __ATOMIC_RELAXED);
+				stats.dropped += __atomic_load_n(&tp_cpu->dropped,
+				                                 __ATOMIC_RELAXED);
+			}
+			return vm_copyout(space, (void*)data, &stats,
+			                  sizeof(stats));
+		}
+		default:
+			return -EINVAL;
+	}
+}
+
+void tracepoint_init(void)
+{
+	mutex_init(&g_tp_mutex, 0);
+	int ret = cdev_alloc("trace", 0, 0, 0600, makedev(10, 2), &fop,
+	                     &dev_trace);
+	if (ret)
+		printf("trace: failed to create device: %s\n", strerror(ret));
+}
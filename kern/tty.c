@@ -57,7 +57,8 @@ static ssize_t tty_fread(struct file *file, struct uio *uio)
 	if (!tty)
 		return -EINVAL;
 	return pipebuf_read(&tty->pipebuf, uio,
-	                    file->flags & O_NONBLOCK ? 0 : 1, NULL);
+	                    (file->flags & O_NONBLOCK) || uio->nonblock ? 0 : 1,
+	                    NULL);
 }
 
 static int tty_fioctl(struct file *file, unsigned long req, uintptr_t data)
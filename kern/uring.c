@@ -0,0 +1,806 @@
+#include <errno.h>
+#include <uring.h>
+#include <file.h>
+#include <poll.h>
+#include <proc.h>
+#include <sock.h>
+#include <stat.h>
+#include <time.h>
+#include <cpu.h>
+#include <std.h>
+#include <uio.h>
+#include <vfs.h>
+#include <mem.h>
+
+/* submission / completion rings shared with userspace: uring_enter
+ * consumes a batch of submission entries in a single syscall, running the
+ * requests whose file is ready (or can't be polled) right away and
+ * registering a poll entry for the others
+ * the poll entries wake the ring poller, but the requests are only run
+ * again by the next uring_enter of the ring, in the context of the thread
+ * waiting for their completions (the buffers are in its address space)
+ * a request run after its file was polled ready is run in non-blocking
+ * mode: the ring mutex is held, and another reader may have consumed the
+ * data in the meantime, in which case the poll entry is registered again
+ */
+
+struct uring_req
+{
+	struct uring *uring;
+	struct uring_sqe sqe;
+	struct file *file;
+	struct poll_entry poll_entry;
+	int events; /* to wait for before running the request */
+	int armed; /* poll_entry is registered */
+	struct iovec *iov;
+	struct iovec iov_buf;
+	size_t iovcnt;
+	size_t count;
+	struct msghdr msg;
+	struct iovec *uiov; /* msg_iov of the userspace msghdr */
+	struct timespec deadline;
+	uint64_t target; /* completions count ending a timeout */
+	TAILQ_ENTRY(uring_req) chain;
+};
+
+struct uring
+{
+	struct mutex mutex;
+	struct poller poller;
+	struct poller_head poll_entries;
+	struct page **pages;
+	size_t pages_count;
+	struct uring_ring *ring;
+	struct uring_sqe *sqes;
+	struct uring_cqe *cqes;
+	uint32_t sq_entries;
+	uint32_t cq_entries;
+	uint32_t sq_head;
+	uint32_t cq_tail;
+	size_t inflight;
+	uint64_t completed; /* completions of the requests, timeouts excluded */
+	uint64_t space_id; /* tlb_id of the space of the buffers */
+	TAILQ_HEAD(, uring_req) reqs;
+};
+
+static const struct file_op uring_fop;
+
+static struct uring *geturing(struct file *file)
+{
+	if (file->op != &uring_fop)
+		return NULL;
+	return file->userdata;
+}
+
+static int is_pipe(struct file *file)
+{
+	return file->node && S_ISFIFO(file->node->attr.mode);
+}
+
+static uint32_t cq_ready(struct uring *uring)
+{
+	uint32_t head = __atomic_load_n(&uring->ring->cq_head, __ATOMIC_ACQUIRE);
+	uint32_t ready = uring->cq_tail - head;
+	if (ready > uring->cq_entries)
+		return uring->cq_entries;
+	return ready;
+}
+
+static void post(struct uring *uring, uint64_t user_data, int32_t res)
+{
+	struct uring_cqe *cqe = &uring->cqes[uring->cq_tail
+	                                   & (uring->cq_entries - 1)];
+	cqe->user_data = user_data;
+	cqe->res = res;
+	cqe->flags = 0;
+	uring->cq_tail++;
+	__atomic_store_n(&uring->ring->cq_tail, uring->cq_tail,
+	                 __ATOMIC_RELEASE);
+	poller_broadcast(&uring->poll_entries, POLLIN);
+}
+
+static void req_free(struct uring_req *req)
+{
+	if (req->armed)
+		poller_del(&req->poll_entry);
+	if (req->file)
+		file_free(req->file);
+	if (req->iov && req->iov != &req->iov_buf)
+		free(req->iov);
+	free(req);
+}
+
+static void req_done(struct uring_req *req, ssize_t res)
+{
+	struct uring *uring = req->uring;
+	post(uring, req->sqe.user_data, res);
+	if (req->sqe.opcode != URING_OP_TIMEOUT)
+		uring->completed++;
+	TAILQ_REMOVE(&uring->reqs, req, chain);
+	uring->inflight--;
+	req_free(req);
+}
+
+static int prep_iov(struct uring_req *req, const struct iovec *uiov,
+                    size_t iovcnt)
+{
+	struct vm_space *space = curcpu()->thread->proc->vm_space;
+	ssize_t count = 0;
+	int ret;
+
+	if (iovcnt > IOV_MAX)
+		return -EINVAL;
+	if (iovcnt)
+	{
+		req->iov = malloc(sizeof(*req->iov) * iovcnt, 0);
+		if (!req->iov)
+			return -ENOMEM;
+		ret = vm_copyin(space, req->iov, uiov, sizeof(*req->iov) * iovcnt);
+		if (ret < 0)
+			return ret;
+	}
+	for (size_t i = 0; i < iovcnt; ++i)
+	{
+		if (__builtin_add_overflow(count, req->iov[i].iov_len, &count))
+			return -EINVAL;
+	}
+	req->iovcnt = iovcnt;
+	req->count = count;
+	return 0;
+}
+
+static int prep_rw(struct uring_req *req, int write)
+{
+	struct file *file = req->file;
+	struct uring_sqe *sqe = &req->sqe;
+
+	switch (file->flags & 3)
+	{
+		case O_RDONLY:
+			if (write)
+				return -EBADF;
+			break;
+		case O_WRONLY:
+			if (!write)
+				return -EBADF;
+			break;
+		case O_RDWR:
+			break;
+		default:
+			return -EBADF;
+	}
+	if (sqe->off < -1)
+		return -EINVAL;
+	if (sqe->off != -1 && (file->sock || is_pipe(file)))
+		return -ESPIPE;
+	req->events = write ? POLLOUT : POLLIN;
+	if (sqe->opcode == URING_OP_READV || sqe->opcode == URING_OP_WRITEV)
+		return prep_iov(req, (struct iovec*)(uintptr_t)sqe->addr,
+		                sqe->len);
+	req->iov_buf.iov_base = (void*)(uintptr_t)sqe->addr;
+	req->iov_buf.iov_len = sqe->len;
+	req->iov = &req->iov_buf;
+	req->iovcnt = 1;
+	req->count = sqe->len;
+	return 0;
+}
+
+static int prep_msg(struct uring_req *req, int send)
+{
+	struct vm_space *space = curcpu()->thread->proc->vm_space;
+	int ret;
+
+	if (!req->file->sock)
+		return -ENOTSOCK;
+	ret = vm_copyin(space, &req->msg, (void*)(uintptr_t)req->sqe.addr,
+	                sizeof(req->msg));
+	if (ret < 0)
+		return ret;
+	if (req->msg.msg_flags & ~(MSG_DONTWAIT))
+		return -EINVAL;
+	req->uiov = req->msg.msg_iov;
+	ret = prep_iov(req, req->uiov, req->msg.msg_iovlen);
+	if (ret < 0)
+		return ret;
+	req->msg.msg_iov = req->iov;
+	req->events = send ? POLLOUT : POLLIN;
+	return 0;
+}
+
+static int prep_timeout(struct uring_req *req)
+{
+	struct vm_space *space = curcpu()->thread->proc->vm_space;
+	struct timespec ts;
+	int ret;
+
+	if (req->sqe.off < 0)
+		return -EINVAL;
+	ret = vm_copyin(space, &ts, (void*)(uintptr_t)req->sqe.addr,
+	                sizeof(ts));
+	if (ret < 0)
+		return ret;
+	ret = timespec_validate(&ts);
+	if (ret < 0)
+		return ret;
+	ret = clock_gettime(CLOCK_MONOTONIC, &req->deadline);
+	if (ret < 0)
+		return ret;
+	timespec_add(&req->deadline, &ts);
+	if (req->sqe.off)
+		req->target = req->uring->completed + req->sqe.off;
+	return 0;
+}
+
+static int req_prep(struct uring_req *req)
+{
+	struct proc *proc = curcpu()->thread->proc;
+	int ret;
+
+	switch (req->sqe.opcode)
+	{
+		case URING_OP_NOP:
+			return 0;
+		case URING_OP_TIMEOUT:
+			return prep_timeout(req);
+	}
+	ret = proc_getfile(proc, req->sqe.fd, &req->file);
+	if (ret < 0)
+		return ret;
+	/* a request holding its own ring would never be released */
+	if (geturing(req->file))
+		return -EINVAL;
+	switch (req->sqe.opcode)
+	{
+		case URING_OP_READ:
+		case URING_OP_READV:
+			return prep_rw(req, 0);
+		case URING_OP_WRITE:
+		case URING_OP_WRITEV:
+			return prep_rw(req, 1);
+		case URING_OP_RECVMSG:
+			return prep_msg(req, 0);
+		case URING_OP_SENDMSG:
+			return prep_msg(req, 1);
+		case URING_OP_ACCEPT:
+			if (!req->file->sock)
+				return -ENOTSOCK;
+			req->events = POLLIN;
+			return 0;
+		case URING_OP_CONNECT:
+			if (!req->file->sock)
+				return -ENOTSOCK;
+			return 0;
+		case URING_OP_POLL_ADD:
+			req->events = req->sqe.op_flags & (POLLIN | POLLPRI | POLLOUT);
+			return 0;
+		case URING_OP_FSYNC:
+			return 0;
+		default:
+			return -EINVAL;
+	}
+}
+
+/* XXX the node times aren't updated */
+static ssize_t exec_rw(struct uring_req *req, int write, int nonblock)
+{
+	struct file *file = req->file;
+	struct uio uio;
+	ssize_t ret;
+
+	uio.iov = req->iov;
+	uio.iovcnt = req->iovcnt;
+	uio.count = req->count;
+	uio.off = req->sqe.off == -1 ? file->off : req->sqe.off;
+	uio.userbuf = 1;
+	uio.nonblock = nonblock;
+	if (write)
+		ret = file_write(file, &uio);
+	else
+		ret = file_read(file, &uio);
+	if (ret >= 0 && req->sqe.off == -1)
+		file->off = uio.off;
+	return ret;
+}
+
+static ssize_t exec_msg(struct uring_req *req, int send, int nonblock)
+{
+	struct vm_space *space = curcpu()->thread->proc->vm_space;
+	struct msghdr msg;
+	ssize_t len;
+	int flags;
+	int ret;
+
+	flags = req->sqe.op_flags;
+	if (nonblock || (req->file->flags & O_NONBLOCK))
+		flags |= MSG_DONTWAIT;
+	if (send)
+		return sock_send(req->file->sock, &req->msg, flags);
+	len = sock_recv(req->file->sock, &req->msg, flags);
+	if (len < 0)
+		return len;
+	msg = req->msg;
+	msg.msg_iov = req->uiov;
+	ret = vm_copyout(space, (void*)(uintptr_t)req->sqe.addr, &msg,
+	                 sizeof(msg));
+	if (ret < 0)
+		return ret;
+	return len;
+}
+
+static ssize_t exec_accept(struct uring_req *req, int nonblock)
+{
+	struct proc *proc = curcpu()->thread->proc;
+	socklen_t *uaddrlen = (socklen_t*)(uintptr_t)req->sqe.addr2;
+	struct file *file;
+	struct sock *child;
+	socklen_t addrlen;
+	ssize_t ret;
+
+	ret = sock_accept(req->file->sock, &child,
+	                  nonblock ? MSG_DONTWAIT : 0);
+	if (ret < 0)
+		return ret;
+	if (uaddrlen)
+	{
+		ret = vm_copyin(proc->vm_space, &addrlen, uaddrlen,
+		                sizeof(addrlen));
+		if (ret < 0)
+			goto end;
+		if (addrlen > child->dst_addrlen)
+			addrlen = child->dst_addrlen;
+		ret = vm_copyout(proc->vm_space, (void*)(uintptr_t)req->sqe.addr,
+		                 &child->dst_addr, addrlen);
+		if (ret < 0)
+			goto end;
+		ret = vm_copyout(proc->vm_space, uaddrlen, &child->dst_addrlen,
+		                 sizeof(*uaddrlen));
+		if (ret < 0)
+			goto end;
+	}
+	ret = file_fromsock(child, 0, &file);
+	if (ret < 0)
+		goto end;
+	ret = proc_allocfd(proc, file, 0);
+	file_free(file);
+
+end:
+	sock_free(child);
+	return ret;
+}
+
+/* XXX the connection is established synchronously */
+static ssize_t exec_connect(struct uring_req *req)
+{
+	struct vm_space *space = curcpu()->thread->proc->vm_space;
+	struct sock *sock = req->file->sock;
+	union sockaddr_union addr;
+	socklen_t addrlen = req->sqe.len;
+	ssize_t ret;
+
+	if (!addrlen || addrlen > sizeof(addr))
+		return -EINVAL;
+	ret = vm_copyin(space, &addr, (void*)(uintptr_t)req->sqe.addr,
+	                addrlen);
+	if (ret < 0)
+		return ret;
+	if (addr.sa.sa_family != sock->domain)
+		return -EAFNOSUPPORT;
+	ret = sock_test_addrlen(addr.sa.sa_family, addrlen);
+	if (ret < 0)
+		return ret;
+	return sock_connect(sock, &addr.sa, addrlen);
+}
+
+static ssize_t req_exec(struct uring_req *req, int nonblock)
+{
+	switch (req->sqe.opcode)
+	{
+		case URING_OP_NOP:
+			return 0;
+		case URING_OP_READ:
+		case URING_OP_READV:
+			return exec_rw(req, 0, nonblock);
+		case URING_OP_WRITE:
+		case URING_OP_WRITEV:
+			return exec_rw(req, 1, nonblock);
+		case URING_OP_RECVMSG:
+			return exec_msg(req, 0, nonblock);
+		case URING_OP_SENDMSG:
+			return exec_msg(req, 1, nonblock);
+		case URING_OP_ACCEPT:
+			return exec_accept(req, nonblock);
+		case URING_OP_CONNECT:
+			return exec_connect(req);
+		case URING_OP_POLL_ADD:
+			/* files which can't be polled never block */
+			return req->events & (POLLIN | POLLOUT);
+		case URING_OP_FSYNC:
+			/* XXX only the shared mappings are written back */
+			if (req->file->node && req->file->node->cache)
+				return vm_cache_sync(req->file->node->cache, 0,
+				                     SIZE_MAX);
+			return 0;
+		default:
+			return -EINVAL;
+	}
+}
+
+static int req_poll(struct uring_req *req)
+{
+	int ret;
+
+	req->poll_entry.poller = &req->uring->poller;
+	req->poll_entry.file = req->file;
+	req->poll_entry.events = req->events | POLLERR | POLLHUP;
+	ret = file_poll(req->file, &req->poll_entry);
+	if (!ret)
+		req->armed = 1;
+	return ret;
+}
+
+/* the file was polled ready */
+static void req_run(struct uring_req *req)
+{
+	ssize_t ret;
+
+	while (1)
+	{
+		ret = req_exec(req, 1);
+		if (ret != -EAGAIN)
+			break;
+		ret = req_poll(req);
+		if (!ret)
+			return;
+		if (ret < 0)
+			break;
+	}
+	req_done(req, ret);
+}
+
+static void req_start(struct uring_req *req)
+{
+	int ret;
+
+	if (req->sqe.opcode == URING_OP_TIMEOUT)
+		return;
+	if (req->events)
+	{
+		ret = req_poll(req);
+		if (!ret)
+			return;
+		if (ret < 0 && ret != -ENOSYS)
+		{
+			req_done(req, ret);
+			return;
+		}
+		if (ret > 0)
+		{
+			if (req->sqe.opcode == URING_OP_POLL_ADD)
+				req_done(req, ret);
+			else
+				req_run(req);
+			return;
+		}
+	}
+	req_done(req, req_exec(req, 0));
+}
+
+static ssize_t submit(struct uring *uring, uint32_t to_submit)
+{
+	uint32_t tail = __atomic_load_n(&uring->ring->sq_tail,
+	                                __ATOMIC_ACQUIRE);
+	uint32_t count = tail - uring->sq_head;
+	uint32_t n;
+
+	if (count > uring->sq_entries)
+		return -EINVAL;
+	if (count > to_submit)
+		count = to_submit;
+	for (n = 0; n < count; ++n)
+	{
+		/* every request gets a completion slot */
+		if (uring->inflight + cq_ready(uring) >= uring->cq_entries)
+			break;
+		struct uring_req *req = malloc(sizeof(*req), M_ZERO);
+		if (!req)
+		{
+			if (!n)
+				return -ENOMEM;
+			break;
+		}
+		req->uring = uring;
+		req->sqe = uring->sqes[uring->sq_head & (uring->sq_entries - 1)];
+		uring->sq_head++;
+		__atomic_store_n(&uring->ring->sq_head, uring->sq_head,
+		                 __ATOMIC_RELEASE);
+		TAILQ_INSERT_TAIL(&uring->reqs, req, chain);
+		uring->inflight++;
+		int ret = req_prep(req);
+		if (ret < 0)
+			req_done(req, ret);
+		else
+			req_start(req);
+	}
+	if (!n && count)
+		return -EBUSY;
+	return n;
+}
+
+static void reap(struct uring *uring)
+{
+	struct uring_req *req;
+	struct uring_req *next;
+	struct timespec now;
+	int revents;
+
+	TAILQ_FOREACH_SAFE(req, &uring->reqs, chain, next)
+	{
+		if (!req->armed)
+			continue;
+		poller_spinlock(&uring->poller);
+		revents = req->poll_entry.revents;
+		poller_unlock(&uring->poller);
+		if (!revents)
+			continue;
+		poller_del(&req->poll_entry);
+		req->armed = 0;
+		if (req->sqe.opcode == URING_OP_POLL_ADD)
+			req_done(req, revents);
+		else
+			req_run(req);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	TAILQ_FOREACH_SAFE(req, &uring->reqs, chain, next)
+	{
+		if (req->sqe.opcode != URING_OP_TIMEOUT)
+			continue;
+		if (req->target && uring->completed >= req->target)
+			req_done(req, 0);
+		else if (timespec_cmp(&req->deadline, &now) <= 0)
+			req_done(req, -ETIME);
+	}
+}
+
+/* sleep until a poll entry is ready or the closest of the timeouts and the
+ * deadline of the caller expires
+ */
+static int uring_wait(struct uring *uring, const struct timespec *deadline)
+{
+	const struct timespec *next = deadline;
+	struct uring_req *req;
+	struct timespec left;
+	struct timespec now;
+	int ret;
+
+	TAILQ_FOREACH(req, &uring->reqs, chain)
+	{
+		if (req->sqe.opcode != URING_OP_TIMEOUT)
+			continue;
+		if (!next || timespec_cmp(&req->deadline, next) < 0)
+			next = &req->deadline;
+	}
+	if (!next)
+		return poller_wait(&uring->poller, NULL);
+	ret = clock_gettime(CLOCK_MONOTONIC, &now);
+	if (ret < 0)
+		return ret;
+	if (timespec_cmp(&now, next) >= 0)
+		return next == deadline ? -ETIME : 0;
+	timespec_diff(&left, next, &now);
+	ret = poller_wait(&uring->poller, &left);
+	if (ret == -EAGAIN)
+		return 0;
+	return ret;
+}
+
+ssize_t uring_enter(struct file *file, uint32_t to_submit,
+                    uint32_t min_complete, uint32_t flags,
+                    const struct timespec *timeout)
+{
+	struct thread *thread = curcpu()->thread;
+	struct uring *uring = geturing(file);
+	struct timespec deadline;
+	ssize_t submitted;
+	ssize_t ret;
+
+	if (!uring)
+		return -EOPNOTSUPP;
+	if (flags & ~URING_ENTER_GETEVENTS)
+		return -EINVAL;
+	/* the requests reference buffers of the space of the ring */
+	if (thread->proc->vm_space->tlb_id != uring->space_id)
+		return -EPERM;
+	if (min_complete > uring->cq_entries)
+		min_complete = uring->cq_entries;
+	if (timeout)
+	{
+		ret = clock_gettime(CLOCK_MONOTONIC, &deadline);
+		if (ret < 0)
+			return ret;
+		timespec_add(&deadline, timeout);
+	}
+	mutex_lock(&uring->mutex);
+	submitted = submit(uring, to_submit);
+	if (submitted < 0)
+	{
+		mutex_unlock(&uring->mutex);
+		return submitted;
+	}
+	ret = 0;
+	while (1)
+	{
+		reap(uring);
+		if (!(flags & URING_ENTER_GETEVENTS)
+		 || cq_ready(uring) >= min_complete
+		 || TAILQ_EMPTY(&uring->reqs))
+			break;
+		ret = uring_wait(uring, timeout ? &deadline : NULL);
+		if (ret < 0)
+			break;
+	}
+	mutex_unlock(&uring->mutex);
+	if (submitted)
+		return submitted;
+	return ret;
+}
+
+static void uring_free(struct uring *uring)
+{
+	struct uring_req *req;
+	while ((req = TAILQ_FIRST(&uring->reqs)))
+	{
+		TAILQ_REMOVE(&uring->reqs, req, chain);
+		req_free(req);
+	}
+	if (uring->ring)
+		vm_unmap(uring->ring, uring->pages_count * PAGE_SIZE);
+	if (uring->pages)
+	{
+		for (size_t i = 0; i < uring->pages_count; ++i)
+		{
+			if (uring->pages[i])
+				pm_free_page(uring->pages[i]);
+		}
+		free(uring->pages);
+	}
+	poller_destroy(&uring->poller);
+	mutex_destroy(&uring->mutex);
+	free(uring);
+}
+
+static int uring_release(struct file *file)
+{
+	struct uring *uring = geturing(file);
+	if (!uring)
+		return -EINVAL;
+	uring_free(uring);
+	return 0;
+}
+
+static int uring_fault(struct vm_zone *zone, off_t off, struct page **page)
+{
+	struct uring *uring = geturing(zone->file);
+	if (!uring)
+		return -EINVAL;
+	size_t n = off / PAGE_SIZE;
+	if (n >= uring->pages_count)
+		return -EFAULT;
+	pm_ref_page(uring->pages[n]);
+	*page = uring->pages[n];
+	return 0;
+}
+
+static const struct vm_zone_op uring_vm_op =
+{
+	.fault = uring_fault,
+};
+
+static int uring_mmap(struct file *file, struct vm_zone *zone)
+{
+	struct uring *uring = geturing(file);
+	if (!uring)
+		return -EINVAL;
+	if (!(zone->flags & MAP_SHARED))
+		return -EINVAL;
+	if (zone->off || zone->size > uring->pages_count * PAGE_SIZE)
+		return -EINVAL;
+	zone->op = &uring_vm_op;
+	return 0;
+}
+
+static int uring_poll(struct file *file, struct poll_entry *entry)
+{
+	struct uring *uring = geturing(file);
+	if (!uring)
+		return -EINVAL;
+	if (cq_ready(uring) && (entry->events & POLLIN))
+		return POLLIN;
+	entry->file_head = &uring->poll_entries;
+	return poller_add(entry);
+}
+
+static const struct file_op uring_fop =
+{
+	.release = uring_release,
+	.mmap = uring_mmap,
+	.poll = uring_poll,
+};
+
+int uring_setup(uint32_t entries, struct uring_params *params,
+                struct file **filep)
+{
+	struct thread *thread = curcpu()->thread;
+	struct uring *uring;
+	struct file *file;
+	uint32_t sq_entries;
+	uint32_t cq_entries;
+	size_t cqes_off;
+	size_t sqes_off;
+	size_t size;
+	int ret;
+
+	if (!entries || entries > URING_MAX_ENTRIES)
+		return -EINVAL;
+	if (params->flags)
+		return -EINVAL;
+	sq_entries = 1;
+	while (sq_entries < entries)
+		sq_entries <<= 1;
+	cq_entries = sq_entries * 2;
+	cqes_off = (sizeof(struct uring_ring) + 63) & ~63;
+	sqes_off = cqes_off + cq_entries * sizeof(struct uring_cqe);
+	size = sqes_off + sq_entries * sizeof(struct uring_sqe);
+	size = (size + PAGE_MASK) & ~PAGE_MASK;
+	uring = malloc(sizeof(*uring), M_ZERO);
+	if (!uring)
+		return -ENOMEM;
+	mutex_init(&uring->mutex, 0);
+	poller_init(&uring->poller);
+	TAILQ_INIT(&uring->poll_entries);
+	TAILQ_INIT(&uring->reqs);
+	uring->sq_entries = sq_entries;
+	uring->cq_entries = cq_entries;
+	uring->space_id = thread->proc->vm_space->tlb_id;
+	uring->pages_count = size / PAGE_SIZE;
+	uring->pages = malloc(sizeof(*uring->pages) * uring->pages_count,
+	                      M_ZERO);
+	if (!uring->pages)
+	{
+		ret = -ENOMEM;
+		goto err;
+	}
+	for (size_t i = 0; i < uring->pages_count; ++i)
+	{
+		ret = pm_alloc_page(&uring->pages[i]);
+		if (ret)
+			goto err;
+	}
+	uring->ring = vm_map_pages(uring->pages, uring->pages_count,
+	                           VM_PROT_RW);
+	if (!uring->ring)
+	{
+		ret = -ENOMEM;
+		goto err;
+	}
+	memset(uring->ring, 0, size);
+	uring->ring->sq_mask = sq_entries - 1;
+	uring->ring->cq_mask = cq_entries - 1;
+	uring->cqes = (struct uring_cqe*)((uint8_t*)uring->ring + cqes_off);
+	uring->sqes = (struct uring_sqe*)((uint8_t*)uring->ring + sqes_off);
+	ret = file_fromnode(NULL, O_RDWR, &file);
+	if (ret)
+		goto err;
+	file->op = &uring_fop;
+	file->userdata = uring;
+	params->sq_entries = sq_entries;
+	params->cq_entries = cq_entries;
+	params->size = size;
+	params->sqes_off = sqes_off;
+	params->cqes_off = cqes_off;
+	*filep = file;
+	return 0;
+
+err:
+	uring_free(uring);
+	return ret;
+}
@@ -0,0 +1,362 @@
+#include <errno.h>
+#include <vdso.h>
+#include <time.h>
+#include <std.h>
+#include <cpu.h>
+#include <mem.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include "arch/x86/cpuid.h"
+#include "arch/x86/asm.h"
+#include "arch/x86/msr.h"
+#else
+#include <arch/csr.h>
+#include <arch/asm.h>
+#endif
+
+/* the vdso is a data page followed by the code of the .vdso.text
+ * section, copied out of the kernel image at boot and mapped read-only
+ * in every process: the code finds the data page at the same distance as
+ * in the kernel image, and reads the counter of the monotonic clock by
+ * itself
+ * the data page is written by the first cpu on each tick under a
+ * sequence lock, the time being extrapolated from the last update with a
+ * multiplication and a shift; the functions fail with -ENOSYS whenever
+ * the counter can't be read from userland or the last update is too old
+ * the code of the vdso can't call anything nor reference any absolute
+ * address: no 64-bit division on the 32-bit archs, no switch, no struct
+ * copy
+ */
+
+#define VDSO_SHIFT     24
+#define VDSO_CPU_SHIFT 12 /* getcpu value is (node << 12) | cpu */
+
+#define VDSO_TEXT   __attribute__((section(".vdso.text"), used, noinline))
+#define VDSO_INLINE static inline __attribute__((always_inline))
+
+struct vdso_data
+{
+	struct vdso_header header;
+	uint32_t seq; /* odd while being updated */
+	uint32_t counter; /* the counter is readable from userland */
+	uint32_t getcpu; /* the cpu id is readable from userland */
+	uint64_t mult; /* ns per cycle << VDSO_SHIFT */
+	uint64_t max_delta; /* cycles extrapolated at most */
+	uint64_t cycle_last; /* counter at the last update */
+	uint64_t sec; /* monotonic time at the last update */
+	uint64_t nsec;
+	uint64_t realtime_sec; /* offset from the monotonic time */
+	uint64_t realtime_nsec;
+};
+
+extern uint8_t _vdso_begin;
+extern uint8_t _vdso_end;
+
+static struct vdso_data vdso_data __attribute__((section(".vdso.data"),
+                                                 aligned(PAGE_SIZE),
+                                                 used));
+
+static struct page **g_vdso_pages;
+static size_t g_vdso_pages_count;
+static struct vdso_data *g_data; /* kernel mapping of the data page */
+static uint64_t g_freq;
+
+VDSO_INLINE const volatile struct vdso_data *get_data(void)
+{
+	const volatile struct vdso_data *data;
+#if defined(__x86_64__)
+	__asm__ ("lea vdso_data(%%rip), %0" : "=r"(data));
+#elif defined(__i386__)
+	__asm__ ("call 1f\n"
+	         "1: pop %0\n"
+	         "add $vdso_data - 1b, %0" : "=r"(data));
+#elif defined(__aarch64__)
+	__asm__ ("adrp %0, vdso_data\n"
+	         "add %0, %0, :lo12:vdso_data" : "=r"(data));
+#elif defined(__arm__)
+#if defined(__thumb__)
+#define PC_OFFSET "4"
+#else
+#define PC_OFFSET "8"
+#endif
+	__asm__ ("ldr %0, 2f\n"
+	         "1: add %0, pc, %0\n"
+	         "b 3f\n"
+	         ".align 2\n"
+	         "2: .word vdso_data - (1b + " PC_OFFSET ")\n"
+	         "3:" : "=r"(data));
+#undef PC_OFFSET
+#elif defined(__riscv)
+	__asm__ (".option push\n"
+	         ".option norelax\n"
+	         "lla %0, vdso_data\n"
+	         ".option pop" : "=r"(data));
+#endif
+	return data;
+}
+
+VDSO_INLINE uint64_t read_counter(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	uint32_t lo;
+	uint32_t hi;
+	__asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+#elif defined(__aarch64__)
+	uint64_t val;
+	__asm__ volatile ("isb\n"
+	                  "mrs %0, cntvct_el0" : "=r"(val) : : "memory");
+	return val;
+#elif defined(__arm__)
+	uint32_t lo;
+	uint32_t hi;
+	__asm__ volatile ("isb\n"
+	                  "mrrc p15, 1, %0, %1, c14"
+	                  : "=r"(lo), "=r"(hi) : : "memory");
+	return ((uint64_t)hi << 32) | lo;
+#elif defined(__riscv) && __riscv_xlen == 64
+	uint64_t val;
+	__asm__ volatile ("rdtime %0" : "=r"(val));
+	return val;
+#elif defined(__riscv)
+	uint32_t lo;
+	uint32_t hi;
+	uint32_t tmp;
+	do
+	{
+		__asm__ volatile ("rdtimeh %0\n"
+		                  "rdtime %1\n"
+		                  "rdtimeh %2"
+		                  : "=r"(hi), "=r"(lo), "=r"(tmp));
+	} while (hi != tmp);
+	return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+VDSO_INLINE uint32_t read_begin(const volatile struct vdso_data *data)
+{
+	uint32_t seq;
+	do
+	{
+		seq = __atomic_load_n(&data->seq, __ATOMIC_ACQUIRE);
+	} while (seq & 1);
+	return seq;
+}
+
+VDSO_INLINE int read_retry(const volatile struct vdso_data *data,
+                           uint32_t seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&data->seq, __ATOMIC_RELAXED) != seq;
+}
+
+VDSO_TEXT static int vdso_clock_gettime(int clock, struct timespec *ts)
+{
+	const volatile struct vdso_data *data = get_data();
+	uint64_t sec;
+	uint64_t nsec;
+	uint32_t seq;
+	if (clock != CLOCK_REALTIME && clock != CLOCK_MONOTONIC)
+		return -ENOSYS;
+	do
+	{
+		seq = read_begin(data);
+		if (!data->counter)
+			return -ENOSYS;
+		uint64_t delta = read_counter() - data->cycle_last;
+		if ((int64_t)delta < 0) /* counters of the cpus slightly off */
+			delta = 0;
+		if (delta > data->max_delta)
+			return -ENOSYS;
+		sec = data->sec;
+		nsec = data->nsec + ((delta * data->mult) >> VDSO_SHIFT);
+		if (clock == CLOCK_REALTIME)
+		{
+			sec += data->realtime_sec;
+			nsec += data->realtime_nsec;
+		}
+	} while (read_retry(data, seq));
+	/* each of the terms is at most one second */
+	if (nsec >= 1000000000)
+	{
+		nsec -= 1000000000;
+		sec++;
+	}
+	if (nsec >= 1000000000)
+	{
+		nsec -= 1000000000;
+		sec++;
+	}
+	ts->tv_sec = sec;
+	ts->tv_nsec = nsec;
+	return 0;
+}
+
+VDSO_TEXT static int vdso_getcpu(unsigned *cpu, unsigned *node)
+{
+#if defined(__i386__) || defined(__x86_64__) || defined(__aarch64__)
+	const volatile struct vdso_data *data = get_data();
+	uintptr_t val;
+	if (!data->getcpu)
+		return -ENOSYS;
+#if defined(__aarch64__)
+	__asm__ volatile ("mrs %0, tpidrro_el0" : "=r"(val));
+#else
+	__asm__ volatile ("rdtscp" : "=c"(val) : : "eax", "edx");
+#endif
+	if (cpu)
+		*cpu = val & ((1 << VDSO_CPU_SHIFT) - 1);
+	if (node)
+		*node = val >> VDSO_CPU_SHIFT;
+	return 0;
+#else
+	/* no register readable from userland is left to hold it */
+	(void)cpu;
+	(void)node;
+	return -ENOSYS;
+#endif
+}
+
+/* XXX the realtime clocks only have a precision of one second, so is
+ * the offset: the vdso may be a second away from the syscall
+ */
+static void init_realtime(struct vdso_data *data)
+{
+	struct timespec monotonic;
+	struct timespec realtime;
+	struct timespec diff;
+	if (clock_gettime(CLOCK_MONOTONIC, &monotonic)
+	 || clock_gettime(CLOCK_REALTIME, &realtime))
+		return;
+	timespec_diff(&diff, &realtime, &monotonic);
+	data->realtime_sec = diff.tv_sec;
+	data->realtime_nsec = diff.tv_nsec;
+}
+
+void vdso_init(void)
+{
+	struct vdso_data *data = NULL;
+	size_t size = &_vdso_end - &_vdso_begin;
+	g_vdso_pages_count = size / PAGE_SIZE;
+	g_vdso_pages = malloc(sizeof(*g_vdso_pages) * g_vdso_pages_count, 0);
+	if (!g_vdso_pages)
+		panic("vdso: failed to allocate pages\n");
+	for (size_t i = 0; i < g_vdso_pages_count; ++i)
+	{
+		if (pm_alloc_page(&g_vdso_pages[i]))
+			panic("vdso: failed to allocate page\n");
+		void *ptr = vm_map(g_vdso_pages[i], PAGE_SIZE, VM_PROT_W);
+		if (!ptr)
+			panic("vdso: failed to map page\n");
+		if (i)
+		{
+			memcpy(ptr, &(&_vdso_begin)[i * PAGE_SIZE], PAGE_SIZE);
+			vm_unmap(ptr, PAGE_SIZE);
+			continue;
+		}
+		memset(ptr, 0, PAGE_SIZE);
+		data = ptr; /* kept mapped for the updates */
+	}
+	data->header.magic = VDSO_MAGIC;
+	data->header.clock_gettime = (uintptr_t)vdso_clock_gettime
+	                           - (uintptr_t)&_vdso_begin;
+	data->header.getcpu = (uintptr_t)vdso_getcpu
+	                    - (uintptr_t)&_vdso_begin;
+#if defined(__i386__) || defined(__x86_64__)
+	if (curcpu()->arch.cpuid.ext_edx & CPUID_EXT_EDX_RDTSCP)
+		data->getcpu = 1;
+#elif defined(__aarch64__)
+	data->getcpu = 1;
+#endif
+	init_realtime(data);
+	g_data = data;
+	vdso_update();
+}
+
+void vdso_init_cpu(struct cpu *cpu)
+{
+	uintptr_t val = (cpu->node << VDSO_CPU_SHIFT) | cpu->id;
+#if defined(__i386__) || defined(__x86_64__)
+	if (cpu->arch.cpuid.ext_edx & CPUID_EXT_EDX_RDTSCP)
+		wrmsr(MSR_TSC_AUX, val);
+#elif defined(__aarch64__)
+	set_tpidrro_el0(val);
+	set_cntkctl_el1(get_cntkctl_el1() | CNTKCTL_EL0VCTEN);
+#elif defined(__arm__)
+	(void)val;
+	set_cntkctl(get_cntkctl() | CNTKCTL_PL0VCTEN);
+#elif defined(__riscv)
+	(void)val;
+	csrs(CSR_SCOUNTEREN, CSR_SCOUNTEREN_TM);
+#endif
+}
+
+/* only called by the first cpu, from its tick */
+void vdso_update(void)
+{
+	if (!g_data)
+		return;
+	const struct clock_counter *counter = clock_get_counter();
+	uint32_t seq = g_data->seq;
+	__atomic_store_n(&g_data->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	if (counter && counter->freq)
+	{
+		if (counter->freq != g_freq)
+		{
+			g_freq = counter->freq;
+			g_data->mult = (1000000000ULL << VDSO_SHIFT) / g_freq;
+			g_data->max_delta = g_freq;
+		}
+		uint64_t cycles = counter->read();
+		uint64_t ticks = cycles - counter->base;
+		g_data->cycle_last = cycles;
+		g_data->sec = ticks / g_freq;
+		g_data->nsec = ((ticks % g_freq) * 1000000000) / g_freq;
+		g_data->counter = 1;
+	}
+	else
+	{
+		g_data->counter = 0;
+	}
+	__atomic_store_n(&g_data->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static int vdso_fault(struct vm_zone *zone, off_t off, struct page **page)
+{
+	(void)zone;
+	size_t n = off / PAGE_SIZE;
+	if (n >= g_vdso_pages_count)
+		return -EFAULT;
+	pm_ref_page(g_vdso_pages[n]);
+	*page = g_vdso_pages[n];
+	return 0;
+}
+
+static const struct vm_zone_op vdso_vm_op =
+{
+	.fault = vdso_fault,
+};
+
+int vdso_map(struct vm_space *space, uintptr_t *addr)
+{
+	struct vm_zone *zone;
+	size_t size = g_vdso_pages_count * PAGE_SIZE;
+	mutex_lock(&space->mutex);
+	int ret = vm_alloc(space, 0, 0, size, VM_PROT_R, MAP_PRIVATE, NULL,
+	                   &zone);
+	if (ret)
+		goto end;
+	/* the pages are the same for every space */
+	zone->op = &vdso_vm_op;
+	zone->flags |= MAP_NOWRITE;
+	*addr = zone->addr;
+	ret = vm_space_protect(space, *addr + PAGE_SIZE, size - PAGE_SIZE,
+	                       VM_PROT_RX);
+	if (ret)
+		vm_free(space, *addr, size);
+
+end:
+	mutex_unlock(&space->mutex);
+	return ret;
+}
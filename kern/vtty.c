@@ -735,7 +735,7 @@ void vtty_free(struct vtty *vtty)
 {
 	if (!vtty)
 		return;
-	/* XXX cursor timer remove */
+	timer_remove(&vtty->cursor_timer);
 	free(vtty->line_widths);
 	free(vtty->buf);
 	tty_free(vtty->tty);
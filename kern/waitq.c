@@ -1,14 +1,11 @@
 #include <errno.h>
 #include <sched.h>
 #include <waitq.h>
+#include <timer.h>
 #include <proc.h>
 #include <cpu.h>
 #include <std.h>
 
-/* queue of threads waiting and having a timeout, ordered by timeout asc */
-struct spinlock g_timeout_lock = SPINLOCK_INITIALIZER();
-static TAILQ_HEAD(, thread) g_timeout_threads = TAILQ_HEAD_INITIALIZER(g_timeout_threads);
-
 void waitq_init(struct waitq *waitq)
 {
 	spinlock_init(&waitq->spinlock);
@@ -36,52 +33,20 @@ static void wakeup_thread(struct waitq *waitq, struct thread *thread, int reason
 void waitq_wakeup_thread(struct waitq *waitq, struct thread *thread, int reason)
 {
 	if (thread->wait_timeout.tv_sec || thread->wait_timeout.tv_nsec)
-	{
-		spinlock_lock(&g_timeout_lock);
-		TAILQ_REMOVE(&g_timeout_threads, thread, waitq_timeout_chain);
-		spinlock_unlock(&g_timeout_lock);
-	}
+		timer_remove(&thread->wait_timer);
 	wakeup_thread(waitq, thread, reason);
 }
 
-void waitq_check_timeout(void)
+static void timeout_cb(struct timer *timer)
 {
-	struct timespec cur;
-	clock_gettime(CLOCK_MONOTONIC, &cur);
-	struct thread *thread;
-	while (1)
-	{
-		spinlock_lock(&g_timeout_lock);
-		thread = TAILQ_FIRST(&g_timeout_threads);
-		if (!thread)
-			break;
-		if (timespec_cmp(&cur, &thread->wait_timeout) > 0)
-		{
-			TAILQ_REMOVE(&g_timeout_threads, thread, waitq_timeout_chain);
-			spinlock_unlock(&g_timeout_lock);
-			wakeup_thread(thread->waitq, thread, -EWOULDBLOCK);
-			continue;
-		}
-		break;
-	}
-	spinlock_unlock(&g_timeout_lock);
-}
-
-static void add_waiting_thread(struct thread *thread)
-{
-	struct thread *it;
-	spinlock_lock(&g_timeout_lock);
-	TAILQ_FOREACH(it, &g_timeout_threads, waitq_timeout_chain)
-	{
-		if (timespec_cmp(&thread->wait_timeout, &it->wait_timeout) < 0)
-		{
-			TAILQ_INSERT_BEFORE(it, thread, waitq_timeout_chain);
-			spinlock_unlock(&g_timeout_lock);
-			return;
-		}
-	}
-	TAILQ_INSERT_TAIL(&g_timeout_threads, thread, waitq_timeout_chain);
-	spinlock_unlock(&g_timeout_lock);
+	struct thread *thread = timer->userdata;
+	struct waitq *waitq = thread->waitq;
+	if (!waitq)
+		return;
+	spinlock_lock(&waitq->spinlock);
+	if (thread->state == THREAD_WAITING && thread->waitq == waitq)
+		wakeup_thread(waitq, thread, -EWOULDBLOCK);
+	spinlock_unlock(&waitq->spinlock);
 }
 
 static void prepare_sleep(struct thread *thread, struct waitq *waitq,
@@ -100,7 +65,8 @@ static void prepare_sleep(struct thread *thread, struct waitq *waitq,
 	{
 		clock_gettime(CLOCK_MONOTONIC, &thread->wait_timeout);
 		timespec_add(&thread->wait_timeout, timeout);
-		add_waiting_thread(thread);
+		timer_add(&thread->wait_timer, thread->wait_timeout,
+		          timeout_cb, thread);
 	}
 }
 
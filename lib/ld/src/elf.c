@@ -386,9 +386,9 @@ static int handle_pt_load(struct elf *elf, const Elf_Phdr *phdr, int fd)
 static int elf_read(struct elf *elf, int fd)
 {
 	Elf_Ehdr ehdr;
-	if (read(fd, &ehdr, sizeof(ehdr)) != sizeof(ehdr))
+	if (pread(fd, &ehdr, sizeof(ehdr), 0) != sizeof(ehdr))
 	{
-		LD_ERR("read: %s", strerror(errno));
+		LD_ERR("pread: %s", strerror(errno));
 		return 1;
 	}
 	if (ehdr.e_ident[EI_MAG0] != ELFMAG0
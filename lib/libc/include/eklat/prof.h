@@ -0,0 +1,70 @@
+#ifndef EKLAT_PROF_H
+#define EKLAT_PROF_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROFIO_START 0x201
+#define PROFIO_STOP  0x202
+#define PROFIO_KSYM  0x203
+#define PROFIO_STATS 0x204
+
+#define PROF_F_KERNEL    (1 << 0)
+#define PROF_F_USER      (1 << 1)
+#define PROF_F_CALLCHAIN (1 << 2)
+
+#define PROF_MAX_DEPTH 32
+
+struct prof_config
+{
+	uint32_t frequency;
+	uint32_t flags;
+	int32_t pid;
+	uint32_t pad0;
+};
+
+#define PROF_FRAME_USER (1 << 0)
+#define PROF_FRAME_FILE (1 << 1)
+
+struct prof_frame
+{
+	uint64_t pc;
+	uint64_t off;
+	uint64_t ino;
+	uint32_t dev;
+	uint32_t flags;
+};
+
+struct prof_sample
+{
+	uint32_t size;
+	uint32_t cpu;
+	int32_t pid;
+	int32_t tid;
+	uint64_t time;
+	uint32_t depth;
+	uint32_t pad0;
+	struct prof_frame frames[];
+};
+
+struct prof_stats
+{
+	uint64_t samples;
+	uint64_t dropped;
+};
+
+struct prof_ksym
+{
+	uint64_t addr;
+	uint64_t off;
+	char name[128];
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef EKLAT_TRACE_H
+#define EKLAT_TRACE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACEIO_START 0x301
+#define TRACEIO_STOP  0x302
+#define TRACEIO_STATS 0x303
+
+enum tp_event
+{
+	TP_SCHED_SWITCH,
+	TP_SCHED_WAKEUP,
+	TP_PAGE_FAULT,
+	TP_SYSCALL_ENTER,
+	TP_SYSCALL_EXIT,
+	TP_BLOCK_SUBMIT,
+	TP_BLOCK_COMPLETE,
+	TP_NET_RX,
+	TP_NET_TX,
+	TP_TCP_INPUT,
+	TP_TCP_OUTPUT,
+	TP_EVENT_COUNT,
+};
+
+#define TP_COMM_LEN 16
+
+/* every record starts with this header, followed by the event payload */
+struct tp_header
+{
+	uint16_t size; /* header + payload */
+	uint16_t event;
+	uint32_t cpu;
+	uint64_t time; /* CLOCK_MONOTONIC, in ns */
+	int32_t pid;
+	int32_t tid;
+};
+
+struct tp_sched_switch
+{
+	int32_t prev_pid;
+	int32_t prev_tid;
+	int32_t prev_pri;
+	int32_t prev_state; /* 0: preempted, otherwise blocked */
+	int32_t next_pid;
+	int32_t next_tid;
+	int32_t next_pri;
+	uint32_t pad0;
+	char prev_comm[TP_COMM_LEN];
+	char next_comm[TP_COMM_LEN];
+};
+
+struct tp_sched_wakeup
+{
+	int32_t pid;
+	int32_t tid;
+	int32_t pri;
+	uint32_t target_cpu;
+	char comm[TP_COMM_LEN];
+};
+
+struct tp_page_fault
+{
+	uint64_t addr;
+	uint64_t duration; /* in ns */
+	uint32_t prot;
+	int32_t ret;
+};
+
+struct tp_syscall_enter
+{
+	uint64_t id;
+	uint64_t args[6];
+};
+
+struct tp_syscall_exit
+{
+	uint64_t id;
+	int64_t ret;
+	uint64_t duration; /* in ns */
+};
+
+/* used by both TP_BLOCK_SUBMIT and TP_BLOCK_COMPLETE
+ * ret and duration are only meaningful on completion
+ */
+struct tp_block
+{
+	uint64_t off;
+	uint64_t size;
+	int64_t ret;
+	uint64_t duration; /* in ns */
+	uint32_t dev;
+	uint32_t write;
+};
+
+/* used by both TP_NET_RX and TP_NET_TX */
+struct tp_net
+{
+	char ifname[16];
+	uint32_t len;
+	uint16_t proto; /* ether type */
+	uint16_t pad0;
+};
+
+/* used by both TP_TCP_INPUT and TP_TCP_OUTPUT */
+struct tp_tcp
+{
+	uint16_t sport;
+	uint16_t dport;
+	uint32_t seq;
+	uint32_t ack;
+	uint32_t len; /* including tcp header */
+	uint16_t win;
+	uint8_t flags;
+	uint8_t pad0;
+};
+
+struct tp_stats
+{
+	uint64_t events;
+	uint64_t dropped;
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -42,6 +42,11 @@ extern "C" {
 #define F_WRLCK 1
 #define F_UNLCK 2
 
+#define SPLICE_F_MOVE     (1 << 0)
+#define SPLICE_F_NONBLOCK (1 << 1)
+#define SPLICE_F_MORE     (1 << 2)
+#define SPLICE_F_GIFT     (1 << 3)
+
 #define FD_CLOEXEC (1 << 0)
 
 struct flock
@@ -58,6 +63,9 @@ int creat(const char *pathname, mode_t mode);
 int openat(int dirfd, const char *pathname, int flags, ...);
 
 int fcntl(int fd, int cmd, ...);
+ssize_t splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out,
+               size_t len, unsigned flags);
+ssize_t tee(int fd_in, int fd_out, size_t len, unsigned flags);
 
 #ifdef __cplusplus
 }
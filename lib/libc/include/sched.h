@@ -11,6 +11,7 @@ extern "C" {
 
 int sched_yield(void);
 pid_t clone(int flags);
+int getcpu(unsigned *cpu, unsigned *node);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,94 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <sys/types.h>
+
+#include <signal.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POSIX_SPAWN_SETPGROUP  (1 << 0)
+#define POSIX_SPAWN_SETSIGMASK (1 << 1)
+#define POSIX_SPAWN_SETSIGDEF  (1 << 2)
+
+#define SPAWN_FA_CLOSE 0
+#define SPAWN_FA_DUP2  1
+#define SPAWN_FA_OPEN  2
+
+#define SPAWN_ACTIONS_MAX 64
+
+struct spawn_file_action
+{
+	int type;
+	int fd;
+	int srcfd;
+	int flags;
+	mode_t mode;
+	const char *path;
+};
+
+struct spawn_attr
+{
+	int flags;
+	pid_t pgroup;
+	sigset_t sigmask;
+	sigset_t sigdefault;
+	const struct spawn_file_action *actions;
+	size_t actions_nb;
+};
+
+typedef struct
+{
+	struct spawn_file_action *actions;
+	size_t actions_nb;
+} posix_spawn_file_actions_t;
+
+typedef struct
+{
+	short flags;
+	pid_t pgroup;
+	sigset_t sigmask;
+	sigset_t sigdefault;
+} posix_spawnattr_t;
+
+int posix_spawn(pid_t *pid, const char *path,
+                const posix_spawn_file_actions_t *file_actions,
+                const posix_spawnattr_t *attrp,
+                char * const argv[], char * const envp[]);
+int posix_spawnp(pid_t *pid, const char *file,
+                 const posix_spawn_file_actions_t *file_actions,
+                 const posix_spawnattr_t *attrp,
+                 char * const argv[], char * const envp[]);
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *file_actions);
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *file_actions);
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *file_actions,
+                                      int fd);
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *file_actions,
+                                     int fd, int newfd);
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *file_actions,
+                                     int fd, const char *path, int flags,
+                                     mode_t mode);
+
+int posix_spawnattr_init(posix_spawnattr_t *attr);
+int posix_spawnattr_destroy(posix_spawnattr_t *attr);
+int posix_spawnattr_getflags(const posix_spawnattr_t *attr, short *flags);
+int posix_spawnattr_setflags(posix_spawnattr_t *attr, short flags);
+int posix_spawnattr_getpgroup(const posix_spawnattr_t *attr, pid_t *pgroup);
+int posix_spawnattr_setpgroup(posix_spawnattr_t *attr, pid_t pgroup);
+int posix_spawnattr_getsigmask(const posix_spawnattr_t *attr,
+                               sigset_t *sigmask);
+int posix_spawnattr_setsigmask(posix_spawnattr_t *attr,
+                               const sigset_t *sigmask);
+int posix_spawnattr_getsigdefault(const posix_spawnattr_t *attr,
+                                  sigset_t *sigdefault);
+int posix_spawnattr_setsigdefault(posix_spawnattr_t *attr,
+                                  const sigset_t *sigdefault);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -31,8 +31,11 @@ extern "C" {
 
 #define MAP_FAILED ((void*)-1)
 
-#define MADV_NORMAL   0
-#define MADV_DONTNEED 1
+#define MADV_NORMAL     0
+#define MADV_DONTNEED   1
+#define MADV_RANDOM     2
+#define MADV_SEQUENTIAL 3
+#define MADV_WILLNEED   4
 
 void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off);
 int munmap(void *addr, size_t len);
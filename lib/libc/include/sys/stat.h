@@ -83,6 +83,22 @@ struct sys_dirent
 	char name[];
 } __attribute__((packed));
 
+/* records of getdentsplus, aligned on 8 bytes: name is nul-terminated and
+ * st is only filled if flags has DIRENTPLUS_STAT (the name may have been
+ * removed since the directory has been read), st_ino being always set
+ */
+#define DIRENTPLUS_STAT (1 << 0)
+
+struct sys_direntplus
+{
+	struct stat st;
+	off_t off;
+	uint16_t reclen;
+	uint8_t type;
+	uint8_t flags;
+	char name[];
+};
+
 int utimensat(int dirfd, const char *pathname, const struct timespec times[2],
               int flags);
 int futimens(int fd, const struct timespec times[2]);
@@ -0,0 +1,15 @@
+#ifndef SYS_SWAP_H
+#define SYS_SWAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int swapon(const char *path, int flags);
+int swapoff(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
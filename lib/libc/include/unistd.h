@@ -57,11 +57,14 @@ extern "C" {
 
 struct stat;
 struct sys_dirent;
+struct sys_direntplus;
 
 typedef unsigned useconds_t;
 
 ssize_t write(int fd, const void *buffer, size_t count);
 ssize_t read(int fd, void *buffer, size_t count);
+ssize_t pwrite(int fd, const void *buffer, size_t count, off_t offset);
+ssize_t pread(int fd, void *buffer, size_t count, off_t offset);
 off_t lseek(int fd, off_t offset, int whence);
 void _exit(int status) __attribute__((noreturn));
 void exit_group(int status) __attribute__((noreturn));
@@ -87,8 +90,10 @@ int ftruncate(int fd, off_t length);
 int ftruncateat(int dirfd, const char *pathname, off_t length, int flags);
 int fsync(int fd);
 int fdatasync(int fd);
+void sync(void);
 
 int getdents(int fd, struct sys_dirent *dirp, unsigned long count);
+int getdentsplus(int fd, struct sys_direntplus *dirp, unsigned long count);
 
 pid_t getpid(void);
 pid_t getppid(void);
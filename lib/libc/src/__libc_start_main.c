@@ -1,3 +1,5 @@
+#include "_vdso.h"
+
 #include <sys/auxv.h>
 
 #include <stddef.h>
@@ -19,6 +21,7 @@ int __libc_start_main(int (*main)(int, char**, char**), int argc, char **argv, c
 		__libc_progname = argv[0];
 	__libc_auxv = auxv;
 	__stack_chk_guard = getauxval(AT_RANDOM);
+	_vdso_init();
 	size_t envc = 0;
 	while (envp[envc])
 		envc++;
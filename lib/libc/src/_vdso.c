@@ -0,0 +1,18 @@
+#include "_vdso.h"
+
+#include <sys/auxv.h>
+
+int (*_vdso_clock_gettime)(clockid_t clk_id, struct timespec *tp);
+int (*_vdso_getcpu)(unsigned *cpu, unsigned *node);
+
+void _vdso_init(void)
+{
+	uintptr_t base = getauxval(AT_SYSINFO_EHDR);
+	if (!base)
+		return;
+	const struct vdso_header *header = (const struct vdso_header*)base;
+	if (header->magic != VDSO_MAGIC)
+		return;
+	_vdso_clock_gettime = (void*)(base + header->clock_gettime);
+	_vdso_getcpu = (void*)(base + header->getcpu);
+}
@@ -0,0 +1,23 @@
+#ifndef _VDSO_H
+#define _VDSO_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define VDSO_MAGIC 0x4F534456
+
+/* start of the image mapped by the kernel, see AT_SYSINFO_EHDR */
+struct vdso_header
+{
+	uint32_t magic;
+	uint32_t clock_gettime;
+	uint32_t getcpu;
+};
+
+/* both return -ENOSYS when the syscall has to be used */
+extern int (*_vdso_clock_gettime)(clockid_t clk_id, struct timespec *tp);
+extern int (*_vdso_getcpu)(unsigned *cpu, unsigned *node);
+
+void _vdso_init(void);
+
+#endif
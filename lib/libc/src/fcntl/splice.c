@@ -0,0 +1,10 @@
+#include "../_syscall.h"
+
+#include <fcntl.h>
+
+ssize_t splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out,
+               size_t len, unsigned flags)
+{
+	return syscall6(SYS_splice, fd_in, (uintptr_t)off_in, fd_out,
+	                (uintptr_t)off_out, len, flags);
+}
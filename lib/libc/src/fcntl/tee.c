@@ -0,0 +1,8 @@
+#include "../_syscall.h"
+
+#include <fcntl.h>
+
+ssize_t tee(int fd_in, int fd_out, size_t len, unsigned flags)
+{
+	return syscall4(SYS_tee, fd_in, fd_out, len, flags);
+}
@@ -0,0 +1,15 @@
+#include "../_syscall.h"
+#include "../_vdso.h"
+
+#include <sched.h>
+
+int getcpu(unsigned *cpu, unsigned *node)
+{
+	if (_vdso_getcpu)
+	{
+		int ret = _vdso_getcpu(cpu, node);
+		if (ret != -ENOSYS)
+			return convert_errno(ret);
+	}
+	return syscall2(SYS_getcpu, (uintptr_t)cpu, (uintptr_t)node);
+}
@@ -0,0 +1,19 @@
+#include "_spawn.h"
+
+#include <stdlib.h>
+#include <errno.h>
+
+int spawn_add_action(posix_spawn_file_actions_t *file_actions,
+                     const struct spawn_file_action *action)
+{
+	if (file_actions->actions_nb >= SPAWN_ACTIONS_MAX)
+		return ENOMEM;
+	struct spawn_file_action *actions = realloc(file_actions->actions,
+	                                            sizeof(*actions)
+	                                          * (file_actions->actions_nb + 1));
+	if (!actions)
+		return ENOMEM;
+	actions[file_actions->actions_nb++] = *action;
+	file_actions->actions = actions;
+	return 0;
+}
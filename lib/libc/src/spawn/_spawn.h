@@ -0,0 +1,9 @@
+#ifndef _SPAWN_H
+#define _SPAWN_H
+
+#include <spawn.h>
+
+int spawn_add_action(posix_spawn_file_actions_t *file_actions,
+                     const struct spawn_file_action *action);
+
+#endif
@@ -0,0 +1,33 @@
+#include "../_syscall.h"
+
+#include <string.h>
+#include <spawn.h>
+#include <errno.h>
+
+int posix_spawn(pid_t *pid, const char *path,
+                const posix_spawn_file_actions_t *file_actions,
+                const posix_spawnattr_t *attrp,
+                char * const argv[], char * const envp[])
+{
+	struct spawn_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	if (attrp)
+	{
+		attr.flags = attrp->flags;
+		attr.pgroup = attrp->pgroup;
+		attr.sigmask = attrp->sigmask;
+		attr.sigdefault = attrp->sigdefault;
+	}
+	if (file_actions)
+	{
+		attr.actions = file_actions->actions;
+		attr.actions_nb = file_actions->actions_nb;
+	}
+	int ret = syscall4(SYS_spawn, (uintptr_t)path, (uintptr_t)&attr,
+	                   (uintptr_t)argv, (uintptr_t)envp);
+	if (ret == -1)
+		return errno;
+	if (pid)
+		*pid = ret;
+	return 0;
+}
@@ -0,0 +1,18 @@
+#include "_spawn.h"
+
+#include <errno.h>
+
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *file_actions,
+                                      int fd)
+{
+	struct spawn_file_action action;
+	if (fd < 0)
+		return EBADF;
+	action.type = SPAWN_FA_CLOSE;
+	action.fd = fd;
+	action.srcfd = -1;
+	action.flags = 0;
+	action.mode = 0;
+	action.path = NULL;
+	return spawn_add_action(file_actions, &action);
+}
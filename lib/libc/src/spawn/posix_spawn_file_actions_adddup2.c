@@ -0,0 +1,18 @@
+#include "_spawn.h"
+
+#include <errno.h>
+
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *file_actions,
+                                     int fd, int newfd)
+{
+	struct spawn_file_action action;
+	if (fd < 0 || newfd < 0)
+		return EBADF;
+	action.type = SPAWN_FA_DUP2;
+	action.fd = newfd;
+	action.srcfd = fd;
+	action.flags = 0;
+	action.mode = 0;
+	action.path = NULL;
+	return spawn_add_action(file_actions, &action);
+}
@@ -0,0 +1,26 @@
+#include "_spawn.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *file_actions,
+                                     int fd, const char *path, int flags,
+                                     mode_t mode)
+{
+	struct spawn_file_action action;
+	if (fd < 0)
+		return EBADF;
+	action.type = SPAWN_FA_OPEN;
+	action.fd = fd;
+	action.srcfd = -1;
+	action.flags = flags;
+	action.mode = mode;
+	action.path = strdup(path);
+	if (!action.path)
+		return ENOMEM;
+	int ret = spawn_add_action(file_actions, &action);
+	if (ret)
+		free((char*)action.path);
+	return ret;
+}
@@ -0,0 +1,12 @@
+#include <stdlib.h>
+#include <spawn.h>
+
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *file_actions)
+{
+	for (size_t i = 0; i < file_actions->actions_nb; ++i)
+		free((char*)file_actions->actions[i].path);
+	free(file_actions->actions);
+	file_actions->actions = NULL;
+	file_actions->actions_nb = 0;
+	return 0;
+}
@@ -0,0 +1,8 @@
+#include <spawn.h>
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *file_actions)
+{
+	file_actions->actions = NULL;
+	file_actions->actions_nb = 0;
+	return 0;
+}
@@ -0,0 +1,7 @@
+#include <spawn.h>
+
+int posix_spawnattr_destroy(posix_spawnattr_t *attr)
+{
+	(void)attr;
+	return 0;
+}
@@ -0,0 +1,8 @@
+#include <spawn.h>
+
+int posix_spawnattr_getsigdefault(const posix_spawnattr_t *attr,
+                                  sigset_t *sigdefault)
+{
+	*sigdefault = attr->sigdefault;
+	return 0;
+}
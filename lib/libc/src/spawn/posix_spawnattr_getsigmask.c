@@ -0,0 +1,8 @@
+#include <spawn.h>
+
+int posix_spawnattr_getsigmask(const posix_spawnattr_t *attr,
+                               sigset_t *sigmask)
+{
+	*sigmask = attr->sigmask;
+	return 0;
+}
@@ -0,0 +1,12 @@
+#include <spawn.h>
+#include <errno.h>
+
+int posix_spawnattr_setflags(posix_spawnattr_t *attr, short flags)
+{
+	if (flags & ~(POSIX_SPAWN_SETPGROUP
+	            | POSIX_SPAWN_SETSIGMASK
+	            | POSIX_SPAWN_SETSIGDEF))
+		return EINVAL;
+	attr->flags = flags;
+	return 0;
+}
@@ -0,0 +1,8 @@
+#include <spawn.h>
+
+int posix_spawnattr_setsigdefault(posix_spawnattr_t *attr,
+                                  const sigset_t *sigdefault)
+{
+	attr->sigdefault = *sigdefault;
+	return 0;
+}
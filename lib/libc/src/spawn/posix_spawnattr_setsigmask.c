@@ -0,0 +1,8 @@
+#include <spawn.h>
+
+int posix_spawnattr_setsigmask(posix_spawnattr_t *attr,
+                               const sigset_t *sigmask)
+{
+	attr->sigmask = *sigmask;
+	return 0;
+}
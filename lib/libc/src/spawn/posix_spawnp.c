@@ -0,0 +1,52 @@
+#include <sys/param.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <spawn.h>
+#include <errno.h>
+
+int posix_spawnp(pid_t *pid, const char *file,
+                 const posix_spawn_file_actions_t *file_actions,
+                 const posix_spawnattr_t *attrp,
+                 char * const argv[], char * const envp[])
+{
+	if (!*file)
+		return ENOENT;
+	if (strchr(file, '/'))
+		return posix_spawn(pid, file, file_actions, attrp, argv, envp);
+	const char *path = getenv("PATH");
+	if (!path)
+		path = "/bin:/usr/bin";
+	size_t file_len = strlen(file);
+	int eacces = 0;
+	while (1)
+	{
+		char buf[MAXPATHLEN];
+		const char *end = strchrnul(path, ':');
+		size_t len = end - path;
+		if (len + file_len + 2 <= sizeof(buf))
+		{
+			memcpy(buf, path, len);
+			if (len)
+				buf[len++] = '/';
+			memcpy(&buf[len], file, file_len + 1);
+			int ret = posix_spawn(pid, buf, file_actions, attrp, argv,
+			                      envp);
+			switch (ret)
+			{
+				case EACCES:
+					eacces = 1;
+					/* FALLTHROUGH */
+				case ENOENT:
+				case ENOTDIR:
+					break;
+				default:
+					return ret;
+			}
+		}
+		if (!*end)
+			break;
+		path = end + 1;
+	}
+	return eacces ? EACCES : ENOENT;
+}
@@ -0,0 +1,13 @@
+#include "_syscall.h"
+
+#include <sys/swap.h>
+
+int swapon(const char *path, int flags)
+{
+	return syscall2(SYS_swapon, (uintptr_t)path, flags);
+}
+
+int swapoff(const char *path)
+{
+	return syscall1(SYS_swapoff, (uintptr_t)path);
+}
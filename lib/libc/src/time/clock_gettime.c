@@ -0,0 +1,15 @@
+#include "../_syscall.h"
+#include "../_vdso.h"
+
+#include <time.h>
+
+int clock_gettime(clockid_t clk_id, struct timespec *tp)
+{
+	if (_vdso_clock_gettime)
+	{
+		int ret = _vdso_clock_gettime(clk_id, tp);
+		if (ret != -ENOSYS)
+			return convert_errno(ret);
+	}
+	return syscall2(SYS_clock_gettime, clk_id, (uintptr_t)tp);
+}
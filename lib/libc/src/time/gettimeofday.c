@@ -0,0 +1,21 @@
+#include <sys/time.h>
+
+#include <time.h>
+
+int gettimeofday(struct timeval *tv, struct timezone *tz)
+{
+	if (tv)
+	{
+		struct timespec ts;
+		if (clock_gettime(CLOCK_REALTIME, &ts) == -1)
+			return -1;
+		tv->tv_sec = ts.tv_sec;
+		tv->tv_usec = ts.tv_nsec / 1000;
+	}
+	if (tz)
+	{
+		tz->tz_minuteswest = 0;
+		tz->tz_dsttime = 0;
+	}
+	return 0;
+}
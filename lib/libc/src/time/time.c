@@ -0,0 +1,11 @@
+#include <time.h>
+
+time_t time(time_t *tloc)
+{
+	struct timespec ts;
+	if (clock_gettime(CLOCK_REALTIME, &ts) == -1)
+		return -1;
+	if (tloc)
+		*tloc = ts.tv_sec;
+	return ts.tv_sec;
+}
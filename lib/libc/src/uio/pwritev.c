@@ -0,0 +1,9 @@
+#include "../_syscall.h"
+
+#include <sys/uio.h>
+
+ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{
+	return syscall4(SYS_pwritev, fd, (uintptr_t)iov, iovcnt,
+	                (uintptr_t)&offset);
+}
@@ -0,0 +1,10 @@
+#include "../_syscall.h"
+
+#include <sys/stat.h>
+
+#include <unistd.h>
+
+int getdentsplus(int fd, struct sys_direntplus *dirp, unsigned long count)
+{
+	return syscall3(SYS_getdentsplus, fd, (uintptr_t)dirp, count);
+}
@@ -0,0 +1,11 @@
+#include <sys/uio.h>
+
+#include <unistd.h>
+
+ssize_t pread(int fd, void *buffer, size_t count, off_t offset)
+{
+	struct iovec iov;
+	iov.iov_base = buffer;
+	iov.iov_len = count;
+	return preadv(fd, &iov, 1, offset);
+}
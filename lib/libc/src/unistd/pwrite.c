@@ -0,0 +1,11 @@
+#include <sys/uio.h>
+
+#include <unistd.h>
+
+ssize_t pwrite(int fd, const void *buffer, size_t count, off_t offset)
+{
+	struct iovec iov;
+	iov.iov_base = (void*)buffer;
+	iov.iov_len = count;
+	return pwritev(fd, &iov, 1, offset);
+}
@@ -0,0 +1,8 @@
+#include "../_syscall.h"
+
+#include <unistd.h>
+
+void sync(void)
+{
+	syscall0(SYS_sync);
+}
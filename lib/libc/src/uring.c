@@ -0,0 +1,15 @@
+#include "_syscall.h"
+
+#include <sys/uring.h>
+
+int uring_setup(uint32_t entries, struct uring_params *params)
+{
+	return syscall2(SYS_uring_setup, entries, (uintptr_t)params);
+}
+
+int uring_enter(int fd, uint32_t to_submit, uint32_t min_complete,
+                uint32_t flags, const struct timespec *timeout)
+{
+	return syscall5(SYS_uring_enter, fd, to_submit, min_complete, flags,
+	                (uintptr_t)timeout);
+}
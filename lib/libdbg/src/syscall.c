@@ -574,6 +574,9 @@ static const struct bitmask_value advise_values[] =
 {
 	BITMASK_VALUE(MADV_NORMAL),
 	BITMASK_VALUE(MADV_DONTNEED),
+	BITMASK_VALUE(MADV_RANDOM),
+	BITMASK_VALUE(MADV_SEQUENTIAL),
+	BITMASK_VALUE(MADV_WILLNEED),
 	BITMASK_END
 };
 
@@ -1535,6 +1538,16 @@ static const struct dbg_syscall syscalls[] =
 	                     {{"set",           DBG_SYSCALL_ARG_SIGSET,
 	                                        DBG_SYSCALL_ARG_OUT}}},
 
+	[SYS_spawn]         = {"spawn",         DBG_SYSCALL_RET_PID, 4,
+	                     {{"path",          DBG_SYSCALL_ARG_PATH,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"attr",          DBG_SYSCALL_ARG_PTR,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"argv",          DBG_SYSCALL_ARG_STRA,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"envp",          DBG_SYSCALL_ARG_STRA,
+	                                        DBG_SYSCALL_ARG_IN}}},
+
 	[SYS_openat]        = {"openat",        DBG_SYSCALL_RET_FD, 4,
 	                     {{"dirfd",         DBG_SYSCALL_ARG_DIRFD,
 	                                        DBG_SYSCALL_ARG_IN},
@@ -1816,6 +1829,60 @@ static const struct dbg_syscall syscalls[] =
 	                     {{"path",          DBG_SYSCALL_ARG_PATH,
 	                                        DBG_SYSCALL_ARG_IN}}},
 
+	[SYS_sendfile]      = {"sendfile",      DBG_SYSCALL_RET_SSIZE, 4,
+	                     {{"out_fd",        DBG_SYSCALL_ARG_FD,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"in_fd",         DBG_SYSCALL_ARG_FD,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"offset",        DBG_SYSCALL_ARG_OFF,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"count",         DBG_SYSCALL_ARG_ULONG,
+	                                        DBG_SYSCALL_ARG_IN}}},
+
+	[SYS_splice]        = {"splice",        DBG_SYSCALL_RET_SSIZE, 6,
+	                     {{"fd_in",         DBG_SYSCALL_ARG_FD,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"off_in",        DBG_SYSCALL_ARG_OFF,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"fd_out",        DBG_SYSCALL_ARG_FD,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"off_out",       DBG_SYSCALL_ARG_OFF,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"len",           DBG_SYSCALL_ARG_ULONG,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"flags",         DBG_SYSCALL_ARG_UINT,
+	                                        DBG_SYSCALL_ARG_IN}}},
+
+	[SYS_tee]           = {"tee",           DBG_SYSCALL_RET_SSIZE, 4,
+	                     {{"fd_in",         DBG_SYSCALL_ARG_FD,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"fd_out",        DBG_SYSCALL_ARG_FD,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"len",           DBG_SYSCALL_ARG_ULONG,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"flags",         DBG_SYSCALL_ARG_UINT,
+	                                        DBG_SYSCALL_ARG_IN}}},
+
+	[SYS_preadv]        = {"preadv",        DBG_SYSCALL_RET_SSIZE, 4,
+	                     {{"fd",            DBG_SYSCALL_ARG_FD,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"iov",           DBG_SYSCALL_ARG_IOV,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"iovcnt",        DBG_SYSCALL_ARG_IOVCNT,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"offset",        DBG_SYSCALL_ARG_OFF,
+	                                        DBG_SYSCALL_ARG_IN}}},
+
+	[SYS_pwritev]       = {"pwritev",       DBG_SYSCALL_RET_SSIZE, 4,
+	                     {{"fd",            DBG_SYSCALL_ARG_FD,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"iov",           DBG_SYSCALL_ARG_IOV,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"iovcnt",        DBG_SYSCALL_ARG_IOVCNT,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"offset",        DBG_SYSCALL_ARG_OFF,
+	                                        DBG_SYSCALL_ARG_IN}}},
+
 	[SYS_getuid]        = {"getuid",        DBG_SYSCALL_RET_UID, 0},
 
 	[SYS_getgid]        = {"getgid",        DBG_SYSCALL_RET_GID, 0},
@@ -1855,6 +1922,32 @@ static const struct dbg_syscall syscalls[] =
 	                     {{"gid",           DBG_SYSCALL_ARG_GID,
 	                                        DBG_SYSCALL_ARG_IN}}},
 
+	[SYS_uring_setup]   = {"uring_setup",   DBG_SYSCALL_RET_FD, 2,
+	                     {{"entries",       DBG_SYSCALL_ARG_UINT,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"params",        DBG_SYSCALL_ARG_PTR,
+	                                        DBG_SYSCALL_ARG_IN}}},
+
+	[SYS_uring_enter]   = {"uring_enter",   DBG_SYSCALL_RET_INT, 5,
+	                     {{"fd",            DBG_SYSCALL_ARG_FD,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"to_submit",     DBG_SYSCALL_ARG_UINT,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"min_complete",  DBG_SYSCALL_ARG_UINT,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"flags",         DBG_SYSCALL_ARG_UINT,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"timeout",       DBG_SYSCALL_ARG_TIMESPEC,
+	                                        DBG_SYSCALL_ARG_IN}}},
+
+	[SYS_getdentsplus]  = {"getdentsplus",  DBG_SYSCALL_RET_INT, 3,
+	                     {{"fd",            DBG_SYSCALL_ARG_FD,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"dirp",          DBG_SYSCALL_ARG_PTR,
+	                                        DBG_SYSCALL_ARG_OUT},
+	                      {"count",         DBG_SYSCALL_ARG_ULONG,
+	                                        DBG_SYSCALL_ARG_IN}}},
+
 	[SYS_socket]        = {"socket",        DBG_SYSCALL_RET_FD, 3,
 	                     {{"domain",        DBG_SYSCALL_ARG_SOCK_FAMILY,
 	                                        DBG_SYSCALL_ARG_IN},
@@ -2060,6 +2153,26 @@ static const struct dbg_syscall syscalls[] =
 	                     {{"cmd",           DBG_SYSCALL_ARG_REBOOT_CMD,
 	                                        DBG_SYSCALL_ARG_IN}}},
 
+	[SYS_sync]          = {"sync",          DBG_SYSCALL_RET_INT, 0},
+
+	[SYS_pagedaemon]    = {"pagedaemon",    DBG_SYSCALL_RET_INT, 0},
+
+	[SYS_swapon]        = {"swapon",        DBG_SYSCALL_RET_INT, 2,
+	                     {{"path",          DBG_SYSCALL_ARG_PATH,
+	                                        DBG_SYSCALL_ARG_IN},
+	                      {"flags",         DBG_SYSCALL_ARG_INT,
+	                                        DBG_SYSCALL_ARG_IN}}},
+
+	[SYS_swapoff]       = {"swapoff",       DBG_SYSCALL_RET_INT, 1,
+	                     {{"path",          DBG_SYSCALL_ARG_PATH,
+	                                        DBG_SYSCALL_ARG_IN}}},
+
+	[SYS_getcpu]        = {"getcpu",        DBG_SYSCALL_RET_INT, 2,
+	                     {{"cpu",           DBG_SYSCALL_ARG_INTP,
+	                                        DBG_SYSCALL_ARG_OUT},
+	                      {"node",          DBG_SYSCALL_ARG_INTP,
+	                                        DBG_SYSCALL_ARG_OUT}}},
+
 	[SYS_shmget]        = {"shmget",        DBG_SYSCALL_RET_SHMID, 3,
 	                     {{"key",           DBG_SYSCALL_ARG_KEY,
 	                                        DBG_SYSCALL_ARG_IN},
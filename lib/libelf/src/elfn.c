@@ -36,9 +36,7 @@ struct elfN_symtab
 static int elfN_readat(struct elfN *elf, void *ptr, ElfN_Word len,
                        ElfN_Off off)
 {
-	if (fseek(elf->fp, off, SEEK_SET) == -1)
-		return 1;
-	if (fread(ptr, 1, len, elf->fp) != len)
+	if (pread(fileno(elf->fp), ptr, len, off) != (ssize_t)len)
 		return 1;
 	return 0;
 }
@@ -0,0 +1,715 @@
+#include <errno.h>
+#include <file.h>
+#include <std.h>
+#include <sma.h>
+#include <uio.h>
+#include <vfs.h>
+#include <mem.h>
+
+/* pages of the MAP_SHARED zones
+ *
+ * shared zones don't own their pages: they map the pages of a cache, one
+ * per file (found through its node) or per anonymous mapping (inherited
+ * through fork)
+ * file pages are mapped read-only until written to, the write fault marks
+ * them dirty (vm_cache_dirty); writing a page back write-protects it again
+ * in every zone mapping it, so that its next write is noticed
+ * read and write on a file with a cache are kept coherent with it: the
+ * dirty pages they overlap are written back before, the cached pages a
+ * write overlaps are read again after
+ *
+ * the cached pages are kept in two global lists for the page daemon:
+ * deactivating a page unmaps it from every zone, a fault moves it back to
+ * the active list; the pages still inactive when reclaimed are dropped
+ * (file pages, after writing them back if dirty) or written to swap
+ * (anonymous pages, read back on the next fault)
+ * the reclaim sleeps with pointers to the pages of a cache as any other
+ * user: the pages aren't freed while the cache is busy
+ */
+
+#define CP_UNLISTED 0
+#define CP_ACTIVE   1
+#define CP_INACTIVE 2
+
+struct vm_cache_page
+{
+	struct page *page; /* NULL if swapped out */
+	struct vm_cache *cache;
+	off_t off;
+	int dirty;
+	int lru; /* CP_* */
+	struct swap_area *area; /* swap slot, if swapped out */
+	size_t slot;
+	struct rb_node tree;
+	TAILQ_ENTRY(vm_cache_page) lru_chain;
+};
+
+TAILQ_HEAD(vm_cache_page_head, vm_cache_page);
+
+struct vm_cache
+{
+	refcount_t refcount; /* zones mapping it, plus the transient users */
+	struct file *file; /* NULL for anonymous memory */
+	struct rb_tree pages; /* offset-indexed */
+	size_t dirty; /* number of dirty pages */
+	size_t busy; /* users sleeping with pointers to its pages */
+	TAILQ_HEAD(, vm_zone) zones;
+	TAILQ_ENTRY(vm_cache) chain;
+};
+
+static struct sma vm_cache_sma;
+static struct sma vm_cache_page_sma;
+/* the file caches, written back by sync */
+static TAILQ_HEAD(, vm_cache) g_vm_caches = TAILQ_HEAD_INITIALIZER(g_vm_caches);
+static struct vm_cache_page_head g_lru_active =
+	TAILQ_HEAD_INITIALIZER(g_lru_active);
+static struct vm_cache_page_head g_lru_inactive =
+	TAILQ_HEAD_INITIALIZER(g_lru_inactive);
+static size_t g_lru_active_count;
+static size_t g_lru_inactive_count;
+
+void vm_cache_init(void)
+{
+	sma_init(&vm_cache_sma, sizeof(struct vm_cache), NULL, NULL,
+	         "vm_cache");
+	sma_init(&vm_cache_page_sma, sizeof(struct vm_cache_page), NULL, NULL,
+	         "vm_cache_page");
+}
+
+static struct vm_cache_page *page_lookup(struct vm_cache *cache, off_t off)
+{
+	struct rb_node *node = cache->pages.root;
+	while (node)
+	{
+		struct vm_cache_page *cp = RB_ENTRY(node, struct vm_cache_page,
+		                                    tree);
+		if (off == cp->off)
+			return cp;
+		if (off < cp->off)
+			node = node->left;
+		else
+			node = node->right;
+	}
+	return NULL;
+}
+
+/* first page at or after off */
+static struct vm_cache_page *page_first(struct vm_cache *cache, off_t off)
+{
+	struct rb_node *node = cache->pages.root;
+	struct vm_cache_page *ret = NULL;
+	while (node)
+	{
+		struct vm_cache_page *cp = RB_ENTRY(node, struct vm_cache_page,
+		                                    tree);
+		if (cp->off >= off)
+		{
+			ret = cp;
+			node = node->left;
+		}
+		else
+		{
+			node = node->right;
+		}
+	}
+	return ret;
+}
+
+static struct vm_cache_page *page_next(struct vm_cache_page *cp)
+{
+	return RB_ENTRY_SAFE(rb_next(&cp->tree), struct vm_cache_page, tree);
+}
+
+static void page_insert(struct vm_cache *cache, struct vm_cache_page *cp)
+{
+	struct rb_node **link = &cache->pages.root;
+	struct rb_node *parent = NULL;
+	while (*link)
+	{
+		parent = *link;
+		struct vm_cache_page *it = RB_ENTRY(parent, struct vm_cache_page,
+		                                    tree);
+		if (cp->off < it->off)
+			link = &parent->left;
+		else
+			link = &parent->right;
+	}
+	rb_insert(&cache->pages, &cp->tree, parent, link);
+}
+
+static void lru_remove(struct vm_cache_page *cp)
+{
+	switch (cp->lru)
+	{
+		case CP_ACTIVE:
+			TAILQ_REMOVE(&g_lru_active, cp, lru_chain);
+			g_lru_active_count--;
+			break;
+		case CP_INACTIVE:
+			TAILQ_REMOVE(&g_lru_inactive, cp, lru_chain);
+			g_lru_inactive_count--;
+			break;
+	}
+	cp->lru = CP_UNLISTED;
+}
+
+static void lru_activate(struct vm_cache_page *cp)
+{
+	if (cp->lru == CP_ACTIVE)
+		return;
+	lru_remove(cp);
+	TAILQ_INSERT_TAIL(&g_lru_active, cp, lru_chain);
+	g_lru_active_count++;
+	cp->lru = CP_ACTIVE;
+}
+
+/* also moves an inactive page to the tail */
+static void lru_deactivate(struct vm_cache_page *cp)
+{
+	lru_remove(cp);
+	TAILQ_INSERT_TAIL(&g_lru_inactive, cp, lru_chain);
+	g_lru_inactive_count++;
+	cp->lru = CP_INACTIVE;
+}
+
+static int page_read(struct vm_cache *cache, struct page *page, off_t off)
+{
+	void *ptr = vm_map(page, PAGE_SIZE, VM_PROT_W);
+	if (!ptr)
+		return -ENOMEM;
+	struct uio uio;
+	struct iovec iov;
+	uio_fromkbuf(&uio, &iov, ptr, PAGE_SIZE, off);
+	ssize_t ret = cache->file->op->read(cache->file, &uio);
+	if (ret >= 0 && ret < PAGE_SIZE)
+		memset(&((uint8_t*)ptr)[ret], 0, PAGE_SIZE - ret);
+	vm_unmap(ptr, PAGE_SIZE);
+	return ret < 0 ? ret : 0;
+}
+
+/* the part of the page past the end of the file isn't written, writes
+ * through a mapping don't extend the file
+ */
+static int page_write(struct vm_cache *cache, struct page *page, off_t off)
+{
+	off_t size = cache->file->node->attr.size;
+	if (off >= size)
+		return 0;
+	size_t len = PAGE_SIZE;
+	if (size - off < PAGE_SIZE)
+		len = size - off;
+	if (!cache->file->op->write)
+		return -EROFS;
+	void *ptr = vm_map(page, PAGE_SIZE, VM_PROT_R);
+	if (!ptr)
+		return -ENOMEM;
+	struct uio uio;
+	struct iovec iov;
+	uio_fromkbuf(&uio, &iov, ptr, len, off);
+	ssize_t ret = cache->file->op->write(cache->file, &uio);
+	vm_unmap(ptr, PAGE_SIZE);
+	if (ret < 0)
+		return ret;
+	if ((size_t)ret != len)
+		return -EIO;
+	return 0;
+}
+
+static void page_dirty(struct vm_cache *cache, struct vm_cache_page *cp)
+{
+	if (cp->dirty)
+		return;
+	cp->dirty = 1;
+	cache->dirty++;
+}
+
+/* the zones of the other spaces are modified without their mutex: the
+ * page tables are only changed under the kernel lock, and a fault
+ * sleeping on this page will find it cached once woken up
+ */
+static void page_protect(struct vm_cache *cache, struct vm_cache_page *cp)
+{
+	struct vm_zone *zone;
+	TAILQ_FOREACH(zone, &cache->zones, cache_chain)
+	{
+		if (!(zone->prot & VM_PROT_W)
+		 || cp->off < zone->off
+		 || (uint64_t)(cp->off - zone->off) >= zone->size)
+			continue;
+		arch_vm_protect(zone->space, zone->addr + (cp->off - zone->off),
+		                PAGE_SIZE, zone->prot & ~VM_PROT_W);
+		vm_tlb_shootdown(zone->space);
+	}
+}
+
+/* same as page_protect, but faulting any access */
+static void page_unmap(struct vm_cache *cache, struct vm_cache_page *cp)
+{
+	struct vm_zone *zone;
+	TAILQ_FOREACH(zone, &cache->zones, cache_chain)
+	{
+		if (cp->off < zone->off
+		 || (uint64_t)(cp->off - zone->off) >= zone->size)
+			continue;
+		arch_vm_unmap(zone->space, zone->addr + (cp->off - zone->off),
+		              PAGE_SIZE);
+		vm_tlb_shootdown(zone->space);
+	}
+}
+
+static void page_drop(struct vm_cache *cache, struct vm_cache_page *cp)
+{
+	lru_remove(cp);
+	rb_remove(&cache->pages, &cp->tree);
+	if (cp->page)
+		pm_free_page(cp->page);
+	else
+		swap_free(cp->area, cp->slot);
+	sma_free(&vm_cache_page_sma, cp);
+}
+
+static int page_alloc(struct vm_cache *cache, off_t off,
+                      struct vm_cache_page **cpp)
+{
+	struct vm_cache_page *cp = sma_alloc(&vm_cache_page_sma, 0);
+	if (!cp)
+		return -ENOMEM;
+	int ret = vm_reclaim_alloc(&cp->page);
+	if (ret)
+	{
+		sma_free(&vm_cache_page_sma, cp);
+		return ret;
+	}
+	if (cache->file)
+	{
+		ret = page_read(cache, cp->page, off);
+		if (ret)
+		{
+			pm_free_page(cp->page);
+			sma_free(&vm_cache_page_sma, cp);
+			return ret;
+		}
+		/* another fault may have read it while sleeping */
+		struct vm_cache_page *it = page_lookup(cache, off);
+		if (it)
+		{
+			pm_free_page(cp->page);
+			sma_free(&vm_cache_page_sma, cp);
+			*cpp = it;
+			return 0;
+		}
+	}
+	else
+	{
+		vm_zero_page(cp->page);
+	}
+	cp->cache = cache;
+	cp->off = off;
+	cp->dirty = 0;
+	cp->lru = CP_UNLISTED;
+	cp->area = NULL;
+	page_insert(cache, cp);
+	*cpp = cp;
+	return 0;
+}
+
+/* read back an anonymous page written to swap by page_evict */
+static int page_swapin(struct vm_cache *cache, struct vm_cache_page *cp)
+{
+	struct page *page;
+	int ret = vm_reclaim_alloc(&page);
+	if (ret)
+		return ret;
+	cache->busy++;
+	ret = swap_read(cp->area, cp->slot, page);
+	cache->busy--;
+	/* another fault may have read it while sleeping */
+	if (cp->page || ret)
+	{
+		pm_free_page(page);
+		return cp->page ? 0 : ret;
+	}
+	swap_free(cp->area, cp->slot);
+	cp->area = NULL;
+	cp->page = page;
+	return 0;
+}
+
+static int cache_alloc(struct file *file, struct vm_cache **cachep)
+{
+	struct vm_cache *cache = sma_alloc(&vm_cache_sma, 0);
+	if (!cache)
+		return -ENOMEM;
+	if (file)
+	{
+		/* a file of its own, unaffected by the flags of the mapping one */
+		int ret = file_fromnode(file->node, O_RDWR, &cache->file);
+		if (ret)
+		{
+			sma_free(&vm_cache_sma, cache);
+			return ret;
+		}
+		if (!cache->file->op || !cache->file->op->read)
+		{
+			file_free(cache->file);
+			sma_free(&vm_cache_sma, cache);
+			return -ENODEV;
+		}
+		file->node->cache = cache;
+		TAILQ_INSERT_TAIL(&g_vm_caches, cache, chain);
+	}
+	else
+	{
+		cache->file = NULL;
+	}
+	refcount_init(&cache->refcount, 0);
+	rb_init(&cache->pages, NULL);
+	cache->dirty = 0;
+	cache->busy = 0;
+	TAILQ_INIT(&cache->zones);
+	*cachep = cache;
+	return 0;
+}
+
+void vm_cache_ref(struct vm_cache *cache)
+{
+	refcount_inc(&cache->refcount);
+}
+
+void vm_cache_free(struct vm_cache *cache)
+{
+	if (refcount_dec(&cache->refcount))
+		return;
+	if (cache->dirty)
+	{
+		/* the cache may be found again while writing back */
+		vm_cache_ref(cache);
+		if (vm_cache_sync(cache, 0, SIZE_MAX))
+			TRACE("failed to write back shared mapping");
+		if (refcount_dec(&cache->refcount))
+			return;
+	}
+	if (cache->file)
+	{
+		cache->file->node->cache = NULL;
+		TAILQ_REMOVE(&g_vm_caches, cache, chain);
+		file_free(cache->file);
+	}
+	struct rb_node *node;
+	while ((node = cache->pages.root))
+		page_drop(cache, RB_ENTRY(node, struct vm_cache_page, tree));
+	sma_free(&vm_cache_sma, cache);
+}
+
+void vm_cache_link(struct vm_zone *zone, struct vm_cache *cache)
+{
+	vm_cache_ref(cache);
+	zone->cache = cache;
+	TAILQ_INSERT_TAIL(&cache->zones, zone, cache_chain);
+}
+
+/* back the zone with the cache of its file, or with a new anonymous one */
+int vm_cache_attach(struct vm_zone *zone, struct file *file)
+{
+	struct vm_cache *cache = file ? file->node->cache : NULL;
+	if (!cache)
+	{
+		int ret = cache_alloc(file, &cache);
+		if (ret)
+			return ret;
+	}
+	vm_cache_link(zone, cache);
+	return 0;
+}
+
+void vm_cache_detach(struct vm_zone *zone)
+{
+	struct vm_cache *cache = zone->cache;
+	TAILQ_REMOVE(&cache->zones, zone, cache_chain);
+	zone->cache = NULL;
+	vm_cache_free(cache);
+}
+
+int vm_cache_fault(struct vm_zone *zone, off_t off, uint32_t prot,
+                   struct page **page, uint32_t *map_prot)
+{
+	struct vm_cache *cache = zone->cache;
+	off_t foff;
+	if (__builtin_add_overflow(zone->off, off, &foff))
+		return -EOVERFLOW;
+	struct vm_cache_page *cp = page_lookup(cache, foff);
+	int ret;
+	if (!cp)
+	{
+		ret = page_alloc(cache, foff, &cp);
+		if (ret)
+			return ret;
+	}
+	else if (!cp->page)
+	{
+		ret = page_swapin(cache, cp);
+		if (ret)
+			return ret;
+	}
+	lru_activate(cp);
+	pm_ref_page(cp->page);
+	*page = cp->page;
+	*map_prot = zone->prot;
+	if (cache->file && (zone->prot & VM_PROT_W))
+	{
+		if (prot & VM_PROT_W)
+			page_dirty(cache, cp);
+		else
+			*map_prot &= ~VM_PROT_W;
+	}
+	return 0;
+}
+
+/* first write to a cached page mapped read-only at poff: a clean file
+ * page, or any page write-protected by a fork or a mprotect
+ */
+int vm_cache_dirty(struct vm_zone *zone, off_t off, uintptr_t poff,
+                   struct page **page)
+{
+	struct vm_cache *cache = zone->cache;
+	if (!(zone->prot & VM_PROT_W))
+		return -EFAULT;
+	struct vm_cache_page *cp = page_lookup(cache, zone->off + off);
+	if (!cp || !cp->page || cp->page->offset != poff)
+		return -EFAULT;
+	if (cache->file)
+		page_dirty(cache, cp);
+	*page = cp->page;
+	return 0;
+}
+
+/* write back the dirty pages overlapping [off, off + size) */
+int vm_cache_sync(struct vm_cache *cache, off_t off, size_t size)
+{
+	if (!cache->file || !cache->dirty)
+		return 0;
+	size_t pad = off & PAGE_MASK;
+	off -= pad;
+	if (size > SIZE_MAX - pad)
+		size = SIZE_MAX;
+	else
+		size += pad;
+	int ret = 0;
+	vm_cache_ref(cache);
+	cache->busy++;
+	for (struct vm_cache_page *cp = page_first(cache, off);
+	     cp && (size_t)(cp->off - off) < size;
+	     cp = page_next(cp))
+	{
+		if (!cp->dirty)
+			continue;
+		/* writes done while writing it back dirty it again */
+		page_protect(cache, cp);
+		cp->dirty = 0;
+		cache->dirty--;
+		ret = page_write(cache, cp->page, cp->off);
+		if (ret)
+		{
+			page_dirty(cache, cp);
+			break;
+		}
+	}
+	cache->busy--;
+	vm_cache_free(cache);
+	return ret;
+}
+
+int vm_cache_sync_all(void)
+{
+	int ret = 0;
+	struct vm_cache *cache = TAILQ_FIRST(&g_vm_caches);
+	if (cache)
+		vm_cache_ref(cache);
+	while (cache)
+	{
+		int err = vm_cache_sync(cache, 0, SIZE_MAX);
+		if (err && !ret)
+			ret = err;
+		struct vm_cache *next = TAILQ_NEXT(cache, chain);
+		if (next)
+			vm_cache_ref(next);
+		vm_cache_free(cache);
+		cache = next;
+	}
+	return ret;
+}
+
+/* reference the cached page at off, splice uses it in place of reading
+ * the file
+ */
+int vm_cache_get_page(struct vm_cache *cache, off_t off, struct page **page)
+{
+	struct vm_cache_page *cp = page_lookup(cache, off);
+	if (!cp || !cp->page)
+		return -ENOENT;
+	pm_ref_page(cp->page);
+	*page = cp->page;
+	return 0;
+}
+
+ssize_t vm_cache_read(struct vm_cache *cache, struct file *file,
+                      struct uio *uio)
+{
+	vm_cache_ref(cache);
+	ssize_t ret = vm_cache_sync(cache, uio->off, uio->count);
+	if (!ret)
+		ret = file->op->read(file, uio);
+	vm_cache_free(cache);
+	return ret;
+}
+
+ssize_t vm_cache_write(struct vm_cache *cache, struct file *file,
+                       struct uio *uio)
+{
+	vm_cache_ref(cache);
+	/* the offset of appending writes is only known once done */
+	ssize_t ret;
+	if (file->flags & O_APPEND)
+		ret = vm_cache_sync(cache, 0, SIZE_MAX);
+	else
+		ret = vm_cache_sync(cache, uio->off, uio->count);
+	if (!ret)
+		ret = file->op->write(file, uio);
+	if (ret > 0)
+	{
+		off_t off = uio->off - ret;
+		off_t start = off & ~(off_t)PAGE_MASK;
+		cache->busy++;
+		for (struct vm_cache_page *cp = page_first(cache, start);
+		     cp && cp->off < uio->off;
+		     cp = page_next(cp))
+		{
+			if (page_read(cache, cp->page, cp->off))
+				TRACE("failed to update shared mapping");
+		}
+		cache->busy--;
+	}
+	vm_cache_free(cache);
+	return ret;
+}
+
+/* unmap the least recently faulted pages, leaving the anonymous ones
+ * mapped if they can't be swapped out
+ */
+size_t vm_cache_deactivate(size_t count)
+{
+	int swap = swap_available();
+	size_t scan = g_lru_active_count;
+	size_t n = 0;
+	struct vm_cache_page *cp;
+	while (n < count && scan-- && (cp = TAILQ_FIRST(&g_lru_active)))
+	{
+		lru_remove(cp);
+		if (!cp->cache->file && !swap)
+		{
+			lru_activate(cp);
+			continue;
+		}
+		page_unmap(cp->cache, cp);
+		lru_deactivate(cp);
+		n++;
+	}
+	return n;
+}
+
+/* write the page back to its file, or to swap for anonymous memory, and
+ * free it if it wasn't faulted again meanwhile
+ */
+static int page_evict(struct vm_cache *cache, struct vm_cache_page *cp)
+{
+	struct swap_area *area = NULL;
+	size_t slot = 0;
+	if (!cache->file && swap_alloc(&area, &slot))
+	{
+		lru_deactivate(cp);
+		return 0;
+	}
+	lru_remove(cp);
+	vm_cache_ref(cache);
+	cache->busy++;
+	int ret;
+	if (cache->file)
+	{
+		cp->dirty = 0;
+		cache->dirty--;
+		ret = page_write(cache, cp->page, cp->off);
+		if (ret)
+			page_dirty(cache, cp);
+	}
+	else
+	{
+		ret = swap_write(area, slot, cp->page);
+	}
+	cache->busy--;
+	int freed = 0;
+	if (!ret
+	 && !cp->dirty
+	 && !cache->busy
+	 && cp->lru == CP_UNLISTED
+	 && refcount_get(&cp->page->refcount) == 1)
+	{
+		if (cache->file)
+		{
+			page_drop(cache, cp);
+		}
+		else
+		{
+			pm_free_page(cp->page);
+			cp->page = NULL;
+			cp->area = area;
+			cp->slot = slot;
+			area = NULL;
+		}
+		freed = 1;
+	}
+	else if (cp->lru == CP_UNLISTED)
+	{
+		lru_activate(cp);
+	}
+	if (area)
+		swap_free(area, slot);
+	vm_cache_free(cache);
+	return freed;
+}
+
+size_t vm_cache_reclaim(size_t count)
+{
+	size_t scan = g_lru_inactive_count;
+	size_t freed = 0;
+	struct vm_cache_page *cp;
+	while (freed < count && scan-- && (cp = TAILQ_FIRST(&g_lru_inactive)))
+	{
+		struct vm_cache *cache = cp->cache;
+		/* mapped again, or used by the kernel */
+		if (refcount_get(&cp->page->refcount) > 1)
+		{
+			lru_activate(cp);
+			continue;
+		}
+		if (cache->busy)
+		{
+			lru_deactivate(cp);
+			continue;
+		}
+		if (cache->file && !cp->dirty)
+		{
+			page_drop(cache, cp);
+			freed++;
+			continue;
+		}
+		/* the cache may be freed by the eviction, cp with it */
+		freed += page_evict(cache, cp);
+	}
+	return freed;
+}
+
+void vm_cache_usage(size_t *active, size_t *inactive)
+{
+	*active = g_lru_active_count;
+	*inactive = g_lru_inactive_count;
+}
@@ -1,3 +1,5 @@
+#include <proc.h>
+#include <std.h>
 #include <mem.h>
 #include <cpu.h>
 
@@ -15,6 +17,106 @@ static int is_range_user(struct vm_space *vm_space, uintptr_t addr, size_t size)
 	return 1;
 }
 
+#ifdef ARCH_COPY_USER
+/* the user memory of the space loaded by the cpu can be accessed
+ * directly, the arch copy routines stopping on faults
+ */
+static int is_space_loaded(struct vm_space *space)
+{
+#if VM_SPACE_ISOLATION == 1
+	(void)space;
+	return 0;
+#else
+	struct thread *thread = curcpu()->thread;
+	return thread && thread->proc->vm_space == space;
+#endif
+}
+
+/* populate the page on which a direct copy stopped, making sure it does
+ * progress to avoid retrying the same fault forever
+ */
+static int populate_fault(struct vm_space *space, uintptr_t addr,
+                          uint32_t prot, uintptr_t *prev)
+{
+	addr &= ~PAGE_MASK;
+	if (addr == *prev)
+		return -EFAULT;
+	*prev = addr;
+	return arch_vm_populate_page(space, addr, prot, NULL);
+}
+
+static int copyin_direct(struct vm_space *space, void *kaddr,
+                         const void *uaddr, size_t n)
+{
+	uintptr_t prev = 0;
+	while (n)
+	{
+		size_t left = arch_copy_from_user(kaddr, uaddr, n);
+		kaddr = (uint8_t*)kaddr + n - left;
+		uaddr = (uint8_t*)uaddr + n - left;
+		n = left;
+		if (!n)
+			break;
+		int ret = populate_fault(space, (uintptr_t)uaddr, VM_PROT_R,
+		                         &prev);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static int copyout_direct(struct vm_space *space, void *uaddr,
+                          const void *kaddr, size_t n)
+{
+	uintptr_t prev = 0;
+	while (n)
+	{
+		size_t left = arch_copy_to_user(uaddr, kaddr, n);
+		kaddr = (uint8_t*)kaddr + n - left;
+		uaddr = (uint8_t*)uaddr + n - left;
+		n = left;
+		if (!n)
+			break;
+		int ret = populate_fault(space, (uintptr_t)uaddr, VM_PROT_W,
+		                         &prev);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/* copy the string page by page, the terminating byte of a page ending
+ * the copy before the next one is accessed
+ */
+static int copystr_direct(struct vm_space *space, char *kstr,
+                          const char *ustr, size_t n)
+{
+	uintptr_t end = space->region.addr + space->region.size;
+	uintptr_t prev = 0;
+	while ((uintptr_t)ustr < end)
+	{
+		if (!n)
+			return -ENAMETOOLONG;
+		size_t len = PAGE_SIZE - ((uintptr_t)ustr & PAGE_MASK);
+		if (len > n)
+			len = n;
+		size_t left = arch_copy_from_user(kstr, ustr, len);
+		if (memchr(kstr, '\0', len - left))
+			return 0;
+		kstr += len - left;
+		ustr += len - left;
+		n -= len - left;
+		if (!left)
+			continue;
+		int ret = populate_fault(space, (uintptr_t)ustr, VM_PROT_R,
+		                         &prev);
+		if (ret)
+			return ret;
+	}
+	return -EFAULT;
+}
+#endif
+
 static int verify_page(struct vm_space *space, size_t addr)
 {
 	return arch_vm_populate_page(space, addr, VM_PROT_R, NULL);
@@ -108,6 +210,10 @@ int vm_copyin(struct vm_space *space, void *kaddr, const void *uaddr,
 {
 	if (!is_range_user(space, (uintptr_t)uaddr, n))
 		return -EFAULT;
+#ifdef ARCH_COPY_USER
+	if (is_space_loaded(space))
+		return copyin_direct(space, kaddr, uaddr, n);
+#endif
 	while (n)
 	{
 		int ret = copyin_page(space, kaddr, uaddr, n);
@@ -120,6 +226,36 @@ int vm_copyin(struct vm_space *space, void *kaddr, const void *uaddr,
 	return 0;
 }
 
+/* copy from the pages already mapped only, stopping at the first one
+ * which isn't instead of faulting it in: usable where sleeping isn't
+ * (the space mutex must be held for the pages to stay mapped)
+ */
+int vm_copyin_nofault(struct vm_space *space, void *kaddr,
+                      const void *uaddr, size_t n)
+{
+	if (!is_range_user(space, (uintptr_t)uaddr, n))
+		return -EFAULT;
+	while (n)
+	{
+		uintptr_t page = (uintptr_t)uaddr;
+		uintptr_t pad = page & PAGE_MASK;
+		uintptr_t len = PAGE_SIZE - pad;
+		page -= pad;
+		if (len > n)
+			len = n;
+		uintptr_t poff;
+		if (arch_vm_lookup(space, page, &poff))
+			return -EFAULT;
+		struct arch_copy_zone *zone = &curcpu()->copy_src_page;
+		arch_set_copy_zone(zone, poff);
+		memcpy(kaddr, (uint8_t*)zone->ptr + pad, len);
+		kaddr = (uint8_t*)kaddr + len;
+		uaddr = (uint8_t*)uaddr + len;
+		n -= len;
+	}
+	return 0;
+}
+
 static int copyout_page(struct vm_space *space, void *uaddr,
                         const void *kaddr, size_t n)
 {
@@ -130,7 +266,7 @@ static int copyout_page(struct vm_space *space, void *uaddr,
 	if (len > n)
 		len = n;
 	uintptr_t poff;
-	int ret = arch_vm_populate_page(space, page, VM_PROT_R, &poff);
+	int ret = arch_vm_populate_page(space, page, VM_PROT_W, &poff);
 	if (ret)
 		return ret;
 	struct arch_copy_zone *zone = &curcpu()->copy_dst_page;
@@ -145,6 +281,10 @@ int vm_copyout(struct vm_space *space, void *uaddr, const void *kaddr,
 {
 	if (!is_range_user(space, (uintptr_t)uaddr, n))
 		return -EFAULT;
+#ifdef ARCH_COPY_USER
+	if (is_space_loaded(space))
+		return copyout_direct(space, uaddr, kaddr, n);
+#endif
 	while (n)
 	{
 		int ret = copyout_page(space, uaddr, kaddr, n);
@@ -161,6 +301,10 @@ int vm_copystr(struct vm_space *space, char *kstr, const char *ustr, size_t n)
 {
 	if (!is_range_user(space, (uintptr_t)ustr, 1))
 		return -EFAULT;
+#ifdef ARCH_COPY_USER
+	if (is_space_loaded(space))
+		return copystr_direct(space, kstr, ustr, n);
+#endif
 	struct arch_copy_zone *zone = &curcpu()->copy_src_page;
 	uintptr_t start = (uintptr_t)ustr & ~PAGE_MASK;
 	uintptr_t end = space->region.addr + space->region.size;
@@ -0,0 +1,202 @@
+#include <errno.h>
+#include <mutex.h>
+#include <queue.h>
+#include <std.h>
+#include <vfs.h>
+#include <sma.h>
+
+/* cache of the lookups, keyed by the directory node and the name: an
+ * entry references its directory and, if the name exists, its node
+ * (negative entries have no node)
+ * only the filesystems whose tree exclusively changes through the node
+ * operations (FS_TYPE_DCACHE) are cached, the entries being dropped by
+ * node_unlink / node_rmdir / node_rename and the negative ones by the
+ * node creations
+ * the lookups aren't serialized with the changes of the directory: a
+ * change done while a lookup sleeps in the filesystem would make it add
+ * a stale entry, so each removal bumps the sequence of the directory
+ * and a lookup only adds its result if the sequence didn't change since
+ * before it started
+ * XXX the entries of a removed directory stay until they are evicted
+ */
+
+#define DCACHE_BUCKETS 1024
+#define DCACHE_MAX     4096
+#define DCACHE_NAME    32
+
+struct dentry
+{
+	struct node *dir;
+	struct node *node;
+	uint32_t hash;
+	uint8_t name_len;
+	char name[DCACHE_NAME];
+	TAILQ_ENTRY(dentry) hash_chain;
+	TAILQ_ENTRY(dentry) lru_chain;
+};
+
+TAILQ_HEAD(dentry_head, dentry);
+
+static struct sma dentry_sma;
+static struct mutex g_dcache_mutex;
+static struct dentry_head g_dcache_buckets[DCACHE_BUCKETS];
+static struct dentry_head g_dcache_lru = TAILQ_HEAD_INITIALIZER(g_dcache_lru); /* most recent first */
+static size_t g_dcache_count;
+
+void dcache_init(void)
+{
+	sma_init(&dentry_sma, sizeof(struct dentry), NULL, NULL, "dentry");
+	mutex_init(&g_dcache_mutex, 0);
+	for (size_t i = 0; i < DCACHE_BUCKETS; ++i)
+		TAILQ_INIT(&g_dcache_buckets[i]);
+}
+
+static int cacheable(struct node *dir, const char *name, size_t name_len)
+{
+	if (!dir->sb || !(dir->sb->type->flags & FS_TYPE_DCACHE))
+		return 0;
+	if (!name_len || name_len > DCACHE_NAME)
+		return 0;
+	/* resolved by the filesystems, across the mount points */
+	if (name[0] == '.' && (name_len == 1 || (name_len == 2 && name[1] == '.')))
+		return 0;
+	return 1;
+}
+
+static uint32_t dcache_hash(struct node *dir, const char *name,
+                            size_t name_len)
+{
+	uint32_t hash = 0x811C9DC5;
+	uintptr_t ptr = (uintptr_t)dir;
+	for (size_t i = 0; i < sizeof(ptr); ++i)
+	{
+		hash ^= (uint8_t)(ptr >> (i * 8));
+		hash *= 0x01000193;
+	}
+	for (size_t i = 0; i < name_len; ++i)
+	{
+		hash ^= (uint8_t)name[i];
+		hash *= 0x01000193;
+	}
+	return hash;
+}
+
+static struct dentry *find(struct node *dir, const char *name,
+                           size_t name_len, uint32_t hash)
+{
+	struct dentry *dentry;
+	TAILQ_FOREACH(dentry, &g_dcache_buckets[hash % DCACHE_BUCKETS],
+	              hash_chain)
+	{
+		if (dentry->hash == hash
+		 && dentry->dir == dir
+		 && dentry->name_len == name_len
+		 && !memcmp(dentry->name, name, name_len))
+			return dentry;
+	}
+	return NULL;
+}
+
+static void unlink_dentry(struct dentry *dentry)
+{
+	TAILQ_REMOVE(&g_dcache_buckets[dentry->hash % DCACHE_BUCKETS],
+	             dentry, hash_chain);
+	TAILQ_REMOVE(&g_dcache_lru, dentry, lru_chain);
+	g_dcache_count--;
+}
+
+/* the nodes may be released, which can't be done with the cache locked */
+static void free_dentry(struct dentry *dentry)
+{
+	if (dentry->node)
+		node_free(dentry->node);
+	node_free(dentry->dir);
+	sma_free(&dentry_sma, dentry);
+}
+
+/* on success, *child is the referenced node or NULL if the name doesn't
+ * exist
+ */
+int dcache_find(struct node *dir, const char *name, size_t name_len,
+                struct node **child)
+{
+	if (!cacheable(dir, name, name_len))
+		return -ENOENT;
+	uint32_t hash = dcache_hash(dir, name, name_len);
+	mutex_lock(&g_dcache_mutex);
+	struct dentry *dentry = find(dir, name, name_len, hash);
+	if (!dentry)
+	{
+		mutex_unlock(&g_dcache_mutex);
+		return -ENOENT;
+	}
+	TAILQ_REMOVE(&g_dcache_lru, dentry, lru_chain);
+	TAILQ_INSERT_HEAD(&g_dcache_lru, dentry, lru_chain);
+	*child = dentry->node;
+	if (*child)
+		node_ref(*child);
+	mutex_unlock(&g_dcache_mutex);
+	return 0;
+}
+
+uint32_t dcache_seq(struct node *dir)
+{
+	return __atomic_load_n(&dir->dcache_seq, __ATOMIC_ACQUIRE);
+}
+
+/* seq is the dcache_seq of dir sampled before the lookup */
+void dcache_add(struct node *dir, const char *name, size_t name_len,
+                struct node *child, uint32_t seq)
+{
+	struct dentry *evicted = NULL;
+	if (!cacheable(dir, name, name_len))
+		return;
+	uint32_t hash = dcache_hash(dir, name, name_len);
+	struct dentry *dentry = sma_alloc(&dentry_sma, 0);
+	if (!dentry)
+		return;
+	node_ref(dir);
+	dentry->dir = dir;
+	if (child)
+		node_ref(child);
+	dentry->node = child;
+	dentry->hash = hash;
+	dentry->name_len = name_len;
+	memcpy(dentry->name, name, name_len);
+	mutex_lock(&g_dcache_mutex);
+	/* raced with a change of the dir, or with another lookup */
+	if (dir->dcache_seq != seq
+	 || find(dir, name, name_len, hash))
+	{
+		mutex_unlock(&g_dcache_mutex);
+		free_dentry(dentry);
+		return;
+	}
+	if (g_dcache_count >= DCACHE_MAX)
+	{
+		evicted = TAILQ_LAST(&g_dcache_lru, dentry_head);
+		unlink_dentry(evicted);
+	}
+	TAILQ_INSERT_HEAD(&g_dcache_buckets[hash % DCACHE_BUCKETS], dentry,
+	                  hash_chain);
+	TAILQ_INSERT_HEAD(&g_dcache_lru, dentry, lru_chain);
+	g_dcache_count++;
+	mutex_unlock(&g_dcache_mutex);
+	if (evicted)
+		free_dentry(evicted);
+}
+
+void dcache_remove(struct node *dir, const char *name, size_t name_len)
+{
+	if (!cacheable(dir, name, name_len))
+		return;
+	uint32_t hash = dcache_hash(dir, name, name_len);
+	mutex_lock(&g_dcache_mutex);
+	__atomic_add_fetch(&dir->dcache_seq, 1, __ATOMIC_RELEASE);
+	struct dentry *dentry = find(dir, name, name_len, hash);
+	if (dentry)
+		unlink_dentry(dentry);
+	mutex_unlock(&g_dcache_mutex);
+	if (dentry)
+		free_dentry(dentry);
+}
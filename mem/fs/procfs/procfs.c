@@ -218,53 +218,57 @@ static int root_lookup(struct node *node, const char *name, size_t name_len,
 		node_ref(*childp);
 		return 0;
 	}
-	struct thread *thread;
-	spinlock_lock(&g_thread_list_lock);
-	TAILQ_FOREACH(thread, &g_thread_list, chain)
+	/* only the canonical decimal form of the tids */
+	pid_t tid = 0;
+	if (!name_len || name_len > 10 || name[0] == '0')
+		return -ENOENT;
+	for (size_t i = 0; i < name_len; ++i)
+	{
+		if (name[i] < '0' || name[i] > '9')
+			return -ENOENT;
+		if (__builtin_mul_overflow(tid, 10, &tid)
+		 || __builtin_add_overflow(tid, name[i] - '0', &tid))
+			return -ENOENT;
+	}
+	struct thread *thread = getthread(tid);
+	if (!thread)
+		return -ENOENT;
+	char tidstr[64];
+	snprintf(tidstr, sizeof(tidstr), "%" PRIu32, thread->tid);
+	ino_t ino = TID_INO(thread->tid, TID_DIR);
+	node_cache_lock(&node->sb->node_cache);
+	*childp = node_cache_find(&node->sb->node_cache, ino);
+	if (*childp)
 	{
-		char tid[64];
-		snprintf(tid, sizeof(tid), "%" PRIu32, thread->tid);
-		if (strlen(tid) != name_len
-		 || strncmp(name, tid, name_len))
-			continue;
-		ino_t ino = TID_INO(thread->tid, TID_DIR);
-		node_cache_lock(&node->sb->node_cache);
-		*childp = node_cache_find(&node->sb->node_cache, ino);
-		if (*childp)
-		{
-			spinlock_unlock(&g_thread_list_lock);
-			node_cache_unlock(&node->sb->node_cache);
-			return 0;
-		}
-		struct procfs_dir *thread_node;
-		fs_attr_mask_t mask = FS_ATTR_UID | FS_ATTR_GID | FS_ATTR_MODE;
-		struct fs_attr attr;
-		attr.uid = thread->proc->cred.euid;
-		attr.gid = thread->proc->cred.egid;
-		attr.mode = 0555;
-		int ret = fs_mkdir(node->sb->private, dir, ino, tid, mask, &attr,
-		                   &tid_fop, &tid_op, &thread_node);
-		if (ret)
-		{
-			spinlock_unlock(&g_thread_list_lock);
-			return ret;
-		}
-		thread_node->node.node.fop = &tid_fop;
-		thread_node->node.node.op = &tid_op;
-		ret = node_cache_add(&node->sb->node_cache, &thread_node->node.node);
 		node_cache_unlock(&node->sb->node_cache);
-		if (ret)
-		{
-			spinlock_unlock(&g_thread_list_lock);
-			node_free(&thread_node->node.node);
-			return ret;
-		}
-		spinlock_unlock(&g_thread_list_lock);
-		*childp = &thread_node->node.node;
+		thread_free(thread);
 		return 0;
 	}
-	spinlock_unlock(&g_thread_list_lock);
-	return -ENOENT;
+	struct procfs_dir *thread_node;
+	fs_attr_mask_t mask = FS_ATTR_UID | FS_ATTR_GID | FS_ATTR_MODE;
+	struct fs_attr attr;
+	attr.uid = thread->proc->cred.euid;
+	attr.gid = thread->proc->cred.egid;
+	attr.mode = 0555;
+	thread_free(thread);
+	int ret = fs_mkdir(node->sb->private, dir, ino, tidstr, mask, &attr,
+	                   &tid_fop, &tid_op, &thread_node);
+	if (ret)
+	{
+		node_cache_unlock(&node->sb->node_cache);
+		return ret;
+	}
+	thread_node->node.node.fop = &tid_fop;
+	thread_node->node.node.op = &tid_op;
+	ret = node_cache_add(&node->sb->node_cache, &thread_node->node.node);
+	node_cache_unlock(&node->sb->node_cache);
+	if (ret)
+	{
+		node_free(&thread_node->node.node);
+		return ret;
+	}
+	*childp = &thread_node->node.node;
+	return 0;
 }
 
 static int root_readdir(struct node *node, struct fs_readdir_ctx *ctx)
@@ -283,7 +287,7 @@ static int root_readdir(struct node *node, struct fs_readdir_ctx *ctx)
 	}
 	size_t i = 3;
 	struct proc *proc;
-	spinlock_lock(&g_proc_list_lock);
+	rwlock_rdlock(&g_proc_list_lock);
 	TAILQ_FOREACH(proc, &g_proc_list, chain)
 	{
 		if (i == (size_t)ctx->off)
@@ -299,7 +303,7 @@ static int root_readdir(struct node *node, struct fs_readdir_ctx *ctx)
 		}
 		i++;
 	}
-	spinlock_unlock(&g_proc_list_lock);
+	rwlock_unlock(&g_proc_list_lock);
 	return written;
 }
 
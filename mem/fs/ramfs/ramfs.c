@@ -25,14 +25,23 @@ struct ramfs_dirent
 	struct node *node;
 	char *name;
 	size_t name_len;
-	LIST_ENTRY(ramfs_dirent) chain;
+	off_t off;
+	TAILQ_ENTRY(ramfs_dirent) chain;
 };
 
+/* the dirents are sorted by their readdir offset, which never changes
+ * cursor is the first dirent at or after cursor_off (NULL for the end of
+ * the directory, cursor_off being -1 if unknown): it's where the last
+ * readdir stopped, so that the next one doesn't have to search for it
+ */
 struct ramfs_dir
 {
 	struct node node;
 	struct node *parent;
-	LIST_HEAD(, ramfs_dirent) nodes;
+	TAILQ_HEAD(, ramfs_dirent) nodes;
+	off_t next_off;
+	struct ramfs_dirent *cursor;
+	off_t cursor_off;
 };
 
 struct ramfs_reg
@@ -91,7 +100,7 @@ struct fs_type g_ramfs_type =
 {
 	.op = &fs_type_op,
 	.name = "ramfs",
-	.flags = 0,
+	.flags = FS_TYPE_DCACHE,
 };
 
 static const struct node_op dir_op =
@@ -213,7 +222,10 @@ static int fs_mkdir(struct ramfs_sb *sb, struct ramfs_dir *parent,
 	dir->parent = parent ? &parent->node : &dir->node;
 	dir->node.fop = &dir_fop;
 	dir->node.op = &dir_op;
-	LIST_INIT(&dir->nodes);
+	TAILQ_INIT(&dir->nodes);
+	dir->next_off = 2;
+	dir->cursor = NULL;
+	dir->cursor_off = -1;
 	*dirp = dir;
 	return 0;
 }
@@ -337,6 +349,22 @@ static void dirent_free(struct ramfs_dirent *dirent)
 	free(dirent);
 }
 
+static void dir_insert(struct ramfs_dir *dir, struct ramfs_dirent *dirent)
+{
+	dirent->off = dir->next_off++;
+	TAILQ_INSERT_TAIL(&dir->nodes, dirent, chain);
+	if (!dir->cursor && dir->cursor_off != -1
+	 && dir->cursor_off <= dirent->off)
+		dir->cursor = dirent;
+}
+
+static void dir_remove(struct ramfs_dir *dir, struct ramfs_dirent *dirent)
+{
+	if (dir->cursor == dirent)
+		dir->cursor = TAILQ_NEXT(dirent, chain);
+	TAILQ_REMOVE(&dir->nodes, dirent, chain);
+}
+
 static void reg_resize(struct ramfs_reg *reg, off_t size)
 {
 	if (size < reg->node.attr.size)
@@ -510,7 +538,7 @@ static int dir_lookup(struct node *node, const char *name, size_t name_len,
 	struct ramfs_dir *dir = (struct ramfs_dir*)node;
 	VFS_HANDLE_DOT_DOTDOT_LOOKUP(node, dir->parent, name, name_len, child);
 	struct ramfs_dirent *dirent;
-	LIST_FOREACH(dirent, &dir->nodes, chain)
+	TAILQ_FOREACH(dirent, &dir->nodes, chain)
 	{
 		if (dirent->name_len != name_len
 		 || memcmp(name, dirent->name, name_len))
@@ -527,22 +555,31 @@ static int dir_readdir(struct node *node, struct fs_readdir_ctx *ctx)
 	int written = 0;
 	struct ramfs_dir *dir = (struct ramfs_dir*)node;
 	VFS_HANDLE_DOT_DOTDOT_READDIR(node, dir->parent, ctx, written);
-	size_t i = 2;
 	struct ramfs_dirent *dirent;
-	LIST_FOREACH(dirent, &dir->nodes, chain)
+	if (ctx->off == dir->cursor_off)
 	{
-		if (i == (size_t)ctx->off)
+		dirent = dir->cursor;
+	}
+	else
+	{
+		TAILQ_FOREACH(dirent, &dir->nodes, chain)
 		{
-			int res = ctx->fn(ctx, dirent->name, dirent->name_len,
-			                  i, dirent->node->ino,
-			                  dirent->node->attr.mode >> 12);
-			if (res)
-				return written;
-			written++;
-			ctx->off++;
+			if (dirent->off >= ctx->off)
+				break;
 		}
-		i++;
 	}
+	for (; dirent; dirent = TAILQ_NEXT(dirent, chain))
+	{
+		int res = ctx->fn(ctx, dirent->name, dirent->name_len,
+		                  dirent->off, dirent->node->ino,
+		                  dirent->node->attr.mode >> 12);
+		if (res)
+			break;
+		written++;
+		ctx->off = dirent->off + 1;
+	}
+	dir->cursor = dirent;
+	dir->cursor_off = ctx->off;
 	return written;
 }
 
@@ -602,7 +639,7 @@ static int dir_mknode(struct node *node, const char *name, size_t name_len,
 		return ret;
 	}
 	dirent->node->nlink++;
-	LIST_INSERT_HEAD(&dir->nodes, dirent, chain);
+	dir_insert(dir, dirent);
 	return 0;
 }
 
@@ -634,7 +671,7 @@ static int dir_symlink(struct node *node, const char *name, size_t name_len,
 		return ret;
 	}
 	dirent->node->nlink++;
-	LIST_INSERT_HEAD(&dir->nodes, dirent, chain);
+	dir_insert(dir, dirent);
 	return 0;
 }
 
@@ -646,14 +683,14 @@ static int dir_rename(struct node *srcdir, const char *srcname,
 	struct ramfs_dirent *srcdirent;
 	struct ramfs_dirent *dstdirent;
 	int ret;
-	LIST_FOREACH(srcdirent, &((struct ramfs_dir*)srcdir)->nodes, chain)
+	TAILQ_FOREACH(srcdirent, &((struct ramfs_dir*)srcdir)->nodes, chain)
 	{
 		if (!strcmp(srcdirent->name, srcname))
 			break;
 	}
 	if (!srcdirent)
 		return -ENOENT;
-	LIST_FOREACH(dstdirent, &((struct ramfs_dir*)dstdir)->nodes, chain)
+	TAILQ_FOREACH(dstdirent, &((struct ramfs_dir*)dstdir)->nodes, chain)
 	{
 		if (!strcmp(dstdirent->name, dstname))
 			break;
@@ -671,7 +708,7 @@ static int dir_rename(struct node *srcdir, const char *srcname,
 				ret = -ENOTDIR;
 				goto end;
 			}
-			if (!LIST_EMPTY(&((struct ramfs_dir*)dstdirent->node)->nodes))
+			if (!TAILQ_EMPTY(&((struct ramfs_dir*)dstdirent->node)->nodes))
 			{
 				ret = -ENOTEMPTY;
 				goto end;
@@ -682,16 +719,15 @@ static int dir_rename(struct node *srcdir, const char *srcname,
 			ret = -EISDIR;
 			goto end;
 		}
-		LIST_REMOVE(dstdirent, chain);
+		dir_remove((struct ramfs_dir*)dstdir, dstdirent);
 		dstdirent->node->nlink--;
 		node_free(dstdirent->node);
 		/* XXX dec nlinks */
 		free(dstdirent->name);
 		free(dstdirent);
 	}
-	LIST_REMOVE(srcdirent, chain);
-	LIST_INSERT_HEAD(&((struct ramfs_dir*)dstdir)->nodes,
-	                 srcdirent, chain);
+	dir_remove((struct ramfs_dir*)srcdir, srcdirent);
+	dir_insert((struct ramfs_dir*)dstdir, srcdirent);
 	if (S_ISDIR(srcdirent->node->attr.mode))
 		((struct ramfs_dir*)srcdirent->node)->parent = dstdir;
 	free(srcdirent->name);
@@ -707,7 +743,7 @@ end:
 static int dir_rmdir(struct node *node, const char *name)
 {
 	struct ramfs_dirent *dirent;
-	LIST_FOREACH(dirent, &((struct ramfs_dir*)node)->nodes, chain)
+	TAILQ_FOREACH(dirent, &((struct ramfs_dir*)node)->nodes, chain)
 	{
 		if (!strcmp(dirent->name, name))
 			break;
@@ -718,11 +754,11 @@ static int dir_rmdir(struct node *node, const char *name)
 		return -ENOTDIR;
 	if (dirent->node->mount)
 		return -EBUSY;
-	if (!LIST_EMPTY(&((struct ramfs_dir*)dirent->node)->nodes))
+	if (!TAILQ_EMPTY(&((struct ramfs_dir*)dirent->node)->nodes))
 		return -ENOTEMPTY;
 	dirent->node->nlink--;
 	node_free(dirent->node);
-	LIST_REMOVE(dirent, chain);
+	dir_remove((struct ramfs_dir*)node, dirent);
 	dirent_free(dirent);
 	return 0;
 }
@@ -730,7 +766,7 @@ static int dir_rmdir(struct node *node, const char *name)
 static int dir_unlink(struct node *node, const char *name)
 {
 	struct ramfs_dirent *dirent;
-	LIST_FOREACH(dirent, &((struct ramfs_dir*)node)->nodes, chain)
+	TAILQ_FOREACH(dirent, &((struct ramfs_dir*)node)->nodes, chain)
 	{
 		if (!strcmp(dirent->name, name))
 			break;
@@ -741,7 +777,7 @@ static int dir_unlink(struct node *node, const char *name)
 		return -EISDIR;
 	dirent->node->nlink--;
 	node_free(dirent->node);
-	LIST_REMOVE(dirent, chain);
+	dir_remove((struct ramfs_dir*)node, dirent);
 	dirent_free(dirent);
 	return 0;
 }
@@ -749,7 +785,7 @@ static int dir_unlink(struct node *node, const char *name)
 static int dir_link(struct node *node, struct node *src, const char *name)
 {
 	struct ramfs_dirent *dirent;
-	LIST_FOREACH(dirent, &((struct ramfs_dir*)node)->nodes, chain)
+	TAILQ_FOREACH(dirent, &((struct ramfs_dir*)node)->nodes, chain)
 	{
 		if (!strcmp(dirent->name, name))
 			return -EEXIST;
@@ -760,7 +796,7 @@ static int dir_link(struct node *node, struct node *src, const char *name)
 	dirent->node = src;
 	dirent->node->nlink++;
 	node_ref(dirent->node);
-	LIST_INSERT_HEAD(&((struct ramfs_dir*)node)->nodes, dirent, chain);
+	dir_insert((struct ramfs_dir*)node, dirent);
 	return 0;
 }
 
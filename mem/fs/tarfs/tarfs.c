@@ -101,7 +101,7 @@ struct fs_type g_tarfs_type =
 {
 	.op = &fs_type_op,
 	.name = "ramfs",
-	.flags = 0,
+	.flags = FS_TYPE_DCACHE,
 };
 
 static const struct node_op dir_op =
@@ -50,6 +50,7 @@ struct node vfs_root =
 void vfs_init_sma(void)
 {
 	sma_init(&fs_sb_sma, sizeof(struct fs_sb), NULL, NULL, "fs_sb");
+	dcache_init();
 }
 
 static int getnode(struct node *cwd, const char *path, int flags,
@@ -490,7 +491,15 @@ int node_lookup(struct node *node, const char *name, size_t name_len,
 {
 	if (!node->op || !node->op->lookup)
 		return -ENOSYS;
-	return node->op->lookup(node, name, name_len, child);
+	if (!dcache_find(node, name, name_len, child))
+		return *child ? 0 : -ENOENT;
+	uint32_t seq = dcache_seq(node);
+	int ret = node->op->lookup(node, name, name_len, child);
+	if (!ret)
+		dcache_add(node, name, name_len, *child, seq);
+	else if (ret == -ENOENT)
+		dcache_add(node, name, name_len, NULL, seq);
+	return ret;
 }
 
 int node_readdir(struct node *node, struct fs_readdir_ctx *ctx)
@@ -505,7 +514,10 @@ int node_mknode(struct node *node, const char *name, size_t name_len,
 {
 	if (!node->op || !node->op->mknode)
 		return -ENOSYS;
-	return node->op->mknode(node, name, name_len, mask, attr, dev);
+	int ret = node->op->mknode(node, name, name_len, mask, attr, dev);
+	if (!ret)
+		dcache_remove(node, name, name_len);
+	return ret;
 }
 
 int node_getattr(struct node *node, fs_attr_mask_t mask,
@@ -530,7 +542,10 @@ int node_symlink(struct node *node, const char *name, size_t name_len,
 {
 	if (!node->op || !node->op->symlink)
 		return -ENOSYS;
-	return node->op->symlink(node, name, name_len, target, mask, attr);
+	int ret = node->op->symlink(node, name, name_len, target, mask, attr);
+	if (!ret)
+		dcache_remove(node, name, name_len);
+	return ret;
 }
 
 ssize_t node_readlink(struct node *node, struct uio *uio)
@@ -544,21 +559,30 @@ int node_link(struct node *node, struct node *src, const char *name)
 {
 	if (!node->op || !node->op->link)
 		return -ENOSYS;
-	return node->op->link(node, src, name);
+	int ret = node->op->link(node, src, name);
+	if (!ret)
+		dcache_remove(node, name, strlen(name));
+	return ret;
 }
 
 int node_unlink(struct node *node, const char *name)
 {
 	if (!node->op || !node->op->unlink)
 		return -ENOSYS;
-	return node->op->unlink(node, name);
+	int ret = node->op->unlink(node, name);
+	if (!ret)
+		dcache_remove(node, name, strlen(name));
+	return ret;
 }
 
 int node_rmdir(struct node *node, const char *name)
 {
 	if (!node->op || !node->op->rmdir)
 		return -ENOSYS;
-	return node->op->rmdir(node, name);
+	int ret = node->op->rmdir(node, name);
+	if (!ret)
+		dcache_remove(node, name, strlen(name));
+	return ret;
 }
 
 int node_rename(struct node *srcdir, const char *srcname,
@@ -566,7 +590,13 @@ int node_rename(struct node *srcdir, const char *srcname,
 {
 	if (!srcdir->op || !srcdir->op->rename)
 		return -ENOSYS;
-	return srcdir->op->rename(srcdir, srcname, dstdir, dstname);
+	int ret = srcdir->op->rename(srcdir, srcname, dstdir, dstname);
+	if (!ret)
+	{
+		dcache_remove(srcdir, srcname, strlen(srcname));
+		dcache_remove(dstdir, dstname, strlen(dstname));
+	}
+	return ret;
 }
 
 int node_cache_init(struct node_cache *cache)
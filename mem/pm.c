@@ -1,147 +1,400 @@
 #include <multiboot.h>
 #include <errno.h>
+#include <numa.h>
+#include <cpu.h>
 #include <mem.h>
 
+/* physical memory is managed by a binary buddy allocator per pool
+ * free blocks are naturally aligned on their size (in physical page
+ * numbers), their first page is flagged PAGE_F_FREE and linked in the
+ * free area of its order
+ *
+ * each cpu keeps a small cache of free pages to make single page
+ * allocations and frees lock-free in the common case: the kernel runs
+ * with interrupts disabled, so a cache is only ever used by its cpu
+ * cached pages are accounted as used in their pool and flagged
+ * PAGE_F_CACHED
+ *
+ * the allocations which have to go to the pools wake the page daemon up
+ * when the free pages run low (see mem/reclaim.c)
+ *
+ * on numa systems the pools are split at the boundaries of the nodes and
+ * the pools of the node of the current cpu are tried first, then the
+ * other nodes by increasing distance (see kern/numa.c)
+ */
+
+#define PCP_HIGH  64 /* max cached pages per cpu */
+#define PCP_BATCH 16 /* pages moved between the cache and the pools */
+
+#define DMA32_LIMIT 0x100000000ULL
+
+struct pm_pcp
+{
+	struct page *pages[PCP_HIGH];
+	size_t count;
+};
+
 struct pm_pool_head g_pm_pools = TAILQ_HEAD_INITIALIZER(g_pm_pools);
 
+static struct pm_pcp g_pm_pcp[MAXCPU];
+static size_t g_pm_pcp_cpus;
+
+static struct lock_class pm_pool_lock_class = LOCK_CLASS_INITIALIZER("pm_pool");
+
 void pm_init_page(struct page *page, uintptr_t poff)
 {
 	page->offset = poff;
 	page->flags = 0;
+	page->order = 0;
 	refcount_init(&page->refcount, 1);
 }
 
-static void update_pm_bitmap_first_free(struct pm_pool *pm_pool, size_t start)
+static struct pm_pool *page_pool(const struct page *page)
+{
+	struct pm_pool *pm_pool;
+	TAILQ_FOREACH(pm_pool, &g_pm_pools, chain)
+	{
+		if (page >= pm_pool->pages
+		 && page < pm_pool->pages + pm_pool->count)
+			return pm_pool;
+	}
+	return NULL;
+}
+
+static void buddy_add(struct pm_pool *pm_pool, struct page *page,
+                      uint32_t order)
+{
+	struct pm_free_area *area = &pm_pool->free_areas[order];
+	page->flags |= PAGE_F_FREE;
+	page->order = order;
+	TAILQ_INSERT_HEAD(&area->pages, page, chain);
+	area->count++;
+}
+
+static void buddy_remove(struct pm_pool *pm_pool, struct page *page)
+{
+	struct pm_free_area *area = &pm_pool->free_areas[page->order];
+	TAILQ_REMOVE(&area->pages, page, chain);
+	area->count--;
+	page->flags &= ~PAGE_F_FREE;
+}
+
+/* returns the free block of the given order at the given page number */
+static struct page *buddy_get(struct pm_pool *pm_pool, size_t pfn,
+                              uint32_t order)
+{
+	if (pfn < pm_pool->offset
+	 || pfn + ((size_t)1 << order) > pm_pool->offset + pm_pool->count)
+		return NULL;
+	struct page *page = &pm_pool->pages[pfn - pm_pool->offset];
+	if (!(page->flags & PAGE_F_FREE) || page->order != order)
+		return NULL;
+	return page;
+}
+
+static void buddy_free(struct pm_pool *pm_pool, size_t pfn, uint32_t order)
+{
+	while (order < PM_MAX_ORDER - 1)
+	{
+		struct page *buddy = buddy_get(pm_pool,
+		                               pfn ^ ((size_t)1 << order),
+		                               order);
+		if (!buddy)
+			break;
+		buddy_remove(pm_pool, buddy);
+		pfn &= ~((size_t)1 << order);
+		order++;
+	}
+	buddy_add(pm_pool, &pm_pool->pages[pfn - pm_pool->offset], order);
+}
+
+static struct page *buddy_alloc(struct pm_pool *pm_pool, uint32_t order)
+{
+	uint32_t o;
+	for (o = order; o < PM_MAX_ORDER; ++o)
+	{
+		if (pm_pool->free_areas[o].count)
+			break;
+	}
+	if (o == PM_MAX_ORDER)
+		return NULL;
+	struct page *page = TAILQ_FIRST(&pm_pool->free_areas[o].pages);
+	buddy_remove(pm_pool, page);
+	while (o > order)
+	{
+		o--;
+		buddy_add(pm_pool, page + ((size_t)1 << o), o);
+	}
+	return page;
+}
+
+/* take a specific page out of the free block containing it */
+static int buddy_claim(struct pm_pool *pm_pool, size_t pfn)
 {
-	for (size_t i = start / (sizeof(size_t) * 8); i < pm_pool->bitmap_size; ++i)
+	for (uint32_t o = 0; o < PM_MAX_ORDER; ++o)
 	{
-		if (pm_pool->bitmap[i] == (size_t)-1)
+		size_t head = pfn & ~(((size_t)1 << o) - 1);
+		struct page *page = buddy_get(pm_pool, head, o);
+		if (!page)
 			continue;
-		for (size_t j = 0; j < sizeof(size_t) * 8; ++j)
+		buddy_remove(pm_pool, page);
+		while (o)
 		{
-			if (pm_pool->bitmap[i] & ((size_t)1 << j))
-				continue;
-			pm_pool->bitmap_first_free = i * sizeof(size_t) * 8 + j;
-			return;
+			o--;
+			size_t half = (size_t)1 << o;
+			if (pfn >= head + half)
+			{
+				buddy_add(pm_pool, &pm_pool->pages[head - pm_pool->offset], o);
+				head += half;
+			}
+			else
+			{
+				buddy_add(pm_pool, &pm_pool->pages[head + half - pm_pool->offset], o);
+			}
 		}
-		panic("no empty bits\n");
+		return 0;
 	}
-	panic("no more pages\n");
+	return -ENOENT;
 }
 
-int pm_alloc_page(struct page **page)
+/* add [start; end[ as maximal naturally-aligned blocks */
+static void buddy_add_range(struct pm_pool *pm_pool, size_t start, size_t end)
 {
-	struct pm_pool *pm_pool;
-	TAILQ_FOREACH(pm_pool, &g_pm_pools, chain)
+	while (start < end)
 	{
-		mutex_spinlock(&pm_pool->mutex);
-		if (pm_pool->bitmap_first_free >= pm_pool->bitmap_size * sizeof(size_t) * 8)
-		{
-			mutex_unlock(&pm_pool->mutex);
-			continue;
-		}
-		size_t i = pm_pool->bitmap_first_free / (sizeof(size_t) * 8);
-		size_t j = pm_pool->bitmap_first_free % (sizeof(size_t) * 8);
-		if (pm_pool->bitmap[i] & ((size_t)1 << j))
-			panic("invalid first page 0x%0*zu: 0x%0*zu\n",
-			      (int)(sizeof(size_t) * 2), pm_pool->bitmap_first_free,
-			      (int)(sizeof(size_t) * 2), pm_pool->bitmap[i]);
-		pm_pool->bitmap[i] |= ((size_t)1 << j);
-		*page = &pm_pool->pages[pm_pool->bitmap_first_free];
-		assert(!refcount_get(&(*page)->refcount), "allocating referenced page (%p, %" PRIu32 " references)\n", (void*)(*page)->offset, refcount_get(&(*page)->refcount));
-		pm_ref_page(*page);
-		update_pm_bitmap_first_free(pm_pool, pm_pool->bitmap_first_free);
-		pm_pool->used++;
-		mutex_unlock(&pm_pool->mutex);
+		uint32_t order = 0;
+		while (order < PM_MAX_ORDER - 1
+		    && !(start & (((size_t)2 << order) - 1))
+		    && start + ((size_t)2 << order) <= end)
+			order++;
+		buddy_add(pm_pool, &pm_pool->pages[start - pm_pool->offset], order);
+		start += (size_t)1 << order;
+	}
+}
+
+static uint32_t size_order(size_t nb)
+{
+	uint32_t order = 0;
+	while (((size_t)1 << order) < nb)
+		order++;
+	return order;
+}
+
+/* the cache of the current cpu, if every booted cpu can use its own
+ * (a booting cpu has no curcpu() yet)
+ */
+static struct pm_pcp *pcp_get(void)
+{
+	size_t cpus = __atomic_load_n(&g_pm_pcp_cpus, __ATOMIC_ACQUIRE);
+	if (!cpus || cpus != __atomic_load_n(&g_ncpus, __ATOMIC_ACQUIRE))
+		return NULL;
+	return &g_pm_pcp[curcpu()->id];
+}
+
+static uint32_t local_node(void)
+{
+	if (!pcp_get())
 		return 0;
+	return curcpu()->node;
+}
+
+static int pool_alloc_pages(struct pm_pool *pm_pool, struct page **pagep,
+                            size_t nb, uint32_t order)
+{
+	mutex_spinlock(&pm_pool->mutex);
+	struct page *page = buddy_alloc(pm_pool, order);
+	if (!page)
+	{
+		mutex_unlock(&pm_pool->mutex);
+		return -ENOMEM;
 	}
-	return -ENOMEM;
+	/* give back the tail of the block */
+	for (size_t i = nb; i < ((size_t)1 << order); ++i)
+		buddy_free(pm_pool, page[i].offset, 0);
+	pm_pool->used += nb;
+	mutex_unlock(&pm_pool->mutex);
+	for (size_t i = 0; i < nb; ++i)
+	{
+		assert(!refcount_get(&page[i].refcount),
+		       "allocating referenced page (%p, %" PRIu32 " references)\n",
+		       (void*)page[i].offset,
+		       refcount_get(&page[i].refcount));
+		pm_ref_page(&page[i]);
+	}
+	*pagep = page;
+	return 0;
 }
 
-int pm_alloc_pages(struct page **page, size_t nb)
+/* allocate nb contiguous pages from the nearest nodes first, preferring
+ * the highest zones of each node to keep low memory for the devices which
+ * need it
+ */
+static int alloc_pages(struct page **pagep, size_t nb, int max_zone)
 {
-	if (!nb)
-		return -EINVAL;
-	struct pm_pool *pm_pool;
-	TAILQ_FOREACH(pm_pool, &g_pm_pools, chain)
+	uint32_t order = size_order(nb);
+	if (order >= PM_MAX_ORDER)
+		return -ENOMEM;
+	const uint32_t *nodes = numa_fallback(local_node());
+	for (size_t i = 0; i < g_numa_nodes; ++i)
 	{
-		mutex_spinlock(&pm_pool->mutex);
-		if (pm_pool->bitmap_first_free >= pm_pool->bitmap_size * sizeof(size_t) * 8)
-		{
-			mutex_unlock(&pm_pool->mutex);
-			continue;
-		}
-		for (size_t i = pm_pool->bitmap_first_free / (sizeof(size_t) * 8); i < pm_pool->bitmap_size; ++i)
+		for (int zone = max_zone; zone >= 0; --zone)
 		{
-			if (pm_pool->bitmap[i] == (size_t)-1)
-				continue;
-			for (size_t j = 0; j < sizeof(size_t) * 8; ++j)
+			struct pm_pool *pm_pool;
+			TAILQ_FOREACH(pm_pool, &g_pm_pools, chain)
 			{
-				if (pm_pool->bitmap[i] & ((size_t)1 << j))
+				if (pm_pool->node != nodes[i]
+				 || pm_pool->zone != zone)
 					continue;
-				size_t off = i * sizeof(size_t) * 8 + j;
-				for (size_t k = 0; k < nb; ++k)
-				{
-					size_t v = off + k;
-					if (pm_pool->bitmap[v / (sizeof(size_t) * 8)] & ((size_t)1 << (v % (sizeof(size_t) * 8))))
-						goto next_page;
-				}
-				for (size_t k = 0; k < nb; ++k)
-				{
-					size_t v = off + k;
-					assert(!refcount_get(&pm_pool->pages[v].refcount), "allocating referenced page\n");
-					pm_ref_page(&pm_pool->pages[v]);
-				}
-				for (size_t k = 0; k < nb; ++k)
-				{
-					size_t v = off + k;
-					pm_pool->bitmap[v / (sizeof(size_t) * 8)] |= ((size_t)1 << (v % (sizeof(size_t) * 8)));
-				}
-				if (pm_pool->bitmap_first_free == off)
-					update_pm_bitmap_first_free(pm_pool, off + nb);
-				*page = &pm_pool->pages[off];
-				pm_pool->used += nb;
-				mutex_unlock(&pm_pool->mutex);
+				if (pool_alloc_pages(pm_pool, pagep, nb, order))
+					continue;
+				vm_reclaim_wakeup();
 				return 0;
-next_page:
-				continue;
 			}
 		}
-		mutex_unlock(&pm_pool->mutex);
 	}
+	vm_reclaim_wakeup();
 	return -ENOMEM;
 }
 
+static void free_page(struct pm_pool *pm_pool, struct page *page)
+{
+	mutex_spinlock(&pm_pool->mutex);
+	buddy_free(pm_pool, page->offset, 0);
+	pm_pool->used--;
+	mutex_unlock(&pm_pool->mutex);
+}
+
+static void pcp_fill(struct pm_pcp *pcp, struct pm_pool *pm_pool)
+{
+	mutex_spinlock(&pm_pool->mutex);
+	while (pcp->count < PCP_BATCH)
+	{
+		struct page *page = buddy_alloc(pm_pool, 0);
+		if (!page)
+			break;
+		page->flags |= PAGE_F_CACHED;
+		pcp->pages[pcp->count++] = page;
+		pm_pool->used++;
+	}
+	mutex_unlock(&pm_pool->mutex);
+}
+
+static void pcp_refill(struct pm_pcp *pcp)
+{
+	const uint32_t *nodes = numa_fallback(local_node());
+	for (size_t i = 0; i < g_numa_nodes; ++i)
+	{
+		for (int zone = PM_ZONE_COUNT - 1; zone >= 0; --zone)
+		{
+			struct pm_pool *pm_pool;
+			TAILQ_FOREACH(pm_pool, &g_pm_pools, chain)
+			{
+				if (pm_pool->node != nodes[i]
+				 || pm_pool->zone != zone)
+					continue;
+				pcp_fill(pcp, pm_pool);
+				if (pcp->count == PCP_BATCH)
+					return;
+			}
+		}
+	}
+}
+
+/* give back the coldest pages */
+static void pcp_drain(struct pm_pcp *pcp, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		struct page *page = pcp->pages[i];
+		page->flags &= ~PAGE_F_CACHED;
+		free_page(page_pool(page), page);
+	}
+	pcp->count -= count;
+	memmove(&pcp->pages[0], &pcp->pages[count],
+	        sizeof(*pcp->pages) * pcp->count);
+}
+
+void pm_init_cpu(void)
+{
+	__atomic_add_fetch(&g_pm_pcp_cpus, 1, __ATOMIC_RELEASE);
+}
+
+size_t pm_cached_pages(void)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < MAXCPU; ++i)
+		count += __atomic_load_n(&g_pm_pcp[i].count, __ATOMIC_RELAXED);
+	return count;
+}
+
+/* approximate, the pools aren't locked */
+size_t pm_free_count(void)
+{
+	size_t count = 0;
+	struct pm_pool *pm_pool;
+	TAILQ_FOREACH(pm_pool, &g_pm_pools, chain)
+		count += pm_pool->count - pm_pool->used;
+	return count + pm_cached_pages();
+}
+
+int pm_alloc_page(struct page **page)
+{
+	struct pm_pcp *pcp = pcp_get();
+	if (!pcp)
+		return alloc_pages(page, 1, PM_ZONE_COUNT - 1);
+	if (!pcp->count)
+	{
+		pcp_refill(pcp);
+		vm_reclaim_wakeup();
+		if (!pcp->count)
+			return -ENOMEM;
+	}
+	*page = pcp->pages[--pcp->count];
+	(*page)->flags &= ~PAGE_F_CACHED;
+	assert(!refcount_get(&(*page)->refcount),
+	       "allocating referenced page (%p, %" PRIu32 " references)\n",
+	       (void*)(*page)->offset, refcount_get(&(*page)->refcount));
+	pm_ref_page(*page);
+	return 0;
+}
+
+int pm_alloc_pages(struct page **page, size_t nb)
+{
+	if (!nb)
+		return -EINVAL;
+	return alloc_pages(page, nb, PM_ZONE_COUNT - 1);
+}
+
+int pm_alloc_pages_dma32(struct page **page, size_t nb)
+{
+	if (!nb)
+		return -EINVAL;
+	return alloc_pages(page, nb, PM_ZONE_DMA32);
+}
+
 void pm_free_page(struct page *page)
 {
 	if (!page)
 		return;
-	struct pm_pool *pm_pool;
-	TAILQ_FOREACH(pm_pool, &g_pm_pools, chain)
+	struct pm_pool *pm_pool = page_pool(page);
+	if (!pm_pool)
+		panic("free_page of invalid address: %p\n", page);
+	if (!refcount_get(&page->refcount))
+		panic("page double free %p\n", page);
+	if (refcount_dec(&page->refcount))
+		return;
+	assert(!(page->flags & PAGE_F_FREE),
+	       "free_page of unallocated page: %p\n", page);
+	struct pm_pcp *pcp = pcp_get();
+	if (!pcp)
 	{
-		if (page < pm_pool->pages
-		 || page >= pm_pool->pages + pm_pool->count)
-			continue;
-		mutex_spinlock(&pm_pool->mutex);
-		if (!refcount_get(&page->refcount))
-			panic("page double free %p\n", page);
-		if (refcount_dec(&page->refcount))
-		{
-			mutex_unlock(&pm_pool->mutex);
-			return;
-		}
-		size_t delta = page - pm_pool->pages;
-		size_t *bitmap = &pm_pool->bitmap[delta / (sizeof(size_t) * 8)];
-		size_t mask = ((size_t)1 << (delta % (sizeof(size_t) * 8)));
-		assert(*bitmap & mask, "free_page of unallocated page: %p\n", page);
-		*bitmap &= ~mask;
-		if (delta < pm_pool->bitmap_first_free)
-			pm_pool->bitmap_first_free = delta;
-		pm_pool->used--;
-		mutex_unlock(&pm_pool->mutex);
+		free_page(pm_pool, page);
 		return;
 	}
-	panic("free_page of invalid address: %p\n", page);
+	if (pcp->count == PCP_HIGH)
+		pcp_drain(pcp, PCP_BATCH);
+	page->flags |= PAGE_F_CACHED;
+	pcp->pages[pcp->count++] = page;
 }
 
 void pm_free_pages(struct page *pages, size_t n)
@@ -167,6 +420,26 @@ struct page *pm_get_page(size_t off)
 	return NULL;
 }
 
+/* take a page out of the cache of the current cpu
+ * fetching happens at boot, on the first cpu, so a cached page can only
+ * be in its cache
+ */
+static void pcp_claim(struct page *page)
+{
+	struct pm_pcp *pcp = &g_pm_pcp[curcpu()->id];
+	for (size_t i = 0; i < pcp->count; ++i)
+	{
+		if (pcp->pages[i] != page)
+			continue;
+		pcp->count--;
+		memmove(&pcp->pages[i], &pcp->pages[i + 1],
+		        sizeof(*pcp->pages) * (pcp->count - i));
+		page->flags &= ~PAGE_F_CACHED;
+		return;
+	}
+	panic("cached page not found %p\n", page);
+}
+
 static struct page *pm_fetch_page(size_t off)
 {
 	struct pm_pool *pm_pool;
@@ -175,18 +448,13 @@ static struct page *pm_fetch_page(size_t off)
 		if (off < pm_pool->offset
 		 || off >= pm_pool->offset + pm_pool->count)
 			continue;
-		size_t pool_off = off - pm_pool->offset;
-		size_t i = pool_off / (sizeof(size_t) * 8);
-		size_t j = pool_off % (sizeof(size_t) * 8);
-		if (!(pm_pool->bitmap[i] & ((size_t)1 << j)))
-		{
-			pm_pool->bitmap[i] |= ((size_t)1 << j);
+		struct page *page = &pm_pool->pages[off - pm_pool->offset];
+		mutex_spinlock(&pm_pool->mutex);
+		if (page->flags & PAGE_F_CACHED)
+			pcp_claim(page);
+		else if (!buddy_claim(pm_pool, off))
 			pm_pool->used++;
-		}
-		struct page *page = &pm_pool->pages[pool_off];
 		pm_ref_page(page);
-		if (pool_off == pm_pool->bitmap_first_free)
-			update_pm_bitmap_first_free(pm_pool, pm_pool->bitmap_first_free);
 		mutex_unlock(&pm_pool->mutex);
 		return page;
 	}
@@ -211,69 +479,141 @@ void pm_free_pt(uintptr_t off)
 		pm_free_page(page);
 }
 
-#if __SIZE_WIDTH__ == 64
-static void init_bitmap(struct pm_pool *pm_pool)
+static void init_pool(struct pm_pool *pm_pool, uintptr_t addr, size_t size)
 {
-	pm_pool->bitmap = PMAP(PAGE_SIZE * (pm_pool->offset + pm_pool->used));
-	pm_pool->bitmap_size = (pm_pool->count + 63) / 64;
-	uint64_t bitmap_bytes = pm_pool->bitmap_size * sizeof(uint64_t);
-	uint64_t bitmap_pages = (bitmap_bytes + PAGE_SIZE - 1) / PAGE_SIZE;
-	uint64_t first_free = bitmap_pages + pm_pool->used;
-	memset(pm_pool->bitmap, 0, bitmap_bytes);
-	for (size_t i = 0; i <= first_free; ++i)
-		pm_pool->bitmap[i / 64] |= ((size_t)1 << (i % 64));
-	pm_pool->bitmap_first_free += bitmap_pages;
-	pm_pool->used += bitmap_pages;
+	mutex_init(&pm_pool->mutex, 0);
+	mutex_set_class(&pm_pool->mutex, &pm_pool_lock_class);
+	pm_pool->offset = addr / PAGE_SIZE;
+	pm_pool->count = size / PAGE_SIZE;
+	pm_pool->used = 0;
+	pm_pool->admin = 0;
+	pm_pool->node = 0;
+	if ((uint64_t)addr + size <= DMA32_LIMIT)
+		pm_pool->zone = PM_ZONE_DMA32;
+	else
+		pm_pool->zone = PM_ZONE_NORMAL;
+	for (size_t i = 0; i < PM_MAX_ORDER; ++i)
+	{
+		TAILQ_INIT(&pm_pool->free_areas[i].pages);
+		pm_pool->free_areas[i].count = 0;
+	}
 }
 
-static void init_pages(struct pm_pool *pm_pool)
+/* split a pool at the given page number, the pages after it going to a
+ * new pool sharing the struct page array of the first one
+ */
+int pm_split_pool(struct pm_pool *pm_pool, size_t pfn)
+{
+	size_t end = pm_pool->offset + pm_pool->count;
+	if (pfn <= pm_pool->offset || pfn >= end)
+		return -EINVAL;
+	struct pm_pool *split = malloc(sizeof(*split), 0);
+	if (!split)
+		return -ENOMEM;
+	init_pool(split, pfn * PAGE_SIZE, (end - pfn) * PAGE_SIZE);
+	split->zone = pm_pool->zone;
+	split->node = pm_pool->node;
+	split->pages = &pm_pool->pages[pfn - pm_pool->offset];
+	mutex_spinlock(&pm_pool->mutex);
+	size_t free_count = 0;
+	for (uint32_t o = 0; o < PM_MAX_ORDER; ++o)
+	{
+		struct page *page = TAILQ_FIRST(&pm_pool->free_areas[o].pages);
+		while (page)
+		{
+			struct page *next = TAILQ_NEXT(page, chain);
+			size_t start = page->offset;
+			size_t block_end = start + ((size_t)1 << o);
+			if (block_end > pfn)
+			{
+				/* a block crossing the split is cut in smaller
+				 * ones, which are of lower orders
+				 */
+				buddy_remove(pm_pool, page);
+				if (start < pfn)
+				{
+					buddy_add_range(pm_pool, start, pfn);
+					start = pfn;
+				}
+				buddy_add_range(split, start, block_end);
+				free_count += block_end - start;
+			}
+			page = next;
+		}
+	}
+	split->used = split->count - free_count;
+	pm_pool->used -= split->used;
+	if (pm_pool->offset + pm_pool->admin > pfn)
+	{
+		split->admin = pm_pool->offset + pm_pool->admin - pfn;
+		pm_pool->admin -= split->admin;
+	}
+	pm_pool->count = pfn - pm_pool->offset;
+	mutex_unlock(&pm_pool->mutex);
+	TAILQ_INSERT_AFTER(&g_pm_pools, pm_pool, split, chain);
+	return 0;
+}
+
+static void init_pages_refcount(struct pm_pool *pm_pool)
 {
-	pm_pool->pages = PMAP(PAGE_SIZE * (pm_pool->offset + pm_pool->used));
-	uint64_t pages_size = sizeof(struct page) * pm_pool->count;
-	uint64_t pages_pages = (pages_size + PAGE_SIZE - 1) / PAGE_SIZE;
-	uint64_t pm_off = pm_pool->offset + pm_pool->bitmap_first_free;
 	for (size_t i = 0; i < pm_pool->count; ++i)
 	{
 		struct page *page = &pm_pool->pages[i];
 		page->offset = pm_pool->offset + i;
 		page->flags = 0;
-		refcount_init(&page->refcount, (i < (pm_off - pm_pool->offset)) ? 1 : 0);
+		page->order = 0;
+		refcount_init(&page->refcount, i < pm_pool->used ? 1 : 0);
 	}
-	for (size_t i = pm_pool->bitmap_first_free; i < pm_off - pm_pool->offset; ++i)
-		pm_pool->bitmap[i / 64] |= ((size_t)1 << (i % 64));
-	pm_pool->bitmap_first_free += pages_pages;
+}
+
+#if __SIZE_WIDTH__ == 64
+static void init_pages(struct pm_pool *pm_pool)
+{
+	pm_pool->pages = PMAP(PAGE_SIZE * (pm_pool->offset + pm_pool->used));
+	uint64_t pages_size = sizeof(struct page) * pm_pool->count;
+	uint64_t pages_pages = (pages_size + PAGE_SIZE - 1) / PAGE_SIZE;
 	pm_pool->used += pages_pages;
+	init_pages_refcount(pm_pool);
 }
 
-static void memory_iterator(uintptr_t addr, size_t size, void *userdata)
+static void add_pool(uintptr_t addr, size_t size)
 {
-	(void)userdata;
 	if (size < 1024 * 1024 * 16) /* at least 16 MiB */
 		return;
 	_Static_assert(sizeof(struct pm_pool) <= PAGE_SIZE);
 	size_t used = 1;
 	arch_pm_init_pmap(addr / PAGE_SIZE, size / PAGE_SIZE, &used);
 	struct pm_pool *pm_pool = PMAP(addr);
-	mutex_init(&pm_pool->mutex, 0);
-	pm_pool->offset = addr / PAGE_SIZE;
-	pm_pool->count = size / PAGE_SIZE;
+	init_pool(pm_pool, addr, size);
 	pm_pool->used = used;
-	pm_pool->bitmap_first_free = used;
-	init_bitmap(pm_pool);
 	init_pages(pm_pool);
 	pm_pool->admin = pm_pool->used;
+	buddy_add_range(pm_pool, pm_pool->offset + pm_pool->used,
+	                pm_pool->offset + pm_pool->count);
 	TAILQ_INSERT_TAIL(&g_pm_pools, pm_pool, chain);
 }
 
+static void memory_iterator(uintptr_t addr, size_t size, void *userdata)
+{
+	(void)userdata;
+	/* memory reachable by 32-bit devices gets its own pool */
+	if (addr < DMA32_LIMIT && addr + size > DMA32_LIMIT)
+	{
+		add_pool(addr, DMA32_LIMIT - addr);
+		add_pool(DMA32_LIMIT, addr + size - DMA32_LIMIT);
+		return;
+	}
+	add_pool(addr, size);
+}
+
 void pm_init(uintptr_t kernel_reserved)
 {
 	mutex_init(&g_vm_mutex, MUTEX_RECURSIVE);
 	multiboot_iterate_memory(kernel_reserved, UINT64_MAX, memory_iterator, NULL);
 	if (TAILQ_EMPTY(&g_pm_pools))
 		panic("no pm ranges found\n");
-	g_vm_heap.addr = VADDR_HEAP_BEGIN;
-	g_vm_heap.size = VADDR_HEAP_END - VADDR_HEAP_BEGIN;
-	TAILQ_INIT(&g_vm_heap.ranges);
+	vm_region_init(&g_vm_heap, VADDR_HEAP_BEGIN,
+	               VADDR_HEAP_END - VADDR_HEAP_BEGIN);
 }
 
 #else
@@ -281,43 +621,15 @@ void pm_init(uintptr_t kernel_reserved)
 static void *init_pm_vaddr;
 extern uint8_t _kernel_end;
 
-static void init_bitmap(struct pm_pool *pm_pool)
-{
-	pm_pool->bitmap = init_pm_vaddr;
-	pm_pool->bitmap_size = (pm_pool->count + 31) / 32;
-	uint32_t bitmap_bytes = pm_pool->bitmap_size * sizeof(uint32_t);
-	uint32_t bitmap_pages = (bitmap_bytes + PAGE_SIZE - 1) / PAGE_SIZE;
-	init_pm_vaddr = (uint8_t*)init_pm_vaddr + PAGE_SIZE * bitmap_pages;
-
-	uint32_t pm_off = pm_pool->offset + pm_pool->bitmap_first_free;
-	arch_pm_init_map(pm_pool->bitmap, &pm_off, bitmap_pages);
-
-	memset(pm_pool->bitmap, 0, bitmap_bytes);
-	for (size_t i = 0; i <= bitmap_pages; ++i)
-		pm_pool->bitmap[i / 32] |= (1 << (i % 32));
-	pm_pool->bitmap_first_free = pm_off - pm_pool->offset;
-}
-
-static void init_pages(struct pm_pool *pm_pool)
+static void init_pages(struct pm_pool *pm_pool, uint32_t *pm_off)
 {
 	pm_pool->pages = init_pm_vaddr;
 	uint32_t pages_size = sizeof(struct page) * pm_pool->count;
 	uint32_t pages_pages = (pages_size + PAGE_SIZE - 1) / PAGE_SIZE;
 	init_pm_vaddr = (uint8_t*)init_pm_vaddr + PAGE_SIZE * pages_pages;
-
-	uint32_t pm_off = pm_pool->offset + pm_pool->bitmap_first_free;
-	arch_pm_init_map(pm_pool->pages, &pm_off, pages_pages);
-
-	for (size_t i = 0; i < pm_pool->count; ++i)
-	{
-		struct page *page = &pm_pool->pages[i];
-		page->offset = pm_pool->offset + i;
-		page->flags = 0;
-		refcount_init(&page->refcount, (i < (pm_off - pm_pool->offset)) ? 1 : 0);
-	}
-	for (size_t i = pm_pool->bitmap_first_free; i < pm_off - pm_pool->offset; ++i)
-		pm_pool->bitmap[i / 32] |= (1 << (i % 32));
-	pm_pool->bitmap_first_free = pm_off - pm_pool->offset;
+	arch_pm_init_map(pm_pool->pages, pm_off, pages_pages);
+	pm_pool->used = *pm_off - pm_pool->offset;
+	init_pages_refcount(pm_pool);
 }
 
 static void memory_iterator(uintptr_t addr, size_t size, void *userdata)
@@ -330,15 +642,11 @@ static void memory_iterator(uintptr_t addr, size_t size, void *userdata)
 	init_pm_vaddr = (uint8_t*)init_pm_vaddr + PAGE_SIZE;
 	uint32_t pm_off = addr / PAGE_SIZE;
 	arch_pm_init_map(pm_pool, &pm_off, 1);
-	mutex_init(&pm_pool->mutex, 0);
-	pm_pool->offset = addr / PAGE_SIZE;
-	pm_pool->count = size / PAGE_SIZE;
-	pm_pool->used = pm_off - pm_pool->offset;
-	pm_pool->bitmap_first_free = pm_off - pm_pool->offset;
-	init_bitmap(pm_pool);
-	init_pages(pm_pool);
-	pm_pool->used = pm_pool->bitmap_first_free;
+	init_pool(pm_pool, addr, size);
+	init_pages(pm_pool, &pm_off);
 	pm_pool->admin = pm_pool->used;
+	buddy_add_range(pm_pool, pm_pool->offset + pm_pool->used,
+	                pm_pool->offset + pm_pool->count);
 	TAILQ_INSERT_TAIL(&g_pm_pools, pm_pool, chain);
 }
 
@@ -349,8 +657,7 @@ void pm_init(uintptr_t kernel_reserved)
 	multiboot_iterate_memory(kernel_reserved, UINT32_MAX, memory_iterator, NULL);
 	if (TAILQ_EMPTY(&g_pm_pools))
 		panic("no pm ranges found\n");
-	g_vm_heap.addr = (uintptr_t)init_pm_vaddr;
-	g_vm_heap.size = VADDR_HEAP_END - g_vm_heap.addr;
-	TAILQ_INIT(&g_vm_heap.ranges);
+	vm_region_init(&g_vm_heap, (uintptr_t)init_pm_vaddr,
+	               VADDR_HEAP_END - (uintptr_t)init_pm_vaddr);
 }
 #endif
@@ -0,0 +1,476 @@
+#include <spinlock.h>
+#include <errno.h>
+#include <waitq.h>
+#include <proc.h>
+#include <time.h>
+#include <cpu.h>
+#include <sma.h>
+#include <std.h>
+#include <mem.h>
+
+/* page reclaim
+ *
+ * the page daemon is woken up when the free pages go below the low
+ * watermark and reclaims up to the high one, the allocations failing
+ * meanwhile reclaim directly (vm_reclaim_alloc)
+ * the reclaimable pages are the cached ones (see mem/cache.c) and the
+ * pages of the private anonymous zones, both kept in an active and an
+ * inactive list: there are no referenced bits to test, so deactivating a
+ * page unmaps it, and a page faulted again is activated back, cheaply
+ * since it is still resident
+ *
+ * the private anonymous pages are deactivated by scanning the spaces, the
+ * unmapped page is then kept in a swap entry of its space, which stays
+ * when the page is written to swap; the fault of its address finds it
+ * back (vm_swap_fault), the swapped out pages are shared by forks as any
+ * other private page
+ * the reclaim doesn't hold the mutex of the space while writing a page: a
+ * busy entry released meanwhile is marked dead and freed once written
+ */
+
+#define RECLAIM_BATCH 32 /* pages reclaimed on allocation failure */
+#define RECLAIM_SCAN  16 /* addresses looked up per page to deactivate */
+
+struct vm_swapent
+{
+	uintptr_t addr;
+	struct page *page; /* resident page, NULL once written to swap */
+	struct swap_area *area;
+	size_t slot;
+	int busy; /* being written to swap */
+	int dead; /* released while busy */
+	struct rb_node tree;
+	TAILQ_ENTRY(vm_swapent) chain;
+};
+
+struct vm_space_head g_vm_spaces = TAILQ_HEAD_INITIALIZER(g_vm_spaces);
+
+static struct sma vm_swapent_sma;
+static TAILQ_HEAD(, vm_swapent) g_anon_inactive =
+	TAILQ_HEAD_INITIALIZER(g_anon_inactive);
+static size_t g_anon_inactive_count;
+
+static struct spinlock g_reclaim_lock;
+static struct waitq g_reclaim_waitq;
+static int g_pagedaemon;
+static size_t g_reclaim_low;
+static size_t g_reclaim_high;
+
+void vm_reclaim_init(void)
+{
+	sma_init(&vm_swapent_sma, sizeof(struct vm_swapent), NULL, NULL,
+	         "vm_swapent");
+	spinlock_init(&g_reclaim_lock);
+	waitq_init(&g_reclaim_waitq);
+	size_t total = 0;
+	struct pm_pool *pm_pool;
+	TAILQ_FOREACH(pm_pool, &g_pm_pools, chain)
+		total += pm_pool->count - pm_pool->admin;
+	size_t min = total / 256;
+	if (min < RECLAIM_BATCH)
+		min = RECLAIM_BATCH;
+	g_reclaim_low = min * 2;
+	g_reclaim_high = min * 3;
+}
+
+static struct vm_swapent *swapent_lookup(struct vm_space *space,
+                                         uintptr_t addr)
+{
+	struct rb_node *node = space->swapents.root;
+	while (node)
+	{
+		struct vm_swapent *ent = RB_ENTRY(node, struct vm_swapent,
+		                                  tree);
+		if (addr == ent->addr)
+			return ent;
+		if (addr < ent->addr)
+			node = node->left;
+		else
+			node = node->right;
+	}
+	return NULL;
+}
+
+/* first entry at or after addr */
+static struct vm_swapent *swapent_first(struct vm_space *space,
+                                        uintptr_t addr)
+{
+	struct rb_node *node = space->swapents.root;
+	struct vm_swapent *ret = NULL;
+	while (node)
+	{
+		struct vm_swapent *ent = RB_ENTRY(node, struct vm_swapent,
+		                                  tree);
+		if (ent->addr >= addr)
+		{
+			ret = ent;
+			node = node->left;
+		}
+		else
+		{
+			node = node->right;
+		}
+	}
+	return ret;
+}
+
+static void swapent_insert(struct vm_space *space, struct vm_swapent *ent)
+{
+	struct rb_node **link = &space->swapents.root;
+	struct rb_node *parent = NULL;
+	while (*link)
+	{
+		parent = *link;
+		struct vm_swapent *it = RB_ENTRY(parent, struct vm_swapent,
+		                                 tree);
+		if (ent->addr < it->addr)
+			link = &parent->left;
+		else
+			link = &parent->right;
+	}
+	rb_insert(&space->swapents, &ent->tree, parent, link);
+}
+
+static struct vm_swapent *swapent_alloc(uintptr_t addr)
+{
+	struct vm_swapent *ent = sma_alloc(&vm_swapent_sma, 0);
+	if (!ent)
+		return NULL;
+	ent->addr = addr;
+	ent->page = NULL;
+	ent->area = NULL;
+	ent->slot = 0;
+	ent->busy = 0;
+	ent->dead = 0;
+	return ent;
+}
+
+static void swapent_free(struct vm_swapent *ent)
+{
+	if (ent->page)
+		pm_free_page(ent->page);
+	else if (ent->area)
+		swap_free(ent->area, ent->slot);
+	sma_free(&vm_swapent_sma, ent);
+}
+
+/* remove the entry from its space, the reclaim frees the busy ones */
+static void swapent_release(struct vm_space *space, struct vm_swapent *ent)
+{
+	rb_remove(&space->swapents, &ent->tree);
+	if (ent->busy)
+	{
+		ent->dead = 1;
+		return;
+	}
+	if (ent->page)
+	{
+		TAILQ_REMOVE(&g_anon_inactive, ent, chain);
+		g_anon_inactive_count--;
+	}
+	swapent_free(ent);
+}
+
+static void swapent_deactivate(struct vm_swapent *ent)
+{
+	TAILQ_INSERT_TAIL(&g_anon_inactive, ent, chain);
+	g_anon_inactive_count++;
+}
+
+/* fault of a private anonymous page: give back the page of its entry,
+ * -ENOENT if there is none
+ * the page of another space (after a fork) is copied, a swapped out one is
+ * read back
+ */
+int vm_swap_fault(struct vm_space *space, uintptr_t addr,
+                  struct page **page)
+{
+	if (!space->swapents.root)
+		return -ENOENT;
+	struct vm_swapent *ent = swapent_lookup(space, addr);
+	if (!ent)
+		return -ENOENT;
+	if (ent->page && refcount_get(&ent->page->refcount) == 1)
+	{
+		pm_ref_page(ent->page);
+		*page = ent->page;
+		swapent_release(space, ent);
+		return 0;
+	}
+	/* allocating may reclaim, but never the entries of this space */
+	struct page *dup;
+	int ret = vm_reclaim_alloc(&dup);
+	if (ret)
+		return ret;
+	if (ent->page)
+	{
+		struct arch_copy_zone *src_zone = &curcpu()->copy_src_page;
+		struct arch_copy_zone *dst_zone = &curcpu()->copy_dst_page;
+		arch_set_copy_zone(src_zone, ent->page->offset);
+		arch_set_copy_zone(dst_zone, dup->offset);
+		memcpy(__builtin_assume_aligned(dst_zone->ptr, PAGE_SIZE),
+		       __builtin_assume_aligned(src_zone->ptr, PAGE_SIZE),
+		       PAGE_SIZE);
+	}
+	else
+	{
+		/* the space mutex is held, the entry stays */
+		ret = swap_read(ent->area, ent->slot, dup);
+		if (ret)
+		{
+			pm_free_page(dup);
+			return ret;
+		}
+	}
+	*page = dup;
+	swapent_release(space, ent);
+	return 0;
+}
+
+/* the pages of the entries are shared with the new space */
+int vm_swap_dup(struct vm_space *dst, struct vm_space *src)
+{
+	for (struct vm_swapent *ent = swapent_first(src, 0);
+	     ent;
+	     ent = RB_ENTRY_SAFE(rb_next(&ent->tree), struct vm_swapent, tree))
+	{
+		struct vm_swapent *dup = swapent_alloc(ent->addr);
+		if (!dup)
+			return -ENOMEM;
+		if (ent->page)
+		{
+			pm_ref_page(ent->page);
+			dup->page = ent->page;
+			swapent_deactivate(dup);
+		}
+		else
+		{
+			swap_ref(ent->area, ent->slot);
+			dup->area = ent->area;
+			dup->slot = ent->slot;
+		}
+		swapent_insert(dst, dup);
+	}
+	return 0;
+}
+
+/* the range gets unmapped: forget its entries */
+void vm_swap_release(struct vm_space *space, uintptr_t addr, size_t size)
+{
+	struct vm_swapent *ent;
+	while ((ent = swapent_first(space, addr))
+	    && ent->addr - addr < size)
+		swapent_release(space, ent);
+}
+
+int vm_swap_test(struct vm_space *space, uintptr_t addr, size_t size)
+{
+	struct vm_swapent *ent = swapent_first(space, addr);
+	return ent && ent->addr - addr < size;
+}
+
+static int is_anon_zone(const struct vm_zone *zone)
+{
+	return !zone->op && !zone->cache && !zone->file && !zone->userdata;
+}
+
+/* unmap up to count pages of the private anonymous zones, from where the
+ * previous scan stopped
+ * the pages mapped elsewhere (by forks, or by the kernel) are skipped
+ */
+static size_t deactivate_space(struct vm_space *space, size_t count)
+{
+	size_t scan = count * RECLAIM_SCAN;
+	size_t n = 0;
+	uintptr_t addr = space->scan_addr;
+	struct vm_zone *zone;
+	TAILQ_FOREACH(zone, &space->zones, chain)
+	{
+		if (!is_anon_zone(zone)
+		 || addr >= zone->addr + zone->size)
+			continue;
+		if (addr < zone->addr)
+			addr = zone->addr;
+		for (; addr < zone->addr + zone->size; addr += PAGE_SIZE)
+		{
+			if (n == count || !scan)
+				goto end;
+			scan--;
+			uintptr_t poff;
+			if (arch_vm_lookup(space, addr, &poff))
+				continue;
+			struct page *page = pm_get_page(poff);
+			if (!page
+			 || page == g_zero_page
+			 || refcount_get(&page->refcount) != 1)
+				continue;
+			struct vm_swapent *ent = swapent_alloc(addr);
+			if (!ent)
+				goto end;
+			pm_ref_page(page);
+			if (arch_vm_unmap(space, addr, PAGE_SIZE))
+			{
+				pm_free_page(page);
+				sma_free(&vm_swapent_sma, ent);
+				goto end;
+			}
+			/* the reference of the mapping is now the entry's */
+			pm_free_page(page);
+			ent->page = page;
+			swapent_insert(space, ent);
+			swapent_deactivate(ent);
+			n++;
+		}
+	}
+	addr = 0;
+
+end:
+	space->scan_addr = addr;
+	if (n)
+		vm_tlb_shootdown(space);
+	return n;
+}
+
+/* the spaces locked elsewhere (and the one of the current thread, which
+ * may be faulting) are skipped, rotating the list so that the next scan
+ * starts with the following space
+ */
+static size_t anon_deactivate(size_t count)
+{
+	struct thread *thread = curcpu()->thread;
+	struct vm_space *self = thread && thread->proc ? thread->proc->vm_space
+	                                               : NULL;
+	size_t n = 0;
+	size_t spaces = 0;
+	struct vm_space *space;
+	TAILQ_FOREACH(space, &g_vm_spaces, chain)
+		spaces++;
+	while (n < count && spaces--)
+	{
+		space = TAILQ_FIRST(&g_vm_spaces);
+		TAILQ_REMOVE(&g_vm_spaces, space, chain);
+		TAILQ_INSERT_TAIL(&g_vm_spaces, space, chain);
+		if (space == self || mutex_trylock(&space->mutex))
+			continue;
+		n += deactivate_space(space, count - n);
+		mutex_unlock(&space->mutex);
+	}
+	return n;
+}
+
+static size_t anon_reclaim(size_t count)
+{
+	size_t freed = 0;
+	struct vm_swapent *ent;
+	while (freed < count && (ent = TAILQ_FIRST(&g_anon_inactive)))
+	{
+		struct swap_area *area;
+		size_t slot;
+		if (swap_alloc(&area, &slot))
+			break;
+		TAILQ_REMOVE(&g_anon_inactive, ent, chain);
+		g_anon_inactive_count--;
+		ent->busy = 1;
+		int ret = swap_write(area, slot, ent->page);
+		ent->busy = 0;
+		if (ent->dead)
+		{
+			swap_free(area, slot);
+			swapent_free(ent);
+			continue;
+		}
+		if (ret)
+		{
+			TRACE("failed to write page to swap");
+			swap_free(area, slot);
+			swapent_deactivate(ent);
+			break;
+		}
+		/* the page may still be shared with the entry of a fork */
+		if (refcount_get(&ent->page->refcount) == 1)
+			freed++;
+		pm_free_page(ent->page);
+		ent->page = NULL;
+		ent->area = area;
+		ent->slot = slot;
+	}
+	return freed;
+}
+
+/* free up to count pages, refilling the inactive lists as they empty */
+size_t vm_reclaim(size_t count)
+{
+	size_t freed = 0;
+	for (size_t pass = 0; pass < 2 && freed < count; ++pass)
+	{
+		freed += vm_cache_reclaim(count - freed);
+		if (freed < count && swap_available())
+			freed += anon_reclaim(count - freed);
+		if (freed >= count)
+			break;
+		vm_cache_deactivate(count - freed);
+		if (swap_available())
+			anon_deactivate(count - freed);
+	}
+	return freed;
+}
+
+/* allocate a page, reclaiming on failure */
+int vm_reclaim_alloc(struct page **page)
+{
+	int ret = pm_alloc_page(page);
+	if (ret != -ENOMEM)
+		return ret;
+	vm_reclaim(RECLAIM_BATCH);
+	return pm_alloc_page(page);
+}
+
+void vm_reclaim_wakeup(void)
+{
+	if (!__atomic_load_n(&g_pagedaemon, __ATOMIC_RELAXED)
+	 || pm_free_count() >= g_reclaim_low)
+		return;
+	spinlock_lock(&g_reclaim_lock);
+	waitq_signal(&g_reclaim_waitq, 0);
+	spinlock_unlock(&g_reclaim_lock);
+}
+
+/* the page daemon runs in the syscall of a process forked by init: the
+ * kernel threads can't sleep
+ */
+int vm_pagedaemon(void)
+{
+	if (g_pagedaemon)
+		return -EBUSY;
+	__atomic_store_n(&g_pagedaemon, 1, __ATOMIC_RELAXED);
+	int ret;
+	while (1)
+	{
+		spinlock_lock(&g_reclaim_lock);
+		if (pm_free_count() >= g_reclaim_low)
+			ret = waitq_wait_tail(&g_reclaim_waitq, &g_reclaim_lock,
+			                      NULL);
+		else
+			ret = 0;
+		spinlock_unlock(&g_reclaim_lock);
+		if (ret == -EINTR)
+			break;
+		size_t free = pm_free_count();
+		if (free >= g_reclaim_high)
+			continue;
+		if (vm_reclaim(g_reclaim_high - free))
+			continue;
+		/* nothing left to reclaim, don't spin on the wakeups */
+		struct timespec ts = {1, 0};
+		ret = thread_sleep(&ts);
+		if (ret == -EINTR)
+			break;
+	}
+	__atomic_store_n(&g_pagedaemon, 0, __ATOMIC_RELAXED);
+	return ret;
+}
+
+size_t vm_swap_inactive(void)
+{
+	return g_anon_inactive_count;
+}
@@ -2,6 +2,16 @@
 #include <sma.h>
 #include <mem.h>
 
+/* free ranges of a region are kept both in an address-ordered list (for
+ * neighbours lookup) and in a red-black tree indexed by address, augmented
+ * by the biggest range size of each subtree (for first-fit search)
+ *
+ * allocating a range node can recurse into the kernel heap region (sma
+ * getting pages through vmalloc): nodes are only allocated when the
+ * region is in a consistent state, and the operation is restarted from
+ * scratch once the node is available
+ */
+
 static struct sma vm_range_sma;
 
 void vm_region_init_sma(void)
@@ -18,6 +28,126 @@ static int is_range_aligned(uintptr_t addr, size_t size)
 	return 1;
 }
 
+static void range_augment(struct rb_node *node)
+{
+	struct vm_range *range = RB_ENTRY(node, struct vm_range, tree);
+	range->max_size = range->size;
+	if (node->left)
+	{
+		struct vm_range *left = RB_ENTRY(node->left, struct vm_range, tree);
+		if (left->max_size > range->max_size)
+			range->max_size = left->max_size;
+	}
+	if (node->right)
+	{
+		struct vm_range *right = RB_ENTRY(node->right, struct vm_range, tree);
+		if (right->max_size > range->max_size)
+			range->max_size = right->max_size;
+	}
+}
+
+/* last range starting at or before addr */
+static struct vm_range *find_range(struct vm_region *region, uintptr_t addr)
+{
+	struct rb_node *node = region->tree.root;
+	struct vm_range *ret = NULL;
+	while (node)
+	{
+		struct vm_range *range = RB_ENTRY(node, struct vm_range, tree);
+		if (range->addr <= addr)
+		{
+			ret = range;
+			node = node->right;
+		}
+		else
+		{
+			node = node->left;
+		}
+	}
+	return ret;
+}
+
+/* lowest range of at least size bytes */
+static struct vm_range *find_fit(struct vm_region *region, size_t size)
+{
+	struct rb_node *node = region->tree.root;
+	if (!node || RB_ENTRY(node, struct vm_range, tree)->max_size < size)
+		return NULL;
+	while (1)
+	{
+		struct vm_range *range = RB_ENTRY(node, struct vm_range, tree);
+		if (node->left
+		 && RB_ENTRY(node->left, struct vm_range, tree)->max_size >= size)
+		{
+			node = node->left;
+			continue;
+		}
+		if (range->size >= size)
+			return range;
+		node = node->right;
+	}
+}
+
+static void insert_range(struct vm_region *region, struct vm_range *range)
+{
+	struct rb_node **link = &region->tree.root;
+	struct rb_node *parent = NULL;
+	while (*link)
+	{
+		parent = *link;
+		struct vm_range *it = RB_ENTRY(parent, struct vm_range, tree);
+		if (range->addr < it->addr)
+			link = &parent->left;
+		else
+			link = &parent->right;
+	}
+	/* the tree parent is a direct neighbour */
+	if (!parent)
+		TAILQ_INSERT_HEAD(&region->ranges, range, chain);
+	else if (link == &parent->left)
+		TAILQ_INSERT_BEFORE(RB_ENTRY(parent, struct vm_range, tree),
+		                    range, chain);
+	else
+		TAILQ_INSERT_AFTER(&region->ranges,
+		                   RB_ENTRY(parent, struct vm_range, tree),
+		                   range, chain);
+	rb_insert(&region->tree, &range->tree, parent, link);
+}
+
+/* returns the node to be freed once the region is consistent */
+static struct vm_range *remove_range(struct vm_region *region,
+                                     struct vm_range *range)
+{
+	TAILQ_REMOVE(&region->ranges, range, chain);
+	rb_remove(&region->tree, &range->tree);
+	if (range == &region->range_0)
+	{
+		region->range_0_used = 0;
+		return NULL;
+	}
+	return range;
+}
+
+/* the range addr & size changed without changing its position */
+static void update_range(struct vm_region *region, struct vm_range *range)
+{
+	rb_augment_path(&region->tree, &range->tree);
+}
+
+static struct vm_range *get_node(struct vm_region *region,
+                                 struct vm_range **spare)
+{
+	struct vm_range *range;
+	if (!region->range_0_used)
+	{
+		region->range_0_used = 1;
+		return &region->range_0;
+	}
+	range = *spare;
+	*spare = NULL;
+	return range;
+}
+
 void vm_region_print(struct vm_region *region)
 {
 	printf("region %p:\n", region);
@@ -33,6 +163,11 @@ void vm_region_print(struct vm_region *region)
 int vm_region_alloc(struct vm_region *region, uintptr_t addr, size_t size,
                     uintptr_t *ret)
 {
+	struct vm_range *spare = NULL;
+	struct vm_range *garbage = NULL;
+	struct vm_range *range;
+	int err = 0;
+
 	if (!is_range_aligned(addr, size))
 		return -EINVAL;
 	if (!size)
@@ -43,274 +178,192 @@ int vm_region_alloc(struct vm_region *region, uintptr_t addr, size_t size,
 	if (addr && (addr < region->addr
 	 || end > region->addr + region->size))
 		return -ENOMEM;
-	if (TAILQ_EMPTY(&region->ranges))
+
+retry:
+	if (!addr)
 	{
-		if (!addr || addr == region->addr)
+		range = find_fit(region, size);
+		if (!range)
 		{
-			region->range_0.addr = region->addr + size;
-			region->range_0.size = region->size - size;
-			TAILQ_INSERT_HEAD(&region->ranges, &region->range_0, chain);
-			*ret = region->addr;
+			err = -ENOMEM;
 			goto end;
 		}
-		if (end == region->addr + region->size)
+		*ret = range->addr;
+		if (range->size == size)
 		{
-			region->range_0.addr = region->addr;
-			region->range_0.size = region->size - size;
-			TAILQ_INSERT_HEAD(&region->ranges, &region->range_0, chain);
-			*ret = region->addr + region->size - size;
-			goto end;
+			garbage = remove_range(region, range);
+		}
+		else
+		{
+			range->addr += size;
+			range->size -= size;
+			update_range(region, range);
 		}
-		struct vm_range *range = sma_alloc(&vm_range_sma, 0);
-		if (!range)
-			return -ENOMEM;
-		range->addr = region->addr;
-		range->size = addr - region->addr;
-		TAILQ_INSERT_HEAD(&region->ranges, range, chain);
-		region->range_0.addr = end;
-		region->range_0.size = region->addr + region->size
-		                     - region->range_0.addr;
-		TAILQ_INSERT_HEAD(&region->ranges, &region->range_0, chain);
-		*ret = addr;
 		goto end;
 	}
-	struct vm_range *item;
-	if (addr)
+	range = find_range(region, addr);
+	if (!range || end > range->addr + range->size)
 	{
-		TAILQ_FOREACH(item, &region->ranges, chain)
-		{
-			if (addr < item->addr)
-				return -ENOMEM;
-			if (addr >= item->addr + item->size)
-				continue;
-			if (size > item->size)
-				continue;
-			if (item->size == size)
-			{
-				if (item->addr != addr)
-					continue;
-				TAILQ_REMOVE(&region->ranges, item, chain);
-				if (item != &region->range_0)
-					sma_free(&vm_range_sma, item);
-				*ret = addr;
-				goto end;
-			}
-			if (addr == item->addr)
-			{
-				item->addr += size;
-				item->size -= size;
-				*ret = addr;
-				goto end;
-			}
-			if (end == item->addr + item->size)
-			{
-				item->size -= size;
-				*ret = addr;
-				goto end;
-			}
-			struct vm_range *newr = sma_alloc(&vm_range_sma, 0);
-			if (!newr)
-				return -ENOMEM;
-			newr->addr = end;
-			newr->size = item->size - (end - item->addr);
-			TAILQ_INSERT_AFTER(&region->ranges, item, newr, chain);
-			item->size = addr - item->addr;
-			*ret = addr;
-			goto end;
-		}
+		err = -ENOMEM;
+		goto end;
 	}
-	else
+	*ret = addr;
+	if (range->addr == addr && range->size == size)
 	{
-		TAILQ_FOREACH(item, &region->ranges, chain)
-		{
-			if (item->size < size)
-				continue;
-			*ret = item->addr;
-			if (item->size == size)
-			{
-				TAILQ_REMOVE(&region->ranges, item, chain);
-				if (item != &region->range_0)
-					sma_free(&vm_range_sma, item);
-			}
-			else
-			{
-				item->addr += size;
-				item->size -= size;
-			}
-			goto end;
-		}
+		garbage = remove_range(region, range);
+		goto end;
+	}
+	if (range->addr == addr)
+	{
+		range->addr += size;
+		range->size -= size;
+		update_range(region, range);
+		goto end;
+	}
+	if (range->addr + range->size == end)
+	{
+		range->size -= size;
+		update_range(region, range);
+		goto end;
 	}
-	return -ENOMEM;
+	/* split */
+	if (region->range_0_used && !spare)
+	{
+		spare = sma_alloc(&vm_range_sma, 0);
+		if (!spare)
+			return -ENOMEM;
+		goto retry;
+	}
+	struct vm_range *newr = get_node(region, &spare);
+	newr->addr = end;
+	newr->size = range->addr + range->size - end;
+	range->size = addr - range->addr;
+	update_range(region, range);
+	insert_range(region, newr);
 
 end:
-	return 0;
+	if (garbage)
+		sma_free(&vm_range_sma, garbage);
+	if (spare)
+		sma_free(&vm_range_sma, spare);
+	return err;
 }
 
 int vm_region_free(struct vm_region *region, uintptr_t addr, size_t size)
 {
+	struct vm_range *spare = NULL;
+	struct vm_range *garbage = NULL;
+	struct vm_range *prev;
+	struct vm_range *next;
+	int err = 0;
+
 	if (!is_range_aligned(addr, size))
 		return -EINVAL;
 	uintptr_t end;
 	if (__builtin_add_overflow(addr, size, &end))
 		return -EOVERFLOW;
-	if (TAILQ_EMPTY(&region->ranges))
+
+retry:
+	prev = find_range(region, addr);
+	next = prev ? TAILQ_NEXT(prev, chain) : TAILQ_FIRST(&region->ranges);
+	if ((prev && prev->addr + prev->size > addr)
+	 || (next && next->addr < end))
 	{
-		region->range_0.addr = addr;
-		region->range_0.size = size;
-		TAILQ_INSERT_HEAD(&region->ranges, &region->range_0, chain);
+		TRACE("vm_region_free of free range %p-%p",
+		      (void*)addr, (void*)end);
+		err = -EINVAL;
 		goto end;
 	}
-	struct vm_range *item;
-	TAILQ_FOREACH(item, &region->ranges, chain)
+	if (prev && prev->addr + prev->size == addr)
 	{
-		if (item->addr == end)
+		prev->size += size;
+		if (next && next->addr == end)
 		{
-			item->addr -= size;
-			item->size += size;
-			struct vm_range *prev = TAILQ_PREV(item, vm_range_head, chain);
-			if (!prev)
-				goto end;
-			if (prev->addr + prev->size != addr)
-				goto end;
-			prev->size += item->size;
-			TAILQ_REMOVE(&region->ranges, item, chain);
-			if (item != &region->range_0)
-				sma_free(&vm_range_sma, item);
-			goto end;
-		}
-		if (item->addr + item->size == addr)
-		{
-			item->size += size;
-			struct vm_range *next = TAILQ_NEXT(item, chain);
-			if (!next)
-				goto end;
-			if (next->addr != item->addr + item->size)
-				goto end;
-			item->size += next->size;
-			TAILQ_REMOVE(&region->ranges, next, chain);
-			if (next != &region->range_0)
-				sma_free(&vm_range_sma, next);
-			goto end;
-		}
-		if (addr < item->addr)
-		{
-			/* XXX get a better solution
-			 * problem is that malloc might remove the first free
-			 * range element, causing "item" var to be already freed.
-			 * doing allocation + set + memory clobber makes
-			 * region->ranges to always be in a valid state
-			 */
-			struct vm_range *new = sma_alloc(&vm_range_sma, 0);
-			__asm__ volatile ("" ::: "memory");
-			if (!new)
-				return -ENOMEM;
-			new->addr = addr;
-			new->size = size;
-			__asm__ volatile ("" ::: "memory");
-			TAILQ_FOREACH(item, &region->ranges, chain)
-			{
-				if (item->addr == end)
-				{
-					item->addr -= size;
-					item->size += size;
-					struct vm_range *prev = TAILQ_PREV(item, vm_range_head, chain);
-					if (!prev)
-					{
-						sma_free(&vm_range_sma, new);
-						goto end;
-					}
-					if (prev->addr + prev->size != addr)
-					{
-						sma_free(&vm_range_sma, new);
-						goto end;
-					}
-					prev->size += item->size;
-					TAILQ_REMOVE(&region->ranges, item, chain);
-					if (item != &region->range_0)
-						sma_free(&vm_range_sma, item);
-					sma_free(&vm_range_sma, new);
-					goto end;
-				}
-				if (item->addr + item->size == addr)
-				{
-					item->size += size;
-					struct vm_range *next = TAILQ_NEXT(item, chain);
-					if (!next)
-					{
-						sma_free(&vm_range_sma, new);
-						goto end;
-					}
-					if (next->addr != item->addr + item->size)
-					{
-						sma_free(&vm_range_sma, new);
-						goto end;
-					}
-					item->size += next->size;
-					TAILQ_REMOVE(&region->ranges, next, chain);
-					if (next != &region->range_0)
-						sma_free(&vm_range_sma, next);
-					sma_free(&vm_range_sma, new);
-					goto end;
-				}
-				if (addr < item->addr)
-				{
-					new->addr = addr;
-					new->size = size;
-					TAILQ_INSERT_BEFORE(item, new, chain);
-					goto end;
-				}
-			}
-			TAILQ_INSERT_TAIL(&region->ranges, new, chain);
-			goto end;
+			prev->size += next->size;
+			garbage = remove_range(region, next);
 		}
+		update_range(region, prev);
+		goto end;
 	}
-	struct vm_range *new = sma_alloc(&vm_range_sma, 0);
-	if (!new)
-		return -ENOMEM;
-	new->addr = addr;
-	new->size = size;
-	TAILQ_INSERT_TAIL(&region->ranges, new, chain);
+	if (next && next->addr == end)
+	{
+		next->addr = addr;
+		next->size += size;
+		update_range(region, next);
+		goto end;
+	}
+	if (region->range_0_used && !spare)
+	{
+		spare = sma_alloc(&vm_range_sma, 0);
+		if (!spare)
+			return -ENOMEM;
+		goto retry;
+	}
+	struct vm_range *newr = get_node(region, &spare);
+	newr->addr = addr;
+	newr->size = size;
+	insert_range(region, newr);
 
 end:
-	return 0;
+	if (garbage)
+		sma_free(&vm_range_sma, garbage);
+	if (spare)
+		sma_free(&vm_range_sma, spare);
+	return err;
 }
 
 int vm_region_test(struct vm_region *region, uintptr_t addr, size_t size)
 {
-	struct vm_range *item;
-	TAILQ_FOREACH(item, &region->ranges, chain)
-	{
-		/* early quit because of ranges ordering */
-		if (addr + size <= item->addr)
-			break;
-		if (addr < item->addr + item->size)
-			return 0;
-	}
+	if (!size)
+		return 1;
+	struct vm_range *range = find_range(region, addr + size - 1);
+	if (range && addr < range->addr + range->size)
+		return 0;
 	return 1;
 }
 
+static void region_setup(struct vm_region *region, uintptr_t addr,
+                         uintptr_t size)
+{
+	region->addr = addr;
+	region->size = size;
+	region->range_0_used = 0;
+	TAILQ_INIT(&region->ranges);
+	rb_init(&region->tree, range_augment);
+}
+
 int vm_region_dup(struct vm_region *dst, const struct vm_region *src)
 {
-	dst->addr = src->addr;
-	dst->size = src->size;
-	TAILQ_INIT(&dst->ranges);
+	region_setup(dst, src->addr, src->size);
 	struct vm_range *item;
 	TAILQ_FOREACH(item, &src->ranges, chain)
 	{
-		struct vm_range *newr = sma_alloc(&vm_range_sma, 0);
-		assert(newr, "can't duplicate new range\n");
+		struct vm_range *newr;
+		if (!dst->range_0_used)
+		{
+			newr = &dst->range_0;
+			dst->range_0_used = 1;
+		}
+		else
+		{
+			newr = sma_alloc(&vm_range_sma, 0);
+			if (!newr)
+				return -ENOMEM;
+		}
 		newr->addr = item->addr;
 		newr->size = item->size;
-		TAILQ_INSERT_TAIL(&dst->ranges, newr, chain);
+		insert_range(dst, newr);
 	}
 	return 0;
 }
 
 void vm_region_init(struct vm_region *region, uintptr_t addr, uintptr_t size)
 {
-	region->addr = addr;
-	region->size = size;
-	TAILQ_INIT(&region->ranges);
+	region_setup(region, addr, size);
+	region->range_0.addr = addr;
+	region->range_0.size = size;
+	region->range_0_used = 1;
+	insert_range(region, &region->range_0);
 }
 
 void vm_region_destroy(struct vm_region *region)
@@ -318,7 +371,8 @@ void vm_region_destroy(struct vm_region *region)
 	struct vm_range *range;
 	while ((range = TAILQ_FIRST(&region->ranges)))
 	{
-		TAILQ_REMOVE(&region->ranges, range, chain);
-		sma_free(&vm_range_sma, range);
+		struct vm_range *garbage = remove_range(region, range);
+		if (garbage)
+			sma_free(&vm_range_sma, garbage);
 	}
 }
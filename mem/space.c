@@ -1,3 +1,4 @@
+#include <tracepoint.h>
 #include <random.h>
 #include <errno.h>
 #include <file.h>
@@ -8,18 +9,34 @@
 #include <vfs.h>
 #include <mem.h>
 
+#define FAULT_AROUND_PAGES 16 /* aligned window mapped on file faults */
+#define FAULT_AROUND_SEQ   64 /* pages mapped ahead of sequential faults */
+
 static struct sma vm_zone_sma;
 static struct sma vm_shm_sma;
 static struct sma vm_space_sma;
 
 struct vm_region g_vm_heap; /* kernel heap */
 struct mutex g_vm_mutex;
+struct page *g_zero_page;
+
+static int vfree_zone(struct vm_space *space, uintptr_t addr, size_t size);
+static int protect_range(struct vm_space *space, uintptr_t addr, size_t size,
+                         uint32_t prot);
 
 void vm_zone_init(void)
 {
 	sma_init(&vm_zone_sma, sizeof(struct vm_zone), NULL, NULL, "vm_zone");
 	sma_init(&vm_shm_sma, sizeof(struct vm_shm), NULL, NULL, "vm_shm");
 	sma_init(&vm_space_sma, sizeof(struct vm_space), NULL, NULL, "vm_space");
+	/* the copy zones aren't setup yet */
+	if (pm_alloc_page(&g_zero_page))
+		panic("failed to allocate zero page\n");
+	void *ptr = vm_map(g_zero_page, PAGE_SIZE, VM_PROT_W);
+	if (!ptr)
+		panic("failed to map zero page\n");
+	memset(ptr, 0, PAGE_SIZE);
+	vm_unmap(ptr, PAGE_SIZE);
 }
 
 static int is_range_user(struct vm_space *vm_space, uintptr_t addr, size_t size)
@@ -81,20 +98,132 @@ static struct vm_zone *zone_dup(const struct vm_zone *zone, uintptr_t addr,
 	dup->off = off;
 	dup->flags = zone->flags;
 	dup->prot = zone->prot;
+	dup->advice = zone->advice;
 	dup->file = zone->file;
 	dup->userdata = zone->userdata;
+	dup->space = zone->space;
+	dup->cache = NULL;
 	if (dup->file)
 		file_ref(dup->file);
+	if (zone->cache)
+		vm_cache_link(dup, zone->cache);
 	return dup;
 }
 
 static void zone_free(struct vm_zone *zone)
 {
+	if (zone->cache)
+		vm_cache_detach(zone);
 	if (zone->file)
 		file_free(zone->file);
 	sma_free(&vm_zone_sma, zone);
 }
 
+/* zones are kept both in an address-ordered list and in an address-indexed
+ * tree; zones never overlap, so resizing a zone in place doesn't change
+ * its position
+ */
+static void zone_insert(struct vm_space *space, struct vm_zone *zone)
+{
+	struct rb_node **link = &space->zones_tree.root;
+	struct rb_node *parent = NULL;
+	while (*link)
+	{
+		parent = *link;
+		struct vm_zone *it = RB_ENTRY(parent, struct vm_zone, tree);
+		if (zone->addr < it->addr)
+			link = &parent->left;
+		else
+			link = &parent->right;
+	}
+	/* the tree parent is a direct neighbour */
+	if (!parent)
+		TAILQ_INSERT_HEAD(&space->zones, zone, chain);
+	else if (link == &parent->left)
+		TAILQ_INSERT_BEFORE(RB_ENTRY(parent, struct vm_zone, tree),
+		                    zone, chain);
+	else
+		TAILQ_INSERT_AFTER(&space->zones,
+		                   RB_ENTRY(parent, struct vm_zone, tree),
+		                   zone, chain);
+	rb_insert(&space->zones_tree, &zone->tree, parent, link);
+}
+
+static void zone_remove(struct vm_space *space, struct vm_zone *zone)
+{
+	TAILQ_REMOVE(&space->zones, zone, chain);
+	rb_remove(&space->zones_tree, &zone->tree);
+}
+
+/* last zone starting at or before addr */
+static struct vm_zone *zone_lookup(struct vm_space *space, uintptr_t addr)
+{
+	struct rb_node *node = space->zones_tree.root;
+	struct vm_zone *ret = NULL;
+	while (node)
+	{
+		struct vm_zone *zone = RB_ENTRY(node, struct vm_zone, tree);
+		if (zone->addr <= addr)
+		{
+			ret = zone;
+			node = node->right;
+		}
+		else
+		{
+			node = node->left;
+		}
+	}
+	return ret;
+}
+
+/* first zone ending after addr */
+static struct vm_zone *zone_first(struct vm_space *space, uintptr_t addr)
+{
+	struct vm_zone *zone = zone_lookup(space, addr);
+	if (!zone)
+		return TAILQ_FIRST(&space->zones);
+	if (addr >= zone->addr + zone->size)
+		return TAILQ_NEXT(zone, chain);
+	return zone;
+}
+
+static int zone_mergeable(const struct vm_zone *a, const struct vm_zone *b)
+{
+	if (a->addr + a->size != b->addr)
+		return 0;
+	/* only anonymous zones, which are fully described by their
+	 * flags and protection
+	 */
+	if (a->op || a->file || a->userdata || a->cache
+	 || b->op || b->file || b->userdata || b->cache)
+		return 0;
+	return a->prot == b->prot
+	    && a->flags == b->flags
+	    && a->advice == b->advice;
+}
+
+/* merge the anonymous zones touching the given range */
+static void merge_zones(struct vm_space *space, uintptr_t addr, uintptr_t end)
+{
+	struct vm_zone *zone = zone_lookup(space, addr ? addr - 1 : 0);
+	if (!zone)
+		zone = TAILQ_FIRST(&space->zones);
+	while (zone && zone->addr <= end)
+	{
+		struct vm_zone *next = TAILQ_NEXT(zone, chain);
+		if (!next)
+			break;
+		if (!zone_mergeable(zone, next))
+		{
+			zone = next;
+			continue;
+		}
+		zone_remove(space, next);
+		zone->size += next->size;
+		zone_free(next);
+	}
+}
+
 int vm_free(struct vm_space *space, uintptr_t addr, size_t size)
 {
 	if (!is_range_aligned(addr, size))
@@ -103,19 +232,34 @@ int vm_free(struct vm_space *space, uintptr_t addr, size_t size)
 	if (__builtin_add_overflow(addr, size, &end))
 		return -EOVERFLOW;
 	struct vm_zone *zone, *nxt;
-	TAILQ_FOREACH_SAFE(zone, &space->zones, chain, nxt)
+	int ret = 0;
+	/* write back the shared pages before losing track of them */
+	for (zone = zone_first(space, addr);
+	     zone && zone->addr < end;
+	     zone = TAILQ_NEXT(zone, chain))
+	{
+		if (!zone->cache)
+			continue;
+		uintptr_t start = addr > zone->addr ? addr : zone->addr;
+		uintptr_t stop = zone->addr + zone->size;
+		if (stop > end)
+			stop = end;
+		if (vm_cache_sync(zone->cache, zone->off + (start - zone->addr),
+		                  stop - start))
+			TRACE("failed to write back shared mapping");
+	}
+	for (zone = zone_first(space, addr); zone; zone = nxt)
 	{
+		nxt = TAILQ_NEXT(zone, chain);
 		if (end <= zone->addr)
 			break;
-		if (addr >= zone->addr + zone->size)
-			continue;
 		if (addr <= zone->addr)
 		{
 			if (end >= zone->addr + zone->size)
 			{
 				/* remove full */
-				TAILQ_REMOVE(&space->zones, zone, chain);
-				vfree_user(space, zone->addr, zone->size);
+				zone_remove(space, zone);
+				vfree_zone(space, zone->addr, zone->size);
 				if (zone->op && zone->op->close)
 					zone->op->close(zone);
 				zone_free(zone);
@@ -124,10 +268,10 @@ int vm_free(struct vm_space *space, uintptr_t addr, size_t size)
 			{
 				/* truncate head */
 				size_t delta = end - zone->addr;
-				vfree_user(space, addr, delta);
+				vfree_zone(space, zone->addr, delta);
 				zone->addr += delta;
 				zone->off += delta;
-				zone->size -= size;
+				zone->size -= delta;
 			}
 		}
 		else
@@ -136,7 +280,7 @@ int vm_free(struct vm_space *space, uintptr_t addr, size_t size)
 			{
 				/* truncate tail */
 				size_t delta = zone->addr + zone->size - addr;
-				vfree_user(space, addr, delta);
+				vfree_zone(space, addr, delta);
 				zone->size -= delta;
 			}
 			else
@@ -146,16 +290,20 @@ int vm_free(struct vm_space *space, uintptr_t addr, size_t size)
 				                                zone->addr + zone->size - end,
 				                                zone->off);
 				if (!newz)
-					return -ENOMEM;
-				TAILQ_INSERT_AFTER(&space->zones, zone, newz, chain);
+				{
+					ret = -ENOMEM;
+					break;
+				}
+				zone_insert(space, newz);
 				zone->size = addr - zone->addr;
 				if (newz->op && newz->op->open)
 					newz->op->open(newz);
-				vfree_user(space, addr, size);
+				vfree_zone(space, addr, size);
 			}
 		}
 	}
-	return 0;
+	vm_tlb_shootdown(space);
+	return ret;
 }
 
 int vm_alloc(struct vm_space *space, uintptr_t addr, off_t off,
@@ -187,18 +335,12 @@ int vm_alloc(struct vm_space *space, uintptr_t addr, off_t off,
 		file_ref(file);
 	zone->prot = prot;
 	zone->flags = flags;
+	zone->advice = MADV_NORMAL;
 	zone->userdata = NULL;
+	zone->space = space;
+	zone->cache = NULL;
 	*zonep = zone;
-	struct vm_zone *it;
-	TAILQ_FOREACH(it, &space->zones, chain)
-	{
-		if (zone->addr < it->addr)
-		{
-			TAILQ_INSERT_BEFORE(it, zone, chain);
-			return 0;
-		}
-	}
-	TAILQ_INSERT_TAIL(&space->zones, zone, chain);
+	zone_insert(space, zone);
 	return 0;
 }
 
@@ -242,13 +384,18 @@ struct vm_space *vm_space_alloc(void)
 	mutex_init(&space->mutex, MUTEX_RECURSIVE);
 	refcount_init(&space->refcount, 1);
 	TAILQ_INIT(&space->zones);
+	rb_init(&space->zones_tree, NULL);
 	TAILQ_INIT(&space->shms);
+	rb_init(&space->swapents, NULL);
+	space->scan_addr = 0;
+	vm_tlb_space_init(space);
 	ret = arch_vm_space_init(space);
 	if (ret)
 	{
 		sma_free(&vm_space_sma, space);
 		return NULL;
 	}
+	TAILQ_INSERT_TAIL(&g_vm_spaces, space, chain);
 	return space;
 }
 
@@ -258,7 +405,8 @@ void vm_space_free(struct vm_space *space)
 		return;
 	if (refcount_dec(&space->refcount))
 		return;
-	arch_vm_space_cleanup(space);
+	TAILQ_REMOVE(&g_vm_spaces, space, chain);
+	vm_space_cleanup(space);
 	mutex_destroy(&space->mutex);
 	sma_free(&vm_space_sma, space);
 }
@@ -270,8 +418,10 @@ static int dup_zones(struct vm_space *dst, struct vm_space *src)
 	{
 		struct vm_zone *dup = zone_dup(zone, zone->addr, zone->size,
 		                               zone->off);
-		assert(dup, "failed to duplicate vm zone\n");
-		TAILQ_INSERT_TAIL(&dst->zones, dup, chain);
+		if (!dup)
+			return -ENOMEM;
+		dup->space = dst;
+		zone_insert(dst, dup);
 		if (dup->op && dup->op->open)
 			dup->op->open(dup);
 	}
@@ -284,7 +434,8 @@ static int dup_shms(struct vm_space *dst, struct vm_space *src)
 	TAILQ_FOREACH(shm, &src->shms, chain)
 	{
 		struct vm_shm *dup = sma_alloc(&vm_shm_sma, 0);
-		assert(dup, "failed to duplicate vm shm\n");
+		if (!dup)
+			return -ENOMEM;
 		dup->addr = shm->addr;
 		dup->size = shm->size;
 		dup->shm = shm->shm;
@@ -307,23 +458,44 @@ struct vm_space *vm_space_dup(struct vm_space *space)
 	mutex_init(&dup->mutex, MUTEX_RECURSIVE);
 	refcount_init(&dup->refcount, 1);
 	TAILQ_INIT(&dup->zones);
+	rb_init(&dup->zones_tree, NULL);
 	TAILQ_INIT(&dup->shms);
+	rb_init(&dup->swapents, NULL);
+	dup->scan_addr = 0;
+	vm_tlb_space_init(dup);
 	ret = arch_vm_space_init(dup);
 	if (ret)
-		panic("failed to allocate vm space\n"); /* XXX */
+	{
+		TRACE("failed to allocate vm space");
+		sma_free(&vm_space_sma, dup);
+		return NULL;
+	}
+	TAILQ_INSERT_TAIL(&g_vm_spaces, dup, chain);
 	mutex_lock(&space->mutex);
 	ret = vm_region_dup(&dup->region, &space->region);
+	if (!ret)
+		ret = dup_zones(dup, space);
+	if (!ret)
+		ret = dup_shms(dup, space);
+	if (!ret)
+		ret = vm_swap_dup(dup, space);
+	if (!ret)
+		ret = arch_vm_space_copy(dup, space);
 	if (ret)
-		panic("failed to duplicate region\n"); /* XXX */
-	ret = dup_zones(dup, space);
-	if (ret)
-		panic("failed to duplicate zones\n"); /* XXX */
-	ret = dup_shms(dup, space);
-	if (ret)
-		panic("failed to duplicate shms\n"); /* XXX */
-	ret = arch_vm_space_copy(dup, space);
-	if (ret)
-		panic("failed to copy vm space\n"); /* XXX */
+	{
+		/* the partial copy is released as any other space */
+		TRACE("failed to duplicate vm space");
+		mutex_unlock(&space->mutex);
+		vm_space_free(dup);
+		return NULL;
+	}
+	/* the shared pages got copied, map the cached ones instead */
+	struct vm_zone *zone;
+	TAILQ_FOREACH(zone, &dup->zones, chain)
+	{
+		if (zone->cache)
+			arch_vm_unmap(dup, zone->addr, zone->size);
+	}
 	mutex_unlock(&space->mutex);
 	return dup;
 }
@@ -337,12 +509,22 @@ int vm_space_protect(struct vm_space *space, uintptr_t addr, size_t size,
 	if (__builtin_add_overflow(addr, size, &end))
 		return -EOVERFLOW;
 	struct vm_zone *zone, *nxt;
-	TAILQ_FOREACH_SAFE(zone, &space->zones, chain, nxt)
+	int ret;
+	if (prot & VM_PROT_W)
+	{
+		for (zone = zone_first(space, addr);
+		     zone && zone->addr < end;
+		     zone = TAILQ_NEXT(zone, chain))
+		{
+			if (zone->flags & MAP_NOWRITE)
+				return -EACCES;
+		}
+	}
+	for (zone = zone_first(space, addr); zone; zone = nxt)
 	{
+		nxt = TAILQ_NEXT(zone, chain);
 		if (end <= zone->addr)
 			break;
-		if (addr >= zone->addr + zone->size)
-			continue;
 		if (addr <= zone->addr)
 		{
 			if (end >= zone->addr + zone->size)
@@ -350,10 +532,10 @@ int vm_space_protect(struct vm_space *space, uintptr_t addr, size_t size,
 				/* protect full */
 				if (prot != zone->prot)
 				{
-					int ret = vm_protect(space, zone->addr,
-					                     zone->size, prot);
+					ret = protect_range(space, zone->addr,
+					                    zone->size, prot);
 					if (ret)
-						return ret;
+						goto end;
 					zone->prot = prot;
 				}
 			}
@@ -368,15 +550,18 @@ int vm_space_protect(struct vm_space *space, uintptr_t addr, size_t size,
 					                                zone->size - delta,
 					                                zone->off + delta);
 					if (!newz)
-						return -ENOMEM;
+					{
+						ret = -ENOMEM;
+						goto end;
+					}
 					zone->size = delta;
-					TAILQ_INSERT_AFTER(&space->zones, zone, newz, chain);
+					zone_insert(space, newz);
 					if (newz->op && newz->op->open)
 						newz->op->open(newz);
-					int ret = vm_protect(space, zone->addr,
-					                     zone->size, prot);
+					ret = protect_range(space, zone->addr,
+					                    zone->size, prot);
 					if (ret)
-						return ret;
+						goto end;
 					zone->prot = prot;
 				}
 			}
@@ -393,15 +578,18 @@ int vm_space_protect(struct vm_space *space, uintptr_t addr, size_t size,
 					                                delta,
 					                                zone->off + addr - zone->addr);
 					if (!newz)
-						return -ENOMEM;
+					{
+						ret = -ENOMEM;
+						goto end;
+					}
 					zone->size -= delta;
-					TAILQ_INSERT_AFTER(&space->zones, zone, newz, chain);
+					zone_insert(space, newz);
 					if (newz->op && newz->op->open)
 						newz->op->open(newz);
-					int ret = vm_protect(space, newz->addr,
-					                     newz->size, prot);
+					ret = protect_range(space, newz->addr,
+					                    newz->size, prot);
 					if (ret)
-						return ret;
+						goto end;
 					newz->prot = prot;
 				}
 			}
@@ -415,50 +603,199 @@ int vm_space_protect(struct vm_space *space, uintptr_t addr, size_t size,
 					struct vm_zone *newl = zone_dup(zone, zone->addr,
 					                                deltal, zone->off);
 					if (!newl)
-						return -ENOMEM;
+					{
+						ret = -ENOMEM;
+						goto end;
+					}
 					struct vm_zone *newh = zone_dup(zone, end,
 					                                deltah,
 					                                zone->off + zone->size - deltah);
 					if (!newh)
 					{
 						zone_free(newl);
-						return -ENOMEM;
+						ret = -ENOMEM;
+						goto end;
 					}
-					TAILQ_INSERT_BEFORE(zone, newl, chain);
-					TAILQ_INSERT_AFTER(&space->zones, zone, newh, chain);
 					zone->addr += deltal;
 					zone->size -= deltal + deltah;
+					zone_insert(space, newl);
+					zone_insert(space, newh);
 					if (newl->op && newl->op->open)
 						newl->op->open(newl);
 					if (newh->op && newh->op->open)
 						newh->op->open(newl);
-					int ret = vm_protect(space, zone->addr,
-					                     zone->size, prot);
+					ret = protect_range(space, zone->addr,
+					                    zone->size, prot);
 					if (ret)
-						return ret;
+						goto end;
 					zone->prot = prot;
 				}
 			}
 		}
 	}
-	return vm_protect(space, addr, size, prot);
+	ret = protect_range(space, addr, size, prot);
+	if (ret)
+		goto end;
+	/* shared pages only get writable once written to */
+	if (prot & VM_PROT_W)
+	{
+		for (zone = zone_first(space, addr);
+		     zone && zone->addr < end;
+		     zone = TAILQ_NEXT(zone, chain))
+		{
+			if (!zone->cache)
+				continue;
+			uintptr_t start = addr > zone->addr ? addr : zone->addr;
+			uintptr_t stop = zone->addr + zone->size;
+			if (stop > end)
+				stop = end;
+			ret = protect_range(space, start, stop - start,
+			                    prot & ~VM_PROT_W);
+			if (ret)
+				goto end;
+		}
+	}
+	merge_zones(space, addr, end);
+
+end:
+	vm_tlb_shootdown(space);
+	return ret;
 }
 
 int vm_space_find(struct vm_space *space, uintptr_t addr,
                   struct vm_zone **zonep)
 {
-	struct vm_zone *zone;
-	TAILQ_FOREACH(zone, &space->zones, chain)
+	struct vm_zone *zone = zone_lookup(space, addr);
+	if (!zone || addr >= zone->addr + zone->size)
+		return -EFAULT;
+	*zonep = zone;
+	return 0;
+}
+
+/* split the zone at addr, the zone keeping the lower part */
+static int zone_split(struct vm_space *space, struct vm_zone *zone,
+                      uintptr_t addr)
+{
+	size_t delta = addr - zone->addr;
+	struct vm_zone *newz = zone_dup(zone, addr, zone->size - delta,
+	                                zone->off + delta);
+	if (!newz)
+		return -ENOMEM;
+	zone->size = delta;
+	zone_insert(space, newz);
+	if (newz->op && newz->op->open)
+		newz->op->open(newz);
+	return 0;
+}
+
+int vm_advise(struct vm_space *space, uintptr_t addr, size_t size,
+              int advice)
+{
+	if (!is_range_aligned(addr, size))
+		return -EINVAL;
+	uintptr_t end;
+	if (__builtin_add_overflow(addr, size, &end))
+		return -EOVERFLOW;
+	if (!is_range_user(space, addr, size))
+		return -ENOMEM;
+	struct vm_zone *zone, *nxt;
+	int ret = 0;
+	for (zone = zone_first(space, addr); zone; zone = nxt)
 	{
-		if (addr < zone->addr)
+		nxt = TAILQ_NEXT(zone, chain);
+		if (end <= zone->addr)
 			break;
-		if (addr < zone->addr + zone->size)
+		uintptr_t zstart = addr > zone->addr ? addr : zone->addr;
+		uintptr_t zend = zone->addr + zone->size;
+		if (zend > end)
+			zend = end;
+		switch (advice)
 		{
-			*zonep = zone;
-			return 0;
+			case MADV_NORMAL:
+			case MADV_RANDOM:
+			case MADV_SEQUENTIAL:
+				if (zone->advice == (uint32_t)advice)
+					break;
+				if (zend < zone->addr + zone->size)
+				{
+					ret = zone_split(space, zone, zend);
+					if (ret)
+						return ret;
+				}
+				if (zstart > zone->addr)
+				{
+					ret = zone_split(space, zone, zstart);
+					if (ret)
+						return ret;
+					zone = TAILQ_NEXT(zone, chain);
+				}
+				zone->advice = advice;
+				break;
+			case MADV_WILLNEED:
+				if (!(zone->prot & VM_PROT_R))
+					break;
+				ret = vm_populate(space, zstart, zend - zstart);
+				if (ret)
+					return ret;
+				break;
+			case MADV_DONTNEED:
+				/* the pages are faulted again on the next access:
+				 * zeroed for anonymous memory, read back for files
+				 */
+				arch_vm_unmap(space, zstart, zend - zstart);
+				vm_swap_release(space, zstart, zend - zstart);
+				break;
+			default:
+				return -EINVAL;
 		}
 	}
-	return -EFAULT;
+	if (advice == MADV_DONTNEED)
+		vm_tlb_shootdown(space);
+	else if (advice != MADV_WILLNEED)
+		merge_zones(space, addr, end);
+	return ret;
+}
+
+/* MS_ASYNC writes back synchronously too, and the shared mappings being
+ * kept coherent with the files, there is nothing to invalidate
+ */
+int vm_msync(struct vm_space *space, uintptr_t addr, size_t size, int flags)
+{
+	if (addr & PAGE_MASK)
+		return -EINVAL;
+	if (flags & ~(MS_ASYNC | MS_SYNC | MS_INVALIDATE))
+		return -EINVAL;
+	if ((flags & (MS_ASYNC | MS_SYNC)) == (MS_ASYNC | MS_SYNC))
+		return -EINVAL;
+	if (size & PAGE_MASK)
+		size += PAGE_SIZE - (size & PAGE_MASK);
+	uintptr_t end;
+	if (__builtin_add_overflow(addr, size, &end))
+		return -ENOMEM;
+	if (!is_range_user(space, addr, size))
+		return -ENOMEM;
+	struct vm_zone *zone;
+	uintptr_t cur = addr;
+	int ret = 0;
+	for (zone = zone_first(space, addr);
+	     zone && zone->addr < end;
+	     zone = TAILQ_NEXT(zone, chain))
+	{
+		if (zone->addr > cur)
+			return -ENOMEM;
+		uintptr_t zstart = addr > zone->addr ? addr : zone->addr;
+		uintptr_t zend = zone->addr + zone->size;
+		if (zend > end)
+			zend = end;
+		cur = zend;
+		if (!zone->cache || ret)
+			continue;
+		ret = vm_cache_sync(zone->cache, zone->off + (zstart - zone->addr),
+		                    zend - zstart);
+	}
+	if (cur < end)
+		return -ENOMEM;
+	return ret;
 }
 
 void vm_space_cleanup(struct vm_space *space)
@@ -466,12 +803,13 @@ void vm_space_cleanup(struct vm_space *space)
 	struct vm_zone *zone;
 	while ((zone = TAILQ_FIRST(&space->zones)))
 	{
-		TAILQ_REMOVE(&space->zones, zone, chain);
-		vfree_user(space, zone->addr, zone->size);
+		zone_remove(space, zone);
+		vfree_zone(space, zone->addr, zone->size);
 		if (zone->op && zone->op->close)
 			zone->op->close(zone);
 		zone_free(zone);
 	}
+	vm_tlb_shootdown(space);
 	vm_region_destroy(&space->region);
 	struct vm_shm *shm;
 	while ((shm = TAILQ_FIRST(&space->shms)))
@@ -509,31 +847,169 @@ int vm_shm_find(struct vm_space *space, uintptr_t addr, struct vm_shm **shmp)
 	return vm_shm ? 0 : -EINVAL;
 }
 
-int vm_fault_page(struct vm_space *space, uintptr_t addr,
-                  struct page **page, struct vm_zone **zonep)
+void vm_zero_page(struct page *page)
+{
+	struct arch_copy_zone *copy_zone = &curcpu()->copy_dst_page;
+	arch_set_copy_zone(copy_zone, page->offset);
+	memset(copy_zone->ptr, 0, PAGE_SIZE);
+}
+
+/* reads of anonymous memory which was never written to are all served
+ * by the shared zero page, mapped without write access: the first write
+ * faults again and gets a page of its own from vm_fault_write
+ */
+int vm_fault_page(struct vm_space *space, uintptr_t addr, uint32_t prot,
+                  struct page **page, uint32_t *map_prot)
 {
 	struct vm_zone *zone;
 	int ret = vm_space_find(space, addr, &zone);
 	if (ret)
 		return ret;
+	if (zone->cache)
+		return vm_cache_fault(zone, addr - zone->addr, prot, page,
+		                      map_prot);
 	if (zone->op)
 	{
 		ret = zone->op->fault(zone, addr - zone->addr, page);
 		if (ret)
 			return ret;
+		*map_prot = zone->prot;
+		if (zone->flags & MAP_NOWRITE)
+			*map_prot &= ~VM_PROT_W;
+		return 0;
 	}
-	else
+	ret = vm_swap_fault(space, addr, page);
+	if (ret != -ENOENT)
 	{
-		ret = pm_alloc_page(page);
 		if (ret)
 			return ret;
-		struct arch_copy_zone *copy_zone = &curcpu()->copy_dst_page;
-		arch_set_copy_zone(copy_zone, (*page)->offset);
-		memset(copy_zone->ptr, 0, PAGE_SIZE);
+		*map_prot = zone->prot;
+		return 0;
 	}
+	if (!(prot & VM_PROT_W))
+	{
+		pm_ref_page(g_zero_page);
+		*page = g_zero_page;
+		*map_prot = zone->prot & ~VM_PROT_W;
+		return 0;
+	}
+	ret = vm_reclaim_alloc(page);
+	if (ret)
+		return ret;
+	vm_zero_page(*page);
+	*map_prot = zone->prot;
+	return 0;
+}
+
+/* first write to the read-only page mapped at addr: the zero page gets
+ * replaced by a private page, clean shared file pages get dirty
+ * the caller maps the returned page writable and shoots down the tlbs
+ */
+int vm_fault_write(struct vm_space *space, uintptr_t addr, uintptr_t poff,
+                   struct page **page, uint32_t *map_prot)
+{
+	if (!space)
+		return -EFAULT;
+	struct vm_zone *zone;
+	int ret = vm_space_find(space, addr, &zone);
+	if (ret)
+		return ret;
+	if (!(zone->prot & VM_PROT_W))
+		return -EFAULT;
+	if (zone->cache)
+	{
+		ret = vm_cache_dirty(zone, addr - zone->addr, poff, page);
+		if (ret)
+			return ret;
+		*map_prot = zone->prot;
+		return 0;
+	}
+	if (zone->op || poff != g_zero_page->offset)
+		return -EFAULT;
+	ret = vm_reclaim_alloc(page);
+	if (ret)
+		return ret;
+	vm_zero_page(*page);
+	pm_free_page(g_zero_page);
+	*map_prot = zone->prot;
+	return 0;
+}
+
+#ifdef ARCH_VM_LARGE_SHIFT
+/* allocate the zeroed pages of a large page at the aligned addr, on a
+ * write fault: only writable private anonymous memory covering the
+ * whole range is eligible
+ */
+int vm_fault_large(struct vm_space *space, uintptr_t addr,
+                   struct page **pages, struct vm_zone **zonep)
+{
+	struct vm_zone *zone;
+	int ret = vm_space_find(space, addr, &zone);
+	if (ret)
+		return ret;
+	if (zone->op
+	 || zone->cache
+	 || !(zone->prot & VM_PROT_W)
+	 || addr < zone->addr
+	 || addr + VM_LARGE_SIZE > zone->addr + zone->size
+	 || vm_swap_test(space, addr, VM_LARGE_SIZE))
+		return -EINVAL;
+	ret = pm_alloc_pages(pages, VM_LARGE_PAGES);
+	if (ret)
+		return ret;
+	for (size_t i = 0; i < VM_LARGE_PAGES; ++i)
+		vm_zero_page(&(*pages)[i]);
 	*zonep = zone;
 	return 0;
 }
+#endif
+
+/* map the neighbours of a faulting page, sparing the traps of the
+ * accesses likely to follow it: the aligned window around the page for
+ * files, the pages after it for sequential accesses
+ */
+static void fault_around(struct vm_space *space, uintptr_t addr,
+                         uint32_t prot)
+{
+	struct vm_zone *zone;
+	if (vm_space_find(space, addr, &zone)
+	 || !(zone->prot & VM_PROT_R))
+		return;
+	uintptr_t start;
+	uintptr_t end;
+	switch (zone->advice)
+	{
+		case MADV_RANDOM:
+			return;
+		case MADV_SEQUENTIAL:
+			start = addr + PAGE_SIZE;
+			end = addr + FAULT_AROUND_SEQ * PAGE_SIZE;
+			break;
+		default:
+			/* anonymous memory is only allocated on demand */
+			if (!zone->op)
+				return;
+			start = addr & ~(FAULT_AROUND_PAGES * PAGE_SIZE - 1);
+			end = start + FAULT_AROUND_PAGES * PAGE_SIZE;
+			break;
+	}
+	/* sequential writes to anonymous memory would fault again on the
+	 * zero page
+	 */
+	if (zone->op || !(zone->prot & VM_PROT_W))
+		prot = VM_PROT_R;
+	if (start < zone->addr)
+		start = zone->addr;
+	if (end < start || end > zone->addr + zone->size)
+		end = zone->addr + zone->size;
+	for (uintptr_t it = start; it < end; it += PAGE_SIZE)
+	{
+		if (it == addr)
+			continue;
+		if (arch_vm_populate_page(space, it, prot, NULL))
+			break;
+	}
+}
 
 int vm_fault(struct vm_space *space, uintptr_t addr, uint32_t prot)
 {
@@ -551,9 +1027,15 @@ int vm_fault(struct vm_space *space, uintptr_t addr, uint32_t prot)
 		      (void*)addr);
 		return -EINVAL;
 	}
+	uint64_t tp_start = tp_enabled(TP_PAGE_FAULT) ? tp_time() : 0;
 	mutex_lock(&space->mutex);
 	int ret = arch_vm_populate_page(space, addr, prot, NULL);
+	if (!ret)
+		fault_around(space, addr,
+		             prot & VM_PROT_W ? VM_PROT_W : VM_PROT_R);
 	mutex_unlock(&space->mutex);
+	if (tp_enabled(TP_PAGE_FAULT))
+		tp_page_fault_emit(addr, prot, ret, tp_start);
 	return ret;
 }
 
@@ -582,11 +1064,47 @@ static int vfree_zone(struct vm_space *space, uintptr_t addr, size_t size)
 	struct mutex *mutex = space ? &space->mutex : &g_vm_mutex;
 	mutex_lock(mutex);
 	arch_vm_unmap(space, addr, size);
+	if (space)
+		vm_swap_release(space, addr, size);
 	int ret = vm_region_free(space ? &space->region : &g_vm_heap, addr, size);
 	mutex_unlock(mutex);
 	return ret;
 }
 
+#ifdef ARCH_VM_LARGE_SHIFT
+/* large allocations are aligned so that they can use large pages */
+static int vmalloc_region(size_t size, uintptr_t *addr)
+{
+	if (size < VM_LARGE_SIZE)
+		return vm_region_alloc(&g_vm_heap, 0, size, addr);
+	size_t pad = VM_LARGE_SIZE - PAGE_SIZE;
+	uintptr_t base;
+	int ret = vm_region_alloc(&g_vm_heap, 0, size + pad, &base);
+	if (ret)
+		return ret;
+	*addr = (base + pad) & ~(VM_LARGE_SIZE - 1);
+	if (*addr != base)
+		vm_region_free(&g_vm_heap, base, *addr - base);
+	if (*addr + size != base + size + pad)
+		vm_region_free(&g_vm_heap, *addr + size,
+		               base + size + pad - *addr - size);
+	return 0;
+}
+
+static int vmalloc_large(uintptr_t addr, size_t size)
+{
+	if ((addr & (VM_LARGE_SIZE - 1)) || size < VM_LARGE_SIZE)
+		return -EINVAL;
+	struct page *pages;
+	int ret = pm_alloc_pages(&pages, VM_LARGE_PAGES);
+	if (ret)
+		return ret;
+	ret = arch_vm_map_large(NULL, addr, pages->offset, VM_PROT_RW);
+	pm_free_pages(pages, VM_LARGE_PAGES);
+	return ret;
+}
+#endif
+
 void *vmalloc(size_t size)
 {
 	if (!is_range_aligned(0, size))
@@ -594,7 +1112,11 @@ void *vmalloc(size_t size)
 	uintptr_t addr = 0;
 	struct mutex *mutex = &g_vm_mutex;
 	mutex_lock(mutex);
+#ifdef ARCH_VM_LARGE_SHIFT
+	if (vmalloc_region(size, &addr))
+#else
 	if (vm_region_alloc(&g_vm_heap, addr, size, &addr))
+#endif
 	{
 		mutex_unlock(mutex);
 		return NULL;
@@ -602,6 +1124,14 @@ void *vmalloc(size_t size)
 	assert(!(addr & PAGE_MASK), "vmalloc unaligned data 0x%zx\n", addr);
 	for (size_t i = 0; i < size; i += PAGE_SIZE)
 	{
+#ifdef ARCH_VM_LARGE_SHIFT
+		/* fallback to small pages if memory is too fragmented */
+		if (!vmalloc_large(addr + i, size - i))
+		{
+			i += VM_LARGE_SIZE - PAGE_SIZE;
+			continue;
+		}
+#endif
 		struct page *page;
 		int ret = pm_alloc_page(&page);
 		if (ret)
@@ -631,11 +1161,14 @@ void vfree(void *ptr, size_t size)
 	int ret = vfree_zone(NULL, (uintptr_t)ptr, size);
 	if (ret)
 		panic("vfree failed\n");
+	vm_tlb_shootdown(NULL);
 }
 
 int vfree_user(struct vm_space *space, uintptr_t addr, size_t size)
 {
-	return vfree_zone(space, addr, size);
+	int ret = vfree_zone(space, addr, size);
+	vm_tlb_shootdown(space);
+	return ret;
 }
 
 void *vm_map(struct page *page, size_t size, uint32_t prot)
@@ -688,7 +1221,9 @@ static int vm_map_user_page(struct vm_space *space, uintptr_t addr,
                             uintptr_t uaddr, uint32_t prot)
 {
 	uintptr_t poff;
-	int ret = arch_vm_populate_page(space, uaddr, VM_PROT_R, &poff);
+	int ret = arch_vm_populate_page(space, uaddr,
+	                                prot & VM_PROT_W ? VM_PROT_W : VM_PROT_R,
+	                                &poff);
 	if (ret)
 		return ret;
 	return arch_vm_map(NULL, addr, poff, PAGE_SIZE, prot);
@@ -735,6 +1270,7 @@ void vm_unmap(void *ptr, size_t size)
 {
 	if (vfree_zone(NULL, (uintptr_t)ptr, size))
 		panic("vunmap failed\n");
+	vm_tlb_shootdown(NULL);
 }
 
 int vm_populate(struct vm_space *space, uintptr_t addr, size_t size)
@@ -744,8 +1280,15 @@ int vm_populate(struct vm_space *space, uintptr_t addr, size_t size)
 		return -EINVAL;
 	for (size_t i = 0; i < size; i += PAGE_SIZE)
 	{
-		int ret = arch_vm_populate_page(space, addr + i, VM_PROT_R,
-		                                NULL);
+		/* prefaulted anonymous memory is meant to be written to */
+		struct vm_zone *zone;
+		int ret = vm_space_find(space, addr + i, &zone);
+		if (ret)
+			return ret;
+		ret = arch_vm_populate_page(space, addr + i,
+		                            zone->prot & VM_PROT_W ? VM_PROT_W
+		                                                   : VM_PROT_R,
+		                            NULL);
 		if (ret)
 			return ret;
 	}
@@ -762,8 +1305,8 @@ int vm_paddr(struct vm_space *space, uintptr_t addr, uintptr_t *paddr)
 	return 0;
 }
 
-int vm_protect(struct vm_space *space, uintptr_t addr, size_t size,
-               uint32_t prot)
+static int protect_range(struct vm_space *space, uintptr_t addr, size_t size,
+                         uint32_t prot)
 {
 	if (!is_range_aligned(addr, size)
 	 || is_range_overflowing(addr, size))
@@ -780,6 +1323,14 @@ int vm_protect(struct vm_space *space, uintptr_t addr, size_t size,
 	return ret;
 }
 
+int vm_protect(struct vm_space *space, uintptr_t addr, size_t size,
+               uint32_t prot)
+{
+	int ret = protect_range(space, addr, size, prot);
+	vm_tlb_shootdown(space);
+	return ret;
+}
+
 /* XXX shame.... */
 static const char *mem_fmt(char *buf, size_t size, size_t n)
 {
@@ -823,18 +1374,31 @@ static const char *mem_fmt(char *buf, size_t size, size_t n)
 
 static void pm_dumpinfo(struct uio *uio)
 {
+	static const char *zone_names[PM_ZONE_COUNT] =
+	{
+		[PM_ZONE_DMA32] = "DMA32",
+		[PM_ZONE_NORMAL] = "Normal",
+	};
 	size_t size = 0;
 	size_t used = 0;
 	size_t admin = 0;
+	size_t free_areas[PM_ZONE_COUNT][PM_MAX_ORDER];
 	struct pm_pool *pm_pool;
+	memset(free_areas, 0, sizeof(free_areas));
 	TAILQ_FOREACH(pm_pool, &g_pm_pools, chain)
 	{
 		mutex_spinlock(&pm_pool->mutex);
 		size += pm_pool->count;
 		used += pm_pool->used;
 		admin += pm_pool->admin;
+		for (size_t i = 0; i < PM_MAX_ORDER; ++i)
+			free_areas[pm_pool->zone][i] += pm_pool->free_areas[i].count;
 		mutex_unlock(&pm_pool->mutex);
 	}
+	size_t cached = pm_cached_pages();
+	if (cached > used)
+		cached = used;
+	used -= cached;
 	char buf[16];
 	uprintf(uio, "PhysicalUsed:      0x%0*zx (%s)\n",
 	        (int)sizeof(size_t) * 2, used * PAGE_SIZE,
@@ -845,21 +1409,24 @@ static void pm_dumpinfo(struct uio *uio)
 	uprintf(uio, "PhysicalReserved : 0x%0*zx (%s)\n",
 	        (int)sizeof(size_t) * 2, admin * PAGE_SIZE,
 	        mem_fmt(buf, sizeof(buf), admin * PAGE_SIZE));
+	uprintf(uio, "PhysicalCached:    0x%0*zx (%s)\n",
+	        (int)sizeof(size_t) * 2, cached * PAGE_SIZE,
+	        mem_fmt(buf, sizeof(buf), cached * PAGE_SIZE));
+	for (size_t i = 0; i < PM_ZONE_COUNT; ++i)
+	{
+		uprintf(uio, "BuddyInfo %-7s:", zone_names[i]);
+		for (size_t j = 0; j < PM_MAX_ORDER; ++j)
+			uprintf(uio, " %zu", free_areas[i][j]);
+		uprintf(uio, "\n");
+	}
 }
 
 static void vm_dumpinfo(struct uio *uio)
 {
 	size_t available = 0;
 	struct vm_range *item;
-	if (TAILQ_EMPTY(&g_vm_heap.ranges))
-	{
-		available = g_vm_heap.size;
-	}
-	else
-	{
-		TAILQ_FOREACH(item, &g_vm_heap.ranges, chain)
-			available += item->size;
-	}
+	TAILQ_FOREACH(item, &g_vm_heap.ranges, chain)
+		available += item->size;
 	size_t size = g_vm_heap.size;
 	size_t used = size - available;
 	char buf[16];
@@ -871,10 +1438,38 @@ static void vm_dumpinfo(struct uio *uio)
 	        mem_fmt(buf, sizeof(buf), size));
 }
 
+static void swap_dumpinfo(struct uio *uio)
+{
+	size_t size;
+	size_t used;
+	size_t active;
+	size_t inactive;
+	swap_usage(&size, &used);
+	vm_cache_usage(&active, &inactive);
+	size_t anon = vm_swap_inactive();
+	char buf[16];
+	uprintf(uio, "SwapUsed:          0x%0*zx (%s)\n",
+	        (int)sizeof(size_t) * 2, used * PAGE_SIZE,
+	        mem_fmt(buf, sizeof(buf), used * PAGE_SIZE));
+	uprintf(uio, "SwapSize:          0x%0*zx (%s)\n",
+	        (int)sizeof(size_t) * 2, size * PAGE_SIZE,
+	        mem_fmt(buf, sizeof(buf), size * PAGE_SIZE));
+	uprintf(uio, "CacheActive:       0x%0*zx (%s)\n",
+	        (int)sizeof(size_t) * 2, active * PAGE_SIZE,
+	        mem_fmt(buf, sizeof(buf), active * PAGE_SIZE));
+	uprintf(uio, "CacheInactive:     0x%0*zx (%s)\n",
+	        (int)sizeof(size_t) * 2, inactive * PAGE_SIZE,
+	        mem_fmt(buf, sizeof(buf), inactive * PAGE_SIZE));
+	uprintf(uio, "AnonInactive:      0x%0*zx (%s)\n",
+	        (int)sizeof(size_t) * 2, anon * PAGE_SIZE,
+	        mem_fmt(buf, sizeof(buf), anon * PAGE_SIZE));
+}
+
 static void paging_dumpinfo(struct uio *uio)
 {
 	pm_dumpinfo(uio);
 	vm_dumpinfo(uio);
+	swap_dumpinfo(uio);
 }
 
 static ssize_t meminfo_read(struct file *file, struct uio *uio)
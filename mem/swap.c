@@ -0,0 +1,207 @@
+#include <errno.h>
+#include <file.h>
+#include <stat.h>
+#include <std.h>
+#include <uio.h>
+#include <vfs.h>
+#include <mem.h>
+
+/* swap areas are regular files or block devices split in page-sized
+ * slots, each slot counting the references to the page it holds: a
+ * swapped out page is shared by the forks of the space it was written
+ * from until they read it back
+ * the areas are accessed through the operations of their file, bypassing
+ * the caches of the shared mappings
+ */
+
+#define SWAP_MAX_REFS UINT16_MAX
+
+#define SLOTS_SIZE(count) (((count) * sizeof(uint16_t) + PAGE_MASK) & ~PAGE_MASK)
+
+struct swap_area
+{
+	struct file *file;
+	uint16_t *slots; /* references of each slot */
+	size_t count; /* number of slots */
+	size_t used; /* referenced slots */
+	size_t hint; /* no free slot before it */
+	TAILQ_ENTRY(swap_area) chain;
+};
+
+static TAILQ_HEAD(, swap_area) g_swap_areas =
+	TAILQ_HEAD_INITIALIZER(g_swap_areas);
+static size_t g_swap_count;
+static size_t g_swap_used;
+
+static off_t area_size(struct file *file)
+{
+	if (S_ISREG(file->node->attr.mode))
+		return file->node->attr.size;
+	if (!file->op->seek)
+		return -EINVAL;
+	return file->op->seek(file, 0, SEEK_END);
+}
+
+int swap_on(struct node *node)
+{
+	if (!S_ISREG(node->attr.mode) && !S_ISBLK(node->attr.mode))
+		return -EINVAL;
+	struct swap_area *area;
+	TAILQ_FOREACH(area, &g_swap_areas, chain)
+	{
+		if (area->file->node == node)
+			return -EBUSY;
+	}
+	struct file *file;
+	int ret = file_fromnode(node, O_RDWR, &file);
+	if (ret)
+		return ret;
+	if (!file->op || !file->op->read || !file->op->write)
+	{
+		ret = -EINVAL;
+		goto err_file;
+	}
+	off_t size = area_size(file);
+	if (size < 0)
+	{
+		ret = size;
+		goto err_file;
+	}
+	size_t count = size / PAGE_SIZE;
+	if (!count)
+	{
+		ret = -EINVAL;
+		goto err_file;
+	}
+	area = malloc(sizeof(*area), 0);
+	if (!area)
+	{
+		ret = -ENOMEM;
+		goto err_file;
+	}
+	area->slots = vmalloc(SLOTS_SIZE(count));
+	if (!area->slots)
+	{
+		ret = -ENOMEM;
+		goto err_area;
+	}
+	memset(area->slots, 0, SLOTS_SIZE(count));
+	area->file = file;
+	area->count = count;
+	area->used = 0;
+	area->hint = 0;
+	TAILQ_INSERT_TAIL(&g_swap_areas, area, chain);
+	g_swap_count += count;
+	return 0;
+
+err_area:
+	free(area);
+err_file:
+	file_free(file);
+	return ret;
+}
+
+/* XXX the swapped out pages aren't read back, the area has to be unused */
+int swap_off(struct node *node)
+{
+	struct swap_area *area;
+	TAILQ_FOREACH(area, &g_swap_areas, chain)
+	{
+		if (area->file->node == node)
+			break;
+	}
+	if (!area)
+		return -EINVAL;
+	if (area->used)
+		return -EBUSY;
+	TAILQ_REMOVE(&g_swap_areas, area, chain);
+	g_swap_count -= area->count;
+	vfree(area->slots, SLOTS_SIZE(area->count));
+	file_free(area->file);
+	free(area);
+	return 0;
+}
+
+int swap_alloc(struct swap_area **areap, size_t *slot)
+{
+	struct swap_area *area;
+	TAILQ_FOREACH(area, &g_swap_areas, chain)
+	{
+		if (area->used == area->count)
+			continue;
+		for (size_t i = area->hint; i < area->count; ++i)
+		{
+			if (area->slots[i])
+				continue;
+			area->slots[i] = 1;
+			area->used++;
+			area->hint = i + 1;
+			g_swap_used++;
+			*areap = area;
+			*slot = i;
+			return 0;
+		}
+	}
+	return -ENOSPC;
+}
+
+void swap_ref(struct swap_area *area, size_t slot)
+{
+	assert(area->slots[slot], "referencing free swap slot\n");
+	assert(area->slots[slot] < SWAP_MAX_REFS, "swap slot overflow\n");
+	area->slots[slot]++;
+}
+
+void swap_free(struct swap_area *area, size_t slot)
+{
+	assert(area->slots[slot], "freeing free swap slot\n");
+	if (--area->slots[slot])
+		return;
+	area->used--;
+	g_swap_used--;
+	if (slot < area->hint)
+		area->hint = slot;
+}
+
+static int swap_io(struct swap_area *area, size_t slot, struct page *page,
+                   int write)
+{
+	void *ptr = vm_map(page, PAGE_SIZE, write ? VM_PROT_R : VM_PROT_W);
+	if (!ptr)
+		return -ENOMEM;
+	struct uio uio;
+	struct iovec iov;
+	uio_fromkbuf(&uio, &iov, ptr, PAGE_SIZE, (off_t)slot * PAGE_SIZE);
+	ssize_t ret;
+	if (write)
+		ret = area->file->op->write(area->file, &uio);
+	else
+		ret = area->file->op->read(area->file, &uio);
+	vm_unmap(ptr, PAGE_SIZE);
+	if (ret < 0)
+		return ret;
+	if (ret != PAGE_SIZE)
+		return -EIO;
+	return 0;
+}
+
+int swap_read(struct swap_area *area, size_t slot, struct page *page)
+{
+	return swap_io(area, slot, page, 0);
+}
+
+int swap_write(struct swap_area *area, size_t slot, struct page *page)
+{
+	return swap_io(area, slot, page, 1);
+}
+
+int swap_available(void)
+{
+	return g_swap_used < g_swap_count;
+}
+
+void swap_usage(size_t *size, size_t *used)
+{
+	*size = g_swap_count;
+	*used = g_swap_used;
+}
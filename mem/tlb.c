@@ -0,0 +1,160 @@
+#include <proc.h>
+#include <cpu.h>
+#include <mem.h>
+
+/* tlb coherency between cpus
+ *
+ * the arch code invalidates the changed translations on the local cpu,
+ * the other cpus are lazily brought up to date:
+ * - each space has a generation, bumped once per batch of unmaps or
+ *   protection changes (vm_tlb_shootdown); a cpu flushes the translations
+ *   of a space before running it if it saw an older generation
+ * - the cpus currently running userland code of the space are sent an ipi
+ *   and waited for: they leave userland to handle it, and can't go back
+ *   before the kernel lock is released, at which point they notice the
+ *   new generation (vm_tlb_enter_user)
+ * - the cpus which left userland aren't sent the ipi, but the space stays
+ *   loaded and the kernel accesses the user memory directly: they check
+ *   the generation when they get the kernel lock (vm_tlb_user_sync)
+ * - kernel mappings have a global generation, checked when taking the
+ *   kernel lock
+ *
+ * the generations also allow tagged tlbs (pcid, asid): each cpu keeps the
+ * translations of a few spaces (vm_tlb_asid), and only flushes a space
+ * when its tag is reused or when it is out of date
+ */
+
+static uint64_t g_tlb_id;
+static uint64_t g_tlb_kern_gen = 1; /* flush the boot translations once */
+
+void vm_tlb_space_init(struct vm_space *space)
+{
+	space->tlb_id = __atomic_add_fetch(&g_tlb_id, 1, __ATOMIC_RELAXED);
+	space->tlb_gen = 0;
+}
+
+size_t vm_tlb_asid(const struct vm_space *space, int *flush)
+{
+	struct cpu_tlb *tlb = &curcpu()->tlb;
+	if (!space)
+	{
+		tlb->asid = 0;
+		*flush = 0;
+		return 0;
+	}
+	uint64_t gen = __atomic_load_n(&space->tlb_gen, __ATOMIC_ACQUIRE);
+	size_t i;
+	for (i = 0; i < CPU_TLB_ASIDS; ++i)
+	{
+		if (tlb->asid_ids[i] == space->tlb_id)
+			break;
+	}
+	if (i == CPU_TLB_ASIDS)
+	{
+		i = tlb->asid_next;
+		tlb->asid_next = (i + 1) % CPU_TLB_ASIDS;
+		tlb->asid_ids[i] = space->tlb_id;
+		*flush = 1;
+	}
+	else
+	{
+		*flush = tlb->asid_gens[i] != gen;
+	}
+	tlb->asid_gens[i] = gen;
+	tlb->asid = i + 1;
+	return i + 1;
+}
+
+void vm_tlb_shootdown(struct vm_space *space)
+{
+#ifdef ARCH_VM_TLB_BROADCAST
+	(void)space;
+#else
+	struct cpu *cpu = curcpu();
+	struct cpu_tlb *tlb = &cpu->tlb;
+	if (!space)
+	{
+		uint64_t gen = __atomic_add_fetch(&g_tlb_kern_gen, 1,
+		                                  __ATOMIC_RELEASE);
+		if (tlb->kern_gen == gen - 1)
+			tlb->kern_gen = gen;
+		return;
+	}
+	uint64_t gen = __atomic_add_fetch(&space->tlb_gen, 1, __ATOMIC_SEQ_CST);
+	/* the local cpu already invalidated the pages of its current space */
+	if (tlb->asid
+	 && tlb->asid_ids[tlb->asid - 1] == space->tlb_id
+	 && tlb->asid_gens[tlb->asid - 1] == gen - 1)
+		tlb->asid_gens[tlb->asid - 1] = gen;
+	if (g_ncpus == 1)
+		return;
+	cpumask_t cpumask;
+	CPUMASK_CLEAR(&cpumask);
+	struct cpu *it;
+	CPU_FOREACH(it)
+	{
+		if (it == cpu)
+			continue;
+		if (__atomic_load_n(&it->tlb.user_space, __ATOMIC_SEQ_CST) != space)
+			continue;
+		CPUMASK_SET(&cpumask, it->id, 1);
+		arch_cpu_ipi(it);
+	}
+	CPU_FOREACH(it)
+	{
+		if (!CPUMASK_GET(&cpumask, it->id))
+			continue;
+		while (__atomic_load_n(&it->tlb.user_space, __ATOMIC_SEQ_CST) == space)
+		{
+			cpu_test_panic();
+			arch_spin_yield();
+		}
+	}
+#endif
+}
+
+void vm_tlb_enter_user(const struct vm_space *space)
+{
+	struct cpu_tlb *tlb = &curcpu()->tlb;
+	if (space)
+	{
+		uint64_t gen = __atomic_load_n(&space->tlb_gen, __ATOMIC_ACQUIRE);
+		if (!tlb->asid
+		 || tlb->asid_ids[tlb->asid - 1] != space->tlb_id
+		 || tlb->asid_gens[tlb->asid - 1] != gen)
+			arch_vm_setspace(space);
+	}
+	__atomic_store_n(&tlb->user_space, space, __ATOMIC_SEQ_CST);
+}
+
+void vm_tlb_leave_user(void)
+{
+	__atomic_store_n(&curcpu()->tlb.user_space, NULL, __ATOMIC_SEQ_CST);
+}
+
+void vm_tlb_user_sync(void)
+{
+#ifndef ARCH_VM_TLB_BROADCAST
+	struct cpu *cpu = curcpu();
+	struct cpu_tlb *tlb = &cpu->tlb;
+	struct thread *thread = cpu->thread;
+	if (!tlb->asid || !thread)
+		return;
+	struct vm_space *space = thread->proc->vm_space;
+	if (!space || tlb->asid_ids[tlb->asid - 1] != space->tlb_id)
+		return;
+	uint64_t gen = __atomic_load_n(&space->tlb_gen, __ATOMIC_ACQUIRE);
+	if (tlb->asid_gens[tlb->asid - 1] != gen)
+		arch_vm_setspace(space);
+#endif
+}
+
+void vm_tlb_kern_sync(void)
+{
+	struct cpu_tlb *tlb = &curcpu()->tlb;
+	uint64_t gen = __atomic_load_n(&g_tlb_kern_gen, __ATOMIC_ACQUIRE);
+	if (tlb->kern_gen == gen)
+		return;
+	arch_vm_tlb_flush();
+	tlb->kern_gen = gen;
+}
@@ -437,7 +437,11 @@ void rx_desc(struct em_queue *queue, struct em_desc *desc, size_t i)
 	em->netif->stats.rx_bytes += len;
 	struct netpkt *netpkt = netpkt_alloc(len);
 	if (!netpkt)
-		panic("em: failed to allocate packet\n");
+	{
+		printf("em: failed to allocate packet\n");
+		em->netif->stats.rx_errors++;
+		return;
+	}
 	memcpy(netpkt->data, queue->buffers[i], len);
 	ether_input(em->netif, netpkt);
 }
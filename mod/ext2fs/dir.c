@@ -3,46 +3,158 @@
 #include <stat.h>
 #include <uio.h>
 
-int dir_lookup(struct node *node, const char *name, size_t name_len,
-               struct node **childp)
+struct ext2_dirent *dir_find_dirent(struct ext2_fs *fs, uint8_t *blk,
+                                    const char *name, size_t name_len)
 {
-	struct ext2_node *dir = (struct ext2_node*)node;
-	VFS_HANDLE_DOT_DOTDOT_LOOKUP(node, dir->parent, name, name_len, childp);
-	struct ext2_fs *fs = node->sb->private;
-	uint8_t blk[EXT2_MAXBLKSZ_U8];
-	uint32_t blkid = 0;
-	int ret = read_node_block(fs, dir, blkid, blk);
-	if (ret)
-		return ret;
-	uint32_t blkoff = 0;
-	for (size_t i = 0; i < dir->inode.size;)
+	for (uint32_t off = 0; off + sizeof(struct ext2_dirent) <= fs->blksz;)
 	{
-		if (blkoff >= fs->blksz)
+		struct ext2_dirent *dirent = (struct ext2_dirent*)&blk[off];
+		if (dirent->rec_len < sizeof(*dirent)
+		 || dirent->rec_len > fs->blksz - off)
+			return NULL; /* XXX corrupted block */
+		if (dirent->inode
+		 && dirent->name_len == name_len
+		 && !memcmp(dirent->name, name, name_len))
+			return dirent;
+		off += dirent->rec_len;
+	}
+	return NULL;
+}
+
+/* use the free space of a dirent (or a deleted one) to store dirent */
+int dir_insert_dirent(struct ext2_fs *fs, uint8_t *blk,
+                      const struct ext2_dirent *dirent)
+{
+	uint32_t size = EXT2_DIRENT_LEN(dirent->name_len);
+	for (uint32_t off = 0; off + sizeof(struct ext2_dirent) <= fs->blksz;)
+	{
+		struct ext2_dirent *cur = (struct ext2_dirent*)&blk[off];
+		if (cur->rec_len < sizeof(*cur)
+		 || cur->rec_len > fs->blksz - off)
+			return -EINVAL;
+		uint32_t used = cur->inode ? EXT2_DIRENT_LEN(cur->name_len) : 0;
+		if (cur->rec_len >= used + size)
 		{
-			blkid += blkoff / fs->blksz;
-			blkoff %= fs->blksz;
-			ret = read_node_block(fs, dir, blkid, blk);
-			if (ret)
-				return ret;
+			struct ext2_dirent *new = (struct ext2_dirent*)&blk[off + used];
+			uint16_t rec_len = cur->rec_len - used;
+			if (used)
+				cur->rec_len = used;
+			memcpy(new, dirent, sizeof(*dirent) + dirent->name_len);
+			new->rec_len = rec_len;
+			return 0;
 		}
-		struct ext2_dirent *dirent = (struct ext2_dirent*)&blk[blkoff];
-		if (dirent->name_len == name_len
+		off += cur->rec_len;
+	}
+	return -ENOSPC;
+}
+
+/* the dirent is merged into the previous one of its block, or only
+ * cleared if it is the first one
+ */
+static int dir_remove_dirent(struct ext2_fs *fs, uint8_t *blk,
+                             const char *name, size_t name_len)
+{
+	struct ext2_dirent *prev = NULL;
+	for (uint32_t off = 0; off + sizeof(struct ext2_dirent) <= fs->blksz;)
+	{
+		struct ext2_dirent *dirent = (struct ext2_dirent*)&blk[off];
+		if (dirent->rec_len < sizeof(*dirent)
+		 || dirent->rec_len > fs->blksz - off)
+			return -EINVAL;
+		if (dirent->inode
+		 && dirent->name_len == name_len
 		 && !memcmp(dirent->name, name, name_len))
 		{
-			struct ext2_node *child;
-			ret = get_node(fs, dirent->inode, &child);
-			if (ret)
-				return -ret;
-			child->parent = node;
-			*childp = &child->node;
+			if (prev)
+			{
+				prev->rec_len += dirent->rec_len;
+			}
+			else
+			{
+				dirent->inode = 0;
+				dirent->file_type = EXT2_FT_UNKNOWN;
+			}
 			return 0;
 		}
-		i += dirent->rec_len;
-		blkoff += dirent->rec_len;
+		prev = dirent;
+		off += dirent->rec_len;
 	}
 	return -ENOENT;
 }
 
+int dir_append_block(struct ext2_node *node, const void *data,
+                     uint32_t *blkid)
+{
+	struct ext2_fs *fs = node->node.sb->private;
+	uint32_t id = node->inode.size / fs->blksz;
+	int ret = write_node_block(fs, node, id, data);
+	if (ret)
+		return ret;
+	node->node.attr.size = (id + 1) * fs->blksz;
+	ret = update_node_inode(node);
+	if (ret)
+		return ret;
+	if (blkid)
+		*blkid = id;
+	return 0;
+}
+
+static int linear_lookup(struct ext2_node *dir, const char *name,
+                         size_t name_len, uint32_t *ino, uint32_t *blkidp)
+{
+	struct ext2_fs *fs = dir->node.sb->private;
+	uint8_t blk[EXT2_MAXBLKSZ_U8];
+	uint32_t blocks = dir->inode.size / fs->blksz;
+	for (uint32_t blkid = 0; blkid < blocks; ++blkid)
+	{
+		int ret = read_node_block(fs, dir, blkid, blk);
+		if (ret)
+			return ret;
+		struct ext2_dirent *dirent = dir_find_dirent(fs, blk, name,
+		                                             name_len);
+		if (dirent)
+		{
+			*ino = dirent->inode;
+			*blkidp = blkid;
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+
+/* inode of the dirent, and the directory block holding it */
+static int dir_find(struct ext2_node *dir, const char *name,
+                    size_t name_len, uint32_t *ino, uint32_t *blkid)
+{
+	struct ext2_fs *fs = dir->node.sb->private;
+	int ret = -EINVAL;
+	if (htree_indexed(fs, dir))
+		ret = htree_lookup(dir, name, name_len, ino, blkid);
+	if (ret == -EINVAL) /* unusable index, which is ignored */
+		ret = linear_lookup(dir, name, name_len, ino, blkid);
+	return ret;
+}
+
+int dir_lookup(struct node *node, const char *name, size_t name_len,
+               struct node **childp)
+{
+	struct ext2_node *dir = (struct ext2_node*)node;
+	VFS_HANDLE_DOT_DOTDOT_LOOKUP(node, dir->parent, name, name_len, childp);
+	struct ext2_fs *fs = node->sb->private;
+	uint32_t blkid;
+	uint32_t ino;
+	int ret = dir_find(dir, name, name_len, &ino, &blkid);
+	if (ret)
+		return ret;
+	struct ext2_node *child;
+	ret = get_node(fs, ino, &child);
+	if (ret)
+		return ret;
+	child->parent = node;
+	*childp = &child->node;
+	return 0;
+}
+
 static int dt_from_ft(int type)
 {
 	switch (type)
@@ -143,22 +255,60 @@ int dir_readdir(struct node *node, struct fs_readdir_ctx *ctx)
 int dir_add_dirent(struct ext2_node *node, const char *name,
                    size_t name_len, ino_t ino, struct ext2_inode *inode)
 {
+	struct ext2_fs *fs = node->node.sb->private;
 	struct
 	{
 		struct ext2_dirent dirent;
 		char name[256];
 	} dirent;
+	uint8_t blk[EXT2_MAXBLKSZ_U8];
+	int ret;
 	dirent.dirent.inode = ino;
-	dirent.dirent.rec_len = sizeof(dirent.dirent) + name_len;
+	dirent.dirent.rec_len = EXT2_DIRENT_LEN(name_len);
 	dirent.dirent.name_len = name_len;
 	dirent.dirent.file_type = ft_from_dt(inode->mode >> 12);
 	memcpy(dirent.name, name, name_len);
-	/* XXX find hole of sizeof(struct ext2_dirent) + name_len bytes */
-	struct uio uio;
-	struct iovec iov;
-	uio_fromkbuf(&uio, &iov, &dirent, sizeof(dirent),
-	            ((struct ext2_node*)node)->inode.size);
-	return node_write((struct ext2_node*)node, &uio);
+	if (htree_indexed(fs, node))
+	{
+		ret = htree_add_dirent(node, &dirent.dirent);
+		if (ret != -EINVAL && ret != -ENOSPC)
+			return ret;
+		/* the index can't be used anymore: the directory goes back to
+		 * being linear, its index blocks being seen as free dirents
+		 */
+		node->inode.flags &= ~EXT2_INDEX_FL;
+		ret = write_inode(fs, node->node.ino, &node->inode);
+		if (ret)
+			return ret;
+	}
+	uint32_t blocks = node->inode.size / fs->blksz;
+	for (uint32_t blkid = 0; blkid < blocks; ++blkid)
+	{
+		ret = read_node_block(fs, node, blkid, blk);
+		if (ret)
+			return ret;
+		ret = dir_insert_dirent(fs, blk, &dirent.dirent);
+		if (!ret)
+			return write_node_block(fs, node, blkid, blk);
+		if (ret != -ENOSPC)
+			return ret;
+	}
+	/* a full single-block directory gets indexed, blk still holding
+	 * its content
+	 */
+	if (blocks == 1
+	 && (fs->ext2sb.feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX))
+	{
+		ret = htree_create(node, blk);
+		if (!ret)
+			return htree_add_dirent(node, &dirent.dirent);
+		if (ret != -EINVAL && ret != -ENOSPC)
+			return ret;
+	}
+	memset(blk, 0, fs->blksz);
+	dirent.dirent.rec_len = fs->blksz;
+	memcpy(blk, &dirent, sizeof(dirent.dirent) + name_len);
+	return dir_append_block(node, blk, NULL);
 }
 
 int dir_mknode(struct node *node, const char *name, size_t name_len,
@@ -234,3 +384,42 @@ err:
 		node_free(child);
 	return ret;
 }
+
+/* the inode is freed with the last reference to its node */
+int dir_unlink(struct node *node, const char *name)
+{
+	struct ext2_node *dir = (struct ext2_node*)node;
+	struct ext2_fs *fs = node->sb->private;
+	size_t name_len = strlen(name);
+	uint8_t blk[EXT2_MAXBLKSZ_U8];
+	struct ext2_node *child;
+	uint32_t blkid;
+	uint32_t ino;
+	int ret = dir_find(dir, name, name_len, &ino, &blkid);
+	if (ret)
+		return ret;
+	ret = get_node(fs, ino, &child);
+	if (ret)
+		return ret;
+	if (S_ISDIR(child->inode.mode))
+	{
+		ret = -EISDIR;
+		goto end;
+	}
+	ret = read_node_block(fs, dir, blkid, blk);
+	if (ret)
+		goto end;
+	ret = dir_remove_dirent(fs, blk, name, name_len);
+	if (ret)
+		goto end;
+	ret = write_node_block(fs, dir, blkid, blk);
+	if (ret)
+		goto end;
+	child->inode.links_count--;
+	child->node.nlink = child->inode.links_count;
+	ret = write_inode(fs, ino, &child->inode);
+
+end:
+	node_free(&child->node);
+	return ret;
+}
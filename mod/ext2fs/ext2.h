@@ -57,12 +57,23 @@ struct ext2_sb
 	uint8_t alignment_253[3];
 	uint32_t default_mount_options;
 	uint32_t first_meta_bg;
-	uint8_t padding[760];
+	uint32_t mkfs_time;
+	uint32_t jnl_blocks[17];
+	uint32_t blocks_count_hi;
+	uint32_t r_blocks_count_hi;
+	uint32_t free_blocks_count_hi;
+	uint16_t min_extra_isize;
+	uint16_t want_extra_isize;
+	uint32_t flags;
+	uint8_t padding[668];
 };
 
 #define EXT2_VALID_FS 1
 #define EXT2_ERROR_FS 2
 
+#define EXT2_FLAGS_SIGNED_HASH   0x1
+#define EXT2_FLAGS_UNSIGNED_HASH 0x2
+
 #define EXT2_ERRORS_CONTINUE 1
 #define EXT2_ERRORS_RO       2
 #define EXT2_ERRORS_PANIC    3
@@ -175,6 +186,45 @@ struct ext2_dirent
 	char name[];
 };
 
+#define EXT2_DIRENT_LEN(name_len) \
+	((sizeof(struct ext2_dirent) + (name_len) + 3) & ~3)
+
+/* hashed directory index (dir_index): the root is in the first block of
+ * the directory, after the "." and ".." dirents (the latter spanning the
+ * whole block), followed by the entries, the first one holding the
+ * count/limit instead of a hash
+ * the intermediate nodes start with an empty dirent spanning the whole
+ * block, so that the index is seen as deleted dirents by the linear
+ * implementations
+ */
+struct ext2_dx_root_info
+{
+	uint32_t reserved_zero;
+	uint8_t hash_version;
+	uint8_t info_length;
+	uint8_t indirect_levels;
+	uint8_t unused_flags;
+};
+
+struct ext2_dx_countlimit
+{
+	uint16_t limit;
+	uint16_t count;
+};
+
+struct ext2_dx_entry
+{
+	uint32_t hash;
+	uint32_t block;
+};
+
+#define EXT2_DX_HASH_LEGACY            0
+#define EXT2_DX_HASH_HALF_MD4          1
+#define EXT2_DX_HASH_TEA               2
+#define EXT2_DX_HASH_LEGACY_UNSIGNED   3
+#define EXT2_DX_HASH_HALF_MD4_UNSIGNED 4
+#define EXT2_DX_HASH_TEA_UNSIGNED      5
+
 struct ext2_fs
 {
 	struct fs_sb *sb;
@@ -220,9 +270,25 @@ int dir_add_dirent(struct ext2_node *node, const char *name,
 int dir_mknode(struct node *node, const char *name, size_t name_len,
                fs_attr_mask_t mask, const struct fs_attr *attr,
                dev_t rdev);
+int dir_unlink(struct node *node, const char *name);
+struct ext2_dirent *dir_find_dirent(struct ext2_fs *fs, uint8_t *blk,
+                                    const char *name, size_t name_len);
+int dir_insert_dirent(struct ext2_fs *fs, uint8_t *blk,
+                      const struct ext2_dirent *dirent);
+int dir_append_block(struct ext2_node *node, const void *data,
+                     uint32_t *blkid);
+
+int htree_indexed(struct ext2_fs *fs, struct ext2_node *node);
+int htree_lookup(struct ext2_node *node, const char *name, size_t name_len,
+                 uint32_t *ino, uint32_t *blkid);
+int htree_add_dirent(struct ext2_node *node,
+                     const struct ext2_dirent *dirent);
+int htree_create(struct ext2_node *node, const uint8_t *blk);
 
 int read_node_block(struct ext2_fs *fs, struct ext2_node *node,
                     uint32_t id, void *data);
+int write_node_block(struct ext2_fs *fs, struct ext2_node *node,
+                     uint32_t id, const void *data);
 int node_truncate(struct ext2_node *node, off_t size);
 ssize_t node_read(struct ext2_node *node, struct uio *uio);
 ssize_t node_write(struct ext2_node *node, struct uio *uio);
@@ -0,0 +1,668 @@
+#include "ext2.h"
+
+#include <errno.h>
+#include <std.h>
+
+/* hashed directories: the name hash gives the leaf block through a one or
+ * two levels index, entries with the same hash possibly overflowing on the
+ * following leaves (which is flagged by the low bit of their index hash)
+ * the dirents are never removed from the index, so a deleted dirent is
+ * only a hole in its leaf
+ * -EINVAL means that the index can't be used, and -ENOSPC that it can't
+ * grow anymore: the directory is then handled as a linear one
+ */
+
+#define DX_BLOCK_MASK 0x0FFFFFFF
+#define DX_MAX_LEVELS 2
+#define DX_ROOT_INFO  24 /* after the "." and ".." dirents */
+
+struct dx_frame
+{
+	uint32_t blkid;
+	uint8_t *blk;
+	struct ext2_dx_entry *entries;
+	uint32_t at;
+};
+
+struct dx_path
+{
+	struct ext2_fs *fs;
+	struct ext2_node *dir;
+	int version;
+	uint32_t hash;
+	uint32_t levels;
+	struct dx_frame frames[DX_MAX_LEVELS];
+	uint32_t leaf_blkid;
+	uint8_t *leaf;
+	uint8_t *data;
+};
+
+struct dx_map
+{
+	uint32_t hash;
+	uint16_t off;
+	uint16_t size;
+};
+
+static void tea_transform(uint32_t *buf, const uint32_t *in)
+{
+	uint32_t sum = 0;
+	uint32_t b0 = buf[0];
+	uint32_t b1 = buf[1];
+	for (size_t i = 0; i < 16; ++i)
+	{
+		sum += 0x9E3779B9;
+		b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+		b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+	}
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+#define ROL(x, s) (((x) << (s)) | ((x) >> (32 - (s))))
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define H(x, y, z) ((x) ^ (y) ^ (z))
+#define ROUND(f, a, b, c, d, x, s) \
+do \
+{ \
+	a += f(b, c, d) + (x); \
+	a = ROL(a, s); \
+} while (0)
+
+static void half_md4_transform(uint32_t *buf, const uint32_t *in)
+{
+	static const uint32_t k2 = 013240474631;
+	static const uint32_t k3 = 015666365641;
+	uint32_t a = buf[0];
+	uint32_t b = buf[1];
+	uint32_t c = buf[2];
+	uint32_t d = buf[3];
+
+	ROUND(F, a, b, c, d, in[0], 3);
+	ROUND(F, d, a, b, c, in[1], 7);
+	ROUND(F, c, d, a, b, in[2], 11);
+	ROUND(F, b, c, d, a, in[3], 19);
+	ROUND(F, a, b, c, d, in[4], 3);
+	ROUND(F, d, a, b, c, in[5], 7);
+	ROUND(F, c, d, a, b, in[6], 11);
+	ROUND(F, b, c, d, a, in[7], 19);
+
+	ROUND(G, a, b, c, d, in[1] + k2, 3);
+	ROUND(G, d, a, b, c, in[3] + k2, 5);
+	ROUND(G, c, d, a, b, in[5] + k2, 9);
+	ROUND(G, b, c, d, a, in[7] + k2, 13);
+	ROUND(G, a, b, c, d, in[0] + k2, 3);
+	ROUND(G, d, a, b, c, in[2] + k2, 5);
+	ROUND(G, c, d, a, b, in[4] + k2, 9);
+	ROUND(G, b, c, d, a, in[6] + k2, 13);
+
+	ROUND(H, a, b, c, d, in[3] + k3, 3);
+	ROUND(H, d, a, b, c, in[7] + k3, 9);
+	ROUND(H, c, d, a, b, in[2] + k3, 11);
+	ROUND(H, b, c, d, a, in[6] + k3, 15);
+	ROUND(H, a, b, c, d, in[1] + k3, 3);
+	ROUND(H, d, a, b, c, in[5] + k3, 9);
+	ROUND(H, c, d, a, b, in[0] + k3, 11);
+	ROUND(H, b, c, d, a, in[4] + k3, 15);
+
+	buf[0] += a;
+	buf[1] += b;
+	buf[2] += c;
+	buf[3] += d;
+}
+
+#undef ROUND
+#undef H
+#undef G
+#undef F
+#undef ROL
+
+static uint32_t legacy_hash(const char *name, size_t len, int is_unsigned)
+{
+	uint32_t hash0 = 0x12A3FE2D;
+	uint32_t hash1 = 0x37ABE8F9;
+	for (size_t i = 0; i < len; ++i)
+	{
+		int c = is_unsigned ? (int)(uint8_t)name[i]
+		                    : (int)(int8_t)name[i];
+		uint32_t hash = hash1 + (hash0 ^ (uint32_t)(c * 7152373));
+		if (hash & 0x80000000)
+			hash -= 0x7FFFFFFF;
+		hash1 = hash0;
+		hash0 = hash;
+	}
+	return hash0 << 1;
+}
+
+/* pack up to num * 4 bytes of the name, padded with its length */
+static void str2hashbuf(const char *name, size_t len, uint32_t *buf,
+                        int num, int is_unsigned)
+{
+	uint32_t pad = (uint32_t)len | ((uint32_t)len << 8);
+	pad |= pad << 16;
+	uint32_t val = pad;
+	if (len > (size_t)num * 4)
+		len = num * 4;
+	for (size_t i = 0; i < len; ++i)
+	{
+		int c = is_unsigned ? (int)(uint8_t)name[i]
+		                    : (int)(int8_t)name[i];
+		val = (uint32_t)c + (val << 8);
+		if ((i % 4) == 3)
+		{
+			*buf++ = val;
+			val = pad;
+			num--;
+		}
+	}
+	if (--num >= 0)
+		*buf++ = val;
+	while (--num >= 0)
+		*buf++ = pad;
+}
+
+static uint32_t dx_hash(struct ext2_fs *fs, int version, const char *name,
+                        size_t len)
+{
+	uint32_t buf[4] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476};
+	uint32_t in[8];
+	uint32_t hash;
+	int is_unsigned = version >= EXT2_DX_HASH_LEGACY_UNSIGNED;
+	const uint32_t *seed = fs->ext2sb.hash_seed;
+	if (seed[0] || seed[1] || seed[2] || seed[3])
+		memcpy(buf, seed, sizeof(buf));
+	switch (version)
+	{
+		case EXT2_DX_HASH_LEGACY:
+		case EXT2_DX_HASH_LEGACY_UNSIGNED:
+			hash = legacy_hash(name, len, is_unsigned);
+			break;
+		case EXT2_DX_HASH_HALF_MD4:
+		case EXT2_DX_HASH_HALF_MD4_UNSIGNED:
+			for (size_t i = 0; i < len; i += 32)
+			{
+				str2hashbuf(&name[i], len - i, in, 8, is_unsigned);
+				half_md4_transform(buf, in);
+			}
+			hash = buf[1];
+			break;
+		case EXT2_DX_HASH_TEA:
+		case EXT2_DX_HASH_TEA_UNSIGNED:
+			for (size_t i = 0; i < len; i += 16)
+			{
+				str2hashbuf(&name[i], len - i, in, 4, is_unsigned);
+				tea_transform(buf, in);
+			}
+			hash = buf[0];
+			break;
+		default:
+			return 0;
+	}
+	hash &= ~1;
+	/* reserved as the end of directory marker of the 32 bits offsets */
+	if (hash == 0xFFFFFFFE)
+		hash = 0xFFFFFFFC;
+	return hash;
+}
+
+static inline struct ext2_dx_countlimit *dx_countlimit(struct dx_frame *frame)
+{
+	return (struct ext2_dx_countlimit*)frame->entries;
+}
+
+int htree_indexed(struct ext2_fs *fs, struct ext2_node *node)
+{
+	return (fs->ext2sb.feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX)
+	    && (node->inode.flags & EXT2_INDEX_FL);
+}
+
+static int path_alloc(struct ext2_node *dir, struct dx_path *path)
+{
+	struct ext2_fs *fs = dir->node.sb->private;
+	path->fs = fs;
+	path->dir = dir;
+	path->data = malloc(fs->blksz * (DX_MAX_LEVELS + 1), 0);
+	if (!path->data)
+		return -ENOMEM;
+	for (size_t i = 0; i < DX_MAX_LEVELS; ++i)
+		path->frames[i].blk = &path->data[fs->blksz * i];
+	path->leaf = &path->data[fs->blksz * DX_MAX_LEVELS];
+	return 0;
+}
+
+static void path_free(struct dx_path *path)
+{
+	free(path->data);
+}
+
+static int dx_valid_block(struct dx_path *path, uint32_t blkid)
+{
+	return blkid && blkid < path->dir->inode.size / path->fs->blksz;
+}
+
+/* read the index node pointed to by the current entry of the upper frame */
+static int read_frame(struct dx_path *path, uint32_t level)
+{
+	struct ext2_fs *fs = path->fs;
+	struct dx_frame *frame = &path->frames[level];
+	struct dx_frame *parent = &path->frames[level - 1];
+	uint32_t blkid = parent->entries[parent->at].block & DX_BLOCK_MASK;
+	if (!dx_valid_block(path, blkid))
+		return -EINVAL;
+	int ret = read_node_block(fs, path->dir, blkid, frame->blk);
+	if (ret)
+		return ret;
+	frame->blkid = blkid;
+	frame->entries = (struct ext2_dx_entry*)&frame->blk[sizeof(struct ext2_dirent)];
+	struct ext2_dx_countlimit *countlimit = dx_countlimit(frame);
+	if (countlimit->limit > (fs->blksz - sizeof(struct ext2_dirent)) / sizeof(struct ext2_dx_entry)
+	 || !countlimit->count
+	 || countlimit->count > countlimit->limit)
+		return -EINVAL;
+	frame->at = 0;
+	return 0;
+}
+
+/* last entry whose hash is lower or equal to the searched one, the first
+ * entry having no hash
+ */
+static void search_frame(struct dx_path *path, struct dx_frame *frame)
+{
+	uint32_t lo = 1;
+	uint32_t hi = dx_countlimit(frame)->count;
+	while (lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (frame->entries[mid].hash > path->hash)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	frame->at = lo - 1;
+}
+
+static int set_leaf(struct dx_path *path)
+{
+	struct dx_frame *frame = &path->frames[path->levels - 1];
+	path->leaf_blkid = frame->entries[frame->at].block & DX_BLOCK_MASK;
+	if (!dx_valid_block(path, path->leaf_blkid))
+		return -EINVAL;
+	return read_node_block(path->fs, path->dir, path->leaf_blkid,
+	                       path->leaf);
+}
+
+static int dx_probe(struct dx_path *path, const char *name, size_t name_len)
+{
+	struct ext2_fs *fs = path->fs;
+	struct dx_frame *root = &path->frames[0];
+	int ret = read_node_block(fs, path->dir, 0, root->blk);
+	if (ret)
+		return ret;
+	struct ext2_dx_root_info *info = (struct ext2_dx_root_info*)&root->blk[DX_ROOT_INFO];
+	if (info->reserved_zero
+	 || info->info_length != sizeof(*info)
+	 || info->indirect_levels >= DX_MAX_LEVELS
+	 || info->hash_version > EXT2_DX_HASH_TEA)
+		return -EINVAL;
+	path->version = info->hash_version;
+	if (fs->ext2sb.flags & EXT2_FLAGS_UNSIGNED_HASH)
+		path->version += EXT2_DX_HASH_LEGACY_UNSIGNED;
+	path->hash = dx_hash(fs, path->version, name, name_len);
+	path->levels = info->indirect_levels + 1;
+	root->blkid = 0;
+	root->entries = (struct ext2_dx_entry*)&root->blk[DX_ROOT_INFO + sizeof(*info)];
+	struct ext2_dx_countlimit *countlimit = dx_countlimit(root);
+	if (countlimit->limit > (fs->blksz - DX_ROOT_INFO - sizeof(*info)) / sizeof(struct ext2_dx_entry)
+	 || !countlimit->count
+	 || countlimit->count > countlimit->limit)
+		return -EINVAL;
+	search_frame(path, root);
+	for (uint32_t i = 1; i < path->levels; ++i)
+	{
+		ret = read_frame(path, i);
+		if (ret)
+			return ret;
+		search_frame(path, &path->frames[i]);
+	}
+	return set_leaf(path);
+}
+
+/* go to the next leaf if it may contain dirents with the searched hash */
+static int dx_next_leaf(struct dx_path *path)
+{
+	uint32_t level = path->levels;
+	struct dx_frame *frame;
+	do
+	{
+		if (!level)
+			return -ENOENT;
+		frame = &path->frames[--level];
+	} while (frame->at + 1 >= dx_countlimit(frame)->count);
+	frame->at++;
+	if ((frame->entries[frame->at].hash & ~1) != path->hash)
+		return -ENOENT;
+	for (uint32_t i = level + 1; i < path->levels; ++i)
+	{
+		int ret = read_frame(path, i);
+		if (ret)
+			return ret;
+	}
+	return set_leaf(path);
+}
+
+int htree_lookup(struct ext2_node *node, const char *name, size_t name_len,
+                 uint32_t *ino, uint32_t *blkid)
+{
+	struct dx_path path;
+	int ret = path_alloc(node, &path);
+	if (ret)
+		return ret;
+	ret = dx_probe(&path, name, name_len);
+	while (!ret)
+	{
+		struct ext2_dirent *dirent = dir_find_dirent(path.fs, path.leaf,
+		                                             name, name_len);
+		if (dirent)
+		{
+			*ino = dirent->inode;
+			*blkid = path.leaf_blkid;
+			break;
+		}
+		ret = dx_next_leaf(&path);
+	}
+	path_free(&path);
+	return ret;
+}
+
+/* hashes of the live dirents of blk starting at off, sorted */
+static size_t map_leaf(struct ext2_fs *fs, int version, const uint8_t *blk,
+                       uint32_t off, struct dx_map *map)
+{
+	size_t n = 0;
+	while (off + sizeof(struct ext2_dirent) <= fs->blksz)
+	{
+		const struct ext2_dirent *dirent = (const struct ext2_dirent*)&blk[off];
+		if (dirent->rec_len < sizeof(*dirent)
+		 || dirent->rec_len > fs->blksz - off)
+			break; /* XXX corrupted block */
+		if (dirent->inode)
+		{
+			struct dx_map entry;
+			entry.hash = dx_hash(fs, version, dirent->name,
+			                     dirent->name_len);
+			entry.off = off;
+			entry.size = EXT2_DIRENT_LEN(dirent->name_len);
+			size_t i = n++;
+			while (i && map[i - 1].hash > entry.hash)
+			{
+				map[i] = map[i - 1];
+				i--;
+			}
+			map[i] = entry;
+		}
+		off += dirent->rec_len;
+	}
+	return n;
+}
+
+static void fill_leaf(struct ext2_fs *fs, uint8_t *dst, const uint8_t *src,
+                      const struct dx_map *map, size_t n)
+{
+	struct ext2_dirent *dirent = NULL;
+	uint32_t off = 0;
+	memset(dst, 0, fs->blksz);
+	for (size_t i = 0; i < n; ++i)
+	{
+		dirent = (struct ext2_dirent*)&dst[off];
+		memcpy(dirent, &src[map[i].off], map[i].size);
+		dirent->rec_len = map[i].size;
+		off += map[i].size;
+	}
+	dirent->rec_len += fs->blksz - off;
+}
+
+/* split the dirents of src (from off) in two leaves, the hash of the
+ * first dirent of the upper one (with its continuation bit) being
+ * returned in hash
+ */
+static int split_leaf(struct ext2_fs *fs, int version, const uint8_t *src,
+                      uint32_t off, uint8_t *low, uint8_t *high,
+                      uint32_t *hash)
+{
+	struct dx_map *map = malloc(sizeof(*map) * (fs->blksz / sizeof(struct ext2_dirent)), 0);
+	if (!map)
+		return -ENOMEM;
+	size_t n = map_leaf(fs, version, src, off, map);
+	if (n < 2)
+	{
+		free(map);
+		return -ENOSPC;
+	}
+	size_t split = n / 2;
+	*hash = map[split].hash;
+	if (map[split - 1].hash == *hash)
+		*hash |= 1;
+	fill_leaf(fs, low, src, map, split);
+	fill_leaf(fs, high, src, &map[split], n - split);
+	free(map);
+	return 0;
+}
+
+static void insert_entry(struct dx_frame *frame, uint32_t hash,
+                         uint32_t block)
+{
+	struct ext2_dx_countlimit *countlimit = dx_countlimit(frame);
+	struct ext2_dx_entry *entry = &frame->entries[frame->at + 1];
+	memmove(entry + 1, entry,
+	        (countlimit->count - frame->at - 1) * sizeof(*entry));
+	entry->hash = hash;
+	entry->block = block;
+	countlimit->count++;
+}
+
+static void init_node(struct ext2_fs *fs, uint8_t *blk)
+{
+	memset(blk, 0, fs->blksz);
+	struct ext2_dirent *dirent = (struct ext2_dirent*)blk;
+	dirent->rec_len = fs->blksz;
+}
+
+/* make room in the lowest index node, either by moving the root entries
+ * to a new node or by splitting the node
+ */
+static int grow_index(struct dx_path *path, uint8_t *tmp)
+{
+	struct ext2_fs *fs = path->fs;
+	struct dx_frame *root = &path->frames[0];
+	struct ext2_dx_countlimit *root_countlimit = dx_countlimit(root);
+	struct ext2_dx_countlimit *countlimit;
+	uint32_t blkid;
+	int ret;
+	if (path->levels == 1)
+	{
+		init_node(fs, tmp);
+		struct ext2_dx_entry *entries = (struct ext2_dx_entry*)&tmp[sizeof(struct ext2_dirent)];
+		memcpy(entries, root->entries,
+		       root_countlimit->count * sizeof(*entries));
+		countlimit = (struct ext2_dx_countlimit*)entries;
+		countlimit->limit = (fs->blksz - sizeof(struct ext2_dirent)) / sizeof(*entries);
+		ret = dir_append_block(path->dir, tmp, &blkid);
+		if (ret)
+			return ret;
+		root_countlimit->count = 1;
+		root->entries[0].block = blkid;
+		((struct ext2_dx_root_info*)&root->blk[DX_ROOT_INFO])->indirect_levels = 1;
+		ret = write_node_block(fs, path->dir, 0, root->blk);
+		if (ret)
+			return ret;
+		struct dx_frame *frame = &path->frames[1];
+		memcpy(frame->blk, tmp, fs->blksz);
+		frame->blkid = blkid;
+		frame->entries = (struct ext2_dx_entry*)&frame->blk[sizeof(struct ext2_dirent)];
+		frame->at = root->at;
+		root->at = 0;
+		path->levels = 2;
+		return 0;
+	}
+	if (root_countlimit->count >= root_countlimit->limit)
+		return -ENOSPC;
+	struct dx_frame *frame = &path->frames[1];
+	countlimit = dx_countlimit(frame);
+	uint32_t split = countlimit->count / 2;
+	uint32_t moved = countlimit->count - split;
+	uint32_t hash = frame->entries[split].hash;
+	init_node(fs, tmp);
+	struct ext2_dx_entry *entries = (struct ext2_dx_entry*)&tmp[sizeof(struct ext2_dirent)];
+	memcpy(entries, &frame->entries[split], moved * sizeof(*entries));
+	((struct ext2_dx_countlimit*)entries)->limit = countlimit->limit;
+	((struct ext2_dx_countlimit*)entries)->count = moved;
+	ret = dir_append_block(path->dir, tmp, &blkid);
+	if (ret)
+		return ret;
+	countlimit->count = split;
+	ret = write_node_block(fs, path->dir, frame->blkid, frame->blk);
+	if (ret)
+		return ret;
+	insert_entry(root, hash, blkid);
+	ret = write_node_block(fs, path->dir, 0, root->blk);
+	if (ret)
+		return ret;
+	if (frame->at >= split)
+	{
+		memcpy(frame->blk, tmp, fs->blksz);
+		frame->blkid = blkid;
+		frame->at -= split;
+		root->at++;
+	}
+	return 0;
+}
+
+int htree_add_dirent(struct ext2_node *node,
+                     const struct ext2_dirent *dirent)
+{
+	struct dx_path path;
+	uint8_t *tmp = NULL;
+	uint32_t hash;
+	uint32_t blkid;
+	int ret = path_alloc(node, &path);
+	if (ret)
+		return ret;
+	struct ext2_fs *fs = path.fs;
+	ret = dx_probe(&path, dirent->name, dirent->name_len);
+	if (ret)
+		goto end;
+	ret = dir_insert_dirent(fs, path.leaf, dirent);
+	if (ret != -ENOSPC)
+	{
+		if (!ret)
+			ret = write_node_block(fs, node, path.leaf_blkid, path.leaf);
+		goto end;
+	}
+	tmp = malloc(fs->blksz * 2, 0);
+	if (!tmp)
+	{
+		ret = -ENOMEM;
+		goto end;
+	}
+	struct dx_frame *frame = &path.frames[path.levels - 1];
+	struct ext2_dx_countlimit *countlimit = dx_countlimit(frame);
+	if (countlimit->count >= countlimit->limit)
+	{
+		ret = grow_index(&path, tmp);
+		if (ret)
+			goto end;
+		frame = &path.frames[path.levels - 1];
+	}
+	uint8_t *low = tmp;
+	uint8_t *high = &tmp[fs->blksz];
+	ret = split_leaf(fs, path.version, path.leaf, 0, low, high, &hash);
+	if (ret)
+		goto end;
+	ret = dir_insert_dirent(fs, path.hash >= hash ? high : low, dirent);
+	if (ret)
+		goto end;
+	ret = dir_append_block(node, high, &blkid);
+	if (ret)
+		goto end;
+	ret = write_node_block(fs, node, path.leaf_blkid, low);
+	if (ret)
+		goto end;
+	insert_entry(frame, hash, blkid);
+	ret = write_node_block(fs, node, frame->blkid, frame->blk);
+
+end:
+	free(tmp);
+	path_free(&path);
+	return ret;
+}
+
+/* index a single-block directory, whose content is in blk: its dirents
+ * (but "." and "..") are split in two leaves, the first block becoming
+ * the root
+ */
+int htree_create(struct ext2_node *node, const uint8_t *blk)
+{
+	struct ext2_fs *fs = node->node.sb->private;
+	const struct ext2_dirent *dot = (const struct ext2_dirent*)blk;
+	if (dot->rec_len < EXT2_DIRENT_LEN(1)
+	 || dot->rec_len > fs->blksz - EXT2_DIRENT_LEN(2)
+	 || dot->name_len != 1 || dot->name[0] != '.')
+		return -EINVAL;
+	const struct ext2_dirent *dotdot = (const struct ext2_dirent*)&blk[dot->rec_len];
+	if (dotdot->rec_len < EXT2_DIRENT_LEN(2)
+	 || dotdot->rec_len > fs->blksz - dot->rec_len
+	 || dotdot->name_len != 2 || memcmp(dotdot->name, "..", 2))
+		return -EINVAL;
+	int version = fs->ext2sb.def_hash_version;
+	if (version > EXT2_DX_HASH_TEA)
+		version = EXT2_DX_HASH_HALF_MD4;
+	int hash_version = version;
+	if (fs->ext2sb.flags & EXT2_FLAGS_UNSIGNED_HASH)
+		hash_version += EXT2_DX_HASH_LEGACY_UNSIGNED;
+	uint8_t *tmp = malloc(fs->blksz * 3, 0);
+	if (!tmp)
+		return -ENOMEM;
+	uint8_t *low = tmp;
+	uint8_t *high = &tmp[fs->blksz];
+	uint8_t *root = &tmp[fs->blksz * 2];
+	uint32_t hash;
+	uint32_t low_blkid;
+	uint32_t high_blkid;
+	int ret = split_leaf(fs, hash_version, blk,
+	                     dot->rec_len + dotdot->rec_len, low, high, &hash);
+	if (ret)
+		goto end;
+	ret = dir_append_block(node, low, &low_blkid);
+	if (ret)
+		goto end;
+	ret = dir_append_block(node, high, &high_blkid);
+	if (ret)
+		goto end;
+	memset(root, 0, fs->blksz);
+	struct ext2_dirent *dirent = (struct ext2_dirent*)root;
+	memcpy(dirent, dot, sizeof(*dirent) + 1);
+	dirent->rec_len = EXT2_DIRENT_LEN(1);
+	dirent = (struct ext2_dirent*)&root[EXT2_DIRENT_LEN(1)];
+	memcpy(dirent, dotdot, sizeof(*dirent) + 2);
+	dirent->rec_len = fs->blksz - EXT2_DIRENT_LEN(1);
+	struct ext2_dx_root_info *info = (struct ext2_dx_root_info*)&root[DX_ROOT_INFO];
+	info->hash_version = version;
+	info->info_length = sizeof(*info);
+	struct ext2_dx_entry *entries = (struct ext2_dx_entry*)&root[DX_ROOT_INFO + sizeof(*info)];
+	struct ext2_dx_countlimit *countlimit = (struct ext2_dx_countlimit*)entries;
+	countlimit->limit = (fs->blksz - DX_ROOT_INFO - sizeof(*info)) / sizeof(*entries);
+	countlimit->count = 2;
+	entries[0].block = low_blkid;
+	entries[1].hash = hash;
+	entries[1].block = high_blkid;
+	ret = write_node_block(fs, node, 0, root);
+	if (ret)
+		goto end;
+	node->inode.flags |= EXT2_INDEX_FL;
+	ret = write_inode(fs, node->node.ino, &node->inode);
+
+end:
+	free(tmp);
+	return ret;
+}
@@ -343,8 +343,8 @@ ssize_t node_read(struct ext2_node *node, struct uio *uio)
 	return org;
 }
 
-static int write_node_block(struct ext2_fs *fs, struct ext2_node *node,
-                            uint32_t id, const void *data)
+int write_node_block(struct ext2_fs *fs, struct ext2_node *node,
+                     uint32_t id, const void *data)
 {
 	uint32_t blkid;
 	int ret = get_node_block_id(fs, node, id, &blkid);
@@ -459,7 +459,7 @@ int alloc_inode(struct ext2_fs *fs, ino_t *ino)
 
 int free_inode(struct ext2_fs *fs, ino_t ino)
 {
-	uint32_t grpid = ino / fs->ext2sb.inodes_per_group;
+	uint32_t grpid = (ino - 1) / fs->ext2sb.inodes_per_group;
 	struct ext2_group_desc group_desc;
 	int ret = read_group_desc(fs, grpid, &group_desc);
 	if (ret)
@@ -470,7 +470,7 @@ int free_inode(struct ext2_fs *fs, ino_t ino)
 	ret = read_block(fs, blk, group_desc.inode_bitmap);
 	if (ret)
 		return ret;
-	uint32_t idx = ino % fs->ext2sb.inodes_per_group;
+	uint32_t idx = (ino - 1) % fs->ext2sb.inodes_per_group;
 	if (!(blk[idx / 8] & (1 << (idx % 8))))
 		return -EINVAL; /* XXX assert */
 	blk[idx / 8] &= ~(1 << (idx % 8));
@@ -481,6 +481,10 @@ int free_inode(struct ext2_fs *fs, ino_t ino)
 	ret = write_group_desc(fs, grpid, &group_desc);
 	if (ret)
 		panic("failed to write group desc\n"); /* XXX */
+	fs->ext2sb.free_inodes_count++;
+	ret = write_sb(fs);
+	if (ret)
+		panic("failed to write ext2 sb\n"); /* XXX */
 	return 0;
 }
 
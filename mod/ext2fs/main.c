@@ -18,6 +18,7 @@ static int reg_fault(struct vm_zone *zone, off_t off, struct page **page);
 
 static ssize_t lnk_readlink(struct node *node, struct uio *uio);
 
+static int ext2fs_node_release(struct node *node);
 static int ext2fs_node_setattr(struct node *node, fs_attr_mask_t mask,
                                const struct fs_attr *attr);
 
@@ -35,7 +36,7 @@ static struct fs_type fs_type =
 {
 	.op = &fs_type_op,
 	.name = "ext2fs",
-	.flags = 0,
+	.flags = FS_TYPE_DCACHE,
 };
 
 static const struct node_op dir_op =
@@ -43,6 +44,7 @@ static const struct node_op dir_op =
 	.lookup = dir_lookup,
 	.readdir = dir_readdir,
 	.mknode = dir_mknode,
+	.unlink = dir_unlink,
 	.getattr = vfs_common_getattr,
 	.setattr = ext2fs_node_setattr,
 };
@@ -53,6 +55,7 @@ static const struct file_op dir_fop =
 
 static const struct node_op reg_op =
 {
+	.release = ext2fs_node_release,
 	.getattr = vfs_common_getattr,
 	.setattr = ext2fs_node_setattr,
 };
@@ -73,6 +76,7 @@ static const struct vm_zone_op reg_vm_op =
 
 static const struct node_op lnk_op =
 {
+	.release = ext2fs_node_release,
 	.readlink = lnk_readlink,
 	.getattr = vfs_common_getattr,
 	.setattr = ext2fs_node_setattr,
@@ -84,24 +88,28 @@ static const struct file_op lnk_fop =
 
 static const struct node_op bdev_op =
 {
+	.release = ext2fs_node_release,
 	.getattr = vfs_common_getattr,
 	.setattr = ext2fs_node_setattr,
 };
 
 static const struct node_op cdev_op =
 {
+	.release = ext2fs_node_release,
 	.getattr = vfs_common_getattr,
 	.setattr = ext2fs_node_setattr,
 };
 
 static const struct node_op fifo_op =
 {
+	.release = ext2fs_node_release,
 	.getattr = vfs_common_getattr,
 	.setattr = ext2fs_node_setattr,
 };
 
 static const struct node_op sock_op =
 {
+	.release = ext2fs_node_release,
 	.getattr = vfs_common_getattr,
 	.setattr = ext2fs_node_setattr,
 };
@@ -164,9 +172,6 @@ static inline void print_dirent(struct ext2_dirent *dirent)
 static int read_disk_blocks(struct ext2_fs *fs, void *data, size_t size,
                             off_t off)
 {
-#if 0
-	printf("reading blocks of 0x%lx bytes at 0x%lx to %p\n", size, off, data);
-#endif
 	struct iovec iov;
 	struct uio uio;
 	uio_fromkbuf(&uio, &iov, data, size, off);
@@ -181,9 +186,6 @@ static int read_disk_blocks(struct ext2_fs *fs, void *data, size_t size,
 static int write_disk_blocks(struct ext2_fs *fs, const void *data, size_t size,
                              off_t off)
 {
-#if 0
-	printf("writing blocks of 0x%lx bytes at 0x%lx to %p\n", size, off, data);
-#endif
 	struct iovec iov;
 	struct uio uio;
 	uio_fromkbuf(&uio, &iov, (void*)data, size, off);
@@ -197,17 +199,11 @@ static int write_disk_blocks(struct ext2_fs *fs, const void *data, size_t size,
 
 int read_disk_data(struct ext2_fs *fs, void *data, size_t count, off_t off)
 {
-#if 0
-	printf("reading 0x%lx bytes at 0x%lx to %p\n", count, off, data);
-#endif
 	return read_disk_blocks(fs, data, count, off);
 }
 
 int write_disk_data(struct ext2_fs *fs, void *data, size_t count, off_t off)
 {
-#if 0
-	printf("writing 0x%lx bytes at 0x%lx to %p\n", count, off, data);
-#endif
 	return write_disk_blocks(fs, data, count, off);
 }
 
@@ -378,7 +374,7 @@ int group_alloc_inode(struct ext2_fs *fs, uint32_t grpid, ino_t *ino)
 		*ino = 0;
 		return 0;
 	}
-	*ino = fs->ext2sb.inodes_per_group * grpid + found;
+	*ino = fs->ext2sb.inodes_per_group * grpid + found + 1;
 	blk[found / 8] |= 1 << (found % 8);
 	ret = write_block(fs, blk, group_desc.inode_bitmap);
 	if (ret)
@@ -608,6 +604,20 @@ static ssize_t lnk_readlink(struct node *node, struct uio *uio)
 	return node_read(lnk, uio);
 }
 
+/* XXX the blocks of the freed inode aren't released */
+static int ext2fs_node_release(struct node *node)
+{
+	struct ext2_node *ext2_node = (struct ext2_node*)node;
+	struct ext2_fs *fs = node->sb->private;
+	if (ext2_node->inode.links_count)
+		return 0;
+	ext2_node->inode.dtime = realtime_seconds();
+	int ret = write_inode(fs, node->ino, &ext2_node->inode);
+	if (ret)
+		return ret;
+	return free_inode(fs, node->ino);
+}
+
 static int ext2fs_node_setattr(struct node *node, fs_attr_mask_t mask,
                                 const struct fs_attr *attr)
 {
@@ -157,7 +157,7 @@ static struct fs_type fs_type =
 {
 	.op = &fs_type_op,
 	.name = "iso9660",
-	.flags = 0,
+	.flags = FS_TYPE_DCACHE,
 };
 
 static const struct node_op dir_op =
@@ -172,7 +172,7 @@ int init_pci_8139(struct pci_device *device, void *userdata)
 	rtl->netif->ether.addr[3] = RTL_RU8(rtl, REG_IDR3);
 	rtl->netif->ether.addr[4] = RTL_RU8(rtl, REG_IDR4);
 	rtl->netif->ether.addr[5] = RTL_RU8(rtl, REG_IDR5);
-	ret = pm_alloc_pages(&rtl->rxb_pages, RXB_NPAGES);
+	ret = pm_alloc_pages_dma32(&rtl->rxb_pages, RXB_NPAGES);
 	if (ret)
 	{
 		printf("rtl8139: failed to allocate rx buffer pages\n");
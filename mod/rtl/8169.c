@@ -90,7 +90,11 @@ static void rx_desc(struct rtl8169 *rtl, struct rtl8169_desc *desc, size_t i)
 	rtl->netif->stats.rx_bytes += len;
 	struct netpkt *netpkt = netpkt_alloc(len);
 	if (!netpkt)
-		panic("rtl8169: failed to allocate packet\n");
+	{
+		printf("rtl8169: failed to allocate packet\n");
+		rtl->netif->stats.rx_errors++;
+		return;
+	}
 	memcpy(netpkt->data, rtl->rxb[i], len);
 	ether_input(rtl->netif, netpkt);
 }
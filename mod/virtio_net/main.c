@@ -201,12 +201,19 @@ static void on_recvq_msg(struct virtq *queue, uint16_t id, uint32_t len)
 {
 	struct virtio_net *net = (struct virtio_net*)queue->dev;
 	struct netpkt *netpkt = netpkt_alloc(len);
-	if (!netpkt)
-		panic("virtio_net: failed to allocate packet\n");
-	net->netif->stats.rx_packets++;
-	net->netif->stats.rx_bytes += len;
-	memcpy(netpkt->data, net->rxb[id] + sizeof(struct virtio_net_header), len);
-	ether_input(net->netif, netpkt);
+	if (netpkt)
+	{
+		net->netif->stats.rx_packets++;
+		net->netif->stats.rx_bytes += len;
+		memcpy(netpkt->data, net->rxb[id] + sizeof(struct virtio_net_header), len);
+		ether_input(net->netif, netpkt);
+	}
+	else
+	{
+		/* drop it, the buffer still has to go back to the device */
+		printf("virtio_net: failed to allocate packet\n");
+		net->netif->stats.rx_errors++;
+	}
 	int ret = add_rx_buf(net, id);
 	if (ret)
 		printf("virtio_net: failed to add rx buf\n");
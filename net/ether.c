@@ -4,6 +4,7 @@
 #include <net/arp.h>
 #include <net/if.h>
 
+#include <tracepoint.h>
 #include <errno.h>
 #include <sock.h>
 #include <std.h>
@@ -17,13 +18,8 @@ int ether_output(struct netif *netif, struct netpkt *pkt,
 	memcpy(hdr->ether_dhost, dst->addr, ETHER_ADDR_LEN);
 	memcpy(hdr->ether_shost, netif->ether.addr, ETHER_ADDR_LEN);
 	hdr->ether_type = htons(ether_type);
-#if 0
-	printf("ether output %lu bytes: " MAC_FMT " - " MAC_FMT " - %" PRIu16 "\n",
-	       pkt->len,
-	       MAC_PRINTF(hdr->ether_shost),
-	       MAC_PRINTF(hdr->ether_dhost),
-	       ntohs(hdr->ether_type));
-#endif
+	if (tp_enabled(TP_NET_TX))
+		tp_net_emit(TP_NET_TX, netif, pkt->len, ether_type);
 	int ret = netif->op->emit(netif, pkt);
 	if (!ret)
 		netpkt_free(pkt);
@@ -35,13 +31,8 @@ int ether_input(struct netif *netif, struct netpkt *pkt)
 	if (pkt->len < sizeof(struct ether_header))
 		return -EINVAL;
 	const struct ether_header *hdr = (struct ether_header*)pkt->data;
-#if 0
-	printf("ether input %lu bytes: " MAC_FMT " - " MAC_FMT " - %" PRIu16 "\n",
-	       pkt->len,
-	       MAC_PRINTF(hdr->ether_shost),
-	       MAC_PRINTF(hdr->ether_dhost),
-	       ntohs(hdr->ether_type));
-#endif
+	if (tp_enabled(TP_NET_RX))
+		tp_net_emit(TP_NET_RX, netif, pkt->len, ntohs(hdr->ether_type));
 	net_raw_queue(AF_PACKET, pkt);
 	/* XXX CRC ? */
 	int ret;
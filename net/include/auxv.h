@@ -19,6 +19,7 @@
 #define AT_RANDOM 15
 #define AT_HWCAP  16
 #define AT_HWCAP2 17
+#define AT_SYSINFO_EHDR 33
 
 #if defined(__aarch64__)
 
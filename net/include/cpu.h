@@ -9,12 +9,27 @@
 #include <queue.h>
 #include <time.h>
 
+#define CPU_TLB_ASIDS 6 /* spaces kept in the tlb of a cpu */
+
+struct vm_space;
+
+struct cpu_tlb
+{
+	const struct vm_space *user_space; /* space possibly used by userland */
+	uint64_t kern_gen; /* kernel mappings generation seen */
+	uint64_t asid_ids[CPU_TLB_ASIDS]; /* space of each asid */
+	uint64_t asid_gens[CPU_TLB_ASIDS]; /* space generation of each asid */
+	size_t asid_next; /* next asid to reuse */
+	size_t asid; /* current asid, 0 if none */
+};
+
 struct cpu
 {
 	struct cpu *self;
 	struct trapframe *trapframe; /* trapframe used for incoming interrupt */
 	struct arch_cpu arch;
 	uint32_t id;
+	uint32_t node; /* numa node */
 	uint8_t *stack;
 	size_t stack_size;
 	size_t must_resched;
@@ -29,6 +44,7 @@ struct cpu
 	uint32_t loadavg[3]; /* fixed point 16.16 */
 	struct arch_copy_zone copy_src_page;
 	struct arch_copy_zone copy_dst_page;
+	struct cpu_tlb tlb;
 	uint64_t interrupt_count[IRQ_COUNT];
 	TAILQ_HEAD(, irq_handle) irq_handles[IRQ_COUNT];
 } __attribute__((aligned(PAGE_SIZE)));
@@ -48,11 +48,17 @@
 #define F_WRLCK 1
 #define F_UNLCK 2
 
+#define SPLICE_F_MOVE     (1 << 0)
+#define SPLICE_F_NONBLOCK (1 << 1)
+#define SPLICE_F_MORE     (1 << 2)
+#define SPLICE_F_GIFT     (1 << 3)
+
 struct poll_entry;
 struct vm_space;
 struct vm_zone;
 struct file_op;
 struct node;
+struct page;
 struct sock;
 struct uio;
 
@@ -102,6 +108,10 @@ int file_open(struct file *file, struct node *node);
 ssize_t file_write(struct file *file, struct uio *uio);
 ssize_t file_read(struct file *file, struct uio *uio);
 ssize_t file_readseq(struct file *file, void *data, size_t count, off_t off);
+ssize_t file_read_page(struct file *file, off_t *off, size_t count,
+                       struct page **page, size_t *poff);
+ssize_t file_write_page(struct file *file, off_t *off, struct page *page,
+                        size_t poff, size_t count);
 int file_ioctl(struct file *file, unsigned long request, uintptr_t data);
 int file_mmap(struct file *file, struct vm_zone *zone);
 int file_seek(struct file *file, off_t off, int whence);
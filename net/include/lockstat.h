@@ -0,0 +1,36 @@
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+#include <types.h>
+
+struct spinlock;
+
+enum lockstat_type
+{
+	LOCKSTAT_SPINLOCK,
+	LOCKSTAT_MUTEX,
+	LOCKSTAT_RWLOCK_RD,
+	LOCKSTAT_RWLOCK_WR,
+};
+
+extern int g_lockstat_enabled;
+
+static inline int lockstat_enabled(void)
+{
+	return __builtin_expect(__atomic_load_n(&g_lockstat_enabled,
+	                                        __ATOMIC_RELAXED), 0);
+}
+
+void lockstat_spinlock_lock(struct spinlock *spinlock, uint32_t ticket);
+void lockstat_spinlock_trylock(struct spinlock *spinlock);
+void lockstat_spinlock_unlock(struct spinlock *spinlock);
+void lockstat_spin_acquired(const void *lock, uintptr_t site, uint64_t wait,
+                            int contended);
+void lockstat_acquired(enum lockstat_type type, uintptr_t site,
+                       uint64_t wait, int contended);
+void lockstat_released(enum lockstat_type type, uintptr_t site,
+                       uint64_t hold);
+
+int lockstat_register_sysfs(void);
+
+#endif
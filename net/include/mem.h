@@ -24,6 +24,7 @@
 #include <arch/mem.h>
 
 #include <refcount.h>
+#include <rbtree.h>
 #include <mutex.h>
 #include <queue.h>
 #include <types.h>
@@ -43,6 +44,11 @@
 #define VM_WB   (1 << 6) /* write-back */
 #define VM_MMIO (1 << 7) /* MMIO (device memory) */
 
+#ifdef ARCH_VM_LARGE_SHIFT
+#define VM_LARGE_SIZE  ((size_t)1 << ARCH_VM_LARGE_SHIFT)
+#define VM_LARGE_PAGES (VM_LARGE_SIZE / PAGE_SIZE)
+#endif
+
 #define MAP_ANONYMOUS (1 << 0)
 #define MAP_SHARED    (1 << 1)
 #define MAP_PRIVATE   (1 << 2)
@@ -50,6 +56,7 @@
 #define MAP_EXCL      (1 << 4)
 #define MAP_POPULATE  (1 << 5)
 #define MAP_NORESERVE (1 << 6)
+#define MAP_NOWRITE   (1 << 16) /* kernel zones of pages shared by all the spaces */
 
 #define PROT_NONE  0
 #define PROT_EXEC  (1 << 0)
@@ -60,26 +67,48 @@
 #define MS_SYNC       (1 << 1)
 #define MS_INVALIDATE (1 << 2)
 
-#define MADV_NORMAL   0
-#define MADV_DONTNEED 1
+#define MADV_NORMAL     0
+#define MADV_DONTNEED   1
+#define MADV_RANDOM     2
+#define MADV_SEQUENTIAL 3
+#define MADV_WILLNEED   4
+
+#define PAGE_F_FREE   (1 << 0) /* first page of a free buddy block */
+#define PAGE_F_CACHED (1 << 1) /* in a per-cpu cache */
+
+#define PM_MAX_ORDER 11 /* blocks up to 4 MiB */
+
+#define PM_ZONE_DMA32  0 /* below 4 GiB */
+#define PM_ZONE_NORMAL 1
+#define PM_ZONE_COUNT  2
 
 struct page
 {
 	uintptr_t offset;
 	refcount_t refcount;
 	uint32_t flags;
+	uint32_t order; /* order of the free block, if PAGE_F_FREE */
+	TAILQ_ENTRY(page) chain;
+};
+
+TAILQ_HEAD(page_head, page);
+
+struct pm_free_area
+{
+	struct page_head pages;
+	size_t count;
 };
 
 struct pm_pool
 {
-	size_t *bitmap;
-	size_t bitmap_size; /* number of size_t */
-	size_t bitmap_first_free;
 	size_t offset; /* page offset */
 	size_t count; /* pages count */
 	size_t used; /* used pages */
-	size_t admin; /* administrative pages (bitmap, struct page) */
+	size_t admin; /* administrative pages (pool, struct page) */
+	int zone;
+	uint32_t node; /* numa node */
 	struct page *pages;
+	struct pm_free_area free_areas[PM_MAX_ORDER];
 	struct mutex mutex;
 	TAILQ_ENTRY(pm_pool) chain;
 };
@@ -90,6 +119,8 @@ struct vm_range
 {
 	uintptr_t addr;
 	size_t size;
+	size_t max_size; /* biggest range of the subtree */
+	struct rb_node tree;
 	TAILQ_ENTRY(vm_range) chain;
 };
 
@@ -100,7 +131,9 @@ struct vm_region
 	uintptr_t addr;
 	size_t size;
 	struct vm_range range_0; /* always have an available item */
+	int range_0_used;
 	struct vm_range_head ranges; /* address-ordered */
+	struct rb_tree tree; /* address-indexed, augmented by max_size */
 };
 
 struct vm_zone;
@@ -112,7 +145,12 @@ struct vm_zone_op
 	int (*fault)(struct vm_zone *zone, off_t off, struct page **page);
 };
 
+struct vm_space;
+struct vm_cache;
+struct swap_area;
 struct file;
+struct node;
+struct uio;
 
 struct vm_zone
 {
@@ -122,9 +160,14 @@ struct vm_zone
 	off_t off;
 	uint32_t flags;
 	uint32_t prot;
+	uint32_t advice; /* MADV_* access pattern */
 	struct file *file;
 	void *userdata;
+	struct vm_space *space;
+	struct vm_cache *cache; /* pages of MAP_SHARED zones */
+	struct rb_node tree;
 	TAILQ_ENTRY(vm_zone) chain;
+	TAILQ_ENTRY(vm_zone) cache_chain;
 };
 
 struct vm_shm
@@ -141,10 +184,18 @@ struct vm_space
 	struct mutex mutex;
 	struct vm_region region;
 	refcount_t refcount;
-	TAILQ_HEAD(, vm_zone) zones;
+	uint64_t tlb_id; /* unique id, for tagged tlbs */
+	uint64_t tlb_gen; /* mappings generation, see vm_tlb_shootdown */
+	TAILQ_HEAD(, vm_zone) zones; /* address-ordered */
+	struct rb_tree zones_tree; /* address-indexed */
 	TAILQ_HEAD(, vm_shm) shms;
+	struct rb_tree swapents; /* address-indexed, see mem/reclaim.c */
+	uintptr_t scan_addr; /* where the next reclaim scan starts */
+	TAILQ_ENTRY(vm_space) chain;
 } __attribute__ ((aligned(PAGE_SIZE)));
 
+TAILQ_HEAD(vm_space_head, vm_space);
+
 void vm_register_sysfs(void);
 size_t vm_available_size(void);
 
@@ -152,14 +203,20 @@ int arch_vm_space_init(struct vm_space *space);
 void arch_vm_space_cleanup(struct vm_space *space);
 int arch_vm_space_copy(struct vm_space *dst, struct vm_space *src);
 void arch_vm_setspace(const struct vm_space *space);
+void arch_vm_tlb_flush(void);
 
 int arch_vm_map(struct vm_space *space, uintptr_t addr, uintptr_t poff,
                 size_t size, uint32_t prot);
 int arch_vm_unmap(struct vm_space *space, uintptr_t addr, size_t size);
+int arch_vm_lookup(struct vm_space *space, uintptr_t addr, uintptr_t *poff);
 int arch_vm_protect(struct vm_space *space, uintptr_t addr, size_t size,
                     uint32_t prot);
 int arch_vm_populate_page(struct vm_space *space, uintptr_t addr,
                           uint32_t prot, uintptr_t *poffp);
+#ifdef ARCH_VM_LARGE_SHIFT
+int arch_vm_map_large(struct vm_space *space, uintptr_t addr, uintptr_t poff,
+                      uint32_t prot);
+#endif
 #if __SIZE_WIDTH__ == 64
 void arch_pm_init_pmap(uintptr_t base, size_t count, size_t *used);
 #else
@@ -169,9 +226,24 @@ void arch_pm_init_map(void *addr, uint32_t *pm_off, size_t pages);
 struct vm_space *vm_space_alloc(void);
 void vm_space_free(struct vm_space *space);
 struct vm_space *vm_space_dup(struct vm_space *space);
+void vm_space_cleanup(struct vm_space *space);
 int vm_fault(struct vm_space *space, uintptr_t addr, uint32_t prot);
-int vm_fault_page(struct vm_space *space, uintptr_t addr,
-                  struct page **page, struct vm_zone **zonep);
+int vm_fault_page(struct vm_space *space, uintptr_t addr, uint32_t prot,
+                  struct page **page, uint32_t *map_prot);
+int vm_fault_write(struct vm_space *space, uintptr_t addr, uintptr_t poff,
+                   struct page **page, uint32_t *map_prot);
+#ifdef ARCH_VM_LARGE_SHIFT
+int vm_fault_large(struct vm_space *space, uintptr_t addr,
+                   struct page **pages, struct vm_zone **zonep);
+#endif
+
+void vm_tlb_space_init(struct vm_space *space);
+size_t vm_tlb_asid(const struct vm_space *space, int *flush);
+void vm_tlb_shootdown(struct vm_space *space);
+void vm_tlb_enter_user(const struct vm_space *space);
+void vm_tlb_leave_user(void);
+void vm_tlb_user_sync(void);
+void vm_tlb_kern_sync(void);
 
 int vm_region_alloc(struct vm_region *region, uintptr_t addr, size_t size,
                     uintptr_t *ret);
@@ -193,6 +265,52 @@ int vm_space_protect(struct vm_space *space, uintptr_t addr, size_t size,
                      uint32_t prot);
 int vm_space_find(struct vm_space *space, uintptr_t addr,
                   struct vm_zone **zonep);
+int vm_advise(struct vm_space *space, uintptr_t addr, size_t size,
+              int advice);
+int vm_msync(struct vm_space *space, uintptr_t addr, size_t size, int flags);
+
+void vm_cache_init(void);
+int vm_cache_attach(struct vm_zone *zone, struct file *file);
+void vm_cache_link(struct vm_zone *zone, struct vm_cache *cache);
+void vm_cache_detach(struct vm_zone *zone);
+void vm_cache_ref(struct vm_cache *cache);
+void vm_cache_free(struct vm_cache *cache);
+int vm_cache_fault(struct vm_zone *zone, off_t off, uint32_t prot,
+                   struct page **page, uint32_t *map_prot);
+int vm_cache_dirty(struct vm_zone *zone, off_t off, uintptr_t poff,
+                   struct page **page);
+int vm_cache_sync(struct vm_cache *cache, off_t off, size_t size);
+int vm_cache_sync_all(void);
+int vm_cache_get_page(struct vm_cache *cache, off_t off, struct page **page);
+ssize_t vm_cache_read(struct vm_cache *cache, struct file *file,
+                      struct uio *uio);
+ssize_t vm_cache_write(struct vm_cache *cache, struct file *file,
+                       struct uio *uio);
+size_t vm_cache_deactivate(size_t count);
+size_t vm_cache_reclaim(size_t count);
+void vm_cache_usage(size_t *active, size_t *inactive);
+
+void vm_reclaim_init(void);
+void vm_reclaim_wakeup(void);
+size_t vm_reclaim(size_t count);
+int vm_reclaim_alloc(struct page **page);
+int vm_pagedaemon(void);
+int vm_swap_fault(struct vm_space *space, uintptr_t addr,
+                  struct page **page);
+int vm_swap_dup(struct vm_space *dst, struct vm_space *src);
+void vm_swap_release(struct vm_space *space, uintptr_t addr, size_t size);
+int vm_swap_test(struct vm_space *space, uintptr_t addr, size_t size);
+size_t vm_swap_inactive(void);
+
+int swap_on(struct node *node);
+int swap_off(struct node *node);
+int swap_alloc(struct swap_area **areap, size_t *slot);
+void swap_ref(struct swap_area *area, size_t slot);
+void swap_free(struct swap_area *area, size_t slot);
+int swap_read(struct swap_area *area, size_t slot, struct page *page);
+int swap_write(struct swap_area *area, size_t slot, struct page *page);
+int swap_available(void);
+void swap_usage(size_t *size, size_t *used);
 
 void *vmalloc(size_t bytes);
 void vfree(void *ptr, size_t bytes);
@@ -214,13 +332,20 @@ int vm_verifystra(struct vm_space *space, const char * const *array);
 
 int vm_copyin(struct vm_space *space, void *kaddr, const void *uaddr,
               size_t n);
+int vm_copyin_nofault(struct vm_space *space, void *kaddr,
+                      const void *uaddr, size_t n);
 int vm_copyout(struct vm_space *space, void *uaddr, const void *kaddr,
                size_t n);
 int vm_copystr(struct vm_space *space, char *kstr, const char *ustr,
                size_t n);
+#ifdef ARCH_COPY_USER
+size_t arch_copy_from_user(void *kaddr, const void *uaddr, size_t n);
+size_t arch_copy_to_user(void *uaddr, const void *kaddr, size_t n);
+#endif
 
 int pm_alloc_page(struct page **page);
 int pm_alloc_pages(struct page **pages, size_t n);
+int pm_alloc_pages_dma32(struct page **pages, size_t n);
 void pm_free_page(struct page *page);
 void pm_free_pages(struct page *page, size_t n);
 void pm_ref_page(struct page *page);
@@ -229,6 +354,10 @@ void pm_free_pt(uintptr_t off);
 int pm_fetch_pages(size_t off, size_t n, struct page **pages);
 void pm_init_page(struct page *page, uintptr_t poff);
 void pm_init(uintptr_t kernel_reserved);
+void pm_init_cpu(void);
+size_t pm_cached_pages(void);
+size_t pm_free_count(void);
+int pm_split_pool(struct pm_pool *pm_pool, size_t pfn);
 
 static inline uintptr_t pm_page_addr(const struct page *page)
 {
@@ -236,8 +365,10 @@ static inline uintptr_t pm_page_addr(const struct page *page)
 }
 
 extern struct pm_pool_head g_pm_pools;
+extern struct vm_space_head g_vm_spaces;
 
 extern struct vm_region g_vm_heap;
 extern struct mutex g_vm_mutex;
+extern struct page *g_zero_page;
 
 #endif
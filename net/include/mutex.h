@@ -3,10 +3,27 @@
 
 #include <spinlock.h>
 #include <waitq.h>
+#include <queue.h>
 #include <types.h>
 
 #define MUTEX_RECURSIVE (1 << 0)
 
+/* contention statistics shared by a set of mutexes
+ * only updated while enabled through sysfs
+ */
+struct lock_class
+{
+	const char *name;
+	size_t acquired;
+	size_t contended; /* owner was found on acquisition */
+	size_t spun; /* contended, acquired while spinning on a running owner */
+	size_t slept; /* contended, acquired after sleeping on the waitq */
+	int registered;
+	TAILQ_ENTRY(lock_class) chain;
+};
+
+#define LOCK_CLASS_INITIALIZER(n) {.name = n}
+
 struct mutex
 {
 	struct spinlock spinlock;
@@ -14,13 +31,19 @@ struct mutex
 	struct thread *owner;
 	int flags;
 	size_t recursive_nb;
+	struct lock_class *lock_class;
+	uintptr_t stat_site; /* lockstat acquisition site */
+	uint64_t stat_start; /* lockstat acquisition time */
 };
 
 void mutex_init(struct mutex *mutex, int flags);
 void mutex_destroy(struct mutex *mutex);
+void mutex_set_class(struct mutex *mutex, struct lock_class *lock_class);
 void mutex_lock(struct mutex *mutex);
 void mutex_spinlock(struct mutex *mutex);
 int mutex_trylock(struct mutex *mutex);
 void mutex_unlock(struct mutex *mutex);
 
+int lockclass_register_sysfs(void);
+
 #endif
@@ -0,0 +1,27 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <types.h>
+
+#define MAXNODE 16
+
+#define NUMA_LOCAL_DISTANCE  10
+#define NUMA_REMOTE_DISTANCE 20
+
+struct cpu;
+
+/* the firmware describes the topology with its own domain ids, they are
+ * mapped to nodes numbered from 0 in the order they are discovered
+ */
+void numa_add_memory(uint32_t domain, uint64_t addr, uint64_t size);
+void numa_add_cpu(uint32_t domain, uint64_t hwid);
+void numa_set_distance(uint32_t from, uint32_t to, uint8_t distance);
+
+void numa_init(void);
+uint32_t numa_cpu_node(const struct cpu *cpu);
+const uint32_t *numa_fallback(uint32_t node);
+int numa_register_sysfs(void);
+
+extern size_t g_numa_nodes;
+
+#endif
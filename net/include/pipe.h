@@ -21,6 +21,13 @@ int pipe_alloc(struct pipe **pipep, struct node *node);
 int fifo_alloc(struct pipe **pipe, struct node **nodep,
                struct file **rfilep, struct file **wfilep);
 void pipe_free(struct pipe *pipe);
+ssize_t pipe_splice(struct file *in, struct file *out, size_t count,
+                    int flags);
+ssize_t pipe_tee(struct file *in, struct file *out, size_t count, int flags);
+ssize_t pipe_splice_from(struct file *out, struct file *in, off_t *off,
+                         size_t count, int flags);
+ssize_t pipe_splice_to(struct file *in, struct file *out, off_t *off,
+                       size_t count, int flags);
 
 extern const struct file_op g_pipe_fop;
 
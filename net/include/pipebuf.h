@@ -7,9 +7,31 @@
 
 #define PIPE_BUF 4096
 
+#define PIPEBUF_PAGES 16
+
+struct page;
+
+/* part of a page referenced by the buffer instead of being copied to the
+ * ringbuf (splice): the ringbuf bytes written before it are read first
+ */
+struct pipebuf_page
+{
+	struct page *page;
+	size_t off;
+	size_t len;
+	size_t bytes; /* ringbuf bytes queued before it */
+	TAILQ_ENTRY(pipebuf_page) chain;
+};
+
+TAILQ_HEAD(pipebuf_page_head, pipebuf_page);
+
 struct pipebuf
 {
 	struct ringbuf ringbuf;
+	struct pipebuf_page_head pages;
+	size_t pages_count;
+	size_t pages_size; /* bytes referenced by the pages */
+	size_t pages_bytes; /* sum of the bytes of the pages */
 	struct waitq *rwaitq;
 	struct waitq *wwaitq;
 	struct mutex *mutex;
@@ -31,6 +53,21 @@ ssize_t pipebuf_write_locked(struct pipebuf *pipebuf, struct uio *uio, size_t mi
                              struct timespec *timeout);
 int pipebuf_poll(struct pipebuf *pipebuf, int events);
 int pipebuf_poll_locked(struct pipebuf *pipebuf, int events);
+ssize_t pipebuf_wait_read_locked(struct pipebuf *pipebuf, int nonblock);
+ssize_t pipebuf_wait_write_locked(struct pipebuf *pipebuf, int nonblock);
+ssize_t pipebuf_take_locked(struct pipebuf *pipebuf,
+                            struct pipebuf_page_head *pages, size_t count,
+                            size_t max);
+void pipebuf_give_locked(struct pipebuf *pipebuf,
+                         struct pipebuf_page_head *pages);
+void pipebuf_unget_locked(struct pipebuf *pipebuf,
+                          struct pipebuf_page_head *pages);
+int pipebuf_page_alloc(struct page *page, size_t off, size_t len,
+                       struct pipebuf_page **pagep);
+void pipebuf_page_free(struct pipebuf_page *pp);
+int pipebuf_pages_dup(struct pipebuf_page_head *dst,
+                      const struct pipebuf_page_head *src);
+void pipebuf_pages_free(struct pipebuf_page_head *pages);
 
 static inline void pipebuf_lock(struct pipebuf *pipebuf)
 {
@@ -84,6 +84,7 @@ int poller_init(struct poller *poller);
 void poller_destroy(struct poller *poller);
 int poller_add(struct poll_entry *entry);
 void poller_remove(struct poller_head *head);
+void poller_del(struct poll_entry *entry);
 int poller_wait(struct poller *poller, struct timespec *timeout);
 void poller_broadcast(struct poller_head *head, int events);
 
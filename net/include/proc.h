@@ -6,6 +6,7 @@
 #include <rwlock.h>
 #include <mutex.h>
 #include <queue.h>
+#include <timer.h>
 #include <types.h>
 #include <time.h>
 #include <cpu.h>
@@ -104,6 +105,8 @@ struct proc
 	char *name;
 	void *entrypoint;
 	struct filedesc *files;
+	unsigned long *files_map;
+	unsigned long *files_full;
 	size_t files_nb;
 	struct rwlock files_lock;
 	struct node *root;
@@ -128,6 +131,7 @@ struct proc
 	TAILQ_ENTRY(proc) chain;
 	TAILQ_ENTRY(proc) child_chain;
 	TAILQ_ENTRY(proc) pgrp_chain;
+	TAILQ_ENTRY(proc) hash_chain;
 };
 
 enum ptrace_state
@@ -162,6 +166,7 @@ struct thread
 	uint8_t *int_stack;
 	uintptr_t tls_addr;
 	struct timespec wait_timeout; /* currently monotonic */
+	struct timer wait_timer;
 	struct waitq *waitq; /* current waitq sleeping on */
 	size_t wait_cpuid;
 	int wstatus;
@@ -189,8 +194,8 @@ struct thread
 	TAILQ_ENTRY(thread) thread_chain;
 	TAILQ_ENTRY(thread) runq_chain;
 	TAILQ_ENTRY(thread) waitq_chain;
-	TAILQ_ENTRY(thread) waitq_timeout_chain;
 	TAILQ_ENTRY(thread) ptrace_chain;
+	TAILQ_ENTRY(thread) hash_chain;
 };
 
 /* XXX this should be moved somewhere else */
@@ -210,7 +215,7 @@ struct elf_info
 
 extern struct spinlock g_sess_list_lock;
 extern struct sess_head g_sess_list;
-extern struct spinlock g_proc_list_lock;
+extern struct rwlock g_proc_list_lock;
 extern struct proc_head g_proc_list;
 extern struct spinlock g_thread_list_lock;
 extern struct thread_head g_thread_list;
@@ -270,6 +275,7 @@ int kproc_create(const char *name, void *entry, const char * const *argv,
                  const char * const *envp, struct thread **thread);
 
 int uproc_clone(struct thread *thread, int flags, struct thread **newthreadp);
+void uproc_discard(struct proc *proc);
 int uthread_clone(struct thread *thread, int flags, struct thread **newthreadp);
 
 int uproc_execve(struct thread *thread, struct file *file, const char *path,
@@ -314,6 +320,7 @@ void thread_illegal_instruction(struct thread *thread);
 
 int proc_getfile(struct proc *proc, int fd, struct file **file);
 int proc_allocfd(struct proc *proc, struct file *file, int cloexec);
+int proc_setfd(struct proc *proc, int fd, struct file *file, int cloexec);
 int proc_freefd(struct proc *proc, int fd);
 
 void proc_update_loadavg(void);
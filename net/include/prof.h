@@ -0,0 +1,68 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include <types.h>
+
+#define PROFIO_START 0x201
+#define PROFIO_STOP  0x202
+#define PROFIO_KSYM  0x203
+#define PROFIO_STATS 0x204
+
+#define PROF_F_KERNEL    (1 << 0) /* sample kernel code */
+#define PROF_F_USER      (1 << 1) /* sample user code */
+#define PROF_F_CALLCHAIN (1 << 2) /* walk the frame pointers */
+
+#define PROF_MAX_DEPTH 32
+
+struct prof_config
+{
+	uint32_t frequency; /* samples per second on each cpu */
+	uint32_t flags;
+	int32_t pid; /* only sample this process if > 0 */
+	uint32_t pad0;
+};
+
+#define PROF_FRAME_USER (1 << 0)
+#define PROF_FRAME_FILE (1 << 1) /* dev, ino and off are valid */
+
+struct prof_frame
+{
+	uint64_t pc;
+	uint64_t off; /* offset of pc in the mapped file */
+	uint64_t ino;
+	uint32_t dev;
+	uint32_t flags;
+};
+
+/* samples are read as a stream of variable size records,
+ * the first frame is the sampled pc, followed by its callers
+ */
+struct prof_sample
+{
+	uint32_t size; /* whole record, including frames */
+	uint32_t cpu;
+	int32_t pid;
+	int32_t tid;
+	uint64_t time; /* monotonic, in nanoseconds */
+	uint32_t depth;
+	uint32_t pad0;
+	struct prof_frame frames[];
+};
+
+struct prof_stats
+{
+	uint64_t samples;
+	uint64_t dropped; /* ring buffer full */
+};
+
+struct prof_ksym
+{
+	uint64_t addr;
+	uint64_t off;
+	char name[128];
+};
+
+void prof_init(void);
+void prof_ipi(void);
+
+#endif
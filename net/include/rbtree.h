@@ -0,0 +1,57 @@
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include <types.h>
+
+/* intrusive red-black tree
+ * the caller does the descent (to allow any key and comparison) and links
+ * the new node with rb_insert
+ * augmented trees provide a callback recomputing the data a node aggregates
+ * from its subtree; it is called bottom-up for every node whose subtree
+ * changed
+ */
+
+#define RB_RED   0
+#define RB_BLACK 1
+
+#define RB_ENTRY(ptr, type, member) \
+	((type*)((uint8_t*)(ptr) - offsetof(type, member)))
+
+#define RB_ENTRY_SAFE(ptr, type, member) \
+	((ptr) ? RB_ENTRY(ptr, type, member) : NULL)
+
+struct rb_node
+{
+	struct rb_node *parent;
+	struct rb_node *left;
+	struct rb_node *right;
+	int color;
+};
+
+struct rb_tree
+{
+	struct rb_node *root;
+	void (*augment)(struct rb_node *node);
+};
+
+static inline int rb_empty(const struct rb_tree *tree)
+{
+	return !tree->root;
+}
+
+void rb_init(struct rb_tree *tree, void (*augment)(struct rb_node *node));
+
+/* link is &parent->left, &parent->right or &tree->root (parent NULL) */
+void rb_insert(struct rb_tree *tree, struct rb_node *node,
+               struct rb_node *parent, struct rb_node **link);
+void rb_remove(struct rb_tree *tree, struct rb_node *node);
+
+/* to be called when the augmented data of a node changed in place */
+void rb_augment_path(struct rb_tree *tree, struct rb_node *node);
+
+struct rb_node *rb_first(const struct rb_tree *tree);
+struct rb_node *rb_last(const struct rb_tree *tree);
+struct rb_node *rb_next(const struct rb_node *node);
+struct rb_node *rb_prev(const struct rb_node *node);
+
+#endif
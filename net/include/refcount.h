@@ -29,6 +29,20 @@ static uint32_t refcount_dec(refcount_t *refcount)
 	return ret;
 }
 
+/* fails if the object is being released */
+static int refcount_inc_not_zero(refcount_t *refcount)
+{
+	uint32_t count = __atomic_load_n(&refcount->count, __ATOMIC_SEQ_CST);
+	do
+	{
+		if (!count)
+			return 0;
+	} while (!__atomic_compare_exchange_n(&refcount->count, &count,
+	                                      count + 1, 0, __ATOMIC_SEQ_CST,
+	                                      __ATOMIC_SEQ_CST));
+	return 1;
+}
+
 static uint32_t refcount_get(refcount_t *refcount)
 {
 	return __atomic_load_n(&refcount->count, __ATOMIC_SEQ_CST);
@@ -14,6 +14,8 @@ struct rwlock
 	struct waitq wwaitq;
 	struct thread *wowner;
 	size_t rlock_nb;
+	uintptr_t stat_site; /* lockstat writer acquisition site */
+	uint64_t stat_start; /* lockstat writer acquisition time */
 };
 
 void rwlock_init(struct rwlock *rwlock);
@@ -29,6 +29,7 @@
 #define AF_PACKET PF_PACKET
 
 #define MSG_DONTWAIT (1 << 0)
+#define MSG_KBUF     (1 << 30) /* kernel only: msg_iov are kernel buffers */
 
 #define SOCK_STREAM 1
 #define SOCK_DGRAM  2
@@ -74,7 +75,7 @@ struct sock_op
 	int (*release)(struct sock *sock);
 	int (*bind)(struct sock *sock, const struct sockaddr *addr,
 	            socklen_t addrlen);
-	int (*accept)(struct sock *sock, struct sock **child);
+	int (*accept)(struct sock *sock, struct sock **child, int flags);
 	int (*connect)(struct sock *sock, const struct sockaddr *addr,
 	               socklen_t addrlen);
 	int (*listen)(struct sock *sock, int backlog);
@@ -129,9 +130,10 @@ int sock_new(int domain, int type, int protocol, const struct sock_op *op,
 void sock_ref(struct sock *sock);
 void sock_free(struct sock *sock);
 
+int sock_test_addrlen(int family, socklen_t addrlen);
 int sock_bind(struct sock *sock, const struct sockaddr *addr,
               socklen_t addrlen);
-int sock_accept(struct sock *sock, struct sock **child);
+int sock_accept(struct sock *sock, struct sock **child, int flags);
 int sock_connect(struct sock *sock, const struct sockaddr *addr,
                  socklen_t addrlen);
 int sock_listen(struct sock *sock, int backlog);
@@ -158,7 +160,8 @@ static inline void uio_from_msghdr(struct uio *uio, const struct msghdr *msg)
 	for (size_t i = 0; i < uio->iovcnt; ++i)
 		uio->count += uio->iov[i].iov_len;
 	uio->off = 0;
-	uio->userbuf = 1;
+	uio->userbuf = !(msg->msg_flags & MSG_KBUF);
+	uio->nonblock = 0;
 }
 
 static inline void sock_lock(struct sock *sock)
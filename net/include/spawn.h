@@ -0,0 +1,43 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <signal.h>
+#include <types.h>
+
+#define SPAWN_SETPGROUP  (1 << 0)
+#define SPAWN_SETSIGMASK (1 << 1)
+#define SPAWN_SETSIGDEF  (1 << 2)
+
+#define SPAWN_FA_CLOSE 0
+#define SPAWN_FA_DUP2  1
+#define SPAWN_FA_OPEN  2
+
+#define SPAWN_ACTIONS_MAX 64
+
+/* applied in order to the fds of the child, before the exec
+ * srcfd is the source of dup2, path, flags and mode the arguments of open
+ */
+struct spawn_file_action
+{
+	int type;
+	int fd;
+	int srcfd;
+	int flags;
+	mode_t mode;
+	const char *path;
+};
+
+/* the exec resets all the signal handlers, so sigdefault has nothing
+ * more to reset
+ */
+struct spawn_attr
+{
+	int flags;
+	pid_t pgroup;
+	sigset_t sigmask;
+	sigset_t sigdefault;
+	const struct spawn_file_action *actions;
+	size_t actions_nb;
+};
+
+#endif
@@ -3,15 +3,23 @@
 
 #include <arch/arch.h>
 
+#include <lockstat.h>
 #include <types.h>
 
+/* ticket lock: the upper half of val is the next ticket to be handed out,
+ * the lower half is the ticket currently owning the lock
+ * cpus are granted the lock in the order they asked for it
+ */
 struct spinlock
 {
-	uintptr_t val;
+	uint32_t val;
 };
 
 #define SPINLOCK_INITIALIZER() {0}
 
+#define SPINLOCK_TICKET_SHIFT 16
+#define SPINLOCK_TICKET_MASK  0xFFFF
+
 static inline void spinlock_init(struct spinlock *spinlock)
 {
 	__atomic_store_n(&spinlock->val, 0, __ATOMIC_RELAXED);
@@ -24,20 +32,59 @@ static inline void spinlock_destroy(struct spinlock *spinlock)
 
 static inline int spinlock_trylock(struct spinlock *spinlock)
 {
-	uintptr_t expected = 0;
-	return __atomic_compare_exchange_n(&spinlock->val, &expected, 1, 0,
-	                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+	uint32_t val = __atomic_load_n(&spinlock->val, __ATOMIC_RELAXED);
+	if ((val >> SPINLOCK_TICKET_SHIFT) != (val & SPINLOCK_TICKET_MASK))
+		return 0;
+	if (!__atomic_compare_exchange_n(&spinlock->val, &val,
+	                                 val + (1 << SPINLOCK_TICKET_SHIFT),
+	                                 0, __ATOMIC_ACQUIRE,
+	                                 __ATOMIC_RELAXED))
+		return 0;
+	if (lockstat_enabled())
+		lockstat_spinlock_trylock(spinlock);
+	return 1;
+}
+
+static inline uint32_t spinlock_get_ticket(struct spinlock *spinlock)
+{
+	uint32_t val = __atomic_fetch_add(&spinlock->val,
+	                                  1 << SPINLOCK_TICKET_SHIFT,
+	                                  __ATOMIC_RELAXED);
+	return val >> SPINLOCK_TICKET_SHIFT;
+}
+
+static inline int spinlock_ticket_ready(struct spinlock *spinlock,
+                                        uint32_t ticket)
+{
+	uint32_t val = __atomic_load_n(&spinlock->val, __ATOMIC_ACQUIRE);
+	return (val & SPINLOCK_TICKET_MASK) == ticket;
 }
 
 static inline void spinlock_lock(struct spinlock *spinlock)
 {
-	while (!spinlock_trylock(spinlock))
+	uint32_t ticket = spinlock_get_ticket(spinlock);
+	if (lockstat_enabled())
+	{
+		lockstat_spinlock_lock(spinlock, ticket);
+		return;
+	}
+	while (!spinlock_ticket_ready(spinlock, ticket))
 		arch_spin_yield();
 }
 
 static inline void spinlock_unlock(struct spinlock *spinlock)
 {
-	__atomic_store_n(&spinlock->val, 0, __ATOMIC_RELEASE);
+	if (lockstat_enabled())
+		lockstat_spinlock_unlock(spinlock);
+	uint32_t val = __atomic_load_n(&spinlock->val, __ATOMIC_RELAXED);
+	uint32_t owner;
+	do
+	{
+		owner = (val + 1) & SPINLOCK_TICKET_MASK;
+	} while (!__atomic_compare_exchange_n(&spinlock->val, &val,
+	                                      (val & ~SPINLOCK_TICKET_MASK) | owner,
+	                                      0, __ATOMIC_RELEASE,
+	                                      __ATOMIC_RELAXED));
 }
 
 #endif
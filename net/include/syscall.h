@@ -31,6 +31,7 @@
 #define SYS_times       27
 #define SYS_sigaltstack 28
 #define SYS_sigpending  29
+#define SYS_spawn       30
 
 /* file */
 #define SYS_openat         40
@@ -68,6 +69,11 @@
 #define SYS_fsync          72
 #define SYS_fdatasync      73
 #define SYS_chroot         74
+#define SYS_sendfile       75
+#define SYS_splice         76
+#define SYS_tee            77
+#define SYS_preadv         78
+#define SYS_pwritev        79
 
 /* creds */
 #define SYS_getuid      80
@@ -81,6 +87,13 @@
 #define SYS_setuid      88
 #define SYS_setgid      89
 
+/* uring */
+#define SYS_uring_setup 90
+#define SYS_uring_enter 91
+
+/* file, continued */
+#define SYS_getdentsplus 92
+
 /* net */
 #define SYS_socket      100
 #define SYS_bind        101
@@ -112,6 +125,11 @@
 #define SYS_sigsuspend    142
 #define SYS_madvise       143
 #define SYS_reboot        144
+#define SYS_sync          145
+#define SYS_pagedaemon    146
+#define SYS_swapon        147
+#define SYS_swapoff       148
+#define SYS_getcpu        149
 
 /* uipc */
 #define SYS_shmget     150
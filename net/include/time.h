@@ -19,6 +19,16 @@ struct timespec
 	time_t tv_nsec;
 };
 
+/* free running counter behind a clock source, also readable from
+ * userland: the vdso extrapolates the time from it
+ */
+struct clock_counter
+{
+	uint64_t freq;
+	uint64_t base; /* value at time 0 */
+	uint64_t (*read)(void);
+};
+
 struct clock_source
 {
 	const char *name;
@@ -26,6 +36,7 @@ struct clock_source
 	int (*getres)(struct timespec *ts);
 	int (*gettime)(struct timespec *ts);
 	int (*settime)(struct timespec *ts);
+	const struct clock_counter *counter;
 };
 
 struct tms
@@ -41,6 +52,7 @@ int clock_register(int clock, const struct clock_source *source);
 int clock_getres(int clock, struct timespec *ts);
 int clock_gettime(int clock, struct timespec *ts);
 int clock_settime(int clock, struct timespec *ts);
+const struct clock_counter *clock_get_counter(void);
 
 time_t realtime_seconds(void);
 
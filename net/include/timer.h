@@ -2,8 +2,10 @@
 #define TIMER_H
 
 #include <queue.h>
+#include <types.h>
 #include <time.h>
 
+struct timer_wheel;
 struct timer;
 
 typedef void (*timer_cb_t)(struct timer *timer);
@@ -11,9 +13,11 @@ typedef void (*timer_cb_t)(struct timer *timer);
 struct timer
 {
 	struct timespec timeout;
+	uint64_t expires; /* in wheel ticks */
 	timer_cb_t cb;
 	void *userdata;
-	TAILQ_ENTRY(timer) chain;
+	struct timer_wheel *wheel; /* NULL if not pending */
+	LIST_ENTRY(timer) chain;
 };
 
 void timer_check_timeout(void);
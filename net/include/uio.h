@@ -18,6 +18,7 @@ struct uio
 	size_t count;
 	off_t off;
 	int userbuf;
+	int nonblock; /* fail with -EAGAIN regardless of O_NONBLOCK */
 };
 
 ssize_t uio_copyout(void *dst, struct uio *uio, size_t count);
@@ -34,6 +35,7 @@ static inline void uio_fromkbuf(struct uio *uio, struct iovec *iov, void *data,
 	uio->count = len;
 	uio->off = off;
 	uio->userbuf = 0;
+	uio->nonblock = 0;
 }
 
 #endif
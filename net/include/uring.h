@@ -0,0 +1,84 @@
+#ifndef URING_H
+#define URING_H
+
+#include <types.h>
+
+#define URING_OP_NOP      0
+#define URING_OP_READ     1
+#define URING_OP_WRITE    2
+#define URING_OP_READV    3
+#define URING_OP_WRITEV   4
+#define URING_OP_RECVMSG  5
+#define URING_OP_SENDMSG  6
+#define URING_OP_ACCEPT   7
+#define URING_OP_CONNECT  8
+#define URING_OP_POLL_ADD 9
+#define URING_OP_TIMEOUT  10
+#define URING_OP_FSYNC    11
+
+#define URING_ENTER_GETEVENTS (1 << 0)
+
+#define URING_MAX_ENTRIES 4096
+
+struct timespec;
+struct file;
+
+/* the ring fd is mapped (MAP_SHARED, offset 0) with the size given back
+ * by uring_setup: it starts with a struct uring_ring, followed by the
+ * completion and the submission entries at cqes_off and sqes_off
+ */
+struct uring_params
+{
+	uint32_t sq_entries;
+	uint32_t cq_entries;
+	uint32_t flags;
+	uint32_t size;
+	uint32_t sqes_off;
+	uint32_t cqes_off;
+};
+
+/* userspace owns sq_tail and cq_head, the kernel sq_head and cq_tail */
+struct uring_ring
+{
+	uint32_t sq_head;
+	uint32_t sq_tail;
+	uint32_t sq_mask;
+	uint32_t cq_head;
+	uint32_t cq_tail;
+	uint32_t cq_mask;
+};
+
+/* off is -1 to use (and update) the file offset, and the number of
+ * completions to wait for (0 for none) of a timeout
+ * addr points to the buffer, iovec, msghdr, sockaddr or timespec, len is
+ * its size (the iovec count of readv / writev)
+ * addr2 points to the socklen_t of accept, op_flags are the poll events
+ * or the msg flags
+ */
+struct uring_sqe
+{
+	uint8_t opcode;
+	uint8_t pad[3];
+	int32_t fd;
+	int64_t off;
+	uint64_t addr;
+	uint64_t addr2;
+	uint32_t len;
+	uint32_t op_flags;
+	uint64_t user_data;
+};
+
+struct uring_cqe
+{
+	uint64_t user_data;
+	int32_t res;
+	uint32_t flags;
+};
+
+int uring_setup(uint32_t entries, struct uring_params *params,
+                struct file **filep);
+ssize_t uring_enter(struct file *file, uint32_t to_submit,
+                    uint32_t min_complete, uint32_t flags,
+                    const struct timespec *timeout);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef VDSO_H
+#define VDSO_H
+
+#include <types.h>
+
+#define VDSO_MAGIC 0x4F534456 /* "VDSO" */
+
+struct vm_space;
+struct cpu;
+
+/* start of the image, pointed to by AT_SYSINFO_EHDR: the entry points
+ * are given as offsets from it, each of them returning -ENOSYS when the
+ * syscall has to be used instead
+ *
+ * int clock_gettime(clockid_t clock, struct timespec *ts);
+ * int getcpu(unsigned *cpu, unsigned *node);
+ */
+struct vdso_header
+{
+	uint32_t magic;
+	uint32_t clock_gettime;
+	uint32_t getcpu;
+};
+
+void vdso_init(void);
+void vdso_init_cpu(struct cpu *cpu);
+void vdso_update(void);
+int vdso_map(struct vm_space *space, uintptr_t *addr);
+
+#endif
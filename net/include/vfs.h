@@ -23,6 +23,7 @@
 #define ISO9660_MAGIC 0x1006
 
 struct fs_node_op;
+struct vm_cache;
 struct fs_sb_op;
 struct file_op;
 struct fs_type;
@@ -70,6 +71,8 @@ struct fs_type_op
 	int (*stat)(struct fs_sb *sb, struct statvfs *st);
 };
 
+#define FS_TYPE_DCACHE (1 << 0) /* the lookups can be cached */
+
 struct fs_type
 {
 	const struct fs_type_op *op;
@@ -148,6 +151,8 @@ struct node
 	ino_t ino;
 	refcount_t refcount;
 	void *userdata;
+	struct vm_cache *cache; /* pages of the shared mappings */
+	uint32_t dcache_seq; /* changes of the dir, see dcache_add */
 	TAILQ_ENTRY(node) cache_chain;
 };
 
@@ -199,6 +204,14 @@ int vfs_getdir(struct node *cwd, const char *path, int flags,
 
 mode_t vfs_getperm(struct node *node, uid_t uid, gid_t gid);
 
+void dcache_init(void);
+int dcache_find(struct node *dir, const char *name, size_t name_len,
+                struct node **child);
+uint32_t dcache_seq(struct node *dir);
+void dcache_add(struct node *dir, const char *name, size_t name_len,
+                struct node *child, uint32_t seq);
+void dcache_remove(struct node *dir, const char *name, size_t name_len);
+
 void node_free(struct node *node);
 void node_ref(struct node *node);
 
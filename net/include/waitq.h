@@ -13,7 +13,6 @@ struct waitq
 	TAILQ_HEAD(, thread) watchers;
 };
 
-void waitq_check_timeout(void);
 void waitq_init(struct waitq *waitq);
 void waitq_destroy(struct waitq *waitq);
 int waitq_wait_tail(struct waitq *waitq, struct spinlock *spinlock,
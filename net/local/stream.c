@@ -332,7 +332,7 @@ int pfl_stream_connect(struct sock *sock, const struct sockaddr *addr,
 	return 0;
 }
 
-int pfl_stream_accept(struct sock *sock, struct sock **child)
+int pfl_stream_accept(struct sock *sock, struct sock **child, int flags)
 {
 	struct sock_pfl_stream *pfl_stream = sock->userdata;
 	/* XXX sock lock */
@@ -341,6 +341,11 @@ int pfl_stream_accept(struct sock *sock, struct sock **child)
 	mutex_lock(&pfl_stream->pfls->mutex);
 	while (!pfl_stream->server.queue_len)
 	{
+		if (flags & MSG_DONTWAIT)
+		{
+			mutex_unlock(&pfl_stream->pfls->mutex);
+			return -EAGAIN;
+		}
 		int ret = waitq_wait_head_mutex(&pfl_stream->sock->rwaitq,
 		                                &pfl_stream->pfls->mutex, NULL);
 		if (ret)
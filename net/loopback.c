@@ -1,11 +1,16 @@
 #include <net/ip4.h>
 #include <net/if.h>
 
+#include <tracepoint.h>
 #include <sock.h>
 #include <std.h>
 
 static int loopback_emit(struct netif *netif, struct netpkt *pkt)
 {
+	if (tp_enabled(TP_NET_TX))
+		tp_net_emit(TP_NET_TX, netif, pkt->len, ETHERTYPE_IP);
+	if (tp_enabled(TP_NET_RX))
+		tp_net_emit(TP_NET_RX, netif, pkt->len, ETHERTYPE_IP);
 	/* XXX hum.... */
 	int ret = ip4_input(netif, pkt);
 	if (!ret)
@@ -4,6 +4,7 @@
 #include <net/arp.h>
 #include <net/if.h>
 
+#include <tracepoint.h>
 #include <proc.h>
 #include <sock.h>
 #include <sma.h>
@@ -255,6 +256,8 @@ ssize_t rawp_send(struct sock *sock, struct msghdr *msg, int flags)
 		ret = -EINVAL;
 		goto end;
 	}
+	if (tp_enabled(TP_NET_TX))
+		tp_net_emit(TP_NET_TX, netif, pkt->len, ntohs(ether->ether_type));
 	ret = netif->op->emit(netif, pkt);
 	if (ret)
 		goto end;
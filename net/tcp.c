@@ -4,6 +4,7 @@
 #include <net/tcp.h>
 #include <net/if.h>
 
+#include <tracepoint.h>
 #include <pipebuf.h>
 #include <random.h>
 #include <sock.h>
@@ -84,31 +85,6 @@ void sock_tcp_init(void)
 	sma_init(&sock_tcp_sma, sizeof(struct sock_tcp), NULL, NULL, "sock_tcp");
 }
 
-static inline void print_tcphdr(const struct tcphdr *tcphdr)
-{
-	printf("sport: %" PRIu16 "\n", htons(tcphdr->th_sport));
-	printf("dport: %" PRIu16 "\n", htons(tcphdr->th_dport));
-	printf("seq: %" PRIu32 "\n", htonl(tcphdr->th_seq));
-	printf("ack: %" PRIu32 "\n", htonl(tcphdr->th_ack));
-	printf("off: %" PRIu8 "\n", tcphdr->th_off);
-	printf("flags: 0x%02" PRIx8, tcphdr->th_flags);
-	if (tcphdr->th_flags & TH_FIN)
-		printf(" FIN");
-	if (tcphdr->th_flags & TH_SYN)
-		printf(" SYN");
-	if (tcphdr->th_flags & TH_RST)
-		printf(" RST");
-	if (tcphdr->th_flags & TH_PUSH)
-		printf(" PUSH");
-	if (tcphdr->th_flags & TH_ACK)
-		printf(" ACK");
-	if (tcphdr->th_flags & TH_URG)
-		printf(" URG");
-	printf("\n");
-	printf("win: %" PRIu16 "\n", htons(tcphdr->th_win));
-	printf("urp: 0x%04" PRIx16 "\n", htons(tcphdr->th_urp));
-}
-
 static int init_clt(struct sock_tcp *sock_tcp)
 {
 	struct sock *sock = sock_tcp->sock;
@@ -478,7 +454,7 @@ end:
 	return ret;
 }
 
-int tcp_accept(struct sock *sock, struct sock **child)
+int tcp_accept(struct sock *sock, struct sock **child, int flags)
 {
 	struct sock_tcp *sock_tcp = sock->userdata;
 	struct sock_tcp *child_tcp;
@@ -492,6 +468,11 @@ int tcp_accept(struct sock *sock, struct sock **child)
 	}
 	while (TAILQ_EMPTY(&sock_tcp->srv.queue))
 	{
+		if (flags & MSG_DONTWAIT)
+		{
+			ret = -EAGAIN;
+			goto end;
+		}
 		ret = waitq_wait_tail_mutex(&sock->rwaitq, &sock->mutex, NULL);
 		if (ret)
 			goto end;
@@ -1100,10 +1081,8 @@ int tcp_input(struct netif *netif, struct netpkt *pkt, struct sockaddr *src,
 		return -EINVAL;
 	}
 	tcphdr = pkt->data;
-#if 0
-	printf("[%" PRId64 "] ==INPUT==\n", realtime_seconds());
-	print_tcphdr(tcphdr);
-#endif
+	if (tp_enabled(TP_TCP_INPUT))
+		tp_tcp_emit(TP_TCP_INPUT, tcphdr, pkt->len);
 	if (tcphdr->th_off < sizeof(*tcphdr) / 4)
 	{
 		printf("tcp: offset too small\n");
@@ -1293,10 +1272,8 @@ static int send_pkt(struct sock_tcp *sock_tcp, struct netpkt *pkt)
 		ret = -ENETUNREACH;
 		goto end;
 	}
-#if 0
-	printf("[%" PRId64 "] ==OUTPUT==\n", realtime_seconds());
-	print_tcphdr(pkt->data);
-#endif
+	if (tp_enabled(TP_TCP_OUTPUT))
+		tp_tcp_emit(TP_TCP_OUTPUT, pkt->data, pkt->len);
 	switch (sock->domain)
 	{
 		case AF_INET:
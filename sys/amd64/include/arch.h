@@ -104,4 +104,12 @@ static inline void arch_spin_yield(void)
 	__asm__ volatile ("pause" : : : "memory");
 }
 
+static inline uint64_t arch_get_cycles(void)
+{
+	uint32_t lo;
+	uint32_t hi;
+	__asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+}
+
 #endif
@@ -1,6 +1,16 @@
 #ifndef ARCH_MEM_H
 #define ARCH_MEM_H
 
+/* user memory of the current space is accessed directly, faults being
+ * caught by the copy routines
+ */
+#define ARCH_COPY_USER
+
+/* 2MB pages are used for large kernel allocations and for aligned
+ * private anonymous memory
+ */
+#define ARCH_VM_LARGE_SHIFT 21
+
 struct page;
 
 struct arch_vm_space
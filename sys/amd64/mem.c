@@ -41,12 +41,20 @@
 #define DIR_FLAG_PWT   (1ULL << 3) /* write through / write back */
 #define DIR_FLAG_PCD   (1ULL << 4) /* must not be cached */
 #define DIR_FLAG_A     (1ULL << 5) /* has been accessed */
+#define DIR_FLAG_PS    (1ULL << 7) /* large page */
+#define DIR_FLAG_G     (1ULL << 8) /* global page */
+#define DIR_FLAG_PAT   (1ULL << 12) /* PAT bit of large pages */
 #define DIR_FLAG_XD    (1ULL << 63) /* execute disable */
 #define DIR_FLAG_MASK  0xFFF0000000000FFFULL
 
 #define DIR_POFF(val)  (DIR_PADDR(val) >> TBL_SHIFT)
 #define DIR_PADDR(val) ((uint64_t)(val) & ~DIR_FLAG_MASK)
 
+#define LARGE_FLAGS(val) ((uint64_t)(val) & (DIR_FLAG_MASK | DIR_FLAG_PAT))
+#define LARGE_POFF(val)  (DIR_POFF(val) & ~(DIR_FLAG_PAT >> TBL_SHIFT))
+#define LARGE_PAGES(lvl) (1ULL << (9 * (lvl)))
+#define LARGE_SIZE(lvl)  (LARGE_PAGES(lvl) * PAGE_SIZE)
+
 #define TBL_FLAG_P     (1ULL << 0) /* is present */
 #define TBL_FLAG_RW    (1ULL << 1) /* enable write */
 #define TBL_FLAG_US    (1ULL << 2) /* available for userspace */
@@ -62,6 +70,13 @@
 #define TBL_POFF(val)  (TBL_PADDR(val) >> TBL_SHIFT)
 #define TBL_PADDR(val) ((uint64_t)(val) & ~TBL_FLAG_MASK)
 
+#define CR3_NOFLUSH (1ULL << 63) /* keep the tlb entries of the pcid */
+
+#define INVPCID_ALL_GLOBAL 2
+
+#define WALK_CREATE (1 << 0) /* allocate the missing tables */
+#define WALK_SPLIT  (1 << 1) /* split the large pages on the way */
+
 extern uint8_t _kernel_end;
 extern uint64_t kern_pml_page;
 
@@ -73,10 +88,18 @@ static inline uint64_t mkentry(uint64_t poff, uint64_t flags)
 	return (poff << 12) | flags;
 }
 
-static void set_pte(struct vm_space *space, uint64_t addr, uint64_t *tbl_ptr,
-                    uintptr_t poff, uint32_t prot)
+/* pcid is only enabled along with global pages: kernel mappings are
+ * shared by every pcid, and invlpg has to invalidate them for all of them
+ */
+static inline int has_pcid(void)
 {
-	uint64_t f = poff ? TBL_FLAG_P : 0;
+	return curcpu()->arch.cpuid.feat_ecx & CPUID_FEAT_ECX_PCID
+	    && curcpu()->arch.cpuid.feat_edx & CPUID_FEAT_EDX_PGE;
+}
+
+static uint64_t pte_flags(struct vm_space *space, uint32_t prot)
+{
+	uint64_t f = 0;
 	if (space)
 		f |= TBL_FLAG_US;
 	if (prot & VM_PROT_W)
@@ -91,7 +114,29 @@ static void set_pte(struct vm_space *space, uint64_t addr, uint64_t *tbl_ptr,
 		f |= TBL_FLAG_PWT; /* PAT 1 */
 	if (!(prot & VM_PROT_X))
 		f |= TBL_FLAG_XD;
-	*tbl_ptr = mkentry(poff, f);
+	if (!space)
+		f |= TBL_FLAG_G;
+	return f;
+}
+
+/* the PAT bit of large pages is moved to make room for the PS bit */
+static uint64_t large_flags(uint64_t f)
+{
+	if (f & TBL_FLAG_PAT)
+		f = (f & ~TBL_FLAG_PAT) | DIR_FLAG_PAT;
+	return f | DIR_FLAG_PS;
+}
+
+static uint64_t small_flags(uint64_t f)
+{
+	f &= ~DIR_FLAG_PS;
+	if (f & DIR_FLAG_PAT)
+		f = (f & ~DIR_FLAG_PAT) | TBL_FLAG_PAT;
+	return f;
+}
+
+static void invalidate(struct vm_space *space, uint64_t addr)
+{
 	if (!space)
 	{
 		invlpg(addr);
@@ -102,8 +147,40 @@ static void set_pte(struct vm_space *space, uint64_t addr, uint64_t *tbl_ptr,
 		invlpg(addr);
 }
 
-static int get_tbl_ptr(struct vm_space *space, uintptr_t addr, int create,
-                       uint64_t **tbl_ptr)
+static void set_pte(struct vm_space *space, uint64_t addr, uint64_t *tbl_ptr,
+                    uintptr_t poff, uint32_t prot)
+{
+	uint64_t f = poff ? TBL_FLAG_P : 0;
+	*tbl_ptr = mkentry(poff, f | pte_flags(space, prot));
+	invalidate(space, addr);
+}
+
+/* replace a large page of the given level by a table of smaller pages
+ * with the same translations, every small page keeps the reference it
+ * had as part of the large one
+ */
+static int split_large(uint64_t *entry, uint8_t level, uint64_t dir_flags)
+{
+	struct page *page;
+	int ret = pm_alloc_page(&page);
+	if (ret)
+		return ret;
+	uint64_t *tbl = PMAP(pm_page_addr(page));
+	uint64_t poff = LARGE_POFF(*entry);
+	uint64_t f = LARGE_FLAGS(*entry);
+	if (level == 1)
+		f = small_flags(f);
+	for (size_t i = 0; i < 512; ++i)
+		tbl[i] = mkentry(poff + i * LARGE_PAGES(level - 1), f);
+	*entry = mkentry(page->offset, dir_flags);
+	return 0;
+}
+
+/* get the entry of the given level (0 for small pages, 1 for 2MB pages,
+ * 2 for 1GB pages) mapping addr
+ */
+static int get_entry(struct vm_space *space, uintptr_t addr, uint8_t level,
+                     int flags, uint64_t **entry)
 {
 	uint64_t pte_id = PML_ID(addr);
 	uint64_t *pte = space ? PMAP(pm_page_addr(space->arch.dir_page)) : PMAP(kern_pml_page);
@@ -111,11 +188,11 @@ static int get_tbl_ptr(struct vm_space *space, uintptr_t addr, int create,
 	if (space)
 		f |= DIR_FLAG_US;
 	uint8_t shift = PDP_SHIFT;
-	for (size_t i = 0; i < 3; ++i)
+	for (uint8_t i = 3; i > level; --i)
 	{
 		if (!(pte[pte_id] & DIR_FLAG_P))
 		{
-			if (!create)
+			if (!(flags & WALK_CREATE))
 				return -EINVAL;
 			struct page *page;
 			int ret = pm_alloc_page(&page);
@@ -124,20 +201,94 @@ static int get_tbl_ptr(struct vm_space *space, uintptr_t addr, int create,
 			pte[pte_id] = mkentry(page->offset, f);
 			memset(PMAP(page->offset * PAGE_SIZE), 0, PAGE_SIZE);
 		}
+		else if (pte[pte_id] & DIR_FLAG_PS)
+		{
+			if (!(flags & WALK_SPLIT))
+				return -EINVAL;
+			int ret = split_large(&pte[pte_id], i, f);
+			if (ret)
+				return ret;
+		}
 		pte = PMAP(DIR_PADDR(pte[pte_id]));
 		pte_id = (addr >> shift) & 0x1FF;
 		shift -= 9;
 	}
-	*tbl_ptr = &pte[pte_id];
+	*entry = &pte[pte_id];
 	return 0;
 }
 
+static int get_tbl_ptr(struct vm_space *space, uintptr_t addr, int flags,
+                       uint64_t **tbl_ptr)
+{
+	return get_entry(space, addr, 0, flags, tbl_ptr);
+}
+
+/* get the large page mapping addr, if any */
+static int get_large(struct vm_space *space, uintptr_t addr,
+                     uint64_t **entry, uint8_t *level)
+{
+	uint64_t pte_id = PML_ID(addr);
+	uint64_t *pte = space ? PMAP(pm_page_addr(space->arch.dir_page)) : PMAP(kern_pml_page);
+	uint8_t shift = PDP_SHIFT;
+	for (uint8_t i = 3; i > 0; --i)
+	{
+		if (!(pte[pte_id] & DIR_FLAG_P))
+			return -EINVAL;
+		if (i < 3 && (pte[pte_id] & DIR_FLAG_PS))
+		{
+			*entry = &pte[pte_id];
+			*level = i;
+			return 0;
+		}
+		pte = PMAP(DIR_PADDR(pte[pte_id]));
+		pte_id = (addr >> shift) & 0x1FF;
+		shift -= 9;
+	}
+	return -EINVAL;
+}
+
+static void free_large(uint64_t entry, uint8_t level)
+{
+	uint64_t poff = LARGE_POFF(entry);
+	for (size_t i = 0; i < LARGE_PAGES(level); ++i)
+		pm_free_pt(poff + i);
+}
+
 void arch_vm_setspace(const struct vm_space *space)
 {
-	if (space)
-		setcr3(pm_page_addr(space->arch.dir_page));
-	else
+	int flush;
+	size_t asid = vm_tlb_asid(space, &flush);
+	if (!space)
+	{
 		setcr3(kern_pml_page);
+		return;
+	}
+	uint64_t cr3 = pm_page_addr(space->arch.dir_page);
+	if (has_pcid())
+	{
+		cr3 |= asid;
+		if (!flush)
+			cr3 |= CR3_NOFLUSH;
+	}
+	setcr3(cr3);
+}
+
+void arch_vm_tlb_flush(void)
+{
+	if (curcpu()->arch.cpuid.extf_0_ebx & CPUID_EXTF_0_EBX_INVPCID)
+	{
+		invpcid(INVPCID_ALL_GLOBAL, 0, 0);
+		return;
+	}
+	uintptr_t cr4 = getcr4();
+	if (cr4 & CR4_PGE)
+	{
+		/* toggling global pages flushes every pcid */
+		setcr4(cr4 & ~CR4_PGE);
+		setcr4(cr4);
+		return;
+	}
+	setcr3(getcr3());
 }
 
 int arch_vm_space_init(struct vm_space *space)
@@ -160,6 +311,11 @@ static void cleanup_level(uint64_t *pte, size_t min, size_t max, uint8_t level)
 		uint64_t entry = pte[i];
 		if (!(entry & DIR_FLAG_P))
 			continue;
+		if (level && (entry & DIR_FLAG_PS))
+		{
+			free_large(entry, level);
+			continue;
+		}
 		if (level)
 		{
 			uint64_t *nxt = PMAP(DIR_PADDR(entry));
@@ -189,6 +345,13 @@ static int dup_table(uint64_t *tbl_dst, uint64_t *tbl_src, uint64_t tbl_id)
 		                          tbl_src[tbl_id] & TBL_FLAG_MASK);
 		return 0;
 	}
+	if (page == g_zero_page)
+	{
+		pm_ref_page(page);
+		tbl_dst[tbl_id] = mkentry(src_poff,
+		                          tbl_src[tbl_id] & TBL_FLAG_MASK);
+		return 0;
+	}
 	int ret = pm_alloc_page(&page);
 	if (ret)
 		return ret;
@@ -203,38 +366,71 @@ static int dup_table(uint64_t *tbl_dst, uint64_t *tbl_src, uint64_t tbl_id)
 	return 0;
 }
 
+static int dup_large(uint64_t *dst, uint64_t *src, uint64_t id, uint8_t level)
+{
+	struct page *pages;
+	int ret = pm_alloc_pages(&pages, LARGE_PAGES(level));
+	if (ret)
+		return ret;
+	dst[id] = mkentry(pages->offset, LARGE_FLAGS(src[id]));
+	memcpy(PMAP(pm_page_addr(pages)),
+	       PMAP(LARGE_POFF(src[id]) * PAGE_SIZE),
+	       LARGE_SIZE(level));
+	return 0;
+}
+
 static int copy_level(uint64_t *dst, uint64_t *src, size_t min, size_t max,
                       uint8_t level)
 {
-	for (size_t i = min; i < max; ++i)
+	size_t i;
+	int ret;
+	for (i = min; i < max; ++i)
 	{
 		if (!(src[i] & DIR_FLAG_P))
 		{
 			dst[i] = src[i];
 			continue;
 		}
+		if (level && (src[i] & DIR_FLAG_PS))
+		{
+			if (!dup_large(dst, src, i, level))
+				continue;
+			/* no contiguous memory left: copy it page by page */
+			ret = split_large(&src[i], level,
+			                  DIR_FLAG_P | DIR_FLAG_RW | DIR_FLAG_US);
+			if (ret)
+				goto err;
+		}
 		if (level)
 		{
 			struct page *pte_page;
-			int ret = pm_alloc_page(&pte_page);
+			ret = pm_alloc_page(&pte_page);
 			if (ret)
-				return ret;
+				goto err;
 			dst[i] = mkentry(pte_page->offset,
 			                 src[i] & DIR_FLAG_MASK);
 			uint64_t *nxt_src = PMAP(DIR_PADDR(src[i]));
 			uint64_t *nxt_dst = PMAP(DIR_PADDR(dst[i]));
 			ret = copy_level(nxt_dst, nxt_src, 0, 512, level - 1);
 			if (ret)
-				return ret;
+			{
+				i++;
+				goto err;
+			}
 		}
 		else
 		{
-			int ret = dup_table(dst, src, i);
+			ret = dup_table(dst, src, i);
 			if (ret)
-				return ret;
+				goto err;
 		}
 	}
 	return 0;
+
+err:
+	/* the entries left are garbage, clear them for the cleanup */
+	memset(&dst[i], 0, (max - i) * sizeof(*dst));
+	return ret;
 }
 
 int arch_vm_space_copy(struct vm_space *dst, struct vm_space *src)
@@ -250,7 +446,7 @@ static int map_page(struct vm_space *space, uintptr_t addr, uintptr_t poff,
 	assert(poff, "vmap null page\n");
 	assert(!(addr & PAGE_MASK), "unaligned vmap %#lx\n", addr);
 	uint64_t *tbl_ptr;
-	int ret = get_tbl_ptr(space, addr, 1, &tbl_ptr);
+	int ret = get_tbl_ptr(space, addr, WALK_CREATE, &tbl_ptr);
 	if (ret)
 	{
 		TRACE("failed to get vmap ptr");
@@ -289,11 +485,35 @@ int arch_vm_map(struct vm_space *space, uintptr_t addr, uintptr_t poff,
 	return 0;
 }
 
+int arch_vm_map_large(struct vm_space *space, uintptr_t addr, uintptr_t poff,
+                      uint32_t prot)
+{
+	assert(!(addr & (LARGE_SIZE(1) - 1)), "unaligned large vmap %#lx\n", addr);
+	assert(!(poff & (LARGE_PAGES(1) - 1)), "unaligned large poff %#lx\n", poff);
+	uint64_t *entry;
+	int ret = get_entry(space, addr, 1, WALK_CREATE, &entry);
+	if (ret)
+		return ret;
+	/* the range may still have an (empty) table of small pages */
+	if (*entry & DIR_FLAG_P)
+		return -EINVAL;
+	*entry = mkentry(poff, DIR_FLAG_P | large_flags(pte_flags(space, prot)));
+	invalidate(space, addr);
+	for (size_t i = 0; i < LARGE_PAGES(1); ++i)
+	{
+		struct page *page = pm_get_page(poff + i);
+		if (page)
+			pm_ref_page(page);
+	}
+	return 0;
+}
+
 static int unmap_page(struct vm_space *space, uintptr_t addr)
 {
 	uint64_t *tbl_ptr;
-	if (get_tbl_ptr(space, addr, 0, &tbl_ptr))
-		return 0;
+	int ret = get_tbl_ptr(space, addr, WALK_SPLIT, &tbl_ptr);
+	if (ret)
+		return ret == -EINVAL ? 0 : ret;
 	if (*tbl_ptr & TBL_FLAG_P)
 		pm_free_pt(TBL_POFF(*tbl_ptr));
 	*tbl_ptr = mkentry(0, 0);
@@ -304,17 +524,60 @@ static int unmap_page(struct vm_space *space, uintptr_t addr)
 int arch_vm_unmap(struct vm_space *space, uintptr_t addr, size_t size)
 {
 	/* XXX optimize pte tree */
-	for (size_t i = 0; i < size; i += PAGE_SIZE)
-		unmap_page(space, addr + i);
+	size_t i = 0;
+	while (i < size)
+	{
+		uint64_t *entry;
+		uint8_t level;
+		if (!get_large(space, addr + i, &entry, &level)
+		 && !((addr + i) & (LARGE_SIZE(level) - 1))
+		 && size - i >= LARGE_SIZE(level))
+		{
+			free_large(*entry, level);
+			*entry = mkentry(0, 0);
+			invalidate(space, addr + i);
+			i += LARGE_SIZE(level);
+			continue;
+		}
+		int ret = unmap_page(space, addr + i);
+		if (ret)
+		{
+			TRACE("failed to split large page");
+			return ret;
+		}
+		i += PAGE_SIZE;
+	}
 	return 0;
 }
 
-static int protect_page(struct vm_space *space, uintptr_t addr, uint32_t prot)
+int arch_vm_lookup(struct vm_space *space, uintptr_t addr, uintptr_t *poff)
 {
+	uint64_t *entry;
+	uint8_t level;
+	if (!get_large(space, addr, &entry, &level))
+	{
+		*poff = LARGE_POFF(*entry) + ((addr >> TBL_SHIFT) & (LARGE_PAGES(level) - 1));
+		return 0;
+	}
 	uint64_t *tbl_ptr;
 	int ret = get_tbl_ptr(space, addr, 0, &tbl_ptr);
 	if (ret)
-		return 0;
+		return ret;
+	if (!(*tbl_ptr & TBL_FLAG_P))
+		return -EINVAL;
+	*poff = TBL_POFF(*tbl_ptr);
+	return 0;
+}
+
+static int protect_page(struct vm_space *space, uintptr_t addr, uint32_t prot)
+{
+	uint64_t *tbl_ptr;
+	int ret = get_tbl_ptr(space, addr, WALK_SPLIT, &tbl_ptr);
+	if (ret)
+		return ret == -EINVAL ? 0 : ret;
+	/* the zero page stays read-only until written to */
+	if (TBL_POFF(*tbl_ptr) == g_zero_page->offset)
+		prot &= ~VM_PROT_W;
 	set_pte(space, addr, tbl_ptr, TBL_POFF(*tbl_ptr), prot);
 	return 0;
 }
@@ -323,46 +586,125 @@ int arch_vm_protect(struct vm_space *space, uintptr_t addr, size_t size,
                     uint32_t prot)
 {
 	/* XXX optimize pte tree */
-	for (size_t i = 0; i < size; i += PAGE_SIZE)
-		protect_page(space, addr + i, prot);
+	size_t i = 0;
+	while (i < size)
+	{
+		uint64_t *entry;
+		uint8_t level;
+		if (!get_large(space, addr + i, &entry, &level)
+		 && !((addr + i) & (LARGE_SIZE(level) - 1))
+		 && size - i >= LARGE_SIZE(level))
+		{
+			*entry = mkentry(LARGE_POFF(*entry),
+			                 DIR_FLAG_P | large_flags(pte_flags(space, prot)));
+			invalidate(space, addr + i);
+			i += LARGE_SIZE(level);
+			continue;
+		}
+		int ret = protect_page(space, addr + i, prot);
+		if (ret)
+		{
+			TRACE("failed to split large page");
+			return ret;
+		}
+		i += PAGE_SIZE;
+	}
+	return 0;
+}
+
+static int check_prot(uint64_t entry, uint32_t prot)
+{
+	if (prot & VM_PROT_X)
+	{
+		if (entry & TBL_FLAG_XD)
+			return -EFAULT;
+	}
+	else if (prot & VM_PROT_W)
+	{
+		if (!(entry & TBL_FLAG_RW))
+			return -EFAULT;
+	}
+	return 0;
+}
+
+/* back the whole aligned range around addr with a single large page if
+ * it is private anonymous memory which hasn't been touched yet
+ */
+static int populate_large(struct vm_space *space, uintptr_t addr,
+                          uint64_t *poffp)
+{
+	uintptr_t base = addr & ~(LARGE_SIZE(1) - 1);
+	uint64_t *entry;
+	int ret = get_entry(space, base, 1, WALK_CREATE, &entry);
+	if (ret)
+		return ret;
+	if (*entry & DIR_FLAG_P)
+		return -EINVAL;
+	struct vm_zone *zone;
+	struct page *pages;
+	ret = vm_fault_large(space, base, &pages, &zone);
+	if (ret)
+		return ret;
+	*entry = mkentry(pages->offset,
+	                 DIR_FLAG_P | large_flags(pte_flags(space, zone->prot)));
+	invalidate(space, base);
+	*poffp = pages->offset + TBL_ID(addr);
 	return 0;
 }
 
 int arch_vm_populate_page(struct vm_space *space, uintptr_t addr,
                           uint32_t prot, uintptr_t *poffp)
 {
+	uint64_t poff;
+	uint64_t *entry;
+	uint8_t level;
+	int ret;
+	if (!get_large(space, addr, &entry, &level))
+	{
+		ret = check_prot(*entry, prot);
+		if (ret)
+			return ret;
+		poff = LARGE_POFF(*entry) + ((addr >> TBL_SHIFT) & (LARGE_PAGES(level) - 1));
+		goto end;
+	}
+	if (space && (prot & VM_PROT_W) && !populate_large(space, addr, &poff))
+		goto end;
 	uint64_t *tbl_ptr;
-	int ret = get_tbl_ptr(space, addr, 1, &tbl_ptr);
+	ret = get_tbl_ptr(space, addr, WALK_CREATE, &tbl_ptr);
 	if (ret)
 	{
 		TRACE("failed to get tbl ptr");
 		return ret;
 	}
-	uint64_t poff;
 	if (*tbl_ptr & TBL_FLAG_P)
 	{
-		if (prot & VM_PROT_X)
-		{
-			if (*tbl_ptr & TBL_FLAG_XD)
-				return -EFAULT;
-		}
-		else if (prot & VM_PROT_W)
+		poff = TBL_POFF(*tbl_ptr);
+		ret = check_prot(*tbl_ptr, prot);
+		if (ret)
 		{
-			if (!(*tbl_ptr & TBL_FLAG_RW))
-				return -EFAULT;
+			if (!(prot & VM_PROT_W))
+				return ret;
+			struct page *page;
+			uint32_t map_prot;
+			ret = vm_fault_write(space, addr, poff, &page, &map_prot);
+			if (ret)
+				return ret;
+			poff = page->offset;
+			set_pte(space, addr, tbl_ptr, poff, map_prot);
+			vm_tlb_shootdown(space);
 		}
-		poff = TBL_POFF(*tbl_ptr);
 	}
 	else
 	{
-		struct vm_zone *zone;
 		struct page *page;
-		ret = vm_fault_page(space, addr, &page, &zone);
+		uint32_t map_prot;
+		ret = vm_fault_page(space, addr, prot, &page, &map_prot);
 		if (ret)
 			return ret;
 		poff = page->offset;
-		set_pte(space, addr, tbl_ptr, poff, zone->prot);
+		set_pte(space, addr, tbl_ptr, poff, map_prot);
 	}
+end:
 	if (poffp)
 		*poffp = poff;
 	return 0;
@@ -375,25 +717,27 @@ void arch_init_copy_zone(struct arch_copy_zone *zone)
 	if (ret)
 		panic("failed to alloc zero page\n");
 	mutex_unlock(&g_vm_mutex);
-	ret = get_tbl_ptr(NULL, (uintptr_t)zone->ptr, 1, &zone->tbl_ptr);
+	ret = get_tbl_ptr(NULL, (uintptr_t)zone->ptr, WALK_CREATE,
+	                  &zone->tbl_ptr);
 	if (ret)
 		panic("failed to get zero page tbl ptr\n");
 }
 
 void arch_set_copy_zone(struct arch_copy_zone *zone, uintptr_t poff)
 {
-	*zone->tbl_ptr = mkentry(poff, TBL_FLAG_P | TBL_FLAG_RW | TBL_FLAG_XD);
+	*zone->tbl_ptr = mkentry(poff, TBL_FLAG_P | TBL_FLAG_RW | TBL_FLAG_XD
+	                             | TBL_FLAG_G);
 	invlpg((uintptr_t)zone->ptr);
 }
 
-static void map_early(uintptr_t addr, uint64_t poff,
+static void map_early(uintptr_t addr, uint64_t poff, uint8_t level,
                       uintptr_t base, size_t *used)
 {
 	static uint64_t prev_pte[3] = {0, 0, 0};
 	uint64_t pte_id = PML_ID(addr);
 	uint64_t *pte = (uint64_t*)kern_pml_page;
 	uint8_t shift = PDP_SHIFT;
-	for (size_t j = 0; j < 3; ++j)
+	for (size_t j = 0; j < 3u - level; ++j)
 	{
 		if (!(pte[pte_id] & DIR_FLAG_P))
 		{
@@ -421,15 +765,32 @@ static void map_early(uintptr_t addr, uint64_t poff,
 		pte_id = (addr >> shift) & 0x1FF;
 		shift -= 9;
 	}
-	pte[pte_id] = mkentry(poff, TBL_FLAG_P | TBL_FLAG_RW | TBL_FLAG_XD);
+	uint64_t f = TBL_FLAG_P | TBL_FLAG_RW | TBL_FLAG_XD | TBL_FLAG_G;
+	if (level)
+		f |= DIR_FLAG_PS;
+	pte[pte_id] = mkentry(poff, f);
 	invlpg(addr);
 }
 
+/* the physical map uses the largest pages available: aligned 1GB and 2MB
+ * ranges don't need any page table, and use a single tlb entry
+ */
 void arch_pm_init_pmap(uintptr_t base, size_t count, size_t *used)
 {
-	for (size_t i = 0; i < count; ++i)
-		map_early((uintptr_t)PMAP(PAGE_SIZE * (base + i)),
-		          base + i, base, used);
+	uint8_t max_level = 1;
+	if (curcpu()->arch.cpuid.ext_edx & CPUID_EXT_EDX_PDPE1GB)
+		max_level = 2;
+	size_t i = 0;
+	while (i < count)
+	{
+		uint64_t poff = base + i;
+		uint8_t level = max_level;
+		while (level && ((poff & (LARGE_PAGES(level) - 1))
+		              || count - i < LARGE_PAGES(level)))
+			level--;
+		map_early((uintptr_t)PMAP(PAGE_SIZE * poff), poff, level, base, used);
+		i += LARGE_PAGES(level);
+	}
 }
 
 void arch_paging_init(void)
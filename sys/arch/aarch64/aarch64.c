@@ -63,7 +63,10 @@ static void aarch64_device_probe(struct acpi_obj *device, void *userdata)
 void arch_cpu_boot(struct cpu *cpu)
 {
 	if (!cpu->id)
+	{
 		g_early_printf = early_printf_uart;
+		cpu->arch.mpidr = get_mpidr_el1();
+	}
 	set_cpacr_el1(get_cpacr_el1() | (3 << 20)); /* fpen */
 	set_tpidr_el1(cpu);
 	set_vbar(&trap_vector);
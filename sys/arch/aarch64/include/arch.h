@@ -66,4 +66,11 @@ static inline void arch_spin_yield(void)
 	__asm__ volatile ("yield" : : : "memory");
 }
 
+static inline uint64_t arch_get_cycles(void)
+{
+	uint64_t val;
+	__asm__ volatile ("mrs %0, cntvct_el0" : "=r"(val));
+	return val;
+}
+
 #endif
@@ -48,6 +48,11 @@ static inline void tlbi_vmalle1is(void)
 	__asm__ volatile ("tlbi vmalle1is" : : : "memory");
 }
 
+static inline void tlbi_aside1(uint64_t asid)
+{
+	__asm__ volatile ("tlbi aside1, %0" : : "r"(asid << 48) : "memory");
+}
+
 static inline void *get_tpidr_el1(void)
 {
 	void *ptr;
@@ -65,6 +70,11 @@ static inline void set_tpidr_el0(uintptr_t val)
 	__asm__ volatile ("msr tpidr_el0, %0" : : "r"(val));
 }
 
+static inline void set_tpidrro_el0(uintptr_t val)
+{
+	__asm__ volatile ("msr tpidrro_el0, %0" : : "r"(val));
+}
+
 static inline void set_ttbr0_el1(uintptr_t val)
 {
 	__asm__ volatile ("msr ttbr0_el1, %0" : : "r"(val));
@@ -133,6 +143,18 @@ static inline uint64_t get_cntvct_el0(void)
 	return val;
 }
 
+static inline uint64_t get_cntkctl_el1(void)
+{
+	uintptr_t val;
+	__asm__ volatile ("mrs %0, cntkctl_el1" : "=r"(val));
+	return val;
+}
+
+static inline void set_cntkctl_el1(uintptr_t val)
+{
+	__asm__ volatile ("msr cntkctl_el1, %0" : : "r"(val));
+}
+
 static inline uint64_t get_mdscr_el1(void)
 {
 	uintptr_t val;
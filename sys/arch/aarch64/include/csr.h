@@ -43,4 +43,7 @@
 #define FPSR_Z   (1 << 30)
 #define FPSR_N   (1 << 31)
 
+#define CNTKCTL_EL0PCTEN (1 << 0)
+#define CNTKCTL_EL0VCTEN (1 << 1)
+
 #endif
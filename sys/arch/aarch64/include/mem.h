@@ -1,6 +1,11 @@
 #ifndef ARCH_MEM_H
 #define ARCH_MEM_H
 
+/* tlb invalidations are broadcast to every cpu of the inner shareable
+ * domain, there is no need for shootdowns
+ */
+#define ARCH_VM_TLB_BROADCAST
+
 struct page;
 
 struct arch_vm_space
@@ -4,6 +4,7 @@
 #include <arch/asm.h>
 
 #include <sched.h>
+#include <prof.h>
 #include <proc.h>
 #include <std.h>
 #include <irq.h>
@@ -281,6 +282,7 @@ void aarch64_trap_handle(uint64_t type, uint64_t esr)
 void handle_ipi(void *userdata)
 {
 	(void)userdata;
+	prof_ipi();
 	if (__atomic_exchange_n(&curcpu()->must_resched, 0, __ATOMIC_SEQ_CST))
 		sched_resched();
 }
@@ -70,7 +70,7 @@ static void set_dir0(struct vm_space *space, uint64_t addr, uint64_t *dir0_ptr,
 {
 	uint64_t f = poff ? (DIR_FLAG_P | DIR_FLAG_AF) : 0;
 	if (space)
-		f |= DIR_FLAG_US;
+		f |= DIR_FLAG_US | DIR_FLAG_NG;
 	if (!(prot & VM_PROT_W))
 		f |= DIR_FLAG_RO;
 	if (!(prot & VM_PROT_X))
@@ -86,14 +86,8 @@ static void set_dir0(struct vm_space *space, uint64_t addr, uint64_t *dir0_ptr,
 	else
 		f |= DIR_FLAG_ATTR(1);
 	*dir0_ptr = mkentry(poff, f);
-	if (!space)
-	{
-		invalidate(addr);
-		return;
-	}
-	struct thread *thread = curcpu()->thread;
-	if (thread && space == thread->proc->vm_space)
-		invalidate(addr);
+	/* the space may be running on another cpu, with any asid */
+	invalidate(addr);
 }
 
 static int get_dir0_ptr(struct vm_space *space, uintptr_t addr, int create,
@@ -125,11 +119,24 @@ static int get_dir0_ptr(struct vm_space *space, uintptr_t addr, int create,
 
 void arch_vm_setspace(const struct vm_space *space)
 {
+	int flush;
+	uint64_t asid = vm_tlb_asid(space, &flush);
 	if (space)
-		set_ttbr0_el1(pm_page_addr(space->arch.dir_page));
+		set_ttbr0_el1(pm_page_addr(space->arch.dir_page) | (asid << 48));
 	else
 		set_ttbr0_el1(0); /* XXX does it even make sense at all ? */
 	isb();
+	if (!flush)
+		return;
+	dsb_ishst();
+	tlbi_aside1(asid);
+	dsb_ish();
+	isb();
+}
+
+void arch_vm_tlb_flush(void)
+{
+	dsb_ishst();
 	tlbi_vmalle1();
 	dsb_ish();
 	isb();
@@ -180,6 +187,13 @@ static int dup_table(uint64_t *dir0_dst, uint64_t *dir0_src, uint64_t dir0_id)
 		                            dir0_src[dir0_id] & DIR_FLAG_MASK);
 		return 0;
 	}
+	if (page == g_zero_page)
+	{
+		pm_ref_page(page);
+		dir0_dst[dir0_id] = mkentry(src_poff,
+		                            dir0_src[dir0_id] & DIR_FLAG_MASK);
+		return 0;
+	}
 	int ret = pm_alloc_page(&page);
 	if (ret)
 		return ret;
@@ -197,7 +211,9 @@ static int dup_table(uint64_t *dir0_dst, uint64_t *dir0_src, uint64_t dir0_id)
 static int copy_level(uint64_t *dst, uint64_t *src, size_t min, size_t max,
                       uint8_t level)
 {
-	for (size_t i = min; i < max; ++i)
+	size_t i;
+	int ret;
+	for (i = min; i < max; ++i)
 	{
 		if (!(src[i] & DIR_FLAG_P))
 		{
@@ -207,25 +223,33 @@ static int copy_level(uint64_t *dst, uint64_t *src, size_t min, size_t max,
 		if (level)
 		{
 			struct page *pte_page;
-			int ret = pm_alloc_page(&pte_page);
+			ret = pm_alloc_page(&pte_page);
 			if (ret)
-				return ret;
+				goto err;
 			dst[i] = mkentry(pte_page->offset,
 			                 src[i] & DIR_FLAG_MASK);
 			uint64_t *nxt_src = PMAP(DIR_PADDR(src[i]));
 			uint64_t *nxt_dst = PMAP(DIR_PADDR(dst[i]));
 			ret = copy_level(nxt_dst, nxt_src, 0, 512, level - 1);
 			if (ret)
-				return ret;
+			{
+				i++;
+				goto err;
+			}
 		}
 		else
 		{
-			int ret = dup_table(dst, src, i);
+			ret = dup_table(dst, src, i);
 			if (ret)
-				return ret;
+				goto err;
 		}
 	}
 	return 0;
+
+err:
+	/* the entries left are garbage, clear them for the cleanup */
+	memset(&dst[i], 0, (max - i) * sizeof(*dst));
+	return ret;
 }
 
 int arch_vm_space_copy(struct vm_space *dst, struct vm_space *src)
@@ -300,12 +324,27 @@ int arch_vm_unmap(struct vm_space *space, uintptr_t addr, size_t size)
 	return 0;
 }
 
+int arch_vm_lookup(struct vm_space *space, uintptr_t addr, uintptr_t *poff)
+{
+	uint64_t *dir0_ptr;
+	int ret = get_dir0_ptr(space, addr, 0, &dir0_ptr);
+	if (ret)
+		return ret;
+	if (!(*dir0_ptr & DIR_FLAG_P))
+		return -EINVAL;
+	*poff = DIR_POFF(*dir0_ptr);
+	return 0;
+}
+
 static int protect_page(struct vm_space *space, uintptr_t addr, uint32_t prot)
 {
 	uint64_t *dir0_ptr;
 	int ret = get_dir0_ptr(space, addr, 0, &dir0_ptr);
 	if (ret)
 		return 0;
+	/* the zero page stays read-only until written to */
+	if (DIR_POFF(*dir0_ptr) == g_zero_page->offset)
+		prot &= ~VM_PROT_W;
 	set_dir0(space, addr, dir0_ptr, DIR_POFF(*dir0_ptr), prot);
 	return 0;
 }
@@ -332,6 +371,7 @@ int arch_vm_populate_page(struct vm_space *space, uintptr_t addr,
 	uint64_t poff;
 	if (*dir0_ptr & DIR_FLAG_P)
 	{
+		poff = DIR_POFF(*dir0_ptr);
 		if (prot & VM_PROT_X)
 		{
 			if (*dir0_ptr & (DIR_FLAG_PXN | DIR_FLAG_UXN))
@@ -340,19 +380,28 @@ int arch_vm_populate_page(struct vm_space *space, uintptr_t addr,
 		else if (prot & VM_PROT_W)
 		{
 			if (*dir0_ptr & DIR_FLAG_RO)
-				return -EFAULT;
+			{
+				struct page *page;
+				uint32_t map_prot;
+				ret = vm_fault_write(space, addr, poff, &page,
+				                     &map_prot);
+				if (ret)
+					return ret;
+				poff = page->offset;
+				set_dir0(space, addr, dir0_ptr, poff, map_prot);
+				vm_tlb_shootdown(space);
+			}
 		}
-		poff = DIR_POFF(*dir0_ptr);
 	}
 	else
 	{
-		struct vm_zone *zone;
 		struct page *page;
-		ret = vm_fault_page(space, addr, &page, &zone);
+		uint32_t map_prot;
+		ret = vm_fault_page(space, addr, prot, &page, &map_prot);
 		if (ret)
 			return ret;
 		poff = page->offset;
-		set_dir0(space, addr, dir0_ptr, poff, zone->prot);
+		set_dir0(space, addr, dir0_ptr, poff, map_prot);
 	}
 	if (poffp)
 		*poffp = poff;
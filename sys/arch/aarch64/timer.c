@@ -5,6 +5,7 @@
 #include <std.h>
 
 static const struct clock_source clock_source;
+static struct clock_counter counter;
 static struct irq_handle vtimer_irq;
 static size_t freq;
 static uint64_t base;
@@ -43,6 +44,8 @@ void timer_init(void)
 	freq = get_cntfrq_el0();
 	base = get_cntvct_el0();
 	current = base;
+	counter.freq = freq;
+	counter.base = base;
 	interval = freq / FREQUENCY;
 	interval_rem = freq % FREQUENCY;
 	set_cntv_cval_el0(base + interval);
@@ -79,6 +82,16 @@ static int settime(struct timespec *ts)
 	return 0;
 }
 
+static uint64_t read_counter(void)
+{
+	return get_cntvct_el0();
+}
+
+static struct clock_counter counter =
+{
+	.read = read_counter,
+};
+
 static const struct clock_source clock_source =
 {
 	.name = "vtimer",
@@ -86,4 +99,5 @@ static const struct clock_source clock_source =
 	.getres = getres,
 	.gettime = gettime,
 	.settime = settime,
+	.counter = &counter,
 };
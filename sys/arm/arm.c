@@ -91,6 +91,7 @@ void arch_cpu_boot(struct cpu *cpu)
 	{
 		kern_l1t_page = get_ttbr0();
 		g_early_printf = early_printf_uart;
+		cpu->arch.mpidr = get_mpidr();
 	}
 	set_cpacr(get_cpacr() | (3 << (10 * 2))); /* enable cp10 */
 	set_cpacr(get_cpacr() | (3 << (11 * 2))); /* enable cp11 */
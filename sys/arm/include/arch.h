@@ -59,4 +59,12 @@ static inline void arch_spin_yield(void)
 	__asm__ volatile ("yield" : : : "memory");
 }
 
+static inline uint64_t arch_get_cycles(void)
+{
+	uint32_t lo;
+	uint32_t hi;
+	__asm__ volatile ("mrrc p15, 1, %0, %1, c14" : "=r"(lo), "=r"(hi));
+	return ((uint64_t)hi << 32) | lo;
+}
+
 #endif
@@ -79,6 +79,18 @@ static inline uintptr_t get_cntfrq(void)
 	return val;
 }
 
+static inline uintptr_t get_cntkctl(void)
+{
+	uintptr_t val;
+	__asm__ volatile ("mrc p15, 0, %0, c14, c1, 0" : "=r"(val));
+	return val;
+}
+
+static inline void set_cntkctl(uintptr_t val)
+{
+	__asm__ volatile ("mcr p15, 0, %0, c14, c1, 0" : : "r"(val));
+}
+
 static inline void set_cntv_cval(uint64_t val)
 {
 	__asm__ volatile ("mcrr p15, 3, %0, %1, c14" : : "r"(val), "r"(val >> 32));
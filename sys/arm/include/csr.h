@@ -21,4 +21,7 @@
 #define PSR_Z     (1 << 30)
 #define PSR_N     (1 << 31)
 
+#define CNTKCTL_PL0PCTEN (1 << 0)
+#define CNTKCTL_PL0VCTEN (1 << 1)
+
 #endif
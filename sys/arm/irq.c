@@ -4,6 +4,7 @@
 #include <arch/asm.h>
 
 #include <sched.h>
+#include <prof.h>
 #include <proc.h>
 #include <cpu.h>
 #include <irq.h>
@@ -238,6 +239,7 @@ void arm_trap_handle(uint32_t type)
 void handle_ipi(void *userdata)
 {
 	(void)userdata;
+	prof_ipi();
 	if (__atomic_exchange_n(&curcpu()->must_resched, 0, __ATOMIC_SEQ_CST))
 		sched_resched();
 }
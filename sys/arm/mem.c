@@ -153,6 +153,8 @@ static int get_l2t_ptr(struct vm_space *space, uintptr_t addr, int create,
 
 void arch_vm_setspace(const struct vm_space *space)
 {
+	int flush;
+	vm_tlb_asid(space, &flush);
 	if (space)
 		set_ttbr0(space->arch.l1t_paddr);
 	else
@@ -162,6 +164,13 @@ void arch_vm_setspace(const struct vm_space *space)
 	dsb();
 }
 
+void arch_vm_tlb_flush(void)
+{
+	dsb();
+	tlbiall();
+	dsb();
+}
+
 static int alloc_l1t(struct vm_space *space)
 {
 	struct page *page;
@@ -231,6 +240,13 @@ static int dup_l2t(uint32_t *l2t_dst, uint32_t *l2t_src, uint32_t l2t_id)
 		                          l2t_src[l2t_id] & L2T_FLAG_MASK);
 		return 0;
 	}
+	if (page == g_zero_page)
+	{
+		pm_ref_page(page);
+		l2t_dst[l2t_id] = mkentry(src_poff,
+		                          l2t_src[l2t_id] & L2T_FLAG_MASK);
+		return 0;
+	}
 	int ret = pm_alloc_page(&page);
 	if (ret)
 		return ret;
@@ -264,21 +280,15 @@ int arch_vm_space_copy(struct vm_space *dst, struct vm_space *src)
 		struct page *l2t_page;
 		ret = pm_alloc_page(&l2t_page);
 		if (ret)
-			goto err;
+			return ret;
 		uint32_t *l2t_dst = vm_map(l2t_page, PAGE_SIZE, VM_PROT_W);
 		pm_free_page(l2t_page);
 		if (!l2t_dst)
 		{
 			TRACE("failed to vmap dst l2t");
-			goto err;
+			return -ENOMEM;
 		}
 		uint32_t *l2t_src = src->arch.l2t[i * 4];
-		if (!l2t_src)
-		{
-			TRACE("failed to vmap src l2t");
-			vm_unmap(l2t_dst, PAGE_SIZE);
-			goto err;
-		}
 		for (size_t j = 0; j < 1024; ++j)
 		{
 			if (!(l2t_src[j] & L2T_FLAG_P))
@@ -289,8 +299,9 @@ int arch_vm_space_copy(struct vm_space *dst, struct vm_space *src)
 			ret = dup_l2t(l2t_dst, l2t_src, j);
 			if (ret)
 			{
-				vm_unmap(l2t_dst, PAGE_SIZE);
-				goto err;
+				/* keep the partial copy for the cleanup */
+				memset(&l2t_dst[j], 0, (1024 - j) * sizeof(*l2t_dst));
+				break;
 			}
 		}
 		for (size_t j = 0; j < 4; ++j)
@@ -300,12 +311,10 @@ int arch_vm_space_copy(struct vm_space *dst, struct vm_space *src)
 			                         | (1024 * j)
 			                         | (src->arch.l1t[i * 4 + j] & L1T_FLAG_MASK);
 		}
+		if (ret)
+			return ret;
 	}
 	return 0;
-
-err:
-	panic("should cleanup\n"); /* XXX */
-	return ret;
 }
 
 static int map_page(struct vm_space *space, uintptr_t addr, uintptr_t poff,
@@ -373,12 +382,27 @@ int arch_vm_unmap(struct vm_space *space, uintptr_t addr, size_t size)
 	return 0;
 }
 
+int arch_vm_lookup(struct vm_space *space, uintptr_t addr, uintptr_t *poff)
+{
+	uint32_t *l2t_ptr;
+	int ret = get_l2t_ptr(space, addr, 0, &l2t_ptr);
+	if (ret)
+		return ret;
+	if (!(*l2t_ptr & L2T_FLAG_P))
+		return -EINVAL;
+	*poff = L2T_POFF(*l2t_ptr);
+	return 0;
+}
+
 static int protect_page(struct vm_space *space, uintptr_t addr, uint32_t prot)
 {
 	uint32_t *l2t_ptr;
 	int ret = get_l2t_ptr(space, addr, 0, &l2t_ptr);
 	if (ret)
 		return 0;
+	/* the zero page stays read-only until written to */
+	if (L2T_POFF(*l2t_ptr) == g_zero_page->offset)
+		prot &= ~VM_PROT_W;
 	set_l2t(space, addr, l2t_ptr, L2T_POFF(*l2t_ptr), prot);
 	return 0;
 }
@@ -405,6 +429,7 @@ int arch_vm_populate_page(struct vm_space *space, uintptr_t addr,
 	uint32_t poff;
 	if (*l2t_ptr & L2T_FLAG_P)
 	{
+		poff = L2T_POFF(*l2t_ptr);
 		if (prot & VM_PROT_X)
 		{
 			if (*l2t_ptr & L2T_FLAG_NX)
@@ -413,24 +438,33 @@ int arch_vm_populate_page(struct vm_space *space, uintptr_t addr,
 		else if (prot & VM_PROT_W)
 		{
 			if (((*l2t_ptr >> 4) & 0x3) < 3)
-				return -EFAULT;
+			{
+				struct page *page;
+				uint32_t map_prot;
+				ret = vm_fault_write(space, addr, poff, &page,
+				                     &map_prot);
+				if (ret)
+					return ret;
+				poff = page->offset;
+				set_l2t(space, addr, l2t_ptr, poff, map_prot);
+				vm_tlb_shootdown(space);
+			}
 		}
 		else
 		{
 			if (((*l2t_ptr >> 4) & 0x3) < 2)
 				return -EFAULT;
 		}
-		poff = L2T_POFF(*l2t_ptr);
 	}
 	else
 	{
-		struct vm_zone *zone;
 		struct page *page;
-		ret = vm_fault_page(space, addr, &page, &zone);
+		uint32_t map_prot;
+		ret = vm_fault_page(space, addr, prot, &page, &map_prot);
 		if (ret)
 			return ret;
 		poff = page->offset;
-		set_l2t(space, addr, l2t_ptr, poff, zone->prot);
+		set_l2t(space, addr, l2t_ptr, poff, map_prot);
 	}
 	if (poffp)
 		*poffp = poff;
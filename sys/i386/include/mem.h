@@ -1,6 +1,11 @@
 #ifndef ARCH_MEM_H
 #define ARCH_MEM_H
 
+/* user memory of the current space is accessed directly, faults being
+ * caught by the copy routines
+ */
+#define ARCH_COPY_USER
+
 #include <types.h>
 
 struct arch_vm_space
@@ -135,12 +135,19 @@ static int get_tbl_ptr(struct vm_space *space, uint32_t addr, int create,
 
 void arch_vm_setspace(const struct vm_space *space)
 {
+	int flush;
+	vm_tlb_asid(space, &flush);
 	if (space)
 		setcr3(pm_page_addr(space->arch.dir_page));
 	else
 		setcr3(kern_dir_page);
 }
 
+void arch_vm_tlb_flush(void)
+{
+	setcr3(getcr3());
+}
+
 int arch_vm_space_init(struct vm_space *space)
 {
 	int ret = pm_alloc_page(&space->arch.dir_page);
@@ -195,6 +202,13 @@ static int dup_table(uint32_t *tbl_dst, uint32_t *tbl_src, uint32_t tbl_id)
 		                          tbl_src[tbl_id] & TBL_FLAG_MASK);
 		return 0;
 	}
+	if (page == g_zero_page)
+	{
+		pm_ref_page(page);
+		tbl_dst[tbl_id] = mkentry(src_poff,
+		                          tbl_src[tbl_id] & TBL_FLAG_MASK);
+		return 0;
+	}
 	int ret = pm_alloc_page(&page);
 	if (ret)
 		return ret;
@@ -233,15 +247,10 @@ int arch_vm_space_copy(struct vm_space *dst, struct vm_space *src)
 		if (!tbl_dst)
 		{
 			TRACE("failed to vmap dst tbl");
-			return ret;
+			dst->arch.dir[i] = 0;
+			return -ENOMEM;
 		}
 		uint32_t *tbl_src = src->arch.tbl[i];
-		if (!tbl_src)
-		{
-			TRACE("failed to vmap src tbl");
-			vm_unmap(tbl_dst, PAGE_SIZE);
-			return ret;
-		}
 		for (size_t j = 0; j < 1024; ++j)
 		{
 			if (!(tbl_src[j] & TBL_FLAG_P))
@@ -252,11 +261,14 @@ int arch_vm_space_copy(struct vm_space *dst, struct vm_space *src)
 			ret = dup_table(tbl_dst, tbl_src, j);
 			if (ret)
 			{
-				vm_unmap(tbl_dst, PAGE_SIZE);
-				return ret;
+				/* keep the partial copy for the cleanup */
+				memset(&tbl_dst[j], 0, (1024 - j) * sizeof(*tbl_dst));
+				break;
 			}
 		}
 		dst->arch.tbl[i] = tbl_dst;
+		if (ret)
+			return ret;
 	}
 	return 0;
 }
@@ -323,12 +335,27 @@ int arch_vm_unmap(struct vm_space *space, uintptr_t addr, size_t size)
 	return 0;
 }
 
+int arch_vm_lookup(struct vm_space *space, uintptr_t addr, uintptr_t *poff)
+{
+	uint32_t *tbl_ptr;
+	int ret = get_tbl_ptr(space, addr, 0, &tbl_ptr);
+	if (ret)
+		return ret;
+	if (!(*tbl_ptr & TBL_FLAG_P))
+		return -EINVAL;
+	*poff = TBL_POFF(*tbl_ptr);
+	return 0;
+}
+
 static int protect_page(struct vm_space *space, uintptr_t addr, uint32_t prot)
 {
 	uint32_t *tbl_ptr;
 	int ret = get_tbl_ptr(space, addr, 0, &tbl_ptr);
 	if (ret)
 		return ret;
+	/* the zero page stays read-only until written to */
+	if (TBL_POFF(*tbl_ptr) == g_zero_page->offset)
+		prot &= ~VM_PROT_W;
 	set_tbl(space, addr, tbl_ptr, TBL_POFF(*tbl_ptr), prot);
 	return 0;
 }
@@ -352,22 +379,32 @@ int arch_vm_populate_page(struct vm_space *space, uintptr_t addr,
 	uint32_t poff;
 	if (*tbl_ptr & TBL_FLAG_P)
 	{
+		poff = TBL_POFF(*tbl_ptr);
 		if (prot & VM_PROT_W)
 		{
 			if (!(*tbl_ptr & TBL_FLAG_RW))
-				return -EFAULT;
+			{
+				struct page *page;
+				uint32_t map_prot;
+				ret = vm_fault_write(space, addr, poff, &page,
+				                     &map_prot);
+				if (ret)
+					return ret;
+				poff = page->offset;
+				set_tbl(space, addr, tbl_ptr, poff, map_prot);
+				vm_tlb_shootdown(space);
+			}
 		}
-		poff = TBL_POFF(*tbl_ptr);
 	}
 	else
 	{
-		struct vm_zone *zone;
 		struct page *page;
-		ret = vm_fault_page(space, addr, &page, &zone);
+		uint32_t map_prot;
+		ret = vm_fault_page(space, addr, prot, &page, &map_prot);
 		if (ret)
 			return ret;
 		poff = page->offset;
-		set_tbl(space, addr, tbl_ptr, poff, zone->prot);
+		set_tbl(space, addr, tbl_ptr, poff, map_prot);
 	}
 	if (poffp)
 		*poffp = poff;
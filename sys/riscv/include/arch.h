@@ -108,4 +108,24 @@ static inline void arch_spin_yield(void)
 	__asm__ volatile ("addi x0, x0, 1");
 }
 
+static inline uint64_t arch_get_cycles(void)
+{
+#if __riscv_xlen == 64
+	uint64_t val;
+	__asm__ volatile ("rdtime %0" : "=r"(val));
+	return val;
+#else
+	uint32_t lo;
+	uint32_t hi;
+	uint32_t tmp;
+	do
+	{
+		__asm__ volatile ("rdtimeh %0" : "=r"(hi));
+		__asm__ volatile ("rdtime %0" : "=r"(lo));
+		__asm__ volatile ("rdtimeh %0" : "=r"(tmp));
+	} while (hi != tmp);
+	return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
 #endif
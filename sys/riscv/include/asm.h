@@ -35,6 +35,18 @@ static inline void sfence_vma(uintptr_t addr, uint16_t asid)
 	__asm__ volatile ("sfence.vma" : : "r"(addr), "r"(asid));
 }
 
+/* invalidate an address for every asid */
+static inline void sfence_vma_addr(uintptr_t addr)
+{
+	__asm__ volatile ("sfence.vma %0, zero" : : "r"(addr) : "memory");
+}
+
+/* invalidate every non-global address of an asid */
+static inline void sfence_vma_asid(uintptr_t asid)
+{
+	__asm__ volatile ("sfence.vma zero, %0" : : "r"(asid) : "memory");
+}
+
 static inline void set_tp(uintptr_t val)
 {
 	__asm__ volatile ("mv tp, %0" : : "r"(val));
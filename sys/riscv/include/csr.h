@@ -134,4 +134,8 @@
 #define CSR_SIE_STIE (1 << 5) /* Supervisor Timer Interrupt Enable */
 #define CSR_SIE_SEIE (1 << 9) /* Supervisor External Interrupt Enable */
 
+#define CSR_SCOUNTEREN_CY (1 << 0) /* CYcle counter readable from U-mode */
+#define CSR_SCOUNTEREN_TM (1 << 1) /* TiMe readable from U-mode */
+#define CSR_SCOUNTEREN_IR (1 << 2) /* Instructions Retired readable from U-mode */
+
 #endif
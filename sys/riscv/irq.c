@@ -4,6 +4,7 @@
 #include <arch/asm.h>
 
 #include <sched.h>
+#include <prof.h>
 #include <proc.h>
 #include <irq.h>
 #include <cpu.h>
@@ -97,6 +98,7 @@ void handle_ipi(struct irq_ctx *ctx)
 {
 	(void)ctx;
 	csrc(CSR_SIP, CSR_SIP_SSIP); /* EOI */
+	prof_ipi();
 	if (__atomic_exchange_n(&curcpu()->must_resched, 0, __ATOMIC_SEQ_CST))
 		sched_resched();
 	cpu_tick();
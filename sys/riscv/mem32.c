@@ -120,6 +120,8 @@ static int get_tbl_ptr(struct vm_space *space, uintptr_t addr, int create,
 
 void arch_vm_setspace(const struct vm_space *space)
 {
+	int flush;
+	vm_tlb_asid(space, &flush);
 	if (space)
 		csrw(CSR_SATP, (1UL << 31) | (pm_page_addr(space->arch.dir_page) >> 12));
 	else
@@ -127,6 +129,11 @@ void arch_vm_setspace(const struct vm_space *space)
 	sfence_vma(0, 0);
 }
 
+void arch_vm_tlb_flush(void)
+{
+	sfence_vma(0, 0);
+}
+
 int arch_vm_space_init(struct vm_space *space)
 {
 	int ret = pm_alloc_page(&space->arch.dir_page);
@@ -181,6 +188,13 @@ static int dup_table(uint32_t *tbl_dst, uint32_t *tbl_src, uint32_t tbl_id)
 		                          tbl_src[tbl_id] & PTE_FLAG_MASK);
 		return 0;
 	}
+	if (page == g_zero_page)
+	{
+		pm_ref_page(page);
+		tbl_dst[tbl_id] = mkentry(src_poff,
+		                          tbl_src[tbl_id] & PTE_FLAG_MASK);
+		return 0;
+	}
 	int ret = pm_alloc_page(&page);
 	if (ret)
 		return ret;
@@ -211,7 +225,7 @@ int arch_vm_space_copy(struct vm_space *dst, struct vm_space *src)
 		struct page *tbl_page;
 		ret = pm_alloc_page(&tbl_page);
 		if (ret)
-			goto err;
+			return ret;
 		dst->arch.dir[i] = mkentry(tbl_page->offset,
 		                           src->arch.dir[i] & PTE_FLAG_MASK);
 		uint32_t *tbl_dst = vm_map(tbl_page, PAGE_SIZE, VM_PROT_W);
@@ -219,15 +233,10 @@ int arch_vm_space_copy(struct vm_space *dst, struct vm_space *src)
 		if (!tbl_dst)
 		{
 			TRACE("failed to vmap dst tbl");
-			goto err;
+			dst->arch.dir[i] = 0;
+			return -ENOMEM;
 		}
 		uint32_t *tbl_src = src->arch.tbl[i];
-		if (!tbl_src)
-		{
-			TRACE("failed to vmap src tbl");
-			vm_unmap(tbl_dst, PAGE_SIZE);
-			goto err;
-		}
 		for (size_t j = 0; j < 1024; ++j)
 		{
 			if (!(tbl_src[j] & PTE_FLAG_V))
@@ -238,17 +247,16 @@ int arch_vm_space_copy(struct vm_space *dst, struct vm_space *src)
 			ret = dup_table(tbl_dst, tbl_src, j);
 			if (ret)
 			{
-				vm_unmap(tbl_dst, PAGE_SIZE);
-				goto err;
+				/* keep the partial copy for the cleanup */
+				memset(&tbl_dst[j], 0, (1024 - j) * sizeof(*tbl_dst));
+				break;
 			}
 		}
 		dst->arch.tbl[i] = tbl_dst;
+		if (ret)
+			return ret;
 	}
 	return 0;
-
-err:
-	panic("should cleanup\n"); /* XXX */
-	return ret;
 }
 
 static int map_page(struct vm_space *space, uintptr_t addr, uintptr_t poff,
@@ -313,12 +321,27 @@ int arch_vm_unmap(struct vm_space *space, uintptr_t addr, size_t size)
 	return 0;
 }
 
+int arch_vm_lookup(struct vm_space *space, uintptr_t addr, uintptr_t *poff)
+{
+	uint32_t *tbl_ptr;
+	int ret = get_tbl_ptr(space, addr, 0, &tbl_ptr);
+	if (ret)
+		return ret;
+	if (!(*tbl_ptr & PTE_FLAG_V))
+		return -EINVAL;
+	*poff = PTE_POFF(*tbl_ptr);
+	return 0;
+}
+
 static int protect_page(struct vm_space *space, uintptr_t addr, uint32_t prot)
 {
 	uint32_t *tbl_ptr;
 	int ret = get_tbl_ptr(space, addr, 0, &tbl_ptr);
 	if (ret)
 		return ret;
+	/* the zero page stays read-only until written to */
+	if (PTE_POFF(*tbl_ptr) == g_zero_page->offset)
+		prot &= ~VM_PROT_W;
 	set_tbl(space, addr, tbl_ptr, PTE_POFF(*tbl_ptr), prot);
 	return 0;
 }
@@ -342,6 +365,7 @@ int arch_vm_populate_page(struct vm_space *space, uintptr_t addr,
 	uint32_t poff;
 	if (*tbl_ptr & PTE_FLAG_V)
 	{
+		poff = PTE_POFF(*tbl_ptr);
 		if (prot & VM_PROT_X)
 		{
 			if (!(*tbl_ptr & PTE_FLAG_X))
@@ -350,24 +374,33 @@ int arch_vm_populate_page(struct vm_space *space, uintptr_t addr,
 		else if (prot & VM_PROT_W)
 		{
 			if (!(*tbl_ptr & PTE_FLAG_W))
-				return -EFAULT;
+			{
+				struct page *page;
+				uint32_t map_prot;
+				ret = vm_fault_write(space, addr, poff, &page,
+				                     &map_prot);
+				if (ret)
+					return ret;
+				poff = page->offset;
+				set_tbl(space, addr, tbl_ptr, poff, map_prot);
+				vm_tlb_shootdown(space);
+			}
 		}
 		else
 		{
 			if (!(*tbl_ptr & PTE_FLAG_R))
 				return -EFAULT;
 		}
-		poff = PTE_POFF(*tbl_ptr);
 	}
 	else
 	{
-		struct vm_zone *zone;
 		struct page *page;
-		ret = vm_fault_page(space, addr, &page, &zone);
+		uint32_t map_prot;
+		ret = vm_fault_page(space, addr, prot, &page, &map_prot);
 		if (ret)
 			return ret;
 		poff = page->offset;
-		set_tbl(space, addr, tbl_ptr, poff, zone->prot);
+		set_tbl(space, addr, tbl_ptr, poff, map_prot);
 	}
 	if (poffp)
 		*poffp = poff;
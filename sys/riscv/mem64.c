@@ -43,15 +43,21 @@
 #define DIR_POFF(val)  (DIR_PADDR(val) >> 12)
 #define DIR_PADDR(val) (((uint64_t)(val) & ~DIR_FLAG_MASK) << 2)
 
+#define SATP_MODE_SV48 (9ULL << 60)
+#define SATP_ASID_SHIFT 44
+#define SATP_ASID_MASK  0xFFFFULL
+
 extern uint8_t _kernel_end;
 extern uint64_t kern_satp_page;
 
+static uint64_t asid_mask; /* implemented asid bits */
+
 static uint64_t *early_vmap_pge = (uint64_t*)0xFFFFFFFFFFE00000;
 static uint64_t *early_vmap_tbl = (uint64_t*)0xFFFFFFFFFFFFF000;
 
 static inline void invalidate(uintptr_t addr)
 {
-	sfence_vma(addr, 0);
+	sfence_vma_addr(addr);
 }
 
 static inline uint64_t mkentry(uint64_t poff, uint64_t flags)
@@ -111,10 +117,30 @@ static int get_dir0_ptr(struct vm_space *space, uintptr_t addr, int create,
 
 void arch_vm_setspace(const struct vm_space *space)
 {
+	int flush;
+	uint64_t asid = vm_tlb_asid(space, &flush);
+	if (asid > asid_mask)
+	{
+		/* not enough asids, share the 0 one */
+		asid = 0;
+		flush = 1;
+	}
+	uint64_t satp = SATP_MODE_SV48 | (asid << SATP_ASID_SHIFT);
 	if (space)
-		csrw(CSR_SATP, (9ULL << 60) | (pm_page_addr(space->arch.dir_page) >> 12));
+		satp |= pm_page_addr(space->arch.dir_page) >> 12;
 	else
-		csrw(CSR_SATP, (9ULL << 60) | (kern_satp_page >> 12));
+		satp |= kern_satp_page >> 12;
+	csrw(CSR_SATP, satp);
+	if (!flush)
+		return;
+	if (asid)
+		sfence_vma_asid(asid);
+	else
+		sfence_vma(0, 0);
+}
+
+void arch_vm_tlb_flush(void)
+{
 	sfence_vma(0, 0);
 }
 
@@ -167,6 +193,13 @@ static int dup_table(uint64_t *dir0_dst, uint64_t *dir0_src, uint64_t dir0_id)
 		                            dir0_src[dir0_id] & DIR_FLAG_MASK);
 		return 0;
 	}
+	if (page == g_zero_page)
+	{
+		pm_ref_page(page);
+		dir0_dst[dir0_id] = mkentry(src_poff,
+		                            dir0_src[dir0_id] & DIR_FLAG_MASK);
+		return 0;
+	}
 	int ret = pm_alloc_page(&page);
 	if (ret)
 		return ret;
@@ -184,7 +217,9 @@ static int dup_table(uint64_t *dir0_dst, uint64_t *dir0_src, uint64_t dir0_id)
 static int copy_level(uint64_t *dst, uint64_t *src, size_t min, size_t max,
                       uint8_t level)
 {
-	for (size_t i = min; i < max; ++i)
+	size_t i;
+	int ret;
+	for (i = min; i < max; ++i)
 	{
 		if (!(src[i] & DIR_FLAG_V))
 		{
@@ -194,25 +229,33 @@ static int copy_level(uint64_t *dst, uint64_t *src, size_t min, size_t max,
 		if (level)
 		{
 			struct page *pte_page;
-			int ret = pm_alloc_page(&pte_page);
+			ret = pm_alloc_page(&pte_page);
 			if (ret)
-				return ret;
+				goto err;
 			dst[i] = mkentry(pte_page->offset,
 			                 src[i] & DIR_FLAG_MASK);
 			uint64_t *nxt_src = PMAP(DIR_PADDR(src[i]));
 			uint64_t *nxt_dst = PMAP(DIR_PADDR(dst[i]));
 			ret = copy_level(nxt_dst, nxt_src, 0, 512, level - 1);
 			if (ret)
-				return ret;
+			{
+				i++;
+				goto err;
+			}
 		}
 		else
 		{
-			int ret = dup_table(dst, src, i);
+			ret = dup_table(dst, src, i);
 			if (ret)
-				return ret;
+				goto err;
 		}
 	}
 	return 0;
+
+err:
+	/* the entries left are garbage, clear them for the cleanup */
+	memset(&dst[i], 0, (max - i) * sizeof(*dst));
+	return ret;
 }
 
 int arch_vm_space_copy(struct vm_space *dst, struct vm_space *src)
@@ -287,12 +330,27 @@ int arch_vm_unmap(struct vm_space *space, uintptr_t addr, size_t size)
 	return 0;
 }
 
+int arch_vm_lookup(struct vm_space *space, uintptr_t addr, uintptr_t *poff)
+{
+	uint64_t *dir0_ptr;
+	int ret = get_dir0_ptr(space, addr, 0, &dir0_ptr);
+	if (ret)
+		return ret;
+	if (!(*dir0_ptr & DIR_FLAG_V))
+		return -EINVAL;
+	*poff = DIR_POFF(*dir0_ptr);
+	return 0;
+}
+
 static int protect_page(struct vm_space *space, uintptr_t addr, uint32_t prot)
 {
 	uint64_t *dir0_ptr;
 	int ret = get_dir0_ptr(space, addr, 0, &dir0_ptr);
 	if (ret)
 		return 0;
+	/* the zero page stays read-only until written to */
+	if (DIR_POFF(*dir0_ptr) == g_zero_page->offset)
+		prot &= ~VM_PROT_W;
 	set_dir0(space, addr, dir0_ptr, DIR_POFF(*dir0_ptr), prot);
 	return 0;
 }
@@ -319,6 +377,7 @@ int arch_vm_populate_page(struct vm_space *space, uintptr_t addr,
 	uint64_t poff;
 	if (*dir0_ptr & DIR_FLAG_V)
 	{
+		poff = DIR_POFF(*dir0_ptr);
 		if (prot & VM_PROT_X)
 		{
 			if (!(*dir0_ptr & DIR_FLAG_X))
@@ -327,24 +386,33 @@ int arch_vm_populate_page(struct vm_space *space, uintptr_t addr,
 		else if (prot & VM_PROT_W)
 		{
 			if (!(*dir0_ptr & DIR_FLAG_W))
-				return -EFAULT;
+			{
+				struct page *page;
+				uint32_t map_prot;
+				ret = vm_fault_write(space, addr, poff, &page,
+				                     &map_prot);
+				if (ret)
+					return ret;
+				poff = page->offset;
+				set_dir0(space, addr, dir0_ptr, poff, map_prot);
+				vm_tlb_shootdown(space);
+			}
 		}
 		else
 		{
 			if (!(*dir0_ptr & DIR_FLAG_R))
 				return -EFAULT;
 		}
-		poff = DIR_POFF(*dir0_ptr);
 	}
 	else
 	{
-		struct vm_zone *zone;
 		struct page *page;
-		ret = vm_fault_page(space, addr, &page, &zone);
+		uint32_t map_prot;
+		ret = vm_fault_page(space, addr, prot, &page, &map_prot);
 		if (ret)
 			return ret;
 		poff = page->offset;
-		set_dir0(space, addr, dir0_ptr, poff, zone->prot);
+		set_dir0(space, addr, dir0_ptr, poff, map_prot);
 	}
 	if (poffp)
 		*poffp = poff;
@@ -434,5 +502,11 @@ void arch_paging_init(void)
 		dir3[i] = dir2_val;
 		memset(PMAP(page->offset * PAGE_SIZE), 0, PAGE_SIZE);
 	}
+	/* the implemented asid bits are the writable ones */
+	uint64_t satp = csrr(CSR_SATP);
+	csrw(CSR_SATP, satp | (SATP_ASID_MASK << SATP_ASID_SHIFT));
+	asid_mask = (csrr(CSR_SATP) >> SATP_ASID_SHIFT) & SATP_ASID_MASK;
+	csrw(CSR_SATP, satp);
+	sfence_vma(0, 0);
 	/* XXX remove identity pages */
 }
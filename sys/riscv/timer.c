@@ -12,6 +12,7 @@
 #include <mem.h>
 
 static const struct clock_source clock_source;
+static struct clock_counter counter;
 static uint32_t freq;
 static uint64_t base;
 static uint64_t current;
@@ -95,6 +96,8 @@ int timer_init(void)
 	}
 	base = csrr_time();
 	current = base;
+	counter.freq = freq;
+	counter.base = base;
 	interval = freq / FREQUENCY;
 	interval_rem = freq % FREQUENCY;
 	csrw_stimecmp(base + interval);
@@ -135,6 +138,16 @@ static int settime(struct timespec *ts)
 	return 0;
 }
 
+static uint64_t read_counter(void)
+{
+	return csrr_time();
+}
+
+static struct clock_counter counter =
+{
+	.read = read_counter,
+};
+
 static const struct clock_source clock_source =
 {
 	.name = "mtime",
@@ -142,4 +155,5 @@ static const struct clock_source clock_source =
 	.getres = getres,
 	.gettime = gettime,
 	.settime = settime,
+	.counter = &counter,
 };
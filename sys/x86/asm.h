@@ -107,6 +107,16 @@ static inline void invlpg(uintptr_t vaddr)
 	__asm__ volatile ("invlpg (%0)" : : "a"(vaddr) : "memory");
 }
 
+static inline void invpcid(uintptr_t type, uint64_t pcid, uint64_t addr)
+{
+	struct
+	{
+		uint64_t pcid;
+		uint64_t addr;
+	} desc = {pcid, addr};
+	__asm__ volatile ("invpcid %0, %1" : : "m"(desc), "r"(type) : "memory");
+}
+
 static inline uintptr_t getf(void)
 {
 	uintptr_t ret;
@@ -255,6 +265,16 @@ static inline void wbinvd(void)
 	__asm__ volatile ("wbinvd" : : : "memory");
 }
 
+static inline void stac(void)
+{
+	__asm__ volatile ("stac" : : : "memory");
+}
+
+static inline void clac(void)
+{
+	__asm__ volatile ("clac" : : : "memory");
+}
+
 #if defined(__x86_64__)
 static inline void swapgs(void)
 {
@@ -0,0 +1,79 @@
+#include "arch/x86/cpuid.h"
+#include "arch/x86/x86.h"
+#include "arch/x86/asm.h"
+
+#include <errno.h>
+#include <cpu.h>
+#include <mem.h>
+
+#ifdef __i386__
+# define EXTABLE_PTR ".long"
+#else
+# define EXTABLE_PTR ".quad"
+#endif
+
+/* every instruction of the copy routines which may fault on user memory
+ * has an entry giving where to resume the execution if it does
+ */
+struct extable_entry
+{
+	uintptr_t insn;
+	uintptr_t fixup;
+};
+
+extern const struct extable_entry _extable_begin[];
+extern const struct extable_entry _extable_end[];
+
+static inline void user_access_begin(void)
+{
+	if (curcpu()->arch.cpuid.extf_0_ebx & CPUID_EXTF_0_EBX_SMAP)
+		stac();
+}
+
+static inline void user_access_end(void)
+{
+	if (curcpu()->arch.cpuid.extf_0_ebx & CPUID_EXTF_0_EBX_SMAP)
+		clac();
+}
+
+/* a fault stops the copy with the registers updated up to the faulting
+ * byte: the returned count is the number of bytes not copied
+ */
+static size_t copy_user(void *dst, const void *src, size_t n)
+{
+	user_access_begin();
+	__asm__ volatile ("1: rep movsb\n"
+	                  "2:\n"
+	                  ".pushsection .extable, \"a\"\n"
+	                  EXTABLE_PTR " 1b, 2b\n"
+	                  ".popsection\n"
+	                  : "+D"(dst), "+S"(src), "+c"(n)
+	                  :
+	                  : "memory");
+	user_access_end();
+	return n;
+}
+
+size_t arch_copy_from_user(void *kaddr, const void *uaddr, size_t n)
+{
+	return copy_user(kaddr, uaddr, n);
+}
+
+size_t arch_copy_to_user(void *uaddr, const void *kaddr, size_t n)
+{
+	return copy_user(uaddr, kaddr, n);
+}
+
+int extable_fixup(uintptr_t ip, uintptr_t *fixup)
+{
+	for (const struct extable_entry *entry = _extable_begin;
+	     entry < _extable_end;
+	     ++entry)
+	{
+		if (entry->insn != ip)
+			continue;
+		*fixup = entry->fixup;
+		return 0;
+	}
+	return -EINVAL;
+}
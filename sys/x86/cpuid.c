@@ -306,6 +306,11 @@ void cpuid_load(void)
 			cpuid->extf_2_edx = edx;
 		}
 	}
+	if (cpuid->max_cpuid >= 0x80000001)
+	{
+		__cpuid(0x80000001, eax, ebx, ecx, edx);
+		cpuid->ext_edx = edx;
+	}
 	__cpuid(2, eax, ebx, ecx, edx);
 	cpuid->cache_eax = eax;
 	cpuid->cache_ebx = ebx;
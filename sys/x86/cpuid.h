@@ -226,6 +226,15 @@ enum cpuid_extf_2_edx
 	CPUID_EXTF_2_EDX_UC_LOCK    = (1 << 6),
 };
 
+enum cpuid_ext_edx
+{
+	CPUID_EXT_EDX_SYSCALL = (1 << 11),
+	CPUID_EXT_EDX_NX      = (1 << 20),
+	CPUID_EXT_EDX_PDPE1GB = (1 << 26),
+	CPUID_EXT_EDX_RDTSCP  = (1 << 27),
+	CPUID_EXT_EDX_LM      = (1 << 29),
+};
+
 enum cpuid_xsave_feat
 {
 	CPUID_XSAVE_FEAT_XSAVEOPT    = (1 << 0),
@@ -272,6 +281,7 @@ struct cpuid
 	uint32_t extf_1_ebx;
 	uint32_t extf_1_edx;
 	uint32_t extf_2_edx;
+	uint32_t ext_edx;
 	uint32_t cache_eax;
 	uint32_t cache_ebx;
 	uint32_t cache_ecx;
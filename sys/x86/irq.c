@@ -4,6 +4,7 @@
 #include "arch/x86/cr.h"
 
 #include <sched.h>
+#include <prof.h>
 #include <proc.h>
 #include <pci.h>
 #include <std.h>
@@ -287,10 +288,19 @@ void handle_page_fault(const struct irq_ctx *ctx)
 	switch (DPL(ctx))
 	{
 		case 0:
+		{
+			/* user copy routines are resumed at their fixup */
+			uintptr_t fixup;
+			if (!extable_fixup(IP(ctx), &fixup))
+			{
+				IP(ctx) = fixup;
+				break;
+			}
 			arch_print_regs(&ctx->trapframe->regs);
 			panic("page fault addr " REG_FMT ": " REG_FMT " @ " REG_FMT "\n",
 			      page_addr, ctx->err, IP(ctx));
 			break;
+		}
 		case 1:
 			panic("invalid DPL 1\n");
 			break;
@@ -427,6 +437,7 @@ void handle_syscall(const struct irq_ctx *ctx)
 void handle_ipi(const struct irq_ctx *ctx)
 {
 	(void)ctx;
+	prof_ipi();
 	if (__atomic_exchange_n(&curcpu()->must_resched, 0, __ATOMIC_SEQ_CST))
 		sched_resched();
 }
@@ -112,5 +112,6 @@
 #define MSR_FS_BASE                   0xC0000100
 #define MSR_GS_BASE                   0xC0000101
 #define MSR_KERNEL_GS_BASE            0xC0000102
+#define MSR_TSC_AUX                   0xC0000103
 
 #endif
@@ -5,6 +5,7 @@
 #include <std.h>
 
 static const struct clock_source clock_source;
+static struct clock_counter counter;
 static uint64_t tsc_base;
 static uint64_t tsc_freq;
 
@@ -27,6 +28,8 @@ void tsc_init(void)
 	}
 	tsc_base = tsc_start;
 	tsc_freq = tsc_end - tsc_start;
+	counter.freq = tsc_freq;
+	counter.base = tsc_base;
 #if 0
 	printf("tsc frequency: %lu.%lu MHz\n", tsc_freq / 1000000000, (tsc_freq / 10000000) % 100);
 #endif
@@ -58,6 +61,16 @@ static int settime(struct timespec *ts)
 	return 0;
 }
 
+static uint64_t read_counter(void)
+{
+	return rdtsc();
+}
+
+static struct clock_counter counter =
+{
+	.read = read_counter,
+};
+
 static const struct clock_source clock_source =
 {
 	.name = "TSC",
@@ -65,4 +78,5 @@ static const struct clock_source clock_source =
 	.getres = getres,
 	.gettime = gettime,
 	.settime = settime,
+	.counter = &counter,
 };
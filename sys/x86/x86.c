@@ -151,6 +151,12 @@ void arch_cpu_boot(struct cpu *cpu)
 	cpuid_load();
 #if defined(__x86_64__)
 	amd64_setup_syscall();
+	if (cpu->arch.cpuid.feat_edx & CPUID_FEAT_EDX_PGE)
+	{
+		setcr4(getcr4() | CR4_PGE);
+		if (cpu->arch.cpuid.feat_ecx & CPUID_FEAT_ECX_PCID)
+			setcr4(getcr4() | CR4_PCIDE);
+	}
 #endif
 	fpu_init();
 	if (!cpu->id)
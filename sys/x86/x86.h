@@ -143,6 +143,7 @@ void com_init(void);
 void com_init_tty(void);
 void tsc_init(void);
 void setup_interrupt_handlers(void);
+int extable_fixup(uintptr_t ip, uintptr_t *fixup);
 void vga_init(int rgb, uint32_t paddr, uint32_t width, uint32_t height,
               uint32_t pitch, uint32_t bpp);
 void hpet_init(uint32_t hw_id, uint32_t addr, uint8_t number,